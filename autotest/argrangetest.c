@@ -0,0 +1,72 @@
+#include <assert.h>
+
+char	buffer[200];
+
+__noinline int scale(int x, int k)
+{
+	return x * 40 + k;
+}
+
+__noinline void fill(int n, int v)
+{
+	for(int i=0; i<n; i++)
+		buffer[i] = v;
+}
+
+__noinline int count(int n)
+{
+	int	s = 0;
+	while (n > 0)
+	{
+		s += n;
+		n -= 3;
+	}
+	return s;
+}
+
+__noinline int select(int op, int a, int b)
+{
+	switch (op)
+	{
+	case 0:
+		return a + b;
+	case 1:
+		return a - b;
+	case 2:
+		return a * b;
+	default:
+		return a & b;
+	}
+}
+
+__noinline long widen(long x)
+{
+	return x * 3;
+}
+
+int	(*sfunc)(int, int, int) = select;
+
+int main(void)
+{
+	int	s = 0;
+	for(char i=0; i<25; i++)
+		s += scale(i, 7);
+	assert(s == 12175);
+
+	fill(100, 7);
+	fill(20, 9);
+	assert(buffer[10] == 9 && buffer[50] == 7);
+
+	assert(count(10) == 22);
+	assert(count(100) == 1717);
+
+	assert(select(0, 3, 4) == 7);
+	assert(select(1, 3, 4) == -1);
+	assert(sfunc(2, 300, 400) == -11072);
+	assert(sfunc(5, 300, 400) == 256);
+
+	assert(widen(100) == 300);
+	assert(widen(100000L) == 300000L);
+
+	return 0;
+}
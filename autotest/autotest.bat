@@ -18,6 +18,24 @@ rem @echo off
 @call :test fastcalltest.c
 @if %errorlevel% neq 0 goto :error
 
+@call :test tailcalltest.c
+@if %errorlevel% neq 0 goto :error
+
+@call :test fastcallzptest.c
+@if %errorlevel% neq 0 goto :error
+
+@call :test zeropagetest.c
+@if %errorlevel% neq 0 goto :error
+
+@call :test zeropageglobaltest.c -fzeropage-globals
+@if %errorlevel% neq 0 goto :error
+
+@call :test pagecrosstest.c
+@if %errorlevel% neq 0 goto :error
+
+@call :test bestfittest.c
+@if %errorlevel% neq 0 goto :error
+
 @call :test strcmptest.c
 @if %errorlevel% neq 0 goto :error
 
@@ -84,6 +102,18 @@ rem @echo off
 @call :test loopboundtest.c
 @if %errorlevel% neq 0 goto :error
 
+@call :test loopstrengthtest.c
+@if %errorlevel% neq 0 goto :error
+
+@call :test loopunrolltest.c
+@if %errorlevel% neq 0 goto :error
+
+@call :test valuenumbertest.c
+@if %errorlevel% neq 0 goto :error
+
+@call :test argrangetest.c
+@if %errorlevel% neq 0 goto :error
+
 @call :test byteindextest.c
 @if %errorlevel% neq 0 goto :error
 
@@ -108,6 +138,9 @@ rem @echo off
 @call :test enumswitch.c
 @if %errorlevel% neq 0 goto :error
 
+@call :test switchtabletest.c
+@if %errorlevel% neq 0 goto :error
+
 @call :test incvector.c
 @if %errorlevel% neq 0 goto :error
 
@@ -160,52 +193,52 @@ echo Failed with error #%errorlevel%.
 exit /b %errorlevel%
 
 :test
-..\release\oscar64 -e %~1
+..\release\oscar64 -e %~2 %~1
 @if %errorlevel% neq 0 goto :error
 
-..\release\oscar64 -e -n %~1
+..\release\oscar64 -e %~2 -n %~1
 @if %errorlevel% neq 0 goto :error
 
-..\release\oscar64 -e -O2 %~1
+..\release\oscar64 -e %~2 -O2 %~1
 @if %errorlevel% neq 0 goto :error
 
-..\release\oscar64 -e -O2 -n %~1
+..\release\oscar64 -e %~2 -O2 -n %~1
 @if %errorlevel% neq 0 goto :error
 
-..\release\oscar64 -e -O0 %~1
+..\release\oscar64 -e %~2 -O0 %~1
 @if %errorlevel% neq 0 goto :error
 
-..\release\oscar64 -e -O0 -n %~1
+..\release\oscar64 -e %~2 -O0 -n %~1
 @if %errorlevel% neq 0 goto :error
 
-..\release\oscar64 -e -Os %~1
+..\release\oscar64 -e %~2 -Os %~1
 @if %errorlevel% neq 0 goto :error
 
-..\release\oscar64 -e -Os -n %~1
+..\release\oscar64 -e %~2 -Os -n %~1
 @if %errorlevel% neq 0 goto :error
 
-..\release\oscar64 -e -O3 %~1
+..\release\oscar64 -e %~2 -O3 %~1
 @if %errorlevel% neq 0 goto :error
 
-..\release\oscar64 -e -O3 -n %~1
+..\release\oscar64 -e %~2 -O3 -n %~1
 @if %errorlevel% neq 0 goto :error
 
 @exit /b 0
 
 :testb
-..\release\oscar64 -e %~1
+..\release\oscar64 -e %~2 %~1
 @if %errorlevel% neq 0 goto :error
 
-..\release\oscar64 -e -O2 %~1
+..\release\oscar64 -e %~2 -O2 %~1
 @if %errorlevel% neq 0 goto :error
 
-..\release\oscar64 -e -O0 %~1
+..\release\oscar64 -e %~2 -O0 %~1
 @if %errorlevel% neq 0 goto :error
 
-..\release\oscar64 -e -Os %~1
+..\release\oscar64 -e %~2 -Os %~1
 @if %errorlevel% neq 0 goto :error
 
-..\release\oscar64 -e -O3 %~1
+..\release\oscar64 -e %~2 -O3 %~1
 @if %errorlevel% neq 0 goto :error
 
 @exit /b 0
@@ -0,0 +1,77 @@
+#include <assert.h>
+#include <string.h>
+
+#pragma region( main, 0x0a00, 0xa000, 1, , {code, data, bss, heap, stack} )
+
+char page[256];
+#pragma align(page, 256)
+char small0[3];
+char row[40];
+#pragma align(row, 16)
+char small1[7];
+const char text[] = "best fit placement";
+int	counts[20];
+
+// The aligned tiles leave a gap of 96 bytes in front of tile0 and of 56
+// bytes in front of tile1, best fit puts both small objects into the
+// second, first fit would use the first one
+
+#pragma section( tiles, 0, , , bss )
+#pragma region( tiles, 0xc0a0, 0xc400, 1, , {tiles} )
+
+#pragma bss( tiles )
+char	tile0[200];
+#pragma align(tile0, 256)
+char	tile1[180];
+#pragma align(tile1, 256)
+char	small2[40];
+char	small3[12];
+#pragma bss( bss )
+
+int sum(const char * p, int n)
+{
+	int	s = 0;
+	for(int i=0; i<n; i++)
+		s += p[i];
+	return s;
+}
+
+int main(void)
+{
+	assert(((unsigned)&page[0] & 0xff) == 0);
+	assert(((unsigned)&row[0] & 0x0f) == 0);
+
+	for(int i=0; i<256; i++)
+		page[i] = i;
+	memset(small0, 1, 3);
+	memset(row, 2, 40);
+	memset(small1, 3, 7);
+	for(int i=0; i<20; i++)
+		counts[i] = i * 5;
+
+	for(int i=0; i<256; i++)
+		assert(page[i] == (char)i);
+	assert(sum(small0, 3) == 3);
+	assert(sum(row, 40) == 80);
+	assert(sum(small1, 7) == 21);
+	assert(strcmp(text, "best fit placement") == 0);
+	for(int i=0; i<20; i++)
+		assert(counts[i] == i * 5);
+
+	memset(tile0, 4, 200);
+	memset(tile1, 5, 180);
+	memset(small2, 6, 40);
+	memset(small3, 7, 12);
+
+	assert((unsigned)&tile0[0] == 0xc100);
+	assert((unsigned)&tile1[0] == 0xc200);
+	assert((unsigned)&small2[0] == 0xc1c8);
+	assert((unsigned)&small3[0] == 0xc1f0);
+
+	assert(sum(tile0, 200) == 800);
+	assert(sum(tile1, 180) == 900);
+	assert(sum(small2, 40) == 240);
+	assert(sum(small3, 12) == 84);
+
+	return 0;
+}
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Compile each test twice with different fill patterns for fresh heap
+# memory and compare the resulting program files, uninitialized state in
+# the compiler shows up as a difference or a failed compile.
+#
+# usage: ./determinism.sh [compiler]
+
+OSCAR64=${1:-../bin/oscar64}
+OUT=${TMPDIR:-/tmp}/oscar64-determinism.$$
+
+mkdir -p $OUT/a $OUT/b
+fail=0
+
+grep -E "^@call :testb? " autotest.bat | tr -d '\r' > $OUT/tests
+
+while read call kind test extra; do
+	for opt in -O0 -O2 "-O2 -n" -Os "-O3 -n"; do
+		name=$(echo $test $extra $opt | tr -c 'a-zA-Z0-9\n' '_')
+		if ! MALLOC_PERTURB_=0 $OSCAR64 $extra $opt -o=$OUT/a/$name.prg $test > /dev/null 2>&1 ||
+		   ! MALLOC_PERTURB_=85 $OSCAR64 $extra $opt -o=$OUT/b/$name.prg $test > /dev/null 2>&1; then
+			echo "FAIL compile $test $extra $opt"
+			fail=1
+		elif ! cmp -s $OUT/a/$name.prg $OUT/b/$name.prg; then
+			echo "FAIL differs $test $extra $opt"
+			fail=1
+		fi
+	done
+done < $OUT/tests
+
+rm -rf $OUT
+
+if [ $fail -eq 0 ]; then
+	echo "determinism ok"
+fi
+exit $fail
@@ -0,0 +1,46 @@
+#include <assert.h>
+#include <stdarg.h>
+
+int	acc;
+
+int vsum(int n, ...)
+{
+	va_list	vl;
+	va_start(vl, n);
+	int	s = 0;
+	for(int i=0; i<n; i++)
+		s += va_arg(vl, int);
+	va_end(vl);
+	return s;
+}
+
+__noinline int leaf(int a, int b)
+{
+	return a * b;
+}
+
+int twice(int x)
+{
+	return leaf(x, 2) + leaf(x, 0);
+}
+
+int (*fptr)(int) = twice;
+
+__noinline int outer(int a, int b, int c)
+{
+	int	s = vsum(3, a, b, leaf(c, 3));
+	s += fptr(a + b);
+	return s + a - b + c;
+}
+
+__noinline int deep(int a, int b)
+{
+	return outer(a, b, a + b) + outer(b, a, 1) + a;
+}
+
+int main(void)
+{
+	assert(outer(1, 2, 3) == 1 + 2 + 9 + 6 + 1 - 2 + 3);
+	assert(deep(3, 4) == (3 + 4 + 21 + 14 + 3 - 4 + 7) + (4 + 3 + 3 + 14 + 4 - 3 + 1) + 3);
+	return 0;
+}
@@ -0,0 +1,106 @@
+#include <assert.h>
+
+char	field[1000];
+int		width = 17;
+
+void fillw(int w, int h)
+{
+	for(int y=0; y<h; y++)
+		for(int x=0; x<w; x++)
+			field[y * w + x] = (char)(x + y);
+}
+
+void checkw(int w, int h)
+{
+	int	i = 0;
+	for(int y=0; y<h; y++)
+		for(int x=0; x<w; x++)
+		{
+			assert(field[i] == (char)(x + y));
+			i++;
+		}
+}
+
+void fillc(void)
+{
+	for(int y=0; y<25; y++)
+		for(int x=0; x<40; x++)
+			field[y * 40 + x] = (char)(y - x);
+}
+
+void checkc(void)
+{
+	int	i = 0;
+	for(int y=0; y<25; y++)
+		for(int x=0; x<40; x++)
+		{
+			assert(field[i] == (char)(y - x));
+			i++;
+		}
+}
+
+void fillg(int h)
+{
+	int	w = width;
+	for(int y=h-1; y>=0; y--)
+		for(int x=0; x<w; x++)
+			field[y * w + x] = (char)(3 * y + x);
+}
+
+void checkg(int h)
+{
+	int	i = 0;
+	for(int y=0; y<h; y++)
+		for(int x=0; x<width; x++)
+		{
+			assert(field[i] == (char)(3 * y + x));
+			i++;
+		}
+}
+
+int sumstep(int w)
+{
+	int	s = 0;
+	for(int y=1; y<30; y+=3)
+	{
+		int	x = 0;
+		while (x < y)
+		{
+			s += y * w;
+			x++;
+		}
+	}
+	return s;
+}
+
+int sumref(int w)
+{
+	int	s = 0;
+	for(int y=1; y<30; y+=3)
+		for(int x=0; x<y; x++)
+			for(int k=0; k<y; k++)
+				s += w;
+	return s;
+}
+
+int main(void)
+{
+	fillw(20, 10);
+	checkw(20, 10);
+	fillw(33, 30);
+	checkw(33, 30);
+
+	fillc();
+	checkc();
+
+	fillg(40);
+	checkg(40);
+	width = 23;
+	fillg(30);
+	checkg(30);
+
+	assert(sumstep(7) == sumref(7));
+	assert(sumstep(-5) == sumref(-5));
+
+	return 0;
+}
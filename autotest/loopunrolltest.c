@@ -0,0 +1,139 @@
+#include <assert.h>
+
+char	buffer[200];
+
+int countge(void)
+{
+	int	a = 0, b = 0;
+	for(int i=0; i<8; i++)
+	{
+		if (i >= 3)
+			a++;
+		else
+			b += 2;
+	}
+	return a * 16 + b;
+}
+
+void fillodd(char n)
+{
+	for(char i=0; i<40; i++)
+	{
+		if (i & 1)
+			buffer[i] = n;
+		else
+			buffer[i] = 0;
+	}
+}
+
+int sumclip(int n, int m)
+{
+	int	s = 0;
+	for(int i=0; i<n; i++)
+	{
+		if (buffer[i] > m)
+			s += m;
+		else
+			s += buffer[i];
+	}
+	return s;
+}
+
+char countdown(void)
+{
+	char	n = 0;
+	for(int i=20; i>0; i-=3)
+	{
+		if (i < 10)
+			buffer[n++] = i;
+		else
+			buffer[n++] = 1;
+	}
+	return n;
+}
+
+int skipfirst(void)
+{
+	char	i = 0;
+	int		s = 0;
+	while (i < 10)
+	{
+		i++;
+		if (i < 5)
+			continue;
+		s += i;
+	}
+	return s;
+}
+
+int skipodd(void)
+{
+	int	i = 0, s = 0;
+	for(;;)
+	{
+		if (buffer[i] & 1)
+		{
+			i++;
+			if (i < 4)
+				continue;
+			s += 100;
+		}
+		s += buffer[i];
+		i++;
+		if (i >= 4)
+			break;
+	}
+	return s;
+}
+
+int skipoddn(int n)
+{
+	int	i = 0, s = 0;
+	for(;;)
+	{
+		if (buffer[i] & 1)
+		{
+			i++;
+			if (i < n)
+				continue;
+			s += 100;
+		}
+		s += buffer[i];
+		i++;
+		if (i >= n)
+			break;
+	}
+	return s;
+}
+
+int main(void)
+{
+	assert(countge() == 5 * 16 + 6);
+
+	fillodd(7);
+	for(int i=0; i<40; i++)
+		assert(buffer[i] == ((i & 1) ? 7 : 0));
+
+	for(int i=0; i<200; i++)
+		buffer[i] = i & 15;
+
+	assert(sumclip(0, 8) == 0);
+	assert(sumclip(1, 8) == 0);
+	assert(sumclip(5, 8) == 10);
+	assert(sumclip(16, 8) == 36 + 7 * 8);
+	assert(sumclip(33, 20) == 2 * 120 + 0);
+
+	assert(countdown() == 7);
+	assert(buffer[3] == 1 && buffer[4] == 8 && buffer[5] == 5 && buffer[6] == 2);
+
+	for(int i=0; i<200; i++)
+		buffer[i] = i;
+
+	assert(skipfirst() == 5 + 6 + 7 + 8 + 9 + 10);
+	assert(skipodd() == 0 + 2 + 100 + 4);
+	assert(skipoddn(4) == 0 + 2 + 100 + 4);
+	assert(skipoddn(8) == 0 + 2 + 4 + 6 + 100 + 8);
+	assert(skipoddn(2) == 0 + 100 + 2);
+
+	return 0;
+}
@@ -0,0 +1,38 @@
+#include <assert.h>
+
+// The table region starts 64 bytes before a page boundary, the table
+// would cross it without the page crossing aware placement
+
+#pragma section( tables, 0, , , bss )
+#pragma region( tables, 0xc0c0, 0xc400, , , {tables} )
+
+#pragma bss( tables )
+char	table[100];
+#pragma bss( bss )
+
+__native unsigned sum(void)
+{
+	unsigned	s = 0;
+	for(char i=0; i<100; i++)
+		s += table[i];
+	return s;
+}
+
+int main(void)
+{
+	for(char i=0; i<100; i++)
+		table[i] = i;
+
+	assert(sum() == 4950);
+
+	// Indexed reads in the loop keep the table within one page, unless
+	// optimizing for size
+
+#ifdef OSCAR_OPTIMIZE_SIZE
+	assert((unsigned)&table[0] == 0xc0c0);
+#else
+	assert((unsigned)&table[0] == 0xc100);
+#endif
+
+	return 0;
+}
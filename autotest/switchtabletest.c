@@ -0,0 +1,277 @@
+// Dense switch statements, that may be lowered to jump tables
+
+int acc;
+
+__noinline void dense(unsigned char c)
+{
+	switch (c)
+	{
+	case 0: acc += 3; break;
+	case 1: acc += 10; break;
+	case 2: acc += 17; break;
+	case 3: acc += 24; break;
+	case 4: acc += 31; break;
+	case 5: acc += 38; break;
+	case 6: acc += 45; break;
+	case 7: acc += 52; break;
+	case 8: acc += 59; break;
+	case 9: acc += 66; break;
+	case 10: acc += 73; break;
+	case 11: acc += 80; break;
+	case 12: acc += 87; break;
+	case 13: acc += 94; break;
+	case 14: acc += 101; break;
+	case 15: acc += 108; break;
+	case 16: acc += 115; break;
+	case 17: acc += 122; break;
+	case 18: acc += 129; break;
+	case 19: acc += 136; break;
+	case 20: acc += 143; break;
+	case 21: acc += 150; break;
+	case 22: acc += 157; break;
+	case 23: acc += 164; break;
+	case 24: acc += 171; break;
+	case 25: acc += 178; break;
+	case 26: acc += 185; break;
+	case 27: acc += 192; break;
+	case 28: acc += 199; break;
+	case 29: acc += 206; break;
+	case 30: acc += 213; break;
+	case 31: acc += 220; break;
+	case 32: acc += 227; break;
+	case 33: acc += 234; break;
+	case 34: acc += 241; break;
+	case 35: acc += 248; break;
+	case 36: acc += 255; break;
+	case 37: acc += 262; break;
+	case 38: acc += 269; break;
+	case 39: acc += 276; break;
+	case 40: acc += 283; break;
+	case 41: acc += 290; break;
+	case 42: acc += 297; break;
+	case 43: acc += 304; break;
+	case 44: acc += 311; break;
+	case 45: acc += 318; break;
+	case 46: acc += 325; break;
+	case 47: acc += 332; break;
+	default: acc -= 1;
+	}
+}
+
+__noinline int offset(unsigned char c)
+{
+	switch (c)
+	{
+	case 100: return c + 1;
+	case 101: return 7;
+	case 102: case 103: return c * 2;
+	case 104: return 9;
+	case 106: return c - 5;
+	case 107: return 1000;
+	case 108: return 11;
+	case 109: return 12;
+	case 110: return c;
+	case 111: return 14;
+	case 112: case 113: case 114: return 15;
+	case 115: return -c;
+	case 116: return 17;
+	case 117: return 18;
+	case 118: return 19;
+	case 119: return 20;
+	case 120: return 21;
+	case 121: return 22;
+	case 122: return 23;
+	}
+
+	return 0;
+}
+
+int offsetref(unsigned char c)
+{
+	if (c < 100 || c > 122 || c == 105)
+		return 0;
+	else if (c == 100)
+		return 101;
+	else if (c == 102 || c == 103)
+		return c * 2;
+	else if (c == 106)
+		return 101;
+	else if (c == 107)
+		return 1000;
+	else if (c == 110)
+		return 110;
+	else if (c >= 112 && c <= 114)
+		return 15;
+	else if (c == 115)
+		return -115;
+	else if (c == 101)
+		return 7;
+	else if (c == 104)
+		return 9;
+	else if (c >= 116)
+		return c - 99;
+	else
+		return c - 97;
+}
+
+// Int switch values need a check of the high byte before the dispatch
+
+__noinline void intdense(int i)
+{
+	switch (i)
+	{
+	case 0: acc += 2; break;
+	case 1: acc += 7; break;
+	case 2: acc += 12; break;
+	case 3: acc += 17; break;
+	case 4: acc += 22; break;
+	case 5: acc += 27; break;
+	case 6: acc += 32; break;
+	case 7: acc += 37; break;
+	case 8: acc += 42; break;
+	case 9: acc += 47; break;
+	case 10: acc += 52; break;
+	case 11: acc += 57; break;
+	case 12: acc += 62; break;
+	case 13: acc += 67; break;
+	case 14: acc += 72; break;
+	case 15: acc += 77; break;
+	case 16: acc += 82; break;
+	case 17: acc += 87; break;
+	case 18: acc += 92; break;
+	case 19: acc += 97; break;
+	case 20: acc += 102; break;
+	case 21: acc += 107; break;
+	case 22: acc += 112; break;
+	case 23: acc += 117; break;
+	case 24: acc += 122; break;
+	case 25: acc += 127; break;
+	case 26: acc += 132; break;
+	case 27: acc += 137; break;
+	case 28: acc += 142; break;
+	case 29: acc += 147; break;
+	case 30: acc += 152; break;
+	case 31: acc += 157; break;
+	case 32: acc += 162; break;
+	case 33: acc += 167; break;
+	case 34: acc += 172; break;
+	case 35: acc += 177; break;
+	case 36: acc += 182; break;
+	case 37: acc += 187; break;
+	case 38: acc += 192; break;
+	case 39: acc += 197; break;
+	default: acc -= 1;
+	}
+}
+
+__noinline void intspan(int i)
+{
+	switch (i)
+	{
+	case 1000: acc += 10; break;
+	case 1001: acc += 11; break;
+	case 1002: acc += 12; break;
+	case 1003: acc += 13; break;
+	case 1004: acc += 14; break;
+	case 1005: acc += 15; break;
+	case 1006: acc += 16; break;
+	case 1008: acc += 18; break;
+	case 1009: acc += 19; break;
+	case 1010: acc += 20; break;
+	case 1011: acc += 21; break;
+	case 1012: acc += 22; break;
+	case 1013: acc += 23; break;
+	case 1014: acc += 24; break;
+	case 1015: acc += 25; break;
+	case 1016: acc += 26; break;
+	case 1017: acc += 27; break;
+	case 1018: acc += 28; break;
+	case 1019: acc += 29; break;
+	case 1020: acc += 30; break;
+	case 1023: acc += 33; break;
+	case 1024: acc += 34; break;
+	case 1025: acc += 35; break;
+	case 1026: acc += 36; break;
+	case 1027: acc += 37; break;
+	case 1028: acc += 38; break;
+	case 1029: acc += 39; break;
+	case 1030: acc += 40; break;
+	case 1031: acc += 41; break;
+	case 1032: acc += 42; break;
+	case 1033: acc += 43; break;
+	case 1034: acc += 44; break;
+	case 1035: acc += 45; break;
+	case 1036: acc += 46; break;
+	case 1037: acc += 47; break;
+	case 1038: acc += 48; break;
+	case 1039: acc += 49; break;
+	default: acc -= 1;
+	}
+}
+
+int intspanref(int i)
+{
+	if (i < 1000 || i >= 1040 || i == 1007 || i == 1021 || i == 1022)
+		return -1;
+	else
+		return i - 990;
+}
+
+__noinline int intnegative(int i)
+{
+	switch (i)
+	{
+	case -4: return 40;
+	case -3: return 30;
+	case -2: return 20;
+	case -1: return 10;
+	case 0: return 0;
+	case 1: return -10;
+	case 2: return -20;
+	}
+
+	return 100;
+}
+
+int main(void)
+{
+	for (int i = -600; i < 1600; i++)
+	{
+		acc = 0;
+		intdense(i);
+		if (acc != (i >= 0 && i < 40 ? i * 5 + 2 : -1))
+			return 3;
+
+		acc = 0;
+		intspan(i);
+		if (acc != intspanref(i))
+			return 4;
+
+		if (intnegative(i) != (i >= -4 && i <= 2 ? -10 * i : 100))
+			return 5;
+	}
+
+	static const int	wide[] = {0x0100, 0x0105, 0x7f05, -0x8000, 0x7fff, 0x03e8 + 0x0100};
+
+	for (int i = 0; i < 6; i++)
+	{
+		acc = 0;
+		intdense(wide[i]);
+		intspan(wide[i]);
+		if (acc != -2)
+			return 6;
+	}
+
+	for (int i = 0; i < 256; i++)
+	{
+		acc = 0;
+		dense(i);
+		if (acc != (i < 48 ? i * 7 + 3 : -1))
+			return 1;
+
+		if (offset(i) != offsetref(i))
+			return 2;
+	}
+
+	return 0;
+}
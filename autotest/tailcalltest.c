@@ -0,0 +1,86 @@
+#include <assert.h>
+
+__noinline long leaf(long a, long b, long c)
+{
+	return a * 3 + b * 5 + c;
+}
+
+__noinline long twice(long a)
+{
+	return a * 2;
+}
+
+// Enough values live across calls to save temporaries, the
+// restore moves in front of the call in tail position
+
+__noinline long saved(long n, long m)
+{
+	long	a = twice(n);
+	long	b = twice(m);
+	long	c = twice(a + b);
+	long	d = twice(c + n);
+	long	e = twice(d + m);
+	return leaf(a + b + n, c + d - m, e + n);
+}
+
+__noinline long select(long n, long m)
+{
+	long	a = twice(n);
+	long	b = twice(m);
+	long	c = twice(a + b);
+	long	d = twice(c + n);
+	long	e = twice(d + m);
+	if (n & 1)
+		return leaf(a, b + c, d + e);
+	else
+		return twice(a + b + c + d + e);
+}
+
+// The caller keeps its own values in the saved temporaries
+
+__noinline long outer(long n, long m)
+{
+	long	a = twice(n + 1);
+	long	b = twice(m + 1);
+	long	c = twice(a + b);
+	long	d = twice(c + n);
+	long	r = saved(n, m);
+	assert(a == 2 * (n + 1));
+	assert(b == 2 * (m + 1));
+	assert(c == 2 * (a + b));
+	assert(d == 2 * (c + n));
+	return r + a + b + c + d;
+}
+
+// Arguments of the recursive function are passed on the stack, the
+// call in tail position has to release the caller frame afterwards
+
+int rec(int n, int a)
+{
+	if (n == 0)
+		return a;
+	return rec(n - 1, a + n);
+}
+
+__noinline int stackcall(int n)
+{
+	char	buffer[20];
+	for(int i=0; i<20; i++)
+		buffer[i] = i + n;
+	return rec(buffer[n], buffer[19]);
+}
+
+volatile long	vn = 3, vm = 4;
+
+int main(void)
+{
+	assert(saved(vn, vm) == 616);
+	assert(select(vn, vm) == 6 * 3 + 36 * 5 + 194);
+	assert(select(vn + 1, vm) == 2 * (8 + 8 + 32 + 72 + 152));
+	assert(outer(vn, vm) == 616 + 8 + 10 + 36 + 78);
+
+	for(int i=0; i<200; i++)
+		assert(stackcall(3) == 43);
+
+	return 0;
+}
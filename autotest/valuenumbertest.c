@@ -0,0 +1,62 @@
+#include <assert.h>
+
+char	buf[20];
+
+__noinline int joinmul(int x, int y, char c)
+{
+	int	r = 0;
+	if (c & 1)
+		r += x * y;
+	else
+		buf[c] = 1;
+	if (c & 2)
+		r += 3;
+	return r + x * y;
+}
+
+__noinline int armsmul(int x, int y, char c)
+{
+	int	r;
+	if (c)
+	{
+		buf[3] = x * y;
+		r = 1;
+	}
+	else
+	{
+		buf[4] = x * y;
+		r = 2;
+	}
+	return x * y + r;
+}
+
+__noinline long diamond(long x, int y, char c)
+{
+	long	r;
+	if (c == 1)
+		r = x * y + 1;
+	else if (c == 2)
+		r = x * y - 1;
+	else
+		r = x * y;
+	return r;
+}
+
+int main(void)
+{
+	assert(joinmul(3, 4, 1) == 24);
+	assert(joinmul(3, 4, 3) == 27);
+	assert(joinmul(3, 4, 2) == 15);
+	assert(joinmul(-5, 7, 0) == -35);
+
+	assert(armsmul(3, 4, 2) == 13);
+	assert(buf[3] == 12);
+	assert(armsmul(5, 6, 0) == 32);
+	assert(buf[4] == 30);
+
+	assert(diamond(100000L, 3, 1) == 300001L);
+	assert(diamond(100000L, 3, 2) == 299999L);
+	assert(diamond(-7, 3, 0) == -21);
+
+	return 0;
+}
@@ -0,0 +1,58 @@
+#include <assert.h>
+
+// Compiled with -fzeropage-globals, the region leaves the kernal variables alone
+
+#pragma region( zeropage, 0x80, 0x90, , , {} )
+
+char			count;
+int				sum;
+long			total;
+char			flags[2];
+char			buffer[100];
+int				init = 1234;
+
+void fill(void)
+{
+	for(count=0; count<100; count++)
+		buffer[count] = count;
+}
+
+void accumulate(void)
+{
+	for(count=0; count<100; count++)
+	{
+		sum += buffer[count];
+		total += (long)buffer[count] * buffer[count];
+		flags[count & 1]++;
+	}
+}
+
+int main(void)
+{
+	// Promoted or not, uninitialized globals start with zero
+
+	assert(count == 0);
+	assert(sum == 0);
+	assert(total == 0);
+	assert(flags[0] == 0 && flags[1] == 0);
+	assert(init == 1234);
+
+	fill();
+	accumulate();
+
+	assert(count == 100);
+	assert(sum == 4950);
+	assert(total == 328350l);
+	assert(flags[0] == 50 && flags[1] == 50);
+
+#if defined(OSCAR_NATIVE_ALL) && defined(OSCAR_ZEROPAGE_GLOBALS)
+	// The loop counter is the most used and must be in the limited region,
+	// initialized and large variables stay in memory
+
+	assert((unsigned)&count >= 0x80 && (unsigned)&count < 0x90);
+	assert((unsigned)&init >= 0x100);
+	assert((unsigned)&buffer[0] >= 0x100);
+#endif
+
+	return 0;
+}
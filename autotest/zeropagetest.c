@@ -0,0 +1,38 @@
+#include <assert.h>
+
+__zeropage long	za, zb;
+__zeropage char	zc[6];
+char			buffer[100];
+long			la;
+char			lc[6];
+
+void copyin(void)
+{
+	for(char i=0; i<100; i++)
+	{
+		za += buffer[i];
+		zb = za;
+	}
+}
+
+void copyzp(void)
+{
+	for(char i=0; i<6; i++)
+		zc[i] = i + 1;
+	lc[0] = zc[0]; lc[1] = zc[1]; lc[2] = zc[2];
+	lc[3] = zc[3]; lc[4] = zc[4]; lc[5] = zc[5];
+}
+
+int main(void)
+{
+	za = 0;
+	for(char i=0; i<100; i++)
+		buffer[i] = i;
+	copyin();
+	la = zb;
+	assert(la == 4950);
+	copyzp();
+	for(char i=0; i<6; i++)
+		assert(lc[i] == i + 1);
+	return 0;
+}
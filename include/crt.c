@@ -19,6 +19,12 @@ void StackStart, StackEnd, BSSStart, BSSEnd;
 #pragma section(stack, 0x0000, StackStart, StackEnd)
 #pragma section(bss, 0x0000, BSSStart, BSSEnd)
 
+#ifdef OSCAR_ZEROPAGE_GLOBALS
+void ZeroPageStart, ZeroPageEnd;
+
+#pragma section(zeropage, 0x0000, ZeroPageStart, ZeroPageEnd)
+#endif
+
 char spentry = 0;
 
 int main(void);
@@ -114,6 +120,20 @@ l2:		dey
 		bne l2
 w2:
 
+#ifdef OSCAR_ZEROPAGE_GLOBALS
+// Clear zero page variables
+
+		lda #0
+		ldx #<ZeroPageStart
+		cpx #<ZeroPageEnd
+		beq w3
+l3:		sta $00, x
+		inx
+		cpx #<ZeroPageEnd
+		bne l3
+w3:
+#endif
+
 		lda	#<StackEnd - 2
 		sta	sp
 		lda	#>StackEnd - 2
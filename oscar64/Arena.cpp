@@ -0,0 +1,161 @@
+#include "Arena.h"
+#include <stdlib.h>
+#include <atomic>
+#include <mutex>
+
+static const size_t	ArenaChunkSize = 0x40000;
+static const size_t	ArenaAlign = 16;
+
+static thread_local Arena* CurrentArena = nullptr;
+static std::atomic<size_t>	ArenaTotalAllocated(0);
+static Arena			*	GlobalArena = nullptr;
+static std::mutex			GlobalArenaLock;
+
+static inline size_t ArenaAlignSize(size_t size)
+{
+	return (size + ArenaAlign - 1) & ~(ArenaAlign - 1);
+}
+
+Arena::Arena(void)
+	: mAllocated(0), mChunks(nullptr), mTop(nullptr), mEnd(nullptr), mObjects(nullptr)
+{
+}
+
+Arena::~Arena(void)
+{
+	if (CurrentArena == this)
+		CurrentArena = nullptr;
+	if (GlobalArena == this)
+		GlobalArena = nullptr;
+
+	Header* h = mObjects;
+	while (h)
+	{
+		if (h->mDestruct)
+			h->mDestruct((char*)h + ArenaAlignSize(sizeof(Header)));
+		h = h->mNext;
+	}
+
+	while (mChunks)
+	{
+		Chunk* c = mChunks;
+		mChunks = c->mNext;
+		free(c);
+	}
+
+	ArenaTotalAllocated -= mAllocated;
+}
+
+char* Arena::AllocateChunk(size_t size)
+{
+	Chunk* c = (Chunk*)malloc(ArenaAlignSize(sizeof(Chunk)) + size);
+	c->mNext = mChunks;
+	c->mSize = size;
+	mChunks = c;
+
+	mAllocated += size;
+	ArenaTotalAllocated += size;
+
+	return (char*)c + ArenaAlignSize(sizeof(Chunk));
+}
+
+void* Arena::Allocate(size_t size, void (*destruct)(void*))
+{
+	size_t	hsize = ArenaAlignSize(sizeof(Header));
+	size_t	asize = hsize + ArenaAlignSize(size);
+
+	char* data;
+	if (asize > ArenaChunkSize / 4)
+	{
+		// Large objects get a chunk of their own, so the remainder
+		// of the current chunk is not wasted
+		data = AllocateChunk(asize);
+	}
+	else
+	{
+		if (size_t(mEnd - mTop) < asize)
+		{
+			mTop = AllocateChunk(ArenaChunkSize);
+			mEnd = mTop + ArenaChunkSize;
+		}
+
+		data = mTop;
+		mTop += asize;
+	}
+
+	Header* h = (Header*)data;
+	h->mDestruct = destruct;
+	h->mArena = this;
+	h->mNext = mObjects;
+	mObjects = h;
+
+	return data + hsize;
+}
+
+void* Arena::New(size_t size, void (*destruct)(void*))
+{
+	if (CurrentArena)
+		return CurrentArena->Allocate(size, destruct);
+	else
+		return NewHeap(size);
+}
+
+void Arena::SetGlobal(Arena* arena)
+{
+	GlobalArena = arena;
+}
+
+void* Arena::NewGlobal(size_t size, void (*destruct)(void*))
+{
+	if (GlobalArena)
+	{
+		std::lock_guard<std::mutex>	lock(GlobalArenaLock);
+		return GlobalArena->Allocate(size, destruct);
+	}
+	else
+		return NewHeap(size);
+}
+
+void* Arena::NewHeap(size_t size)
+{
+	size_t	hsize = ArenaAlignSize(sizeof(Header));
+	Header* h = (Header*)malloc(hsize + size);
+	h->mDestruct = nullptr;
+	h->mNext = nullptr;
+	h->mArena = nullptr;
+
+	return (char*)h + hsize;
+}
+
+void Arena::Delete(void* ptr)
+{
+	if (ptr)
+	{
+		Header* h = (Header*)((char*)ptr - ArenaAlignSize(sizeof(Header)));
+		if (h->mArena)
+			h->mDestruct = nullptr;
+		else
+			free(h);
+	}
+}
+
+Arena* Arena::Current(void)
+{
+	return CurrentArena;
+}
+
+size_t Arena::TotalAllocated(void)
+{
+	return ArenaTotalAllocated;
+}
+
+ArenaScope::ArenaScope(Arena* arena)
+	: mPrev(CurrentArena)
+{
+	CurrentArena = arena;
+}
+
+ArenaScope::~ArenaScope(void)
+{
+	CurrentArena = mPrev;
+}
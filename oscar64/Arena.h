@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stddef.h>
+#include <type_traits>
+
+// Region allocator for the many small objects of the intermediate and
+// native code, allocation is a pointer bump in the current arena of the
+// thread and all objects of an arena are destroyed together when the
+// arena is deleted
+
+class Arena
+{
+public:
+	Arena(void);
+	~Arena(void);
+
+	void* Allocate(size_t size, void (*destruct)(void*));
+
+	static void* New(size_t size, void (*destruct)(void*));
+	static void Delete(void* ptr);
+
+	static Arena* Current(void);
+
+	// Arena for objects that live as long as the compiler, it is shared
+	// by all threads and independent of the current arena
+
+	static void SetGlobal(Arena* arena);
+	static void* NewGlobal(size_t size, void (*destruct)(void*));
+
+	size_t	mAllocated;
+
+	static size_t	TotalAllocated(void);
+protected:
+	struct Chunk
+	{
+		Chunk	*	mNext;
+		size_t		mSize;
+	};
+
+	struct Header
+	{
+		void	(*mDestruct)(void*);
+		Header	*	mNext;
+		Arena	*	mArena;
+	};
+
+	Chunk	*	mChunks;
+	char	*	mTop, * mEnd;
+	Header	*	mObjects;
+
+	char* AllocateChunk(size_t size);
+
+	static void* NewHeap(size_t size);
+};
+
+// Makes an arena the current arena of the thread for the lifetime
+// of the scope
+
+class ArenaScope
+{
+public:
+	ArenaScope(Arena* arena);
+	~ArenaScope(void);
+protected:
+	Arena* mPrev;
+};
+
+// Base class for objects allocated in the current arena, falls back to
+// the heap if the thread has no current arena
+
+template<class T>
+class ArenaObject
+{
+public:
+	static void* operator new(size_t size)
+	{
+		return Arena::New(size, std::is_trivially_destructible<T>::value ? nullptr : Destruct);
+	}
+
+	static void operator delete(void* ptr)
+	{
+		Arena::Delete(ptr);
+	}
+protected:
+	static void Destruct(void* ptr)
+	{
+		static_cast<T*>(ptr)->~T();
+	}
+};
+
+// Base class for objects that live as long as the compiler, allocated in
+// the global arena, or on the heap if there is no global arena
+
+template<class T>
+class GlobalArenaObject
+{
+public:
+	static void* operator new(size_t size)
+	{
+		return Arena::NewGlobal(size, std::is_trivially_destructible<T>::value ? nullptr : Destruct);
+	}
+
+	static void operator delete(void* ptr)
+	{
+		Arena::Delete(ptr);
+	}
+protected:
+	static void Destruct(void* ptr)
+	{
+		static_cast<T*>(ptr)->~T();
+	}
+};
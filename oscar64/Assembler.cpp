@@ -338,6 +338,77 @@ int AsmInsSize(AsmInsType type, AsmInsMode mode)
 		return 1;
 }
 
+static const int AsmInsModeCycles[NUM_ASM_INS_MODES] =
+{
+	2,
+	2,
+	3,
+	4,
+	4,
+	4,
+	4,
+	4,
+	5,
+	6,
+	5,
+	2,
+};
+
+int AsmInsCycles(AsmInsType type, AsmInsMode mode, bool cross, bool taken)
+{
+	switch (type)
+	{
+	case ASMIT_ASL:
+	case ASMIT_LSR:
+	case ASMIT_ROL:
+	case ASMIT_ROR:
+	case ASMIT_INC:
+	case ASMIT_DEC:
+		if (mode == ASMIM_IMPLIED)
+			return 2;
+		else if (mode == ASMIM_ABSOLUTE_X)
+			return 7;
+		else
+			return AsmInsModeCycles[mode] + 2;
+	case ASMIT_STA:
+	case ASMIT_STX:
+	case ASMIT_STY:
+		if (mode == ASMIM_ABSOLUTE_X || mode == ASMIM_ABSOLUTE_Y || mode == ASMIM_INDIRECT_Y)
+			return AsmInsModeCycles[mode] + 1;
+		else
+			return AsmInsModeCycles[mode];
+	case ASMIT_JMP:
+		return mode == ASMIM_INDIRECT ? 5 : 3;
+	case ASMIT_JSR:
+	case ASMIT_RTS:
+	case ASMIT_RTI:
+		return 6;
+	case ASMIT_PHA:
+	case ASMIT_PHP:
+		return 3;
+	case ASMIT_PLA:
+	case ASMIT_PLP:
+		return 4;
+	case ASMIT_BRK:
+		return 7;
+	case ASMIT_INV:
+	case ASMIT_BYTE:
+		return 0;
+	default:
+		if (mode == ASMIM_RELATIVE)
+			return taken ? (cross ? 4 : 3) : 2;
+		else if (cross && (mode == ASMIM_ABSOLUTE_X || mode == ASMIM_ABSOLUTE_Y || mode == ASMIM_INDIRECT_Y))
+			return AsmInsModeCycles[mode] + 1;
+		else
+			return AsmInsModeCycles[mode];
+	}
+}
+
+bool AsmInsPageCrossPenalty(AsmInsType type, AsmInsMode mode)
+{
+	return AsmInsCycles(type, mode, true, true) > AsmInsCycles(type, mode, false, true);
+}
+
 static inline char toupper(char ch)
 {
 	if (ch >= 'a' && ch <= 'z')
@@ -347,7 +418,7 @@ static inline char toupper(char ch)
 }
 AsmInsType FindAsmInstruction(const char* ins)
 {
-	if (!ins[3])
+	if (ins[0] && ins[1] && ins[2] && !ins[3])
 	{
 		for (int i = 0; i < NUM_ASM_INS_TYPES; i++)
 		{
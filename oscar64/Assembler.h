@@ -53,4 +53,12 @@ bool HasAsmInstructionMode(AsmInsType type, AsmInsMode mode);
 
 int AsmInsSize(AsmInsType type, AsmInsMode mode);
 
+// Cycles of an instruction on the 6502, cross is set when the indexed effective
+// address or the branch target lies in another page than the base address or
+// the next instruction, taken is set for a taken branch
+
+int AsmInsCycles(AsmInsType type, AsmInsMode mode, bool cross = false, bool taken = false);
+
+bool AsmInsPageCrossPenalty(AsmInsType type, AsmInsMode mode);
+
 void InitAssembler(void);
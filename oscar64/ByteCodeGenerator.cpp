@@ -212,7 +212,7 @@ static ByteCode TransposeBranchCondition(ByteCode code)
 }
 
 ByteCodeInstruction::ByteCodeInstruction(ByteCode code)
-	: mCode(code), mRelocate(false), mRegisterFinal(false), mLinkerObject(nullptr), mValue(0), mRegister(0)
+	: mCode(code), mRelocate(false), mRegisterFinal(false), mLinkerObject(nullptr), mRuntime(nullptr), mValue(0), mRegister(0), mLive(0)
 {
 }
 
@@ -1310,10 +1310,16 @@ ByteCodeBasicBlock::ByteCodeBasicBlock(void)
 {
 	mTrueJump = mFalseJump = NULL;
 	mTrueLink = mFalseLink = NULL;
+	mBranch = BC_NOP;
 	mOffset = -1;
+	mIndex = mSize = mPlace = mLinear = 0;
 	mPlaced = false;
 	mAssembled = false;
 	mBypassed = false;
+	mNeedsNop = false;
+	mVisited = false;
+	mLocked = false;
+	mNumEntries = 0;
 	mExitLive = 0;
 }
 
@@ -235,7 +235,7 @@ public:
 	bool CheckAccuSize(uint32 & used);
 };
 
-class ByteCodeBasicBlock
+class ByteCodeBasicBlock : public GlobalArenaObject<ByteCodeBasicBlock>
 {
 public:
 	DynamicArray<uint8>					mCode;
@@ -316,7 +316,7 @@ public:
 
 class ByteCodeGenerator;
 
-class ByteCodeProcedure
+class ByteCodeProcedure : public GlobalArenaObject<ByteCodeProcedure>
 {
 public:
 	ByteCodeProcedure(void);
@@ -4,7 +4,7 @@
 #include "Errors.h"
 #include "Linker.h"
 
-class CompilationUnit
+class CompilationUnit : public GlobalArenaObject<CompilationUnit>
 {
 public:
 	Location			mLocation;
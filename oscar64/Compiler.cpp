@@ -5,12 +5,22 @@
 #include "InterCode.h"
 #include "ByteCodeGenerator.h"
 #include "NativeCodeGenerator.h"
+#include "NativeCodeCache.h"
 #include "Emulator.h"
 #include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 Compiler::Compiler(void)
-	: mByteCodeFunctions(nullptr), mCompilerOptions(COPT_DEFAULT), mDefines({nullptr, nullptr})
+	: mByteCodeFunctions(nullptr), mNativeCodeFunctions(nullptr), mCompilerOptions(COPT_DEFAULT), mNumThreads(1), mDefines({nullptr, nullptr})
 {
+	// The parse tree, the linker objects and the variables of the intermediate
+	// code are allocated in the arena of the compiler and released with it
+
+	mArena = new Arena();
+	Arena::SetGlobal(mArena);
+
 	mErrors = new Errors();
 	mLinker = new Linker(mErrors);
 	mCompilationUnits = new CompilationUnits(mErrors);
@@ -34,7 +44,20 @@ Compiler::Compiler(void)
 
 Compiler::~Compiler(void)
 {
-
+	for (int i = 0; i < mNativeCodeFunctions.Size(); i++)
+		delete mNativeCodeFunctions[i];
+
+	delete mGlobalAnalyzer;
+	delete mInterCodeModule;
+	delete mNativeCodeGenerator;
+	delete mInterCodeGenerator;
+	delete mByteCodeGenerator;
+	delete mPreprocessor;
+	delete mCompilationUnits;
+	delete mLinker;
+	delete mErrors;
+
+	delete mArena;
 }
 
 void Compiler::AddDefine(const Ident* ident, const char* value)
@@ -130,6 +153,7 @@ void Compiler::CompileProcedure(InterCodeProcedure* proc)
 				printf("Generate native code <%s>\n", proc->mIdent->mString);
 
 			ncproc->Compile(proc);
+			mNativeCodeFunctions.Push(ncproc);
 		}
 		else
 		{
@@ -144,10 +168,200 @@ void Compiler::CompileProcedure(InterCodeProcedure* proc)
 	}
 }
 
+static void CollectCompileOrder(InterCodeProcedure* proc, GrowingInterCodeProcedurePtrArray& order, GrowingArray<bool>& visited)
+{
+	if (!visited[proc->mID])
+	{
+		visited[proc->mID] = true;
+
+		for (int i = 0; i < proc->mCalledFunctions.Size(); i++)
+			CollectCompileOrder(proc->mCalledFunctions[i], order, visited);
+
+		order.Push(proc);
+	}
+}
+
+static void AddCompileDependency(InterCodeProcedure* proc, InterCodeProcedure* cproc, const GrowingIntArray& position, GrowingArray<GrowingIntArray*>& depends)
+{
+	// The procedure compiled later in the serial order has to wait for the
+	// other, so it sees the same state of the call partner as a serial build
+
+	int	pi = position[proc->mID], ci = position[cproc->mID];
+
+	if (pi >= 0 && ci >= 0)
+	{
+		if (pi > ci)
+			depends[pi]->Push(ci);
+		else if (ci > pi)
+			depends[ci]->Push(pi);
+	}
+}
+
+void Compiler::CompileProceduresParallel(void)
+{
+	int	numProcs = mInterCodeModule->mProcedures.Size();
+
+	GrowingInterCodeProcedurePtrArray	order(nullptr);
+	GrowingArray<bool>					visited(false);
+	visited.SetSize(numProcs, true);
+
+	for (int i = 0; i < numProcs; i++)
+		CollectCompileOrder(mInterCodeModule->mProcedures[i], order, visited);
+
+	GrowingIntArray		position(-1);
+	position.SetSize(numProcs, true);
+	for (int i = 0; i < order.Size(); i++)
+		position[order[i]->mID] = i;
+
+	GrowingArray<GrowingIntArray*>	depends(nullptr);
+	for (int i = 0; i < order.Size(); i++)
+		depends.Push(new GrowingIntArray(-1));
+
+	for (int i = 0; i < order.Size(); i++)
+	{
+		InterCodeProcedure* proc = order[i];
+
+		for (int j = 0; j < proc->mCalledFunctions.Size(); j++)
+			AddCompileDependency(proc, proc->mCalledFunctions[j], position, depends);
+
+		// Calls may have been resolved from function pointers during optimization
+
+		for (int j = 0; j < proc->mBlocks.Size(); j++)
+		{
+			InterCodeBasicBlock* block = proc->mBlocks[j];
+			for (int k = 0; k < block->mInstructions.Size(); k++)
+			{
+				InterInstruction* ins = block->mInstructions[k];
+				if (ins && (ins->mCode == IC_CALL || ins->mCode == IC_CALL_NATIVE) && ins->mSrc[0].mTemp < 0 && ins->mSrc[0].mLinkerObject && ins->mSrc[0].mLinkerObject->mProc)
+					AddCompileDependency(proc, ins->mSrc[0].mLinkerObject->mProc, position, depends);
+			}
+		}
+	}
+
+	// Translation from intermediate to native code and all access to shared
+	// data is done by this thread in serial order, only the optimization of
+	// the native code is distributed to the worker threads
+
+	std::mutex								queueLock, sharedLock;
+	std::condition_variable					queueCond, doneCond;
+	GrowingArray<NativeCodeProcedure*>		queue(nullptr);
+	GrowingArray<bool>						done(false);
+	int										queueRead = 0;
+	bool									finished = false;
+
+	done.SetSize(order.Size(), true);
+
+	auto worker = [&]()
+	{
+		for (;;)
+		{
+			NativeCodeProcedure* ncproc;
+			{
+				std::unique_lock<std::mutex>	lock(queueLock);
+				queueCond.wait(lock, [&]() { return finished || queueRead < queue.Size(); });
+				if (queueRead == queue.Size())
+					return;
+				ncproc = queue[queueRead++];
+			}
+
+			ncproc->Optimize();
+
+			{
+				std::lock_guard<std::mutex>		lock(sharedLock);
+				ncproc->Assemble();
+			}
+
+			{
+				std::lock_guard<std::mutex>		lock(queueLock);
+				done[position[ncproc->mInterProc->mID]] = true;
+			}
+			doneCond.notify_all();
+		}
+	};
+
+	GrowingArray<std::thread*>	threads(nullptr);
+	for (int i = 0; i < mNumThreads; i++)
+		threads.Push(new std::thread(worker));
+
+	for (int i = 0; i < order.Size(); i++)
+	{
+		InterCodeProcedure* proc = order[i];
+
+		{
+			std::unique_lock<std::mutex>	lock(queueLock);
+			const GrowingIntArray& deps(*depends[i]);
+			doneCond.wait(lock, [&]() {
+				for (int j = 0; j < deps.Size(); j++)
+					if (!done[deps[j]])
+						return false;
+				return true;
+			});
+		}
+
+		proc->mCompiled = true;
+
+		std::unique_lock<std::mutex>	lock(sharedLock);
+
+		proc->MapCallerSavedTemps();
+
+		if (proc->mNativeProcedure)
+		{
+			NativeCodeProcedure* ncproc = new NativeCodeProcedure(mNativeCodeGenerator);
+			if (mCompilerOptions & COPT_VERBOSE2)
+				printf("Generate native code <%s>\n", proc->mIdent->mString);
+
+			ncproc->Translate(proc);
+			mNativeCodeFunctions.Push(ncproc);
+
+			lock.unlock();
+
+			{
+				std::lock_guard<std::mutex>		qlock(queueLock);
+				queue.Push(ncproc);
+			}
+			queueCond.notify_one();
+		}
+		else
+		{
+			ByteCodeProcedure* bgproc = new ByteCodeProcedure();
+
+			if (mCompilerOptions & COPT_VERBOSE2)
+				printf("Generate byte code <%s>\n", proc->mIdent->mString);
+
+			bgproc->Compile(mByteCodeGenerator, proc);
+			mByteCodeFunctions.Push(bgproc);
+
+			lock.unlock();
+
+			{
+				std::lock_guard<std::mutex>		qlock(queueLock);
+				done[i] = true;
+			}
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex>		lock(queueLock);
+		finished = true;
+	}
+	queueCond.notify_all();
+
+	for (int i = 0; i < threads.Size(); i++)
+	{
+		threads[i]->join();
+		delete threads[i];
+	}
+
+	for (int i = 0; i < depends.Size(); i++)
+		delete depends[i];
+}
+
 bool Compiler::GenerateCode(void)
 {
 	Location	loc;
 
+	ArenaScope	scope(mInterCodeModule->mArena);
+
 	Declaration* dcrtstart = mCompilationUnits->mStartup;
 	if (!dcrtstart)
 	{
@@ -236,6 +450,15 @@ bool Compiler::GenerateCode(void)
 	}
 
 	mGlobalAnalyzer->CheckInterrupt();
+	mGlobalAnalyzer->CheckArgumentRanges();
+	if (mCompilerOptions & COPT_OPTIMIZE_ZEROPAGE)
+	{
+		// The default zeropage region overlaps variables of the kernal
+		if (regionZeroPage->mStart == 0x0080 && regionZeroPage->mEnd == 0x00ff)
+			mErrors->Error(loc, EWARN_ZEROPAGE_GLOBALS_IGNORED, "Zero page globals ignored, zeropage region not limited with #pragma region");
+		else
+			mGlobalAnalyzer->PromoteZeroPage(regionZeroPage, mCompilationUnits->mSectionBSS, mCompilationUnits->mSectionZeroPage);
+	}
 	mGlobalAnalyzer->AutoInline();
 	//mGlobalAnalyzer->DumpCallGraph();
 
@@ -336,6 +559,9 @@ bool Compiler::GenerateCode(void)
 	if (mCompilerOptions & COPT_VERBOSE)
 		printf("Generate native code\n");
 
+	if (mNumThreads > 1)
+		CompileProceduresParallel();
+
 	for (int i = 0; i < mInterCodeModule->mProcedures.Size(); i++)
 	{
 		InterCodeProcedure* proc = mInterCodeModule->mProcedures[i];
@@ -352,6 +578,18 @@ bool Compiler::GenerateCode(void)
 			mCompilationUnits->mSectionStack->mSections.Push(proc->mLinkerObject->mStackSection);
 	}
 
+	// The case tables are added in compile order and not in the order the
+	// procedures are assembled, which differs between parallel builds
+
+	for (int i = 0; i < mNativeCodeFunctions.Size(); i++)
+		mNativeCodeFunctions[i]->AddCaseTables();
+
+	if ((mCompilerOptions & COPT_VERBOSE) && mNativeCodeGenerator->mCache)
+	{
+		NativeCodeCache* cache = mNativeCodeGenerator->mCache;
+		printf("Native code cache %d hits, %d misses, %d stored\n", int(cache->mHits), int(cache->mMisses), int(cache->mStores));
+	}
+
 	LinkerObject* byteCodeObject = nullptr;
 	if (!(mCompilerOptions & COPT_NATIVE))
 	{
@@ -486,7 +724,7 @@ bool Compiler::BuildLZO(const char* targetPath)
 
 bool Compiler::WriteOutputFile(const char* targetPath, DiskImage * d64)
 {
-	char	prgPath[200], mapPath[200], asmPath[200], lblPath[200], intPath[200], bcsPath[200];
+	char	prgPath[200], mapPath[200], asmPath[200], lblPath[200], intPath[200], bcsPath[200], timePath[200];
 
 	strcpy_s(prgPath, targetPath);
 	int		i = strlen(prgPath);
@@ -500,12 +738,14 @@ bool Compiler::WriteOutputFile(const char* targetPath, DiskImage * d64)
 	strcpy_s(lblPath, prgPath);
 	strcpy_s(intPath, prgPath);
 	strcpy_s(bcsPath, prgPath);
+	strcpy_s(timePath, prgPath);
 
 	strcat_s(mapPath, "map");
 	strcat_s(asmPath, "asm");
 	strcat_s(lblPath, "lbl");
 	strcat_s(intPath, "int");
 	strcat_s(bcsPath, "bcs");
+	strcat_s(timePath, "time.json");
 
 	if (mCompilerOptions & COPT_TARGET_PRG)
 	{
@@ -569,10 +809,20 @@ bool Compiler::WriteOutputFile(const char* targetPath, DiskImage * d64)
 		mByteCodeGenerator->WriteByteCodeStats(bcsPath);
 	}
 
+	if (mCompilerOptions & COPT_TIME_REPORT)
+	{
+		PassProfileReport	report(mInterCodeModule);
+		report.Print(stdout);
+
+		if (mCompilerOptions & COPT_VERBOSE)
+			printf("Writing <%s>\n", timePath);
+		report.WriteJSON(timePath);
+	}
+
 	return true;
 }
 
-int Compiler::ExecuteCode(bool profile)
+int Compiler::ExecuteCode(const char* targetPath, bool profile)
 {
 	Location	loc;
 
@@ -596,8 +846,23 @@ int Compiler::ExecuteCode(bool profile)
 	printf("Emulation result %d\n", ecode);
 
 	if (profile)
+	{
 		emu->DumpProfile();
 
+		char	profPath[200];
+		strcpy_s(profPath, targetPath);
+		int		i = strlen(profPath);
+		while (i > 0 && profPath[i - 1] != '.')
+			i--;
+		if (i > 0)
+			profPath[i] = 0;
+		strcat_s(profPath, "prof");
+
+		if (mCompilerOptions & COPT_VERBOSE)
+			printf("Writing <%s>\n", profPath);
+		emu->WriteProfile(profPath);
+	}
+
 	if (ecode != 0)
 	{
 		char	sd[20];
@@ -605,5 +870,7 @@ int Compiler::ExecuteCode(bool profile)
 		mErrors->Error(loc, EERR_EXECUTION_FAILED, "Execution failed", sd);
 	}
 
+	delete emu;
+
 	return ecode;
 }
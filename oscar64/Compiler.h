@@ -25,10 +25,13 @@ public:
 	InterCodeGenerator* mInterCodeGenerator;
 	InterCodeModule* mInterCodeModule;
 	GlobalAnalyzer* mGlobalAnalyzer;
+	Arena* mArena;
 
 	GrowingArray<ByteCodeProcedure*>	mByteCodeFunctions;
+	GrowingArray<NativeCodeProcedure*>	mNativeCodeFunctions;
 
 	uint64	mCompilerOptions;
+	int		mNumThreads;
 
 	struct Define
 	{
@@ -42,11 +45,12 @@ public:
 	bool ParseSource(void);
 	bool GenerateCode(void);
 	bool WriteOutputFile(const char* targetPath, DiskImage * d64);
-	int ExecuteCode(bool profile);
+	int ExecuteCode(const char* targetPath, bool profile);
 
 	void AddDefine(const Ident* ident, const char* value);
 
 	void RegisterRuntime(const Location& loc, const Ident* ident);
 
 	void CompileProcedure(InterCodeProcedure* proc);
+	void CompileProceduresParallel(void);
 };
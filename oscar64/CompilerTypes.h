@@ -11,6 +11,7 @@ static const uint64 COPT_OPTIMIZE_AUTO_UNROLL = 0x00000040;
 static const uint64 COPT_OPTIMIZE_CONST_EXPRESSIONS = 0x00000080;
 
 static const uint64 COPT_OPTIMIZE_CODE_SIZE = 0x00000100;
+static const uint64 COPT_OPTIMIZE_ZEROPAGE = 0x00000200;
 
 static const uint64 COPT_TARGET_PRG = 0x100000000ULL;
 static const uint64 COPT_TARGET_CRT16 = 0x200000000ULL;
@@ -21,6 +22,7 @@ static const uint64 COPT_TARGET_LZO = 0x2000000000ULL;
 
 static const uint64 COPT_VERBOSE = 0x10000000000ULL;
 static const uint64 COPT_VERBOSE2 = 0x20000000000ULL;
+static const uint64 COPT_TIME_REPORT = 0x40000000000ULL;
 
 static const uint64 COPT_NATIVE = 0x01000000;
 
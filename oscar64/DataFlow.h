@@ -0,0 +1,221 @@
+#pragma once
+
+#include "Array.h"
+
+// Worklist solvers for dataflow problems on the blocks reachable from an
+// entry block.  The block type provides mTrueJump, mFalseJump, mVisited
+// and the scratch index mDataFlowIndex, the visited flags have to be reset
+// before a solver is constructed.
+
+template<class T>
+class DataFlowGraph
+{
+public:
+	DataFlowGraph(T* entry);
+
+	// Blocks in postorder
+
+	GrowingArray<T*>	mBlocks;
+protected:
+	GrowingArray<int>	mPredStart, mPreds;
+
+	void Collect(T* block);
+};
+
+// Backward problems evaluate the blocks in postorder, afterwards a block is
+// evaluated again only when the entry set of one of its successors changed.
+
+template<class T>
+class BackwardDataFlow : public DataFlowGraph<T>
+{
+public:
+	BackwardDataFlow(T* entry);
+
+	// The update function recomputes the sets of the block from the entry
+	// sets of its successors and returns true if its own entry set changed,
+	// the result is the number of block evaluations
+
+	int Solve(bool (T::*update)(void));
+};
+
+// Forward problems evaluate the blocks in reverse postorder, afterwards a
+// block is evaluated again only when the exit set of one of its
+// predecessors changed.
+
+template<class T>
+class ForwardDataFlow : public DataFlowGraph<T>
+{
+public:
+	ForwardDataFlow(T* entry);
+
+	// The update function is called with the block, it recomputes the sets
+	// of the block from the exit sets of its predecessors and returns true
+	// if its own exit sets changed, the result is the number of block
+	// evaluations
+
+	template<class F>
+	int Solve(F update);
+};
+
+template<class T>
+DataFlowGraph<T>::DataFlowGraph(T* entry)
+	: mBlocks(nullptr), mPredStart(0), mPreds(0)
+{
+	Collect(entry);
+
+	int	n = mBlocks.Size();
+
+	// Predecessor lists in compressed form, the predecessors of block i
+	// are mPreds[mPredStart[i]] .. mPreds[mPredStart[i + 1] - 1]
+
+	mPredStart.SetSize(n + 1, true);
+	for (int i = 0; i <= n; i++)
+		mPredStart[i] = 0;
+
+	for (int i = 0; i < n; i++)
+	{
+		T* b = mBlocks[i];
+		if (b->mTrueJump)
+			mPredStart[b->mTrueJump->mDataFlowIndex + 1]++;
+		if (b->mFalseJump)
+			mPredStart[b->mFalseJump->mDataFlowIndex + 1]++;
+	}
+
+	for (int i = 0; i < n; i++)
+		mPredStart[i + 1] += mPredStart[i];
+
+	GrowingArray<int>	fill(mPredStart);
+	mPreds.SetSize(mPredStart[n], true);
+
+	for (int i = 0; i < n; i++)
+	{
+		T* b = mBlocks[i];
+		if (b->mTrueJump)
+			mPreds[fill[b->mTrueJump->mDataFlowIndex]++] = i;
+		if (b->mFalseJump)
+			mPreds[fill[b->mFalseJump->mDataFlowIndex]++] = i;
+	}
+}
+
+template<class T>
+void DataFlowGraph<T>::Collect(T* block)
+{
+	if (!block->mVisited)
+	{
+		block->mVisited = true;
+
+		if (block->mTrueJump) Collect(block->mTrueJump);
+		if (block->mFalseJump) Collect(block->mFalseJump);
+
+		block->mDataFlowIndex = mBlocks.Size();
+		mBlocks.Push(block);
+	}
+}
+
+template<class T>
+BackwardDataFlow<T>::BackwardDataFlow(T* entry)
+	: DataFlowGraph<T>(entry)
+{
+}
+
+template<class T>
+int BackwardDataFlow<T>::Solve(bool (T::*update)(void))
+{
+	int	n = this->mBlocks.Size();
+
+	// Ring buffer of pending blocks, each block is at most once in the queue
+
+	GrowingArray<int>	queue(0);
+	GrowingArray<bool>	queued(false);
+	queue.SetSize(n, true);
+	queued.SetSize(n, true);
+
+	for (int i = 0; i < n; i++)
+	{
+		queue[i] = i;
+		queued[i] = true;
+	}
+
+	int	head = 0, count = n, evaluations = 0;
+	while (count > 0)
+	{
+		int	i = queue[head];
+		head = (head + 1) % n;
+		count--;
+		queued[i] = false;
+
+		evaluations++;
+		if ((this->mBlocks[i]->*update)())
+		{
+			for (int j = this->mPredStart[i]; j < this->mPredStart[i + 1]; j++)
+			{
+				int	p = this->mPreds[j];
+				if (!queued[p])
+				{
+					queued[p] = true;
+					queue[(head + count) % n] = p;
+					count++;
+				}
+			}
+		}
+	}
+
+	return evaluations;
+}
+
+template<class T>
+ForwardDataFlow<T>::ForwardDataFlow(T* entry)
+	: DataFlowGraph<T>(entry)
+{
+}
+
+template<class T>
+template<class F>
+int ForwardDataFlow<T>::Solve(F update)
+{
+	int	n = this->mBlocks.Size();
+
+	// Ring buffer of pending blocks, each block is at most once in the queue
+
+	GrowingArray<int>	queue(0);
+	GrowingArray<bool>	queued(false);
+	queue.SetSize(n, true);
+	queued.SetSize(n, true);
+
+	for (int i = 0; i < n; i++)
+	{
+		queue[i] = n - 1 - i;
+		queued[i] = true;
+	}
+
+	int	head = 0, count = n, evaluations = 0;
+	while (count > 0)
+	{
+		int	i = queue[head];
+		head = (head + 1) % n;
+		count--;
+		queued[i] = false;
+
+		evaluations++;
+		T* b = this->mBlocks[i];
+		if (update(b))
+		{
+			T* succ[2] = { b->mTrueJump, b->mFalseJump };
+			for (int j = 0; j < 2; j++)
+			{
+				if (succ[j])
+				{
+					int	s = succ[j]->mDataFlowIndex;
+					if (!queued[s])
+					{
+						queued[s] = true;
+						queue[(head + count) % n] = s;
+						count++;
+					}
+				}
+			}
+		}
+	}
+
+	return evaluations;
+}
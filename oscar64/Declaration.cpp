@@ -84,7 +84,8 @@ Declaration* DeclarationScope::Lookup(const Ident* ident)
 
 
 Expression::Expression(const Location& loc, ExpressionType type)
-	:	mLocation(loc), mType(type), mLeft(nullptr), mRight(nullptr), mConst(false)
+	:	mLocation(loc), mType(type), mLeft(nullptr), mRight(nullptr), mToken(TK_NONE), mDecValue(nullptr), mDecType(nullptr),
+	mAsmInsType(ASMIT_NOP), mAsmInsMode(ASMIM_IMPLIED), mConst(false)
 {
 
 }
@@ -513,15 +514,15 @@ Expression* Expression::ConstantFold(Errors * errors)
 }
 
 Declaration::Declaration(const Location& loc, DecType type)
-	: mLocation(loc), mType(type), mScope(nullptr), mData(nullptr), mIdent(nullptr), mSize(0), mOffset(0), mFlags(0), mComplexity(0), mLocalSize(0), 
+	: mLocation(loc), mType(type), mToken(TK_NONE), mScope(nullptr), mData(nullptr), mIdent(nullptr), mSection(nullptr), mSize(0), mOffset(0), mNumVars(0), mFlags(0), mComplexity(0), mLocalSize(0), 
 	mBase(nullptr), mParams(nullptr), mValue(nullptr), mNext(nullptr), mVarIndex(-1), mLinkerObject(nullptr), mCallers(nullptr), mCalled(nullptr), mAlignment(1), 
-	mInteger(0), mNumber(0), mMinValue(-0x80000000LL), mMaxValue(0x7fffffffLL), mFastCallBase(0), mFastCallSize(0)
+	mInteger(0), mNumber(0), mMinValue(-0x80000000LL), mMaxValue(0x7fffffffLL), mFastCallBase(0), mFastCallSize(0), mUseCount(0)
 {}
 
 Declaration::~Declaration(void)
 {
-	delete mScope;
-	delete[] mData;
+	// Scope and data may be shared with copies of the declaration, they
+	// are released with the global arena
 }
 
 Declaration* Declaration::ToConstType(void)
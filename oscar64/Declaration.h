@@ -5,6 +5,7 @@
 #include "MachineTypes.h"
 #include "Assembler.h"
 #include "Array.h"
+#include "Arena.h"
 
 class LinkerObject;
 class LinkerSection;
@@ -81,13 +82,16 @@ static const uint64 DTF_FUNC_ANALYZING  = (1ULL << 35);
 static const uint64 DTF_FUNC_CONSTEXPR	= (1ULL << 36);
 static const uint64 DTF_FUNC_INTRSAVE   = (1ULL << 37);
 static const uint64 DTF_FUNC_INTRCALLED = (1ULL << 38);
+static const uint64 DTF_FUNC_HOT		= (1ULL << 41);
+static const uint64 DTF_FUNC_COLD		= (1ULL << 42);
 
 static const uint64 DTF_VAR_ALIASING	= (1ULL << 39);
+static const uint64 DTF_VAR_RANGE		= (1ULL << 40);
 
 
 class Declaration;
 
-class DeclarationScope
+class DeclarationScope : public GlobalArenaObject<DeclarationScope>
 {
 public:
 	DeclarationScope(DeclarationScope * parent);
@@ -148,7 +152,7 @@ enum ExpressionType
 	EX_ASSUME
 };
 
-class Expression
+class Expression : public GlobalArenaObject<Expression>
 {
 public:
 	Expression(const Location& loc, ExpressionType type);
@@ -169,7 +173,7 @@ public:
 	bool IsSame(const Expression* exp) const;
 };
 
-class Declaration
+class Declaration : public GlobalArenaObject<Declaration>
 {
 public:
 	Declaration(const Location & loc, DecType type);
@@ -181,7 +185,7 @@ public:
 	Declaration*		mBase, *mParams, * mNext;
 	Expression*			mValue;
 	DeclarationScope*	mScope;
-	int					mOffset, mSize, mVarIndex, mNumVars, mComplexity, mLocalSize, mAlignment, mFastCallBase, mFastCallSize;
+	int					mOffset, mSize, mVarIndex, mNumVars, mComplexity, mLocalSize, mAlignment, mFastCallBase, mFastCallSize, mUseCount;
 	int64				mInteger, mMinValue, mMaxValue;
 	double				mNumber;
 	uint64				mFlags;
@@ -3,6 +3,7 @@
 #include "Assembler.h"
 #include "InterCode.h"
 #include "Linker.h"
+#include "NumberSet.h"
 
 ByteCodeDisassembler::ByteCodeDisassembler(void)
 {
@@ -747,6 +748,84 @@ void NativeCodeDisassembler::Disassemble(FILE* file, const uint8* memory, int ba
 		}
 	}
 
+	// Assembler objects like the startup code mix data with instructions,
+	// only compiled procedures are split into blocks
+
+	if (proc)
+		DumpBlockCycles(file, memory, start, size);
+}
+
+void NativeCodeDisassembler::DumpBlockCycles(FILE* file, const uint8* memory, int start, int size)
+{
+	// Blocks start at the procedure entry, at branch and jump targets inside
+	// the procedure and after each branch, jump or return
+
+	NumberSet	leaders(size + 1);
+	leaders += 0;
+
+	int		ip = start;
+	while (ip < start + size)
+	{
+		AsmInsData	d = DecInsData[memory[ip]];
+		int			next = ip + AsmInsSize(d.mType, d.mMode);
+
+		if (d.mMode == ASMIM_RELATIVE)
+		{
+			int	target = next + int8(memory[ip + 1]);
+			if (target >= start && target < start + size)
+				leaders += target - start;
+		}
+		else if (d.mType == ASMIT_JMP && d.mMode == ASMIM_ABSOLUTE)
+		{
+			int	target = memory[ip + 1] + 256 * memory[ip + 2];
+			if (target >= start && target < start + size)
+				leaders += target - start;
+		}
+
+		if (next < start + size && (d.mMode == ASMIM_RELATIVE || d.mType == ASMIT_JMP || d.mType == ASMIT_RTS || d.mType == ASMIT_RTI))
+			leaders += next - start;
+
+		ip = next;
+	}
+
+	fprintf(file, "; estimated cycles per block\n");
+
+	ip = start;
+	while (ip < start + size)
+	{
+		int		bstart = ip, cycles = 0, cross = 0, taken = -1;
+
+		do
+		{
+			AsmInsData	d = DecInsData[memory[ip]];
+			int			next = ip + AsmInsSize(d.mType, d.mMode);
+
+			if (d.mMode == ASMIM_RELATIVE)
+			{
+				int	target = next + int8(memory[ip + 1]);
+				cycles += AsmInsCycles(d.mType, d.mMode);
+				taken = AsmInsCycles(d.mType, d.mMode, (target & 0xff00) != (next & 0xff00), true) - AsmInsCycles(d.mType, d.mMode);
+			}
+			else
+			{
+				cycles += AsmInsCycles(d.mType, d.mMode);
+
+				// Indexed reads from a page aligned base never cross a page
+
+				if (AsmInsPageCrossPenalty(d.mType, d.mMode) && !((d.mMode == ASMIM_ABSOLUTE_X || d.mMode == ASMIM_ABSOLUTE_Y) && memory[ip + 1] == 0))
+					cross++;
+			}
+
+			ip = next;
+		} while (ip < start + size && !leaders[ip - start]);
+
+		fprintf(file, ";   %04x : %3d", bstart, cycles);
+		if (taken >= 0)
+			fprintf(file, ", %3d if taken", cycles + taken);
+		if (cross)
+			fprintf(file, ", up to %d more on page crossing", cross);
+		fprintf(file, "\n");
+	}
 }
 
 const char* NativeCodeDisassembler::AddrName(int addr, char* buffer, Linker* linker)
@@ -32,6 +32,7 @@ public:
 protected:
 	const char* TempName(uint8 tmp, char* buffer, InterCodeProcedure* proc, Linker* linker);
 	const char* AddrName(int addr, char* buffer, Linker* linker);
+	void DumpBlockCycles(FILE* file, const uint8* memory, int start, int size);
 };
 
 
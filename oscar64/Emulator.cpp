@@ -321,6 +321,7 @@ bool Emulator::EmulateInstruction(AsmInsType type, AsmInsMode mode, int addr, in
 		mIP = addr;
 		break;
 	case ASMIT_JSR:
+		mCalls[addr]++;
 		mRegS--;
 		mMemory[0x100 + mRegS] = (mIP - 1) >> 8;
 		mRegS--;
@@ -496,12 +497,44 @@ void Emulator::DumpProfile(void)
 	DumpCycles();
 }
 
+bool Emulator::WriteProfile(const char* filename)
+{
+	FILE* file;
+	fopen_s(&file, filename, "wb");
+	if (file)
+	{
+		for (int i = 0; i < mLinker->mObjects.Size(); i++)
+		{
+			LinkerObject* lobj = mLinker->mObjects[i];
+			if (lobj->mIdent && lobj->mType == LOT_NATIVE_CODE && (lobj->mFlags & LOBJF_REFERENCED))
+			{
+				int64	cycles = 0;
+				for (int j = 0; j < lobj->mSize; j++)
+					cycles += mCycles[(lobj->mAddress + j) & 0xffff];
+
+				// The source file tells static functions of the same name apart
+
+				fprintf(file, "%s %lld %d %s\n", lobj->mIdent->mString, cycles, mCalls[lobj->mAddress & 0xffff], lobj->mLocation.mFileName ? lobj->mLocation.mFileName : "");
+			}
+		}
+
+		fclose(file);
+
+		return true;
+	}
+	else
+		return false;
+}
+
 int Emulator::Emulate(int startIP)
 {
 	int	trace = 0;
 
 	for (int i = 0; i < 0x10000; i++)
+	{
 		mCycles[i] = 0;
+		mCalls[i] = 0;
+	}
 
 	mIP = startIP;
 	mRegA = 0;
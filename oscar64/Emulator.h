@@ -12,7 +12,7 @@ public:
 	~Emulator(void);
 
 	uint8		mMemory[0x10000];
-	int			mCycles[0x10000];
+	int			mCycles[0x10000], mCalls[0x10000];
 
 	int		mIP;
 	uint8	mRegA, mRegX, mRegY, mRegS, mRegP;
@@ -21,6 +21,7 @@ public:
 
 	int Emulate(int startIP);
 	void DumpProfile(void);
+	bool WriteProfile(const char* filename);
 	bool EmulateInstruction(AsmInsType type, AsmInsMode mode, int addr, int & cycles);
 protected:
 	void UpdateStatus(uint8 result);
@@ -4,7 +4,7 @@
 #include <stdlib.h>
 
 Errors::Errors(void)
-	: mErrorCount(0)
+	: mErrorCount(0), mExitOnLimit(true)
 {
 
 }
@@ -19,6 +19,8 @@ void Errors::Error(const Location& loc, ErrorID eid, const char* msg, const Iden
 
 void Errors::Error(const Location& loc, ErrorID eid, const char* msg, const char* info) 
 {
+	std::lock_guard<std::mutex>	guard(mLock);
+
 	const char* level = "info";
 	if (eid >= EERR_GENERIC)
 	{
@@ -30,12 +32,17 @@ void Errors::Error(const Location& loc, ErrorID eid, const char* msg, const char
 		level = "warning";
 	}
 
+	// A resident compiler can not exit, it drops the messages after the limit
+
+	if (mErrorCount > 11 && !mExitOnLimit)
+		return;
+
 	if (info)
 		fprintf(stderr, "%s(%d, %d) : %s %d: %s '%s'\n", loc.mFileName, loc.mLine, loc.mColumn, level ,eid, msg, info);
 	else
 		fprintf(stderr, "%s(%d, %d) : %s %d: %s\n", loc.mFileName, loc.mLine, loc.mColumn, level, eid, msg);
 
-	if (mErrorCount > 10)
+	if (mErrorCount > 10 && mExitOnLimit)
 		exit(20);
 }
 
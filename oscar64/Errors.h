@@ -1,5 +1,7 @@
 #pragma once
 
+#include <mutex>
+
 class Location
 {
 public:
@@ -24,6 +26,7 @@ enum ErrorID
 	EWARN_BOOL_SHORTCUT,
 	EWARN_OPTIMIZER_LOCKED,
 	EWARN_LOOP_UNROLL_IGNORED,
+	EWARN_ZEROPAGE_GLOBALS_IGNORED,
 
 	EERR_GENERIC = 3000,
 	EERR_FILE_NOT_FOUND,
@@ -72,6 +75,8 @@ public:
 	Errors(void);
 
 	int		mErrorCount;
+	bool	mExitOnLimit;
+	std::mutex	mLock;
 
 	void Error(const Location& loc, ErrorID eid, const char* msg, const Ident * info);
 	void Error(const Location& loc, ErrorID eid, const char* msg, const char* info = nullptr);
@@ -1,7 +1,7 @@
 #include "GlobalAnalyzer.h"
 
 GlobalAnalyzer::GlobalAnalyzer(Errors* errors, Linker* linker)
-	: mErrors(errors), mLinker(linker), mCalledFunctions(nullptr), mCallingFunctions(nullptr), mVariableFunctions(nullptr), mFunctions(nullptr), mCompilerOptions(COPT_DEFAULT)
+	: mErrors(errors), mLinker(linker), mCalledFunctions(nullptr), mCallingFunctions(nullptr), mVariableFunctions(nullptr), mFunctions(nullptr), mGlobalVariables(nullptr), mUseWeight(1), mLoopDepth(0), mCompilerOptions(COPT_DEFAULT), mProfile({ nullptr, nullptr, 0, 0 }), mProfileCycles(0)
 {
 
 }
@@ -52,6 +52,70 @@ void GlobalAnalyzer::DumpCallGraph(void)
 	}
 }
 
+bool GlobalAnalyzer::ReadProfile(const char* filename)
+{
+	FILE* file;
+	fopen_s(&file, filename, "r");
+	if (file)
+	{
+		char	line[1024];
+		while (fgets(line, 1024, file))
+		{
+			int	i = 0;
+			while (line[i] && line[i] != ' ')
+				i++;
+
+			if (i > 0 && line[i] == ' ')
+			{
+				line[i] = 0;
+
+				char* cp;
+				ProfileEntry	pe;
+				pe.mIdent = Ident::Unique(line);
+				pe.mCycles = strtoll(line + i + 1, &cp, 10);
+				pe.mCalls = strtol(cp, &cp, 10);
+
+				while (*cp == ' ')
+					cp++;
+				int	n = strlen(cp);
+				while (n > 0 && (cp[n - 1] == '\n' || cp[n - 1] == '\r'))
+					cp[--n] = 0;
+				pe.mFileName = n > 0 ? Ident::Unique(cp) : nullptr;
+
+				mProfile.Push(pe);
+				mProfileCycles += pe.mCycles;
+			}
+		}
+
+		fclose(file);
+
+		return true;
+	}
+	else
+		return false;
+}
+
+void GlobalAnalyzer::ApplyProfile(Declaration* dec)
+{
+	// Entries of profiles without a source file match by name only
+
+	const Ident* fileName = dec->mLocation.mFileName ? Ident::Unique(dec->mLocation.mFileName) : nullptr;
+
+	int j = 0;
+	while (j < mProfile.Size() && (mProfile[j].mIdent != dec->mIdent || mProfile[j].mFileName && mProfile[j].mFileName != fileName))
+		j++;
+
+	if (j < mProfile.Size())
+	{
+		const ProfileEntry& pe(mProfile[j]);
+
+		if (pe.mCycles == 0)
+			dec->mFlags |= DTF_FUNC_COLD;
+		else if (pe.mCycles * 50 >= mProfileCycles || pe.mCalls >= 1000)
+			dec->mFlags |= DTF_FUNC_HOT;
+	}
+}
+
 void GlobalAnalyzer::AutoInline(void)
 {
 	bool	changed = false;
@@ -81,12 +145,16 @@ void GlobalAnalyzer::AutoInline(void)
 
 				int	cost = (f->mComplexity - 20 * nparams);
 
+				// Hot functions from a profile may grow the code, cold ones only when inlining does not
+
+				int		limit = (f->mFlags & DTF_FUNC_HOT) ? 1000 : 0;
+
 				bool	doinline = false;
 				if ((mCompilerOptions & COPT_OPTIMIZE_INLINE) && (f->mFlags & DTF_REQUEST_INLINE))
 					doinline = true;
-				if ((mCompilerOptions & COPT_OPTIMIZE_AUTO_INLINE) && (cost * (f->mCallers.Size() - 1) <= 0))
+				if ((mCompilerOptions & COPT_OPTIMIZE_AUTO_INLINE) && (cost * (f->mCallers.Size() - 1) <= limit))
 					doinline = true;
-				if ((mCompilerOptions & COPT_OPTIMIZE_AUTO_INLINE_ALL) && (cost * (f->mCallers.Size() - 1) <= 10000))
+				if ((mCompilerOptions & COPT_OPTIMIZE_AUTO_INLINE_ALL) && !(f->mFlags & DTF_FUNC_COLD) && (cost * (f->mCallers.Size() - 1) <= 10000))
 					doinline = true;
 
 				if (doinline)
@@ -132,30 +200,69 @@ void GlobalAnalyzer::AutoInline(void)
 	}
 }
 
+int GlobalAnalyzer::FastCallExtent(Declaration* procDec)
+{
+	if (procDec->mType == DT_CONST_FUNCTION)
+	{
+		CheckFastcall(procDec);
+
+		if (procDec->mBase->mFlags & DTF_FASTCALL)
+			return procDec->mBase->mFastCallBase + procDec->mBase->mFastCallSize;
+		else if ((procDec->mFlags & (DTF_FUNC_RECURSIVE | DTF_FUNC_ANALYZING)) || !(procDec->mBase->mFlags & DTF_STACKCALL))
+			return 1000;
+
+		// A stack called function only uses the parameter area of its callees
+
+		procDec->mFlags |= DTF_FUNC_ANALYZING;
+
+		int	nbase = 0;
+		for (int i = 0; i < procDec->mCalled.Size(); i++)
+		{
+			int n = FastCallExtent(procDec->mCalled[i]);
+			if (n > nbase)
+				nbase = n;
+		}
+
+		procDec->mFlags &= ~DTF_FUNC_ANALYZING;
+
+		return nbase;
+	}
+	else if (procDec->mType == DT_TYPE_FUNCTION)
+	{
+		// Called through a pointer, so any function that has its address taken
+
+		int	nbase = 0;
+		for (int i = 0; i < mVariableFunctions.Size(); i++)
+		{
+			int n = FastCallExtent(mVariableFunctions[i]);
+			if (n > nbase)
+				nbase = n;
+		}
+
+		return nbase;
+	}
+	else
+		return 1000;
+}
+
 void GlobalAnalyzer::CheckFastcall(Declaration* procDec)
 {
-	if (!(procDec->mBase->mFlags & DTF_FASTCALL) && !(procDec->mBase->mFlags & DTF_STACKCALL) && (procDec->mType == DT_CONST_FUNCTION))
+	if (!(procDec->mBase->mFlags & DTF_FASTCALL) && !(procDec->mBase->mFlags & DTF_STACKCALL) && !(procDec->mFlags & DTF_FUNC_ANALYZING) && (procDec->mType == DT_CONST_FUNCTION))
 	{
 		if (!(procDec->mBase->mFlags & DTF_VARIADIC) && !(procDec->mFlags & DTF_FUNC_VARIABLE) && !(procDec->mFlags & DTF_FUNC_RECURSIVE))
 		{
+			procDec->mFlags |= DTF_FUNC_ANALYZING;
+
 			int	nbase = 0;
 			for (int i = 0; i < procDec->mCalled.Size(); i++)
 			{
-				Declaration* cf = procDec->mCalled[i];
-
-				CheckFastcall(cf);
-
-				cf = cf->mBase;
-				if (cf->mFlags & DTF_FASTCALL)
-				{
-					int n = cf->mFastCallBase + cf->mFastCallSize;
-					if (n > nbase)
-						nbase = n;
-				}
-				else
-					nbase = 1000;
+				int n = FastCallExtent(procDec->mCalled[i]);
+				if (n > nbase)
+					nbase = n;
 			}
 
+			procDec->mFlags &= ~DTF_FUNC_ANALYZING;
+
 			int		nparams = 0;
 
 			if (procDec->mBase->mBase->mType == DT_TYPE_STRUCT)
@@ -215,6 +322,191 @@ void GlobalAnalyzer::CheckInterrupt(void)
 	} while (changed);
 }
 
+static bool GetTypeRange(Declaration* type, int64& minValue, int64& maxValue)
+{
+	if (type->mType == DT_TYPE_ENUM)
+	{
+		minValue = type->mMinValue;
+		maxValue = type->mMaxValue;
+		return true;
+	}
+	else if (type->mType == DT_TYPE_INTEGER || type->mType == DT_TYPE_BOOL)
+	{
+		if (type->mFlags & DTF_SIGNED)
+		{
+			minValue = -(1LL << (8 * type->mSize - 1));
+			maxValue = (1LL << (8 * type->mSize - 1)) - 1;
+		}
+		else
+		{
+			minValue = 0;
+			maxValue = (1LL << (8 * type->mSize)) - 1;
+		}
+		return true;
+	}
+	else
+		return false;
+}
+
+static bool GetExpressionRange(Expression* exp, int64& minValue, int64& maxValue)
+{
+	if (exp->mType == EX_CONSTANT && exp->mDecValue->mType == DT_CONST_INTEGER)
+	{
+		minValue = maxValue = exp->mDecValue->mInteger;
+		return true;
+	}
+	else if (exp->mType == EX_BINARY && exp->mToken == TK_BINARY_AND && exp->mRight->mType == EX_CONSTANT && exp->mRight->mDecValue->mType == DT_CONST_INTEGER && exp->mRight->mDecValue->mInteger >= 0)
+	{
+		minValue = 0;
+		maxValue = exp->mRight->mDecValue->mInteger;
+		return true;
+	}
+	else if (exp->mType == EX_CONDITIONAL)
+	{
+		int64	tmin, tmax, fmin, fmax;
+		if (GetExpressionRange(exp->mRight->mLeft, tmin, tmax) && GetExpressionRange(exp->mRight->mRight, fmin, fmax))
+		{
+			minValue = tmin < fmin ? tmin : fmin;
+			maxValue = tmax > fmax ? tmax : fmax;
+			return true;
+		}
+	}
+	
+	if (exp->mDecType)
+		return GetTypeRange(exp->mDecType, minValue, maxValue);
+	else
+		return false;
+}
+
+void GlobalAnalyzer::ResetArgumentRange(Declaration* pdec)
+{
+	if (GetTypeRange(pdec->mBase, pdec->mMinValue, pdec->mMaxValue))
+		pdec->mFlags |= DTF_VAR_RANGE;
+}
+
+void GlobalAnalyzer::ResetArgumentRanges(Declaration* procDec)
+{
+	Declaration* pdec = procDec->mBase->mParams;
+	while (pdec)
+	{
+		ResetArgumentRange(pdec);
+		pdec = pdec->mNext;
+	}
+}
+
+void GlobalAnalyzer::MergeArgumentRanges(Declaration* procDec, Expression* args)
+{
+	if (procDec->mBase->mFlags & DTF_VARIADIC)
+	{
+		ResetArgumentRanges(procDec);
+		return;
+	}
+
+	Declaration* pdec = procDec->mBase->mParams;
+	while (pdec)
+	{
+		int64	pmin, pmax;
+		if (GetTypeRange(pdec->mBase, pmin, pmax))
+		{
+			int64	amin = pmin, amax = pmax;
+
+			if (args)
+			{
+				Expression* aexp = args->mType == EX_LIST ? args->mLeft : args;
+				if (!GetExpressionRange(aexp, amin, amax) || amin < pmin || amax > pmax)
+				{
+					amin = pmin;
+					amax = pmax;
+				}
+			}
+
+			if (!(pdec->mFlags & DTF_VAR_RANGE))
+			{
+				pdec->mMinValue = amin;
+				pdec->mMaxValue = amax;
+				pdec->mFlags |= DTF_VAR_RANGE;
+			}
+			else
+			{
+				if (amin < pdec->mMinValue)
+					pdec->mMinValue = amin;
+				if (amax > pdec->mMaxValue)
+					pdec->mMaxValue = amax;
+			}
+		}
+
+		if (args && args->mType == EX_LIST)
+			args = args->mRight;
+		else
+			args = nullptr;
+		pdec = pdec->mNext;
+	}
+}
+
+void GlobalAnalyzer::CheckArgumentRanges(void)
+{
+	for (int i = 0; i < mFunctions.Size(); i++)
+	{
+		Declaration* f = mFunctions[i];
+		if (f->mCallers.Size() == 0 || (f->mFlags & (DTF_FUNC_VARIABLE | DTF_FUNC_ASSEMBLER | DTF_EXPORT | DTF_INTERRUPT | DTF_HWINTERRUPT)))
+			ResetArgumentRanges(f);
+	}
+}
+
+void GlobalAnalyzer::PromoteZeroPage(LinkerRegion* region, LinkerSection* bssSection, LinkerSection* zeroPageSection)
+{
+	int	avail = region->mEnd - region->mStart;
+
+	for (int i = 0; i < region->mSections.Size(); i++)
+	{
+		LinkerSection* lsec = region->mSections[i];
+		for (int j = 0; j < lsec->mObjects.Size(); j++)
+			avail -= lsec->mObjects[j]->mSize;
+	}
+
+	// Small zero initialized globals are candidates, explicit zero page variables without
+	// an object yet reduce the available space
+
+	GrowingArray<Declaration*>	candidates(nullptr);
+
+	for (int i = 0; i < mGlobalVariables.Size(); i++)
+	{
+		Declaration* dec = mGlobalVariables[i];
+		if (dec->mFlags & DTF_ZEROPAGE)
+		{
+			if (!dec->mLinkerObject)
+				avail -= dec->mSize;
+		}
+		else if (dec->mSection == bssSection && !dec->mValue && dec->mSize > 0 && dec->mSize <= 4 && dec->mUseCount > 0)
+		{
+			int j = candidates.Size();
+			while (j > 0 && candidates[j - 1]->mUseCount * dec->mSize < dec->mUseCount * candidates[j - 1]->mSize)
+				j--;
+			candidates.Insert(j, dec);
+		}
+	}
+
+	for (int i = 0; i < candidates.Size(); i++)
+	{
+		Declaration* dec = candidates[i];
+		if (dec->mSize <= avail)
+		{
+			if (mCompilerOptions & COPT_VERBOSE2)
+				printf("Promote <%s> to zero page, %d uses\n", dec->mIdent->mString, dec->mUseCount);
+
+			dec->mFlags |= DTF_ZEROPAGE;
+			dec->mSection = zeroPageSection;
+			if (dec->mLinkerObject)
+			{
+				dec->mLinkerObject->MoveToSection(zeroPageSection);
+				dec->mLinkerObject->mFlags |= LOBJF_ZEROPAGE;
+			}
+
+			avail -= dec->mSize;
+		}
+	}
+}
+
 void GlobalAnalyzer::AnalyzeProcedure(Expression* exp, Declaration* dec)
 {
 	if (dec->mFlags & DTF_FUNC_ANALYZING)
@@ -232,6 +524,19 @@ void GlobalAnalyzer::AnalyzeProcedure(Expression* exp, Declaration* dec)
 		dec->mFlags |= DTF_ANALYZED;
 		dec->mFlags |= DTF_FUNC_INTRSAVE;
 
+		ApplyProfile(dec);
+
+		// Weight of global variable accesses, scaled by the profile and the loop nesting
+
+		int	weight = mUseWeight, depth = mLoopDepth;
+		mLoopDepth = 0;
+		if (dec->mFlags & DTF_FUNC_COLD)
+			mUseWeight = 0;
+		else if (dec->mFlags & DTF_FUNC_HOT)
+			mUseWeight = 16;
+		else
+			mUseWeight = 1;
+
 		if (dec->mFlags & DTF_INTERRUPT)
 			dec->mFlags |= DTF_FUNC_INTRCALLED;
 
@@ -246,6 +551,9 @@ void GlobalAnalyzer::AnalyzeProcedure(Expression* exp, Declaration* dec)
 		else
 			mErrors->Error(dec->mLocation, EERR_UNDEFINED_OBJECT, "Calling undefined function", dec->mIdent);
 
+		mUseWeight = weight;
+		mLoopDepth = depth;
+
 		dec->mFlags &= ~DTF_FUNC_ANALYZING;
 	}
 }
@@ -288,6 +596,7 @@ void GlobalAnalyzer::AnalyzeAssembler(Expression* exp, Declaration* procDec)
 			{
 				AnalyzeProcedure(adec->mValue, adec);
 				RegisterCall(procDec, adec);
+				ResetArgumentRanges(adec);
 			}
 		}
 
@@ -301,6 +610,9 @@ void GlobalAnalyzer::AnalyzeGlobalVariable(Declaration* dec)
 	{
 		dec->mFlags |= DTF_ANALYZED;
 
+		if (dec->mType == DT_VARIABLE)
+			mGlobalVariables.Push(dec);
+
 		if (dec->mValue)
 		{
 			Analyze(dec->mValue, dec);
@@ -351,6 +663,8 @@ Declaration * GlobalAnalyzer::Analyze(Expression* exp, Declaration* procDec)
 		{
 			procDec->mFlags &= ~DTF_FUNC_CONSTEXPR;
 			AnalyzeGlobalVariable(exp->mDecValue);
+			if (procDec->mFlags & DTF_NATIVE)
+				exp->mDecValue->mUseCount += mUseWeight << (3 * (mLoopDepth < 4 ? mLoopDepth : 4));
 		}
 		else
 		{
@@ -366,6 +680,8 @@ Declaration * GlobalAnalyzer::Analyze(Expression* exp, Declaration* procDec)
 		ldec = Analyze(exp->mLeft, procDec);
 		rdec = Analyze(exp->mRight, procDec);
 		RegisterProc(rdec);
+		if (ldec->mType == DT_ARGUMENT)
+			ResetArgumentRange(ldec);
 		return ldec;
 
 	case EX_BINARY:
@@ -379,13 +695,18 @@ Declaration * GlobalAnalyzer::Analyze(Expression* exp, Declaration* procDec)
 		return TheBoolTypeDeclaration;
 
 	case EX_PREINCDEC:
-		return Analyze(exp->mLeft, procDec);
+		ldec = Analyze(exp->mLeft, procDec);
+		if (ldec->mType == DT_ARGUMENT)
+			ResetArgumentRange(ldec);
+		return ldec;
 	case EX_PREFIX:
 		ldec = Analyze(exp->mLeft, procDec);
 		if (exp->mToken == TK_BINARY_AND)
 		{
 			if (ldec->mType == DT_VARIABLE)
 				ldec->mFlags |= DTF_VAR_ALIASING;
+			else if (ldec->mType == DT_ARGUMENT)
+				ResetArgumentRange(ldec);
 		} 
 		else if (exp->mToken == TK_MUL)
 		{
@@ -396,7 +717,10 @@ Declaration * GlobalAnalyzer::Analyze(Expression* exp, Declaration* procDec)
 	case EX_POSTFIX:
 		break;
 	case EX_POSTINCDEC:
-		return Analyze(exp->mLeft, procDec);
+		ldec = Analyze(exp->mLeft, procDec);
+		if (ldec->mType == DT_ARGUMENT)
+			ResetArgumentRange(ldec);
+		return ldec;
 	case EX_INDEX:
 		ldec = Analyze(exp->mLeft, procDec);
 		if (ldec->mType == DT_VARIABLE || ldec->mType == DT_ARGUMENT)
@@ -411,6 +735,8 @@ Declaration * GlobalAnalyzer::Analyze(Expression* exp, Declaration* procDec)
 	case EX_CALL:
 		ldec = Analyze(exp->mLeft, procDec);
 		RegisterCall(procDec, ldec);
+		if (ldec->mType == DT_CONST_FUNCTION)
+			MergeArgumentRanges(ldec, exp->mRight);
 		if (!(GetProcFlags(ldec) & (DTF_FUNC_INTRSAVE | DTF_INTERRUPT)))
 		{
 			procDec->mFlags &= ~DTF_FUNC_INTRSAVE;
@@ -439,8 +765,10 @@ Declaration * GlobalAnalyzer::Analyze(Expression* exp, Declaration* procDec)
 	case EX_WHILE:
 		procDec->mFlags &= ~DTF_FUNC_CONSTEXPR;
 
+		mLoopDepth++;
 		ldec = Analyze(exp->mLeft, procDec);
 		rdec = Analyze(exp->mRight, procDec);
+		mLoopDepth--;
 		break;
 	case EX_IF:
 		ldec = Analyze(exp->mLeft, procDec);
@@ -455,15 +783,19 @@ Declaration * GlobalAnalyzer::Analyze(Expression* exp, Declaration* procDec)
 
 		if (exp->mLeft->mRight)
 			ldec = Analyze(exp->mLeft->mRight, procDec);
+		mLoopDepth++;
 		if (exp->mLeft->mLeft->mLeft)
 			ldec = Analyze(exp->mLeft->mLeft->mLeft, procDec);
 		rdec = Analyze(exp->mRight, procDec);
 		if (exp->mLeft->mLeft->mRight)
 			ldec = Analyze(exp->mLeft->mLeft->mRight, procDec);
+		mLoopDepth--;
 		break;
 	case EX_DO:
+		mLoopDepth++;
 		ldec = Analyze(exp->mLeft, procDec);
 		rdec = Analyze(exp->mRight, procDec);
+		mLoopDepth--;
 		break;
 	case EX_BREAK:
 	case EX_CONTINUE:
@@ -14,6 +14,10 @@ public:
 	void AutoInline(void);
 	void CheckFastcall(Declaration* procDec);
 	void CheckInterrupt(void);
+	void CheckArgumentRanges(void);
+	void PromoteZeroPage(LinkerRegion* region, LinkerSection* bssSection, LinkerSection* zeroPageSection);
+
+	bool ReadProfile(const char* filename);
 
 	void AnalyzeProcedure(Expression* exp, Declaration* procDec);
 	void AnalyzeAssembler(Expression* exp, Declaration* procDec);
@@ -25,12 +29,30 @@ protected:
 	Errors* mErrors;
 	Linker* mLinker;
 
-	GrowingArray<Declaration*>		mCalledFunctions, mCallingFunctions, mVariableFunctions, mFunctions;
+	GrowingArray<Declaration*>		mCalledFunctions, mCallingFunctions, mVariableFunctions, mFunctions, mGlobalVariables;
+	int								mUseWeight, mLoopDepth;
+
+	struct ProfileEntry
+	{
+		const Ident	*	mIdent, * mFileName;
+		int64			mCycles;
+		int				mCalls;
+	};
+
+	GrowingArray<ProfileEntry>		mProfile;
+	int64							mProfileCycles;
+
+	void ApplyProfile(Declaration* dec);
 
 	Declaration* Analyze(Expression* exp, Declaration* procDec);
 
 	uint64 GetProcFlags(Declaration* to) const;
+	int FastCallExtent(Declaration* procDec);
 	void RegisterCall(Declaration* from, Declaration* to);
 	void RegisterProc(Declaration* to);
+
+	void ResetArgumentRange(Declaration* pdec);
+	void ResetArgumentRanges(Declaration* procDec);
+	void MergeArgumentRanges(Declaration* procDec, Expression* args);
 };
 
@@ -1,8 +1,10 @@
 #include "InterCode.h"
 #include "CompilerTypes.h"
+#include "DataFlow.h"
 
 #include <stdio.h>
 #include <math.h>
+#include <new>
 
 int InterTypeSize[] = {
 	0,
@@ -25,7 +27,7 @@ static bool IsIntegerType(InterType type)
 }
 
 IntegerValueRange::IntegerValueRange(void)
-	: mMinState(S_UNKNOWN), mMaxState(S_UNKNOWN)
+	: mMinValue(0), mMaxValue(0), mMinState(S_UNKNOWN), mMaxState(S_UNKNOWN)
 {}
 
 IntegerValueRange::~IntegerValueRange(void)
@@ -2375,7 +2377,7 @@ void ValueSet::UpdateValue(InterInstruction * ins, const GrowingInstructionPtrAr
 
 
 InterOperand::InterOperand(void)
-	: mTemp(INVALID_TEMPORARY), mType(IT_NONE), mFinal(false), mIntConst(0), mFloatConst(0), mVarIndex(-1), mOperandSize(0), mLinkerObject(nullptr), mMemory(IM_NONE)
+	: mIntConst(0), mFloatConst(0), mLinkerObject(nullptr), mTemp(INVALID_TEMPORARY), mVarIndex(-1), mOperandSize(0), mType(IT_NONE), mMemory(IM_NONE), mFinal(false)
 {}
 
 bool InterOperand::IsUByte(void) const
@@ -2459,13 +2461,66 @@ InterInstruction::InterInstruction(void)
 	mOperator = IA_NONE;
 
 	mNumOperands = 3;
+	mSrc = mInlineSrc;
 
 	mInUse = false;
 	mVolatile = false;
 	mInvariant = false;
+	mExpensive = false;
 	mSingleAssignment = false;
 }
 
+InterInstruction::InterInstruction(const InterInstruction& ins)
+{
+	mSrc = mInlineSrc;
+	*this = ins;
+}
+
+InterInstruction::~InterInstruction(void)
+{
+	if (mSrc != mInlineSrc)
+		Arena::Delete(mSrc);
+}
+
+InterInstruction& InterInstruction::operator=(const InterInstruction& ins)
+{
+	if (this != &ins)
+	{
+		mCode = ins.mCode;
+		mOperator = ins.mOperator;
+		mInUse = ins.mInUse;
+		mInvariant = ins.mInvariant;
+		mVolatile = ins.mVolatile;
+		mExpensive = ins.mExpensive;
+		mSingleAssignment = ins.mSingleAssignment;
+		mDst = ins.mDst;
+		mConst = ins.mConst;
+		mLocation = ins.mLocation;
+
+		ReserveOperands(ins.mNumOperands);
+		mNumOperands = ins.mNumOperands;
+		for (int i = 0; i < 3 || i < mNumOperands; i++)
+			mSrc[i] = ins.mSrc[i];
+	}
+
+	return *this;
+}
+
+void InterInstruction::ReserveOperands(int num)
+{
+	if (num > 3 && mSrc == mInlineSrc)
+	{
+		// The extra operands live in the arena of the instruction, and
+		// are released together with it
+		InterOperand* src = (InterOperand*)Arena::New(8 * sizeof(InterOperand), nullptr);
+		for (int i = 0; i < 3; i++)
+			new (src + i) InterOperand(mInlineSrc[i]);
+		for (int i = 3; i < 8; i++)
+			new (src + i) InterOperand();
+		mSrc = src;
+	}
+}
+
 void InterInstruction::SetCode(const Location& loc, InterCode code)
 {
 	this->mCode = code;
@@ -2753,6 +2808,30 @@ bool InterInstruction::PropagateConstTemps(const GrowingInstructionPtrArray& cte
 		}
 	} break;
 
+	case IC_RELATIONAL_OPERATOR:
+	{
+		bool	changed = false;
+
+		for (int i = 0; i < 2; i++)
+		{
+			if (mSrc[i].mTemp >= 0 && ctemps[mSrc[i].mTemp] && IsIntegerType(ctemps[mSrc[i].mTemp]->mDst.mType))
+			{
+				InterInstruction* ains = ctemps[mSrc[i].mTemp];
+				mSrc[i] = ains->mConst;
+				mSrc[i].mType = ains->mDst.mType;
+				mSrc[i].mRange.mMinState = mSrc[i].mRange.mMaxState = IntegerValueRange::S_BOUND;
+				mSrc[i].mRange.mMinValue = mSrc[i].mRange.mMaxValue = mSrc[i].mIntConst;
+				changed = true;
+			}
+		}
+
+		if (changed)
+		{
+			this->ConstantFolding();
+			return true;
+		}
+	} break;
+
 	case IC_CONVERSION_OPERATOR:
 	case IC_UNARY_OPERATOR:
 	{
@@ -3352,6 +3431,13 @@ bool InterInstruction::ConstantFolding(void)
 					assert(mSrc[0].mTemp >= 0);
 					return true;
 				}
+				else if ((mOperator == IA_AND || mOperator == IA_MUL) && mSrc[0].mIntConst == 0)
+				{
+					mCode = IC_CONSTANT;
+					mConst.mIntConst = 0;
+					mNumOperands = 0;
+					return true;
+				}
 				else if (mOperator == IA_MODU && (mSrc[0].mIntConst & (mSrc[0].mIntConst - 1)) == 0)
 				{
 					mOperator = IA_AND;
@@ -3644,11 +3730,17 @@ InterCodeBasicBlock::InterCodeBasicBlock(void)
 	mEntryValueRange(IntegerValueRange()), mTrueValueRange(IntegerValueRange()), mFalseValueRange(IntegerValueRange()), mLocalValueRange(IntegerValueRange()), 
 	mReverseValueRange(IntegerValueRange()), mEntryBlocks(nullptr), mLoadStoreInstructions(nullptr), mLoopPathBlocks(nullptr), mMemoryValueSize(0), mEntryMemoryValueSize(0)
 {
+	mIndex = 0;
+	mNumEntries = 0;
+	mNumEntered = 0;
 	mVisited = false;
 	mInPath = false;
 	mLoopHead = false;
 	mChecked = false;
+	mConditionBlockTrue = false;
+	mLoopPath = false;
 	mTraceIndex = -1;
+	mDataFlowIndex = -1;
 	mUnreachable = false;
 }
 
@@ -5091,13 +5183,15 @@ void InterCodeBasicBlock::SimplifyIntegerRangeRelops(void)
 }
 
 
-bool InterCodeBasicBlock::BuildGlobalIntegerRangeSets(bool initial, const GrowingVariableArray& localVars)
+bool InterCodeBasicBlock::BuildGlobalIntegerRangeSets(bool initial, const GrowingVariableArray& localVars, bool& changed)
 {
-	bool	changed = false;
+	// Evaluated by the forward dataflow solver, returns true if the exit
+	// ranges of the block changed.  The evaluations of a block per pass are
+	// limited, if its ranges still change the next pass picks them up.
+
+	bool	rchanged = false;
 
 	mNumEntered++;
-	if (!mLoopHead && mNumEntered < mEntryBlocks.Size())
-		return false;
 
 	mLocalValueRange.Clear();
 
@@ -5119,39 +5213,36 @@ bool InterCodeBasicBlock::BuildGlobalIntegerRangeSets(bool initial, const Growin
 
 	for (int i = 0; i < mLocalValueRange.Size(); i++)
 		if (!mLocalValueRange[i].Same(mEntryValueRange[i]))
-			changed = true;
+			rchanged = true;
 
 	if (mVisited && mNumEntered >= 2 * mEntryBlocks.Size())
-		return changed;
+	{
+		if (rchanged)
+			changed = true;
+		return false;
+	}
 
 	if (mTrueJump && !mFalseJump)
 	{
 		for (int i = 0; i < mEntryMemoryValueSize.Size(); i++)
 		{
 			if (mEntryMemoryValueSize[i] != mTrueJump->mMemoryValueSize[i])
-				changed = true;
+				rchanged = true;
 		}
 	}
 
-	if (!mVisited || changed)
-	{
-		mVisited = true;
-
-		if (changed)
-		{
-			mEntryValueRange = mLocalValueRange;
+	mVisited = true;
 
-			UpdateLocalIntegerRangeSets(localVars);
+	if (rchanged)
+	{
+		mEntryValueRange = mLocalValueRange;
 
-		}
+		UpdateLocalIntegerRangeSets(localVars);
 
-		if (mTrueJump && mTrueJump->BuildGlobalIntegerRangeSets(initial, localVars))
-			changed = true;
-		if (mFalseJump && mFalseJump->BuildGlobalIntegerRangeSets(initial, localVars))
-			changed = true;
+		changed = true;
 	}
 
-	return changed;
+	return rchanged;
 }
 
 static int64 SignedTypeMin(InterType type)
@@ -6533,33 +6624,14 @@ void InterCodeBasicBlock::PerformTempForwarding(TempForwardingTable& forwardingT
 	}
 }
 
-bool InterCodeBasicBlock::BuildGlobalRequiredTempSet(NumberSet& fromRequiredTemps)
+bool InterCodeBasicBlock::BuildGlobalRequiredTempSet(void)
 {
-	bool revisit = false;
-
-	if (!mVisited)
-	{
-		mVisited = true;
-
-		NumberSet	newRequiredTemps(mExitRequiredTemps);
-
-		if (mTrueJump && mTrueJump->BuildGlobalRequiredTempSet(newRequiredTemps)) revisit = true;
-		if (mFalseJump && mFalseJump->BuildGlobalRequiredTempSet(newRequiredTemps)) revisit = true;
-
-		if (!(newRequiredTemps <= mExitRequiredTemps))
-		{
-			revisit = true;
-
-			mExitRequiredTemps = newRequiredTemps;
-			newRequiredTemps -= mLocalProvidedTemps;
-			mEntryRequiredTemps |= newRequiredTemps;
-		}
-
-	}
+	bool	changed = false;
 
-	fromRequiredTemps |= mEntryRequiredTemps;
+	if (mTrueJump && mExitRequiredTemps.Union(mTrueJump->mEntryRequiredTemps)) changed = true;
+	if (mFalseJump && mExitRequiredTemps.Union(mFalseJump->mEntryRequiredTemps)) changed = true;
 
-	return revisit;
+	return changed && mEntryRequiredTemps.UnionExcept(mExitRequiredTemps, mLocalProvidedTemps);
 }
 
 bool InterCodeBasicBlock::RemoveUnusedResultInstructions(void)
@@ -6658,33 +6730,14 @@ void InterCodeBasicBlock::BuildGlobalProvidedStaticVariableSet(const GrowingVari
 	}
 }
 
-bool InterCodeBasicBlock::BuildGlobalRequiredStaticVariableSet(const GrowingVariableArray& staticVars, NumberSet& fromRequiredVars)
+bool InterCodeBasicBlock::BuildGlobalRequiredStaticVariableSet(void)
 {
-	bool revisit = false;
-
-	if (!mVisited)
-	{
-		mVisited = true;
-
-		NumberSet	newRequiredVars(mExitRequiredStatics);
-
-		if (mTrueJump && mTrueJump->BuildGlobalRequiredStaticVariableSet(staticVars, newRequiredVars)) revisit = true;
-		if (mFalseJump && mFalseJump->BuildGlobalRequiredStaticVariableSet(staticVars, newRequiredVars)) revisit = true;
-
-		if (!(newRequiredVars <= mExitRequiredStatics))
-		{
-			revisit = true;
-
-			mExitRequiredStatics = newRequiredVars;
-			newRequiredVars -= mLocalProvidedStatics;
-			mEntryRequiredStatics |= newRequiredVars;
-		}
-
-	}
+	bool	changed = false;
 
-	fromRequiredVars |= mEntryRequiredStatics;
+	if (mTrueJump && mExitRequiredStatics.Union(mTrueJump->mEntryRequiredStatics)) changed = true;
+	if (mFalseJump && mExitRequiredStatics.Union(mFalseJump->mEntryRequiredStatics)) changed = true;
 
-	return revisit;
+	return changed && mEntryRequiredStatics.UnionExcept(mExitRequiredStatics, mLocalProvidedStatics);
 }
 
 bool InterCodeBasicBlock::RemoveUnusedStaticStoreInstructions(const GrowingVariableArray& staticVars)
@@ -6777,39 +6830,28 @@ void InterCodeBasicBlock::BuildGlobalProvidedVariableSet(const GrowingVariableAr
 	}
 }
 
-bool InterCodeBasicBlock::BuildGlobalRequiredVariableSet(const GrowingVariableArray& localVars, NumberSet& fromRequiredVars, const GrowingVariableArray& params, NumberSet& fromRequiredParams, InterMemory paramMemory)
+bool InterCodeBasicBlock::BuildGlobalRequiredVariableSet(void)
 {
-	bool revisit = false;
+	bool	changed = false, changedParams = false;
 
-	if (!mVisited)
+	if (mTrueJump)
 	{
-		mVisited = true;
-
-		NumberSet	newRequiredVars(mExitRequiredVars);
-		NumberSet	newRequiredParams(mExitRequiredParams);
-
-		if (mTrueJump && mTrueJump->BuildGlobalRequiredVariableSet(localVars, newRequiredVars, params, newRequiredParams, paramMemory)) revisit = true;
-		if (mFalseJump && mFalseJump->BuildGlobalRequiredVariableSet(localVars, newRequiredVars, params, newRequiredParams, paramMemory)) revisit = true;
-
-		if (!(newRequiredVars <= mExitRequiredVars) || !(newRequiredParams <= mExitRequiredParams))
-		{
-			revisit = true;
-
-			mExitRequiredVars = newRequiredVars;
-			newRequiredVars -= mLocalProvidedVars;
-			mEntryRequiredVars |= newRequiredVars;
-
-			mExitRequiredParams = newRequiredParams;
-			newRequiredParams -= mLocalProvidedParams;
-			mEntryRequiredParams |= newRequiredParams;
-		}
-
+		if (mExitRequiredVars.Union(mTrueJump->mEntryRequiredVars)) changed = true;
+		if (mExitRequiredParams.Union(mTrueJump->mEntryRequiredParams)) changedParams = true;
+	}
+	if (mFalseJump)
+	{
+		if (mExitRequiredVars.Union(mFalseJump->mEntryRequiredVars)) changed = true;
+		if (mExitRequiredParams.Union(mFalseJump->mEntryRequiredParams)) changedParams = true;
 	}
 
-	fromRequiredVars |= mEntryRequiredVars;
-	fromRequiredParams |= mEntryRequiredParams;
+	bool	entryChanged = false;
+	if (changed && mEntryRequiredVars.UnionExcept(mExitRequiredVars, mLocalProvidedVars))
+		entryChanged = true;
+	if (changedParams && mEntryRequiredParams.UnionExcept(mExitRequiredParams, mLocalProvidedParams))
+		entryChanged = true;
 
-	return revisit;
+	return entryChanged;
 }
 
 bool InterCodeBasicBlock::RemoveUnusedStoreInstructions(const GrowingVariableArray& localVars, const GrowingVariableArray& params, InterMemory paramMemory)
@@ -8530,6 +8572,280 @@ bool InterCodeBasicBlock::MoveTrainCrossBlock(void)
 	return changed;
 }
 
+bool InterCodeBasicBlock::IsDominatedBy(const InterCodeBasicBlock* block) const
+{
+	const InterCodeBasicBlock* b = this;
+	while (b)
+	{
+		if (b == block)
+			return true;
+		b = b->mDominator;
+	}
+	return false;
+}
+
+void InterCodeBasicBlock::CollectValueNumberDefinitions(GrowingIntArray& tdefs, GrowingInterCodeBasicBlockPtrArray& tblocks, NumberSet& storedParams, bool& storedFParams)
+{
+	if (!mVisited)
+	{
+		mVisited = true;
+
+		for (int i = 0; i < mInstructions.Size(); i++)
+		{
+			InterInstruction* ins = mInstructions[i];
+
+			int	t = ins->mDst.mTemp;
+			if (t >= 0)
+			{
+				tdefs[t]++;
+				tblocks[t] = this;
+			}
+
+			if (ins->mCode == IC_CALL || ins->mCode == IC_CALL_NATIVE || ins->mCode == IC_ASSEMBLER)
+				storedFParams = true;
+			else if (ins->mCode != IC_LOAD)
+			{
+				for (int j = 0; j < ins->mNumOperands; j++)
+				{
+					if (ins->mSrc[j].mTemp < 0)
+					{
+						if (ins->mSrc[j].mMemory == IM_PARAM)
+							storedParams += ins->mSrc[j].mVarIndex;
+						else if (ins->mSrc[j].mMemory == IM_FPARAM)
+							storedFParams = true;
+					}
+				}
+				if (ins->mCode == IC_CONSTANT && ins->mConst.mMemory == IM_PARAM)
+					storedParams += ins->mConst.mVarIndex;
+			}
+		}
+
+		if (mTrueJump) mTrueJump->CollectValueNumberDefinitions(tdefs, tblocks, storedParams, storedFParams);
+		if (mFalseJump) mFalseJump->CollectValueNumberDefinitions(tdefs, tblocks, storedParams, storedFParams);
+	}
+}
+
+static bool IsValueNumberCandidate(const InterInstruction* ins, const GrowingIntArray& tdefs)
+{
+	if (ins->mDst.mTemp < 0)
+		return false;
+
+	if (ins->mCode != IC_BINARY_OPERATOR && ins->mCode != IC_UNARY_OPERATOR && ins->mCode != IC_CONVERSION_OPERATOR && ins->mCode != IC_LEA)
+		return false;
+
+	bool	temp = false;
+	for (int i = 0; i < ins->mNumOperands; i++)
+	{
+		if (ins->mSrc[i].mTemp >= 0)
+		{
+			if (tdefs[ins->mSrc[i].mTemp] != 1)
+				return false;
+			temp = true;
+		}
+	}
+
+	return temp;
+}
+
+static bool IsEqualValue(const InterInstruction* ins1, const InterInstruction* ins2, const GrowingIntArray& tvalues)
+{
+	if (ins1->mCode != ins2->mCode || ins1->mOperator != ins2->mOperator || ins1->mNumOperands != ins2->mNumOperands || ins1->mDst.mType != ins2->mDst.mType)
+		return false;
+
+	for (int i = 0; i < ins1->mNumOperands; i++)
+	{
+		const InterOperand& op1(ins1->mSrc[i]), & op2(ins2->mSrc[i]);
+
+		if (op1.mTemp >= 0 || op2.mTemp >= 0)
+		{
+			if (op1.mTemp < 0 || op2.mTemp < 0 || op1.mType != op2.mType || tvalues[op1.mTemp] != tvalues[op2.mTemp])
+				return false;
+		}
+		else if (!op1.IsEqual(op2))
+			return false;
+	}
+
+	return true;
+}
+
+void InterCodeBasicBlock::NumberParameterLoads(const GrowingIntArray& tdefs, const NumberSet& storedParams, const NumberSet& aliasedParams, bool storedFParams, GrowingIntArray& tvalues, GrowingInstructionPtrArray& tloads, GrowingInstructionPtrArray& loads)
+{
+	if (!mVisited)
+	{
+		mVisited = true;
+
+		for (int i = 0; i < mInstructions.Size(); i++)
+		{
+			InterInstruction* ins = mInstructions[i];
+
+			if (ins->mCode == IC_LOAD && !ins->mVolatile && ins->mSrc[0].mTemp < 0 && tdefs[ins->mDst.mTemp] == 1 &&
+				(ins->mSrc[0].mMemory == IM_PARAM && !storedParams[ins->mSrc[0].mVarIndex] && !aliasedParams[ins->mSrc[0].mVarIndex] ||
+				 ins->mSrc[0].mMemory == IM_FPARAM && !storedFParams))
+			{
+				int	j = 0;
+				while (j < loads.Size() && !(loads[j]->mSrc[0].IsEqual(ins->mSrc[0]) && loads[j]->mSrc[0].mOperandSize == ins->mSrc[0].mOperandSize && loads[j]->mDst.mType == ins->mDst.mType))
+					j++;
+
+				if (j < loads.Size())
+					tvalues[ins->mDst.mTemp] = loads[j]->mDst.mTemp;
+				else
+					loads.Push(ins);
+				tloads[ins->mDst.mTemp] = ins;
+			}
+		}
+
+		if (mTrueJump) mTrueJump->NumberParameterLoads(tdefs, storedParams, aliasedParams, storedFParams, tvalues, tloads, loads);
+		if (mFalseJump) mFalseJump->NumberParameterLoads(tdefs, storedParams, aliasedParams, storedFParams, tvalues, tloads, loads);
+	}
+}
+
+bool InterCodeBasicBlock::IsValueBusy(const InterCodeBasicBlock* dom, const InterInstruction* ins, const GrowingIntArray& tvalues, GrowingIntArray& busy, int mark) const
+{
+	if (this == dom || !IsDominatedBy(dom))
+		return false;
+
+	// Relative to the mark of the current search 1 in progress, 2 busy,
+	// 3 not busy, anything else is a leftover of an earlier search
+
+	int	state = busy[mIndex] - mark;
+	if (state == 1 || state == 3)
+		return false;
+	else if (state == 2)
+		return true;
+
+	busy[mIndex] = mark + 1;
+
+	bool	found = false;
+	for (int i = 0; !found && i < mInstructions.Size(); i++)
+		found = IsEqualValue(mInstructions[i], ins, tvalues);
+
+	if (!found && mTrueJump)
+		found = mTrueJump->IsValueBusy(dom, ins, tvalues, busy, mark) && (!mFalseJump || mFalseJump->IsValueBusy(dom, ins, tvalues, busy, mark));
+
+	busy[mIndex] = mark + (found ? 2 : 3);
+
+	return found;
+}
+
+void InterCodeBasicBlock::HoistBusyValues(InterCodeProcedure* proc, const GrowingIntArray& dfirst, const GrowingInterCodeBasicBlockPtrArray& dchildren, GrowingIntArray& tdefs, GrowingInterCodeBasicBlockPtrArray& tblocks, GrowingIntArray& tvalues, GrowingInstructionPtrArray& tloads, GrowingIntArray& busy, int& mark, int& hoisted)
+{
+	// Children first, so values move up the dominator tree step by step
+
+	for (int i = dfirst[mIndex]; i < dfirst[mIndex + 1]; i++)
+		dchildren[i]->HoistBusyValues(proc, dfirst, dchildren, tdefs, tblocks, tvalues, tloads, busy, mark, hoisted);
+
+	if (!mTrueJump || mTrueJump->mDominator != this || (mFalseJump && mFalseJump->mDominator != this))
+		return;
+
+	for (int i = 0; i < mTrueJump->mInstructions.Size(); i++)
+	{
+		InterInstruction* ins = mTrueJump->mInstructions[i];
+
+		if (IsValueNumberCandidate(ins, tdefs))
+		{
+			bool	hoist = true;
+			for (int j = 0; hoist && j < ins->mNumOperands; j++)
+			{
+				int	t = ins->mSrc[j].mTemp;
+				if (t >= 0 && !IsDominatedBy(tblocks[t]) && !tloads[t])
+					hoist = false;
+			}
+
+			for (int j = 0; hoist && j < mInstructions.Size(); j++)
+			{
+				if (IsEqualValue(mInstructions[j], ins, tvalues))
+					hoist = false;
+			}
+
+			if (hoist && mFalseJump)
+			{
+				mark += 4;
+				hoist = mFalseJump->IsValueBusy(this, ins, tvalues, busy, mark);
+			}
+
+			if (hoist)
+			{
+				int	tindex = mInstructions.Size() - 1;
+				if (mFalseJump && tindex > 0 && mInstructions[tindex - 1]->mDst.mTemp == mInstructions[tindex]->mSrc[0].mTemp && CanBypassUp(ins, mInstructions[tindex - 1]))
+					tindex--;
+
+				InterInstruction* nins = ins->Clone();
+
+				// Operands loaded from read only parameters are loaded again
+
+				for (int j = 0; j < nins->mNumOperands; j++)
+				{
+					int	t = nins->mSrc[j].mTemp;
+					if (t >= 0)
+					{
+						if (!IsDominatedBy(tblocks[t]))
+						{
+							InterInstruction* lins = tloads[t]->Clone();
+							lins->mDst.mTemp = proc->AddTemporary(lins->mDst.mType);
+							lins->mDst.mRange.Reset();
+							tdefs[lins->mDst.mTemp] = 1;
+							tblocks[lins->mDst.mTemp] = this;
+							tvalues[lins->mDst.mTemp] = tvalues[t];
+							tloads[lins->mDst.mTemp] = tloads[t];
+							mInstructions.Insert(tindex++, lins);
+
+							nins->mSrc[j].mTemp = lins->mDst.mTemp;
+						}
+						nins->mSrc[j].mRange.Reset();
+					}
+				}
+
+				nins->mDst.mTemp = proc->AddTemporary(nins->mDst.mType);
+				nins->mDst.mRange.Reset();
+				tdefs[nins->mDst.mTemp] = 1;
+				tblocks[nins->mDst.mTemp] = this;
+				tvalues[nins->mDst.mTemp] = nins->mDst.mTemp;
+				tloads[nins->mDst.mTemp] = nullptr;
+				mInstructions.Insert(tindex, nins);
+
+				hoisted++;
+			}
+		}
+	}
+}
+
+void InterCodeBasicBlock::GlobalValueNumbering(const GrowingIntArray& dfirst, const GrowingInterCodeBasicBlockPtrArray& dchildren, const GrowingIntArray& tdefs, const GrowingIntArray& tvalues, GrowingInstructionPtrArray& avail, int& eliminated)
+{
+	int	navail = avail.Size();
+
+	for (int i = 0; i < mInstructions.Size(); i++)
+	{
+		InterInstruction* ins = mInstructions[i];
+
+		if (IsValueNumberCandidate(ins, tdefs))
+		{
+			int	j = 0;
+			while (j < avail.Size() && !IsEqualValue(avail[j], ins, tvalues))
+				j++;
+
+			if (j < avail.Size())
+			{
+				ins->mCode = IC_LOAD_TEMPORARY;
+				ins->mSrc[0].mTemp = avail[j]->mDst.mTemp;
+				ins->mSrc[0].mType = avail[j]->mDst.mType;
+				ins->mSrc[0].mMemory = IM_NONE;
+				ins->mSrc[0].mRange = avail[j]->mDst.mRange;
+				ins->mNumOperands = 1;
+				eliminated++;
+			}
+			else if (tdefs[ins->mDst.mTemp] == 1)
+				avail.Push(ins);
+		}
+	}
+
+	// Continue with all blocks immediately dominated by this block
+
+	for (int i = dfirst[mIndex]; i < dfirst[mIndex + 1]; i++)
+		dchildren[i]->GlobalValueNumbering(dfirst, dchildren, tdefs, tvalues, avail, eliminated);
+
+	avail.SetSize(navail);
+}
+
 bool InterCodeBasicBlock::ForwardDiamondMovedTemp(void)
 {
 	bool changed = false;
@@ -9794,9 +10110,241 @@ void InterCodeBasicBlock::InnerLoopOptimization(const NumberSet& aliasedParams)
 	}
 }
 
-void InterCodeBasicBlock::SingleBlockLoopUnrolling(void)
+bool InterCodeBasicBlock::CollectNestedLoopBody(InterCodeBasicBlock* head, GrowingArray<InterCodeBasicBlock*>& body)
 {
-	if (!mVisited)
+	if (this == head)
+		return true;
+
+	if (body.IndexOf(this) != -1)
+		return true;
+	body.Push(this);
+
+	if (mEntryBlocks.Size() == 0)
+		return false;
+
+	for (int i = 0; i < mEntryBlocks.Size(); i++)
+		if (!mEntryBlocks[i]->CollectNestedLoopBody(head, body))
+			return false;
+
+	return true;
+}
+
+void InterCodeBasicBlock::LoopStrengthReduction(InterCodeProcedure* proc, const NumberSet& aliasedParams)
+{
+	if (!mVisited)
+	{
+		mVisited = true;
+
+		// Process the inner loops first, so that the products they leave in
+		// their prefix can be reduced by the enclosing loop
+
+		if (mTrueJump)
+			mTrueJump->LoopStrengthReduction(proc, aliasedParams);
+		if (mFalseJump)
+			mFalseJump->LoopStrengthReduction(proc, aliasedParams);
+
+		if (mLoopHead && mLoopPrefix)
+		{
+			GrowingArray<InterCodeBasicBlock*> body(nullptr);
+			body.Push(this);
+
+			bool	natural = true;
+			for (int i = 0; i < mEntryBlocks.Size(); i++)
+			{
+				if (mEntryBlocks[i] != mLoopPrefix && !mEntryBlocks[i]->CollectNestedLoopBody(this, body))
+					natural = false;
+			}
+
+			if (natural)
+			{
+				int	numTemps = mEntryRequiredTemps.Size();
+
+				GrowingArray<int>					ndefs(0);
+				GrowingArray<InterInstructionPtr>	tdefs(nullptr);
+
+				bool	hasCall = false, hasIndirectStore = false;
+
+				for (int bi = 0; bi < body.Size(); bi++)
+				{
+					InterCodeBasicBlock* block = body[bi];
+					for (int i = 0; i < block->mInstructions.Size(); i++)
+					{
+						InterInstruction* ins = block->mInstructions[i];
+						if (ins->mDst.mTemp >= 0)
+						{
+							ndefs[ins->mDst.mTemp]++;
+							tdefs[ins->mDst.mTemp] = ins;
+						}
+						if (HasSideEffect(ins->mCode) || ins->mCode == IC_COPY || ins->mCode == IC_STRCPY)
+							hasCall = true;
+						else if (ins->mCode == IC_STORE && ins->mSrc[1].mTemp >= 0)
+							hasIndirectStore = true;
+					}
+				}
+
+				for (int bi = 0; bi < body.Size(); bi++)
+				{
+					InterCodeBasicBlock* block = body[bi];
+					for (int i = 0; i < block->mInstructions.Size(); i++)
+					{
+						InterInstruction* ins = block->mInstructions[i];
+
+						if ((ins->mCode == IC_BINARY_OPERATOR && (ins->mOperator == IA_MUL || ins->mOperator == IA_SHL)) && IsIntegerType(ins->mDst.mType) && ins->mDst.mTemp >= 0)
+						{
+							// Find the basic induction variable, it is updated exactly once in the
+							// loop by adding a constant
+
+							int	ii = -1;
+							for (int k = 0; k < 2; k++)
+							{
+								int	t = ins->mSrc[k].mTemp;
+								if (t >= 0 && t < numTemps && ins->mSrc[k].mType == ins->mDst.mType && ndefs[t] == 1 && mEntryRequiredTemps[t] && !(ins->mOperator == IA_SHL && k == 0))
+								{
+									InterInstruction* iins = tdefs[t];
+									if (iins->mCode == IC_BINARY_OPERATOR && iins->mOperator == IA_ADD && iins->mDst.mType == ins->mDst.mType &&
+										(iins->mSrc[0].mTemp == t && iins->mSrc[1].mTemp < 0 || iins->mSrc[1].mTemp == t && iins->mSrc[0].mTemp < 0))
+										ii = k;
+								}
+							}
+
+							if (ii < 0)
+								continue;
+
+							const InterOperand& fop(ins->mSrc[1 - ii]);
+
+							// The factor has to be a constant or a loop invariant temporary
+
+							InterInstruction* fins = nullptr;
+							if (fop.mTemp < 0)
+							{
+								if (ins->mOperator == IA_MUL && fop.mIntConst < 2 || ins->mOperator == IA_SHL && fop.mIntConst < 1)
+									continue;
+							}
+							else if (fop.mTemp >= numTemps || ins->mOperator == IA_SHL)
+								continue;
+							else if (ndefs[fop.mTemp] == 1)
+							{
+								fins = tdefs[fop.mTemp];
+								if (fins->mCode == IC_CONSTANT)
+									;
+								else if (fins->mCode == IC_LOAD && fins->mSrc[0].mTemp < 0 && !fins->mVolatile && !hasCall &&
+									(fins->mSrc[0].mMemory == IM_PARAM || fins->mSrc[0].mMemory == IM_FPARAM || fins->mSrc[0].mMemory == IM_LOCAL || fins->mSrc[0].mMemory == IM_GLOBAL))
+								{
+									if (hasIndirectStore && !((fins->mSrc[0].mMemory == IM_PARAM || fins->mSrc[0].mMemory == IM_FPARAM) && !aliasedParams[fins->mSrc[0].mVarIndex]))
+										continue;
+
+									bool	stored = false;
+									for (int bj = 0; !stored && bj < body.Size(); bj++)
+									{
+										InterCodeBasicBlock* blockj = body[bj];
+										for (int j = 0; !stored && j < blockj->mInstructions.Size(); j++)
+										{
+											InterInstruction* sins = blockj->mInstructions[j];
+											if (sins->mCode == IC_STORE && sins->mSrc[1].mTemp < 0 && sins->mSrc[1].mMemory == fins->mSrc[0].mMemory &&
+												sins->mSrc[1].mVarIndex == fins->mSrc[0].mVarIndex && sins->mSrc[1].mLinkerObject == fins->mSrc[0].mLinkerObject)
+												stored = true;
+										}
+									}
+									if (stored)
+										continue;
+								}
+								else
+									continue;
+							}
+							else if (ndefs[fop.mTemp] != 0)
+								continue;
+
+							InterInstruction* iins = tdefs[ins->mSrc[ii].mTemp];
+							int64	step = iins->mSrc[0].mTemp < 0 ? iins->mSrc[0].mIntConst : iins->mSrc[1].mIntConst;
+
+							InterOperand	rop;
+							rop.mTemp = proc->AddTemporary(ins->mDst.mType);
+							rop.mType = ins->mDst.mType;
+
+							InterOperand	kop = fop;
+							kop.mFinal = false;
+							if (fins)
+							{
+								// Evaluate the factor again in the prefix
+
+								InterInstruction* kins = new InterInstruction(*fins);
+								kins->mDst.mTemp = proc->AddTemporary(fins->mDst.mType);
+								kins->mDst.mFinal = false;
+								mLoopPrefix->mInstructions.Insert(mLoopPrefix->mInstructions.Size() - 1, kins);
+								kop.mTemp = kins->mDst.mTemp;
+							}
+
+							InterInstruction* pins = new InterInstruction(*ins);
+							pins->mDst = rop;
+							pins->mSrc[ii].mFinal = false;
+							pins->mSrc[1 - ii] = kop;
+							mLoopPrefix->mInstructions.Insert(mLoopPrefix->mInstructions.Size() - 1, pins);
+
+							InterInstruction* ains = new InterInstruction();
+							ains->mCode = IC_BINARY_OPERATOR;
+							ains->mOperator = IA_ADD;
+							ains->mLocation = iins->mLocation;
+							ains->mDst = rop;
+							ains->mSrc[1] = rop;
+
+							if (kop.mTemp < 0)
+							{
+								ains->mSrc[0] = kop;
+								if (ins->mOperator == IA_SHL)
+									ains->mSrc[0].mIntConst = step << kop.mIntConst;
+								else
+									ains->mSrc[0].mIntConst = step * kop.mIntConst;
+							}
+							else if (step == 1)
+								ains->mSrc[0] = kop;
+							else if (step == -1)
+							{
+								ains->mOperator = IA_SUB;
+								ains->mSrc[0] = kop;
+							}
+							else
+							{
+								InterInstruction* sins = new InterInstruction();
+								sins->mCode = IC_BINARY_OPERATOR;
+								sins->mOperator = IA_MUL;
+								sins->mLocation = ins->mLocation;
+								sins->mDst = kop;
+								sins->mDst.mTemp = proc->AddTemporary(kop.mType);
+								sins->mSrc[1] = kop;
+								sins->mSrc[0] = kop;
+								sins->mSrc[0].mTemp = -1;
+								sins->mSrc[0].mIntConst = step;
+								mLoopPrefix->mInstructions.Insert(mLoopPrefix->mInstructions.Size() - 1, sins);
+								ains->mSrc[0] = sins->mDst;
+							}
+
+							InterCodeBasicBlock* iblock = nullptr;
+							int	ip = 0;
+							for (int bj = 0; !iblock && bj < body.Size(); bj++)
+							{
+								ip = body[bj]->mInstructions.IndexOf(iins);
+								if (ip >= 0)
+									iblock = body[bj];
+							}
+							iblock->mInstructions.Insert(ip + 1, ains);
+							if (iblock == block && ip < i)
+								i++;
+
+							ins->mCode = IC_LOAD_TEMPORARY;
+							ins->mOperator = IA_NONE;
+							ins->mSrc[0] = rop;
+							ins->mNumOperands = 1;
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void InterCodeBasicBlock::SingleBlockLoopUnrolling(void)
+{
+	if (!mVisited)
 	{
 		mVisited = true;
 
@@ -9864,6 +10412,409 @@ void InterCodeBasicBlock::SingleBlockLoopUnrolling(void)
 	}
 }
 
+static InterOperator InvertRelational(InterOperator oper)
+{
+	switch (oper)
+	{
+	case IA_CMPEQ:
+		return IA_CMPNE;
+	case IA_CMPNE:
+		return IA_CMPEQ;
+	case IA_CMPGES:
+		return IA_CMPLS;
+	case IA_CMPLES:
+		return IA_CMPGS;
+	case IA_CMPGS:
+		return IA_CMPLES;
+	case IA_CMPLS:
+		return IA_CMPGES;
+	case IA_CMPGEU:
+		return IA_CMPLU;
+	case IA_CMPLEU:
+		return IA_CMPGU;
+	case IA_CMPGU:
+		return IA_CMPLEU;
+	case IA_CMPLU:
+		return IA_CMPGEU;
+	default:
+		return oper;
+	}
+}
+
+static InterOperator MirrorRelational(InterOperator oper)
+{
+	switch (oper)
+	{
+	case IA_CMPGES:
+		return IA_CMPLES;
+	case IA_CMPLES:
+		return IA_CMPGES;
+	case IA_CMPGS:
+		return IA_CMPLS;
+	case IA_CMPLS:
+		return IA_CMPGS;
+	case IA_CMPGEU:
+		return IA_CMPLEU;
+	case IA_CMPLEU:
+		return IA_CMPGEU;
+	case IA_CMPGU:
+		return IA_CMPLU;
+	case IA_CMPLU:
+		return IA_CMPGU;
+	default:
+		return oper;
+	}
+}
+
+static int64 TruncateIntConst(int64 val, InterType type, bool sign)
+{
+	switch (type)
+	{
+	case IT_INT8:
+		return sign ? int64(int8(val)) : int64(uint8(val));
+	case IT_INT16:
+		return sign ? int64(int16(val)) : int64(uint16(val));
+	case IT_INT32:
+		return sign ? int64(int32(val)) : int64(uint32(val));
+	default:
+		return val;
+	}
+}
+
+static bool FindInductionStep(InterCodeBasicBlock* block, int ireg, int & step)
+{
+	int	i = block->mInstructions.Size() - 3;
+	while (i >= 0 && block->mInstructions[i]->mDst.mTemp != ireg)
+		i--;
+	if (i < 0)
+		return false;
+
+	InterInstruction* ins = block->mInstructions[i];
+	if (ins->mCode == IC_BINARY_OPERATOR && ins->mOperator == IA_ADD)
+	{
+		if (ins->mSrc[1].mTemp == ireg && ins->mSrc[0].mTemp < 0)
+			step = int(ins->mSrc[0].mIntConst);
+		else if (ins->mSrc[0].mTemp == ireg && ins->mSrc[1].mTemp < 0)
+			step = int(ins->mSrc[1].mIntConst);
+		else
+			return false;
+	}
+	else if (ins->mCode == IC_BINARY_OPERATOR && ins->mOperator == IA_SUB && ins->mSrc[1].mTemp == ireg && ins->mSrc[0].mTemp < 0)
+		step = -int(ins->mSrc[0].mIntConst);
+	else
+		return false;
+
+	return step != 0;
+}
+
+bool InterCodeBasicBlock::MultiBlockLoopUnrolling(InterCodeProcedure* proc, GrowingInterCodeBasicBlockPtrArray& unrolled, int budget, bool partial)
+{
+	if (!mVisited)
+	{
+		mVisited = true;
+
+		if (mLoopHead && unrolled.IndexOf(this) < 0)
+		{
+			GrowingInterCodeBasicBlockPtrArray	body(nullptr), tails(nullptr);
+			InterCodeBasicBlock* entry = nullptr;
+			int	nentries = 0;
+
+			body.Push(this);
+			for (int i = 0; i < mEntryBlocks.Size(); i++)
+			{
+				GrowingInterCodeBasicBlockPtrArray	path(nullptr);
+				if (mEntryBlocks[i]->CollectNestedLoopBody(this, path))
+				{
+					tails.Push(mEntryBlocks[i]);
+					for (int j = 0; j < path.Size(); j++)
+						if (body.IndexOf(path[j]) < 0)
+							body.Push(path[j]);
+				}
+				else
+				{
+					entry = mEntryBlocks[i];
+					nentries++;
+				}
+			}
+
+			// Only inner loops with a single entry, that can only be left
+			// through the condition at the end of an iteration
+
+			bool	simple = nentries == 1 && body.Size() > 1;
+			int		size = 0;
+
+			for (int i = 0; simple && i < body.Size(); i++)
+			{
+				InterCodeBasicBlock* block = body[i];
+
+				if (i > 0)
+				{
+					if (block->mLoopHead)
+						simple = false;
+					for (int j = 0; j < block->mEntryBlocks.Size(); j++)
+						if (body.IndexOf(block->mEntryBlocks[j]) < 0)
+							simple = false;
+				}
+
+				if (tails.IndexOf(block) < 0 && (block->mTrueJump && body.IndexOf(block->mTrueJump) < 0 || block->mFalseJump && body.IndexOf(block->mFalseJump) < 0))
+					simple = false;
+
+				for (int j = 0; j < block->mInstructions.Size(); j++)
+				{
+					InterCode	code = block->mInstructions[j]->mCode;
+					if (code == IC_ASSEMBLER || code == IC_JUMPF)
+						simple = false;
+				}
+
+				size += block->mInstructions.Size() - 1;
+			}
+
+			int				ireg = -1, step = 0;
+			InterOperator	oper = IA_NONE;
+			InterOperand	limit;
+			InterType		itype = IT_NONE;
+
+			for (int i = 0; simple && i < tails.Size(); i++)
+			{
+				InterCodeBasicBlock* block = tails[i];
+				int	nins = block->mInstructions.Size();
+
+				// The branch of a tail that does not go to the head must
+				// leave the loop, a continue in the middle of the body is
+				// no exit and would be turned into one by the unrolling
+
+				if (block->mFalseJump && body.IndexOf(block->mTrueJump == this ? block->mFalseJump : block->mTrueJump) >= 0)
+					simple = false;
+				else if (nins >= 3 && block->mFalseJump && (block->mTrueJump == this) != (block->mFalseJump == this) &&
+					block->mInstructions[nins - 1]->mCode == IC_BRANCH &&
+					block->mInstructions[nins - 2]->mCode == IC_RELATIONAL_OPERATOR && block->mInstructions[nins - 2]->mDst.mTemp == block->mInstructions[nins - 1]->mSrc[0].mTemp)
+				{
+					InterInstruction* cins = block->mInstructions[nins - 2];
+					InterOperator	cop = block->mTrueJump == this ? cins->mOperator : InvertRelational(cins->mOperator);
+					InterOperand	cl;
+					int				creg = -1, cstep = 0;
+
+					if (cins->mSrc[1].mTemp >= 0 && cins->mSrc[1].mTemp != cins->mSrc[0].mTemp && FindInductionStep(block, cins->mSrc[1].mTemp, cstep))
+					{
+						creg = cins->mSrc[1].mTemp;
+						cl = cins->mSrc[0];
+					}
+					else if (cins->mSrc[0].mTemp >= 0 && cins->mSrc[0].mTemp != cins->mSrc[1].mTemp && FindInductionStep(block, cins->mSrc[0].mTemp, cstep))
+					{
+						creg = cins->mSrc[0].mTemp;
+						cl = cins->mSrc[1];
+						cop = MirrorRelational(cop);
+					}
+
+					InterType	ctype = cins->mSrc[0].mType;
+
+					if (creg < 0 || (ctype != IT_INT8 && ctype != IT_INT16 && ctype != IT_INT32))
+						simple = false;
+					else if (i == 0)
+					{
+						ireg = creg;
+						step = cstep;
+						oper = cop;
+						limit = cl;
+						itype = ctype;
+					}
+					else if (creg != ireg || cstep != step || cop != oper || ctype != itype || cl.mTemp != limit.mTemp || cl.mTemp < 0 && cl.mIntConst != limit.mIntConst)
+						simple = false;
+				}
+				else
+					simple = false;
+			}
+
+			if (simple)
+			{
+				// The induction variable is changed exactly once per iteration
+
+				int	ndefs = 0;
+				for (int i = 0; i < body.Size(); i++)
+				{
+					InterCodeBasicBlock* block = body[i];
+					for (int j = 0; j < block->mInstructions.Size(); j++)
+					{
+						InterInstruction* ins = block->mInstructions[j];
+						if (ins->mDst.mTemp == ireg)
+							ndefs++;
+						else if (ins->mDst.mTemp >= 0 && ins->mDst.mTemp == limit.mTemp)
+							simple = false;
+					}
+				}
+				if (ndefs != tails.Size())
+					simple = false;
+			}
+
+			if (simple)
+			{
+				int		count = -1;
+				int64	start = 0;
+				bool	sign = oper == IA_CMPGES || oper == IA_CMPLES || oper == IA_CMPGS || oper == IA_CMPLS;
+
+				if (limit.mTemp < 0)
+				{
+					const GrowingIntegerValueRangeArray& range(entry->mFalseJump == this ? entry->mFalseValueRange : entry->mTrueValueRange);
+
+					if (ireg < range.Size() && range[ireg].IsConstant())
+					{
+						start = TruncateIntConst(range[ireg].mMinValue, itype, sign);
+
+						int64	v = start, l = TruncateIntConst(limit.mIntConst, itype, sign);
+
+						int	n = 0;
+						do {
+							v = TruncateIntConst(v + step, itype, sign);
+							n++;
+						} while (n < 0x10000 && ConstantFolding(oper, itype, v, l));
+
+						if (n < 0x10000)
+							count = n;
+					}
+				}
+
+				int		copies = 0;
+				bool	full = false;
+
+				if (count > 0 && count * size <= budget)
+				{
+					copies = count;
+					full = true;
+				}
+				else if (partial && count > 0)
+				{
+					copies = 4;
+					while (copies > 1 && (count % copies != 0 || copies * size > budget))
+						copies >>= 1;
+				}
+				else if (partial && 2 * size <= budget)
+					copies = 2;
+
+				if (copies > 1 || full)
+				{
+					int	nb = body.Size();
+
+					GrowingInterCodeBasicBlockPtrArray	blocks(nullptr);
+					for (int i = 0; i < nb; i++)
+						blocks.Push(body[i]);
+
+					for (int k = 1; k < copies; k++)
+					{
+						for (int i = 0; i < nb; i++)
+						{
+							InterCodeBasicBlock* block = new InterCodeBasicBlock();
+							proc->Append(block);
+
+							for (int j = 0; j < body[i]->mInstructions.Size(); j++)
+								block->mInstructions.Push(body[i]->mInstructions[j]->Clone());
+
+							block->mEntryValueRange = body[i]->mEntryValueRange;
+							block->mTrueValueRange = body[i]->mTrueValueRange;
+							block->mFalseValueRange = body[i]->mFalseValueRange;
+							block->mLocalValueRange = body[i]->mLocalValueRange;
+							block->mReverseValueRange = body[i]->mReverseValueRange;
+
+							blocks.Push(block);
+						}
+					}
+
+					// Relink the copies, the original blocks last, as their
+					// successors define the structure of the loop
+
+					for (int k = copies - 1; k >= 0; k--)
+					{
+						InterCodeBasicBlock* next = k + 1 < copies ? blocks[(k + 1) * nb] : this;
+
+						for (int i = 0; i < nb; i++)
+						{
+							InterCodeBasicBlock* src = body[i], * block = blocks[k * nb + i];
+
+							if (tails.IndexOf(src) >= 0 && (full || count > 0 && k + 1 < copies))
+							{
+								InterCodeBasicBlock* exit = src->mTrueJump == this ? src->mFalseJump : src->mTrueJump;
+
+								InterInstruction* jins = new InterInstruction();
+								jins->mCode = IC_JUMP;
+								block->mInstructions[block->mInstructions.Size() - 1] = jins;
+
+								block->mTrueJump = k + 1 < copies ? next : exit;
+								block->mFalseJump = nullptr;
+							}
+							else
+							{
+								InterCodeBasicBlock* tj = src->mTrueJump, * fj = src->mFalseJump;
+
+								if (tj == this)
+									tj = next;
+								else if (tj && body.IndexOf(tj) > 0)
+									tj = blocks[k * nb + body.IndexOf(tj)];
+
+								if (fj == this)
+									fj = next;
+								else if (fj && body.IndexOf(fj) > 0)
+									fj = blocks[k * nb + body.IndexOf(fj)];
+
+								block->mTrueJump = tj;
+								block->mFalseJump = fj;
+							}
+						}
+					}
+
+					if (full)
+					{
+						// The value of the induction variable is known in each copy
+
+						int64	v = start;
+
+						InterInstruction* cins = new InterInstruction();
+						cins->mCode = IC_CONSTANT;
+						cins->mDst.mTemp = ireg;
+						cins->mDst.mType = itype;
+						cins->mConst.mType = itype;
+						cins->mConst.mIntConst = v;
+						mInstructions.Insert(0, cins);
+
+						for (int k = 0; k < copies; k++)
+						{
+							v = TruncateIntConst(v + step, itype, sign);
+
+							for (int i = 0; i < nb; i++)
+							{
+								InterCodeBasicBlock* block = blocks[k * nb + i];
+								for (int j = 0; j < block->mInstructions.Size(); j++)
+								{
+									InterInstruction* ins = block->mInstructions[j];
+									if (ins->mDst.mTemp == ireg && ins->mCode == IC_BINARY_OPERATOR)
+									{
+										ins->mCode = IC_CONSTANT;
+										ins->mConst.mType = itype;
+										ins->mConst.mIntConst = v;
+										ins->mSrc[0].mTemp = -1;
+										ins->mSrc[1].mTemp = -1;
+										ins->mNumOperands = 0;
+									}
+								}
+							}
+						}
+
+						mLoopHead = false;
+					}
+					unrolled.Push(this);
+
+					return true;
+				}
+			}
+		}
+
+		if (mTrueJump && mTrueJump->MultiBlockLoopUnrolling(proc, unrolled, budget, partial))
+			return true;
+		if (mFalseJump && mFalseJump->MultiBlockLoopUnrolling(proc, unrolled, budget, partial))
+			return true;
+	}
+
+	return false;
+}
+
 
 void InterCodeBasicBlock::SingleBlockLoopOptimisation(const NumberSet& aliasedParams, const GrowingVariableArray& staticVars)
 {
@@ -11666,14 +12617,20 @@ void InterCodeBasicBlock::Disassemble(FILE* file, bool dumpSets)
 }
 
 InterCodeProcedure::InterCodeProcedure(InterCodeModule * mod, const Location & location, const Ident* ident, LinkerObject * linkerObject)
-	: mTemporaries(IT_NONE), mBlocks(nullptr), mLocation(location), mTempOffset(-1), mTempSizes(0), 
+	: mTemporaries(IT_NONE), mEntryBlock(nullptr), mBlocks(nullptr), mLocation(location), mTempOffset(-1), mTempSizes(0), 
+	mTempSize(0), mCommonFrameSize(0), mFreeCallerSavedTemps(0), mLocalSize(0), mNumLocals(0),
 	mRenameTable(-1), mRenameUnionTable(-1), mGlobalRenameTable(-1),
-	mValueForwardingTable(nullptr), mLocalVars(nullptr), mParamVars(nullptr), mModule(mod),
-	mIdent(ident), mLinkerObject(linkerObject),
-	mNativeProcedure(false), mLeafProcedure(false), mCallsFunctionPointer(false), mCalledFunctions(nullptr), mFastCallProcedure(false), 
+	mValueForwardingTable(nullptr), mLocalVars(nullptr), mParamVars(nullptr), mModule(mod), mCompilerOptions(mod->mCompilerOptions),
+	mIdent(ident), mSection(nullptr), mLinkerObject(linkerObject),
+	mNativeProcedure(false), mLeafProcedure(false), mCallsFunctionPointer(false), mHasDynamicStack(false), mHasInlineAssembler(false), mCallsByteCode(false),
+	mCalledFunctions(nullptr), mFastCallProcedure(false), 
 	mInterrupt(false), mHardwareInterrupt(false), mCompiled(false), mInterruptCalled(false), 
-	mSaveTempsLinkerObject(nullptr)
+	mHotProcedure(false), mColdProcedure(false),
+	mSaveTempsLinkerObject(nullptr), mInterProfile(nullptr), mNativeProfile(nullptr),
+	mValueNumberingEliminated(0), mValueNumberingHoisted(0)
 {
+	mArena = new Arena();
+
 	mID = mModule->mProcedures.Size();
 	mModule->mProcedures.Push(this);
 	mLinkerObject->mProc = this;
@@ -11682,6 +12639,17 @@ InterCodeProcedure::InterCodeProcedure(InterCodeModule * mod, const Location & l
 
 InterCodeProcedure::~InterCodeProcedure(void)
 {
+	delete mArena;
+}
+
+void InterCodeProcedure::ReleaseCode(void)
+{
+	mEntryBlock = nullptr;
+	mBlocks.SetSize(0);
+	mValueForwardingTable.SetSize(0);
+
+	delete mArena;
+	mArena = nullptr;
 }
 
 void InterCodeProcedure::ResetEntryBlocks(void)
@@ -11749,9 +12717,44 @@ void InterCodeProcedure::CheckFinal(void)
 
 void InterCodeProcedure::DisassembleDebug(const char* name)
 {
+	if (mInterProfile)
+		mInterProfile->Checkpoint(name, NumInstructions());
+
 	Disassemble(name);
 }
 
+void InterCodeProcedure::BuildGlobalIntegerRangeSets(bool initial, const char* name)
+{
+	// Passes over all blocks are repeated until the ranges are stable, the
+	// blocks of a pass are evaluated again as long as a predecessor changes
+
+	ResetVisited();
+	ForwardDataFlow<InterCodeBasicBlock>	flow(mEntryBlock);
+
+	bool	changed;
+	do {
+		DisassembleDebug(name);
+
+		ResetVisited();
+		changed = false;
+		ProfileIteration("integer ranges", flow.Solve([&](InterCodeBasicBlock* block) { return block->BuildGlobalIntegerRangeSets(initial, mLocalVars, changed); }));
+	} while (changed);
+}
+
+void InterCodeProcedure::ProfileIteration(const char* name, int count)
+{
+	if (mInterProfile)
+		mInterProfile->Iteration(name, count);
+}
+
+int InterCodeProcedure::NumInstructions(void) const
+{
+	int	num = 0;
+	for (int i = 0; i < mBlocks.Size(); i++)
+		num += mBlocks[i]->mInstructions.Size();
+	return num;
+}
+
 void InterCodeProcedure::BuildTraces(bool expand, bool dominators, bool compact)
 {
 	// Count number of entries
@@ -11799,14 +12802,12 @@ void InterCodeProcedure::BuildDataFlowSets(void)
 	mEntryBlock->BuildGlobalProvidedTempSet(NumberSet(numTemps));
 
 	//
-	// Build set of globaly required temporaries, might need
-	// multiple iterations until it stabilizes
+	// Build set of globaly required temporaries, blocks are revisited
+	// until it stabilizes
 	//
-	NumberSet	totalRequired(numTemps);
-
-	do {
-		ResetVisited();
-	} while (mEntryBlock->BuildGlobalRequiredTempSet(totalRequired));
+	ResetVisited();
+	BackwardDataFlow<InterCodeBasicBlock>	flow(mEntryBlock);
+	ProfileIteration("required temps", flow.Solve(&InterCodeBasicBlock::BuildGlobalRequiredTempSet));
 
 	ResetVisited();
 	mEntryBlock->CollectLocalUsedTemps(numTemps);
@@ -11981,11 +12982,9 @@ void InterCodeProcedure::RemoveUnusedInstructions(void)
 		ResetVisited();
 		mEntryBlock->BuildGlobalProvidedTempSet(NumberSet(numTemps));
 
-		NumberSet	totalRequired2(numTemps);
-
-		do {
-			ResetVisited();
-		} while (mEntryBlock->BuildGlobalRequiredTempSet(totalRequired2));
+		ResetVisited();
+		BackwardDataFlow<InterCodeBasicBlock>	flow(mEntryBlock);
+		ProfileIteration("required temps", flow.Solve(&InterCodeBasicBlock::BuildGlobalRequiredTempSet));
 
 		ResetVisited();
 	} while (mEntryBlock->RemoveUnusedResultInstructions());
@@ -12017,12 +13016,9 @@ void InterCodeProcedure::RemoveUnusedStoreInstructions(InterMemory	paramMemory)
 			ResetVisited();
 			mEntryBlock->BuildGlobalProvidedVariableSet(mLocalVars, NumberSet(mLocalVars.Size()), mParamVars, NumberSet(mParamVars.Size()), paramMemory);
 
-			NumberSet	totalRequired2(mLocalVars.Size());
-			NumberSet	totalRequiredParams(mParamVars.Size());
-
-			do {
-				ResetVisited();
-			} while (mEntryBlock->BuildGlobalRequiredVariableSet(mLocalVars, totalRequired2, mParamVars, totalRequiredParams, paramMemory));
+			ResetVisited();
+			BackwardDataFlow<InterCodeBasicBlock>	flow(mEntryBlock);
+			ProfileIteration("required variables", flow.Solve(&InterCodeBasicBlock::BuildGlobalRequiredVariableSet));
 
 			ResetVisited();
 		} while (mEntryBlock->RemoveUnusedStoreInstructions(mLocalVars, mParamVars, paramMemory));
@@ -12041,11 +13037,9 @@ void InterCodeProcedure::RemoveUnusedStoreInstructions(InterMemory	paramMemory)
 			ResetVisited();
 			mEntryBlock->BuildGlobalProvidedStaticVariableSet(mModule->mGlobalVars, NumberSet(mModule->mGlobalVars.Size()));
 
-			NumberSet	totalRequired2(mModule->mGlobalVars.Size());
-
-			do {
-				ResetVisited();
-			} while (mEntryBlock->BuildGlobalRequiredStaticVariableSet(mModule->mGlobalVars, totalRequired2));
+			ResetVisited();
+			BackwardDataFlow<InterCodeBasicBlock>	flow(mEntryBlock);
+			ProfileIteration("required static variables", flow.Solve(&InterCodeBasicBlock::BuildGlobalRequiredStaticVariableSet));
 
 			ResetVisited();
 		} while (mEntryBlock->RemoveUnusedStaticStoreInstructions(mModule->mGlobalVars));
@@ -12054,6 +13048,88 @@ void InterCodeProcedure::RemoveUnusedStoreInstructions(InterMemory	paramMemory)
 	}
 }
 
+void InterCodeProcedure::GlobalValueNumbering(void)
+{
+	int	numTemps = mTemporaries.Size();
+
+	ResetEntryBlocks();
+	ResetVisited();
+	mEntryBlock->CollectEntryBlocks(nullptr);
+
+	for (int i = 0; i < mBlocks.Size(); i++)
+		mBlocks[i]->mDominator = nullptr;
+	mEntryBlock->BuildDominatorTree(nullptr);
+
+	// The blocks immediately dominated by a block b, in the order of the
+	// block list, are dchildren[dfirst[b->mIndex]] to dchildren[dfirst[b->mIndex + 1] - 1]
+
+	GrowingIntArray						dfirst(0), dnext(0);
+	GrowingInterCodeBasicBlockPtrArray	dchildren(nullptr);
+
+	dfirst.SetSize(mBlocks.Size() + 1, true);
+	for (int i = 0; i < mBlocks.Size(); i++)
+	{
+		if (mBlocks[i]->mDominator)
+			dfirst[mBlocks[i]->mDominator->mIndex + 1]++;
+	}
+	for (int i = 0; i < mBlocks.Size(); i++)
+		dfirst[i + 1] += dfirst[i];
+
+	dnext.SetSize(mBlocks.Size());
+	dchildren.SetSize(dfirst[mBlocks.Size()]);
+	for (int i = 0; i < mBlocks.Size(); i++)
+		dnext[i] = dfirst[i];
+	for (int i = 0; i < mBlocks.Size(); i++)
+	{
+		if (mBlocks[i]->mDominator)
+			dchildren[dnext[mBlocks[i]->mDominator->mIndex]++] = mBlocks[i];
+	}
+
+	// Only temporaries with a single assignment have the same value in
+	// all dominated blocks, loads from parameters, that are never written,
+	// share the value number of the first load
+
+	GrowingIntArray						tdefs(0), tvalues(-1);
+	GrowingInterCodeBasicBlockPtrArray	tblocks(nullptr);
+	GrowingInstructionPtrArray			tloads(nullptr), loads(nullptr);
+	NumberSet							storedParams(mParamAliasedSet.Size());
+	bool								storedFParams = false;
+
+	tdefs.SetSize(numTemps, true);
+	tblocks.SetSize(numTemps, true);
+	tloads.SetSize(numTemps, true);
+	tvalues.SetSize(numTemps);
+	for (int i = 0; i < numTemps; i++)
+		tvalues[i] = i;
+
+	ResetVisited();
+	mEntryBlock->CollectValueNumberDefinitions(tdefs, tblocks, storedParams, storedFParams);
+
+	ResetVisited();
+	mEntryBlock->NumberParameterLoads(tdefs, storedParams, mParamAliasedSet, storedFParams, tvalues, tloads, loads);
+
+	int		hoisted = 0, eliminated = 0, mark = 0;
+
+	GrowingIntArray	busy(0);
+	busy.SetSize(mBlocks.Size(), true);
+
+	mEntryBlock->HoistBusyValues(this, dfirst, dchildren, tdefs, tblocks, tvalues, tloads, busy, mark, hoisted);
+
+	GrowingInstructionPtrArray	avail(nullptr);
+
+	mEntryBlock->GlobalValueNumbering(dfirst, dchildren, tdefs, tvalues, avail, eliminated);
+
+	if (hoisted > 0 || eliminated > 0)
+	{
+		mValueNumberingHoisted += hoisted;
+		mValueNumberingEliminated += eliminated;
+
+		BuildDataFlowSets();
+		TempForwarding();
+		RemoveUnusedInstructions();
+	}
+}
+
 void InterCodeProcedure::MergeCommonPathInstructions(void)
 {
 	bool	changed;
@@ -12282,6 +13358,12 @@ void InterCodeProcedure::Close(void)
 
 	mEntryBlock = mBlocks[0];
 
+	if (mModule->mCompilerOptions & COPT_TIME_REPORT)
+	{
+		mInterProfile = new PassProfile();
+		mInterProfile->Start(NumInstructions());
+	}
+
 	DisassembleDebug("start");
 
 	BuildTraces(true);
@@ -12320,6 +13402,8 @@ void InterCodeProcedure::Close(void)
 	// Find all local variables that are never aliased
 	//
 	GrowingIntArray		localTable(-1), paramTable(-1);
+	localTable.SetSize(numTemps);
+	paramTable.SetSize(numTemps);
 	ResetVisited();
 	mEntryBlock->CollectLocalAddressTemps(localTable, paramTable);
 
@@ -12346,6 +13430,7 @@ void InterCodeProcedure::Close(void)
 	//	Now forward constant values
 	//
 	do {
+		ProfileIteration("value forwarding");
 		valueSet.FlushAll();
 		mValueForwardingTable.SetSize(numTemps, true);
 		tvalidSet.Reset(numTemps + 32);
@@ -12462,6 +13547,16 @@ void InterCodeProcedure::Close(void)
 
 	BuildDataFlowSets();
 #endif
+
+	if (mModule->mCompilerOptions & COPT_OPTIMIZE_BASIC)
+	{
+		ResetVisited();
+		mEntryBlock->LoopStrengthReduction(this, mParamAliasedSet);
+
+		DisassembleDebug("loop strength reduction");
+
+		BuildDataFlowSets();
+	}
 	CheckUsedDefinedTemps();
 
 	ExpandSelect();
@@ -12504,6 +13599,7 @@ void InterCodeProcedure::Close(void)
 
 	do
 	{
+		ProfileIteration("Copy forwarding");
 		GrowingInstructionPtrArray	cipa(nullptr);
 		ResetVisited();
 		changed = mEntryBlock->PropagateVariableCopy(cipa, mModule->mGlobalVars);
@@ -12539,17 +13635,9 @@ void InterCodeProcedure::Close(void)
 	ResetVisited();
 	mEntryBlock->BuildLocalIntegerRangeSets(mTemporaries.Size(), mLocalVars);
 
-	do {
-		DisassembleDebug("tt");
+	BuildGlobalIntegerRangeSets(true, "tt");
 
-		ResetVisited();
-	} while (mEntryBlock->BuildGlobalIntegerRangeSets(true, mLocalVars));
-
-	do {
-		DisassembleDebug("tq");
-
-		ResetVisited();
-	} while (mEntryBlock->BuildGlobalIntegerRangeSets(false, mLocalVars));
+	BuildGlobalIntegerRangeSets(false, "tq");
 
 
 	DisassembleDebug("Estimated value range");
@@ -12557,17 +13645,9 @@ void InterCodeProcedure::Close(void)
 	ResetVisited();
 	mEntryBlock->RestartLocalIntegerRangeSets(mLocalVars);
 
-	do {
-		DisassembleDebug("tr");
-
-		ResetVisited();
-	} while (mEntryBlock->BuildGlobalIntegerRangeSets(true, mLocalVars));
+	BuildGlobalIntegerRangeSets(true, "tr");
 
-	do {
-		DisassembleDebug("tr");
-
-		ResetVisited();
-	} while (mEntryBlock->BuildGlobalIntegerRangeSets(false, mLocalVars));
+	BuildGlobalIntegerRangeSets(false, "tr");
 
 	DisassembleDebug("Estimated value range 2");
 #endif
@@ -12615,28 +13695,85 @@ void InterCodeProcedure::Close(void)
 	ResetVisited();
 	mEntryBlock->RestartLocalIntegerRangeSets(mLocalVars);
 
-	do {
-		DisassembleDebug("tr");
+	BuildGlobalIntegerRangeSets(true, "tr");
 
-		ResetVisited();
-	} while (mEntryBlock->BuildGlobalIntegerRangeSets(true, mLocalVars));
-
-	do {
-		DisassembleDebug("tr");
-
-		ResetVisited();
-	} while (mEntryBlock->BuildGlobalIntegerRangeSets(false, mLocalVars));
+	BuildGlobalIntegerRangeSets(false, "tr");
 
 	DisassembleDebug("Estimated value range 2");
 #endif
 
 #if 1
-	if (mModule->mCompilerOptions & COPT_OPTIMIZE_AUTO_UNROLL)
+	if (mCompilerOptions & COPT_OPTIMIZE_AUTO_UNROLL)
 	{
 		ResetVisited();
 		mEntryBlock->SingleBlockLoopUnrolling();
 
 		DisassembleDebug("Single Block loop unrolling");
+
+		GrowingInterCodeBasicBlockPtrArray	unrolled(nullptr);
+		bool	partial = !(mCompilerOptions & COPT_OPTIMIZE_CODE_SIZE);
+		int		budget = partial ? 64 : 16;
+
+		bool	unrolledAny = false;
+		do {
+			ResetEntryBlocks();
+			ResetVisited();
+			mEntryBlock->CollectEntryBlocks(nullptr);
+
+			ResetVisited();
+			changed = mEntryBlock->MultiBlockLoopUnrolling(this, unrolled, budget, partial);
+			if (changed)
+				unrolledAny = true;
+		} while (changed);
+
+		if (unrolledAny)
+		{
+			ResetVisited();
+			for (int i = 0; i < mBlocks.Size(); i++)
+				mBlocks[i]->mNumEntries = 0;
+			mEntryBlock->CollectEntries();
+
+			// The copies of the loop body share their temporaries, split
+			// them again into single assignments
+
+			BuildDataFlowSets();
+
+			RenameTemporaries();
+
+			BuildDataFlowSets();
+
+			if (mTemporaries.Size() > activeSet.Size())
+				activeSet.Reset(mTemporaries.Size());
+
+			do {
+				TempForwarding();
+			} while (GlobalConstantPropagation());
+
+			ResetVisited();
+			mEntryBlock->SimplifyIntegerRangeRelops();
+
+			// Folded branches merge the copies into larger blocks, that may
+			// now contain several assignments to the same temporary
+
+			ResetVisited();
+			mEntryBlock->DropUnreachable();
+
+			ResetEntryBlocks();
+			ResetVisited();
+			mEntryBlock->CollectEntryBlocks(nullptr);
+
+			BuildDataFlowSets();
+			BuildTraces(false);
+
+			BuildDataFlowSets();
+			RenameTemporaries();
+			BuildDataFlowSets();
+
+			if (mTemporaries.Size() > activeSet.Size())
+				activeSet.Reset(mTemporaries.Size());
+		}
+
+		DisassembleDebug("Multi block loop unrolling");
 	}
 #endif
 
@@ -12661,6 +13798,7 @@ void InterCodeProcedure::Close(void)
 	DisassembleDebug("Rebuilt traces");
 
 	do {
+		ProfileIteration("Peephole optimized");
 		TempForwarding();
 	} while (GlobalConstantPropagation());
 
@@ -12728,6 +13866,7 @@ void InterCodeProcedure::Close(void)
 	mEntryBlock->CollectEntryBlocks(nullptr);
 
 	do {
+		ProfileIteration("prop const op up");
 		changed = false;
 
 		ResetVisited();
@@ -12791,6 +13930,7 @@ void InterCodeProcedure::Close(void)
 
 #if 1
 	do {
+		ProfileIteration("Global Constant Prop 1");
 		TempForwarding();
 	} while (GlobalConstantPropagation());
 
@@ -12844,9 +13984,16 @@ void InterCodeProcedure::Close(void)
 
 		BuildDataFlowSets();
 		do {
+			ProfileIteration("Global Constant Prop 2");
 			TempForwarding();
 		} while (GlobalConstantPropagation());
 
+		if (mModule->mCompilerOptions & COPT_OPTIMIZE_BASIC)
+		{
+			GlobalValueNumbering();
+			DisassembleDebug("Global value numbering");
+		}
+
 		LoadStoreForwarding(paramMemory);
 
 		MergeCommonPathInstructions();
@@ -13196,11 +14343,9 @@ void InterCodeProcedure::ReduceTemporaries(void)
 	ResetVisited();
 	mEntryBlock->BuildGlobalProvidedTempSet(NumberSet(numTemps));
 
-	NumberSet	totalRequired2(numTemps);
-
-	do {
-		ResetVisited();
-	} while (mEntryBlock->BuildGlobalRequiredTempSet(totalRequired2));
+	ResetVisited();
+	BackwardDataFlow<InterCodeBasicBlock>	flow(mEntryBlock);
+	ProfileIteration("required temps", flow.Solve(&InterCodeBasicBlock::BuildGlobalRequiredTempSet));
 
 	collisionSet = new NumberSet[numTemps];
 
@@ -13249,11 +14394,9 @@ void InterCodeProcedure::ReduceTemporaries(void)
 	ResetVisited();
 	mEntryBlock->BuildGlobalProvidedTempSet(NumberSet(numRenamedTemps));
 
-	NumberSet	totalRequired3(numRenamedTemps);
-
-	do {
-		ResetVisited();
-	} while (mEntryBlock->BuildGlobalRequiredTempSet(totalRequired3));
+	ResetVisited();
+	BackwardDataFlow<InterCodeBasicBlock>	flow2(mEntryBlock);
+	ProfileIteration("required temps", flow2.Solve(&InterCodeBasicBlock::BuildGlobalRequiredTempSet));
 }
 
 void InterCodeProcedure::MapCallerSavedTemps(void)
@@ -13353,6 +14496,9 @@ void InterCodeProcedure::Disassemble(FILE* file)
 
 	fprintf(file, "\n");
 
+	if (mValueNumberingEliminated || mValueNumberingHoisted)
+		fprintf(file, "GVN: %d eliminated, %d hoisted\n", mValueNumberingEliminated, mValueNumberingHoisted);
+
 	ResetVisited();
 	mEntryBlock->Disassemble(file, false);
 }
@@ -13401,11 +14547,21 @@ void InterCodeProcedure::Disassemble(const char* name, bool dumpSets)
 InterCodeModule::InterCodeModule(Linker * linker)
 	: mLinker(linker), mGlobalVars(nullptr), mProcedures(nullptr), mCompilerOptions(0)
 {
+	mArena = new Arena();
 }
 
 InterCodeModule::~InterCodeModule(void)
 {
+	delete mArena;
+}
+
+void InterCodeModule::ReleaseCode(void)
+{
+	for (int i = 0; i < mProcedures.Size(); i++)
+		mProcedures[i]->ReleaseCode();
 
+	delete mArena;
+	mArena = nullptr;
 }
 
 bool InterCodeModule::Disassemble(const char* filename)
@@ -8,8 +8,10 @@
 #include "MachineTypes.h"
 #include "Ident.h"
 #include "Linker.h"
+#include "PassProfile.h"
+#include "Arena.h"
 
-enum InterCode
+enum InterCode : uint8
 {
 	IC_NONE,
 	IC_LOAD_TEMPORARY,
@@ -40,7 +42,7 @@ enum InterCode
 	IC_UNREACHABLE
 };
 
-enum InterType
+enum InterType : uint8
 {
 	IT_NONE,
 	IT_BOOL,
@@ -53,7 +55,7 @@ enum InterType
 
 extern int InterTypeSize[];
 
-enum InterMemory
+enum InterMemory : uint8
 {
 	IM_NONE,
 	IM_PARAM,
@@ -68,7 +70,7 @@ enum InterMemory
 	IM_FFRAME,
 };
 
-enum InterOperator
+enum InterOperator : uint8
 {
 	IA_NONE,
 	IA_ADD,
@@ -141,7 +143,7 @@ public:
 
 	int64		mMinValue, mMaxValue;
 	
-	enum State
+	enum State : uint8
 	{
 		S_UNKNOWN,
 		S_UNBOUND,
@@ -225,7 +227,7 @@ public:
 	void Build(int from, int to);
 };
 
-class InterVariable
+class InterVariable : public GlobalArenaObject<InterVariable>
 {
 public:
 	Location						mLocation;
@@ -236,7 +238,7 @@ public:
 	LinkerObject				*	mLinkerObject;
 
 	InterVariable(void)
-		: mUsed(false), mAliased(false), mTemp(false), mIndex(-1), mSize(0), mOffset(0), mIdent(nullptr), mLinkerObject(nullptr)
+		: mUsed(false), mAliased(false), mTemp(false), mIndex(-1), mSize(0), mOffset(0), mAddr(0), mNumReferences(0), mIdent(nullptr), mLinkerObject(nullptr)
 	{
 	}
 };
@@ -244,15 +246,15 @@ public:
 class InterOperand
 {
 public:
-	int					mTemp;
-	InterType			mType;
-	bool				mFinal;
 	int64				mIntConst;
 	double				mFloatConst;
-	int					mVarIndex, mOperandSize;
 	LinkerObject	*	mLinkerObject;
-	InterMemory			mMemory;
 	IntegerValueRange	mRange;
+	int					mTemp;
+	int					mVarIndex, mOperandSize;
+	InterType			mType;
+	InterMemory			mMemory;
+	bool				mFinal;
 
 	void Forward(const InterOperand& op);
 	void ForwardMem(const InterOperand& op);
@@ -268,20 +270,25 @@ public:
 	void Disassemble(FILE* file);
 };
 
-class InterInstruction
+class InterInstruction : public ArenaObject<InterInstruction>
 {
 public:
 	InterCode							mCode;
-	InterOperand						mSrc[8];
-	InterOperand						mDst;
-	InterOperand						mConst;
 	InterOperator						mOperator;
+	bool								mInUse, mInvariant, mVolatile, mExpensive, mSingleAssignment;
 	int									mNumOperands;
+	InterOperand					*	mSrc;
+	InterOperand						mDst;
+	InterOperand						mConst;
 	Location							mLocation;
 
-	bool								mInUse, mInvariant, mVolatile, mExpensive, mSingleAssignment;
-
 	InterInstruction(void);
+	InterInstruction(const InterInstruction& ins);
+	~InterInstruction(void);
+
+	InterInstruction& operator=(const InterInstruction& ins);
+
+	void ReserveOperands(int num);
 
 	bool IsEqual(const InterInstruction* ins) const;
 	bool IsEqualSource(const InterInstruction* ins) const;
@@ -325,12 +332,16 @@ public:
 	bool ConstantFoldingRelationRange(void);
 
 	void Disassemble(FILE* file);
+protected:
+	// Most instructions have up to three source operands, only inline
+	// assembler needs more and allocates them out of line
+	InterOperand						mInlineSrc[3];
 };
 
-class InterCodeBasicBlock
+class InterCodeBasicBlock : public ArenaObject<InterCodeBasicBlock>
 {
 public:
-	int								mIndex, mNumEntries, mNumEntered, mTraceIndex;
+	int								mIndex, mNumEntries, mNumEntered, mTraceIndex, mDataFlowIndex;
 	InterCodeBasicBlock			*	mTrueJump, * mFalseJump, * mLoopPrefix, * mDominator;
 	GrowingInstructionArray			mInstructions;
 
@@ -392,7 +403,7 @@ public:
 
 	void BuildLocalTempSets(int num);
 	void BuildGlobalProvidedTempSet(NumberSet fromProvidedTemps);
-	bool BuildGlobalRequiredTempSet(NumberSet& fromRequiredTemps);
+	bool BuildGlobalRequiredTempSet(void);
 	bool RemoveUnusedResultInstructions(void);
 	void BuildCallerSaveTempSet(NumberSet& callerSaveTemps);
 	void BuildConstTempSets(void);
@@ -400,18 +411,18 @@ public:
 
 	void BuildLocalVariableSets(const GrowingVariableArray& localVars, const GrowingVariableArray& params, InterMemory paramMemory);
 	void BuildGlobalProvidedVariableSet(const GrowingVariableArray& localVars, NumberSet fromProvidedVars, const GrowingVariableArray& params, NumberSet fromProvidedParams, InterMemory paramMemory);
-	bool BuildGlobalRequiredVariableSet(const GrowingVariableArray& localVars, NumberSet& fromRequiredVars, const GrowingVariableArray& params, NumberSet& fromRequiredParams, InterMemory paramMemory);
+	bool BuildGlobalRequiredVariableSet(void);
 	bool RemoveUnusedStoreInstructions(const GrowingVariableArray& localVars, const GrowingVariableArray& params, InterMemory paramMemory);
 
 	void BuildStaticVariableSet(const GrowingVariableArray& staticVars);
 	void BuildGlobalProvidedStaticVariableSet(const GrowingVariableArray& staticVars, NumberSet fromProvidedVars);
-	bool BuildGlobalRequiredStaticVariableSet(const GrowingVariableArray& staticVars, NumberSet& fromRequiredVars);
+	bool BuildGlobalRequiredStaticVariableSet(void);
 	bool RemoveUnusedStaticStoreInstructions(const GrowingVariableArray& staticVars);
 
 	void RestartLocalIntegerRangeSets(const GrowingVariableArray& localVars);
 	void BuildLocalIntegerRangeSets(int num, const GrowingVariableArray& localVars);
 	void UpdateLocalIntegerRangeSets(const GrowingVariableArray& localVars);
-	bool BuildGlobalIntegerRangeSets(bool initial, const GrowingVariableArray& localVars);
+	bool BuildGlobalIntegerRangeSets(bool initial, const GrowingVariableArray& localVars, bool& changed);
 	void SimplifyIntegerRangeRelops(void);
 
 	GrowingIntArray			mEntryRenameTable;
@@ -472,15 +483,25 @@ public:
 	bool CanMoveInstructionDown(int si, int ti) const;
 	bool MergeCommonPathInstructions(void);
 
+	bool IsDominatedBy(const InterCodeBasicBlock* block) const;
+	void CollectValueNumberDefinitions(GrowingIntArray& tdefs, GrowingInterCodeBasicBlockPtrArray& tblocks, NumberSet& storedParams, bool& storedFParams);
+	void NumberParameterLoads(const GrowingIntArray& tdefs, const NumberSet& storedParams, const NumberSet& aliasedParams, bool storedFParams, GrowingIntArray& tvalues, GrowingInstructionPtrArray& tloads, GrowingInstructionPtrArray& loads);
+	bool IsValueBusy(const InterCodeBasicBlock* dom, const InterInstruction* ins, const GrowingIntArray& tvalues, GrowingIntArray& busy, int mark) const;
+	void HoistBusyValues(InterCodeProcedure* proc, const GrowingIntArray& dfirst, const GrowingInterCodeBasicBlockPtrArray& dchildren, GrowingIntArray& tdefs, GrowingInterCodeBasicBlockPtrArray& tblocks, GrowingIntArray& tvalues, GrowingInstructionPtrArray& tloads, GrowingIntArray& busy, int& mark, int& hoisted);
+	void GlobalValueNumbering(const GrowingIntArray& dfirst, const GrowingInterCodeBasicBlockPtrArray& dchildren, const GrowingIntArray& tdefs, const GrowingIntArray& tvalues, GrowingInstructionPtrArray& avail, int& eliminated);
+
 	void CheckFinalLocal(void);
 	void CheckFinal(void);
 
 	void PeepholeOptimization(const GrowingVariableArray& staticVars);
 	void SingleBlockLoopOptimisation(const NumberSet& aliasedParams, const GrowingVariableArray& staticVars);
 	void SingleBlockLoopUnrolling(void);
+	bool MultiBlockLoopUnrolling(InterCodeProcedure* proc, GrowingInterCodeBasicBlockPtrArray& unrolled, int budget, bool partial);
 	bool CollectLoopBody(InterCodeBasicBlock* head, GrowingArray<InterCodeBasicBlock*> & body);
 	void CollectLoopPath(const GrowingArray<InterCodeBasicBlock*>& body, GrowingArray<InterCodeBasicBlock*>& path);
 	void InnerLoopOptimization(const NumberSet& aliasedParams);
+	bool CollectNestedLoopBody(InterCodeBasicBlock* head, GrowingArray<InterCodeBasicBlock*>& body);
+	void LoopStrengthReduction(InterCodeProcedure* proc, const NumberSet& aliasedParams);
 
 	InterCodeBasicBlock* BuildLoopPrefix(InterCodeProcedure * proc);
 	void BuildLoopSuffix(InterCodeProcedure* proc);
@@ -505,7 +526,7 @@ public:
 
 class InterCodeModule;
 
-class InterCodeProcedure
+class InterCodeProcedure : public GlobalArenaObject<InterCodeProcedure>
 {
 protected:
 	GrowingIntArray						mRenameTable, mRenameUnionTable, mGlobalRenameTable;
@@ -523,12 +544,15 @@ public:
 	int									mTempSize, mCommonFrameSize, mCallerSavedTemps, mFreeCallerSavedTemps;
 	bool								mLeafProcedure, mNativeProcedure, mCallsFunctionPointer, mHasDynamicStack, mHasInlineAssembler, mCallsByteCode, mFastCallProcedure;
 	bool								mInterrupt, mHardwareInterrupt, mCompiled, mInterruptCalled;
+	bool								mHotProcedure, mColdProcedure;
 	GrowingInterCodeProcedurePtrArray	mCalledFunctions;
 
 	InterCodeModule					*	mModule;
 	int									mID;
+	uint64								mCompilerOptions;
 
 	int									mLocalSize, mNumLocals;
+	int									mValueNumberingEliminated, mValueNumberingHoisted;
 	GrowingVariableArray				mLocalVars, mParamVars;
 
 	Location							mLocation;
@@ -536,6 +560,10 @@ public:
 
 	LinkerObject					*	mLinkerObject, * mSaveTempsLinkerObject;
 
+	PassProfile						*	mInterProfile, * mNativeProfile;
+
+	Arena							*	mArena;
+
 	InterCodeProcedure(InterCodeModule * module, const Location & location, const Ident * ident, LinkerObject* linkerObject);
 	~InterCodeProcedure(void);
 
@@ -558,9 +586,14 @@ public:
 	void ReduceTemporaries(void);
 	void Disassemble(FILE* file);
 	void Disassemble(const char* name, bool dumpSets = false);
+
+	int NumInstructions(void) const;
+
+	void ReleaseCode(void);
 protected:
 	void BuildTraces(bool expand, bool dominators = true, bool compact = false);
 	void BuildDataFlowSets(void);
+	void BuildGlobalIntegerRangeSets(bool initial, const char* name);
 	void RenameTemporaries(void);
 	void TempForwarding(void);
 	void RemoveUnusedInstructions(void);
@@ -571,6 +604,7 @@ protected:
 	void RemoveUnusedStoreInstructions(InterMemory	paramMemory);
 	void MergeCommonPathInstructions(void);
 	void PushSinglePathResultInstructions(void);
+	void GlobalValueNumbering(void);
 	void PromoteSimpleLocalsToTemp(InterMemory paramMemory, int nlocals, int nparams);
 	void SimplifyIntegerNumeric(FastNumberSet& activeSet);
 	void MergeIndexedLoadStore(void);
@@ -586,6 +620,7 @@ protected:
 	void CheckFinal(void);
 
 	void DisassembleDebug(const char* name);
+	void ProfileIteration(const char* name, int count = 1);
 };
 
 class InterCodeModule
@@ -596,6 +631,8 @@ public:
 
 	bool Disassemble(const char* name);
 
+	void ReleaseCode(void);
+
 	GrowingInterCodeProcedurePtrArray	mProcedures;
 
 	GrowingVariableArray				mGlobalVars;
@@ -604,4 +641,5 @@ public:
 
 	uint64				mCompilerOptions;
 
+	Arena			*	mArena;
 };
@@ -2565,6 +2565,7 @@ InterCodeGenerator::ExValue InterCodeGenerator::TranslateExpression(Declaration*
 
 				InterInstruction	*	jins = new InterInstruction();
 				jins->mCode = IC_ASSEMBLER;
+				jins->ReserveOperands(refvars.Size() + 1);
 				jins->mSrc[0].mType = IT_POINTER;
 				jins->mSrc[0].mTemp = ins->mDst.mTemp;
 				jins->mNumOperands = 1;
@@ -3343,6 +3344,7 @@ InterCodeGenerator::ExValue InterCodeGenerator::TranslateExpression(Declaration*
 		{
 			vl = TranslateExpression(procType, proc, block, exp->mLeft, breakBlock, continueBlock, inlineMapper);
 			vl = Dereference(proc, block, vl);
+			int	vsize = vl.mType->mSize;
 			vl = CoerceType(proc, block, vl, TheSignedIntTypeDeclaration);
 
 			InterCodeBasicBlock	* dblock = nullptr;
@@ -3420,7 +3422,92 @@ InterCodeGenerator::ExValue InterCodeGenerator::TranslateExpression(Declaration*
 				sexp = sexp->mRight;
 			}
 
-			BuildSwitchTree(proc, sblock, vl, switchNodes, 0, switchNodes.Size(), dblock ? dblock : eblock);
+			InterCodeBasicBlock* tblock = dblock ? dblock : eblock;
+
+			int	ncases = switchNodes.Size();
+			if (vsize > 1 && ncases >= 4)
+			{
+				// A dense switch on a value wider than a byte is rebased to the
+				// first case and checked against the range of the cases, the
+				// low byte is then sufficient for the remaining compares, which
+				// the native code generator can replace with a jump table
+
+				int	first = switchNodes[0].mValue, span = switchNodes[ncases - 1].mValue - first;
+
+				if (span < 256 && span < 4 * (ncases + 1))
+				{
+					if (first != 0)
+					{
+						InterInstruction* fins = new InterInstruction();
+						fins->mCode = IC_CONSTANT;
+						fins->mConst.mType = IT_INT16;
+						fins->mConst.mIntConst = first;
+						fins->mDst.mType = IT_INT16;
+						fins->mDst.mTemp = proc->AddTemporary(fins->mDst.mType);
+						sblock->Append(fins);
+
+						InterInstruction* sins = new InterInstruction();
+						sins->mCode = IC_BINARY_OPERATOR;
+						sins->mOperator = IA_SUB;
+						sins->mSrc[0].mType = IT_INT16;
+						sins->mSrc[0].mTemp = fins->mDst.mTemp;
+						sins->mSrc[1].mType = IT_INT16;
+						sins->mSrc[1].mTemp = vl.mTemp;
+						sins->mDst.mType = IT_INT16;
+						sins->mDst.mTemp = proc->AddTemporary(sins->mDst.mType);
+						sblock->Append(sins);
+
+						vl.mTemp = sins->mDst.mTemp;
+
+						for (int i = 0; i < ncases; i++)
+							switchNodes[i].mValue -= first;
+					}
+
+					InterInstruction* vins = new InterInstruction();
+					vins->mCode = IC_CONSTANT;
+					vins->mConst.mType = IT_INT16;
+					vins->mConst.mIntConst = span;
+					vins->mDst.mType = IT_INT16;
+					vins->mDst.mTemp = proc->AddTemporary(vins->mDst.mType);
+					sblock->Append(vins);
+
+					InterInstruction* cins = new InterInstruction();
+					cins->mCode = IC_RELATIONAL_OPERATOR;
+					cins->mOperator = IA_CMPGU;
+					cins->mSrc[0].mType = IT_INT16;
+					cins->mSrc[0].mTemp = vins->mDst.mTemp;
+					cins->mSrc[1].mType = IT_INT16;
+					cins->mSrc[1].mTemp = vl.mTemp;
+					cins->mDst.mType = IT_BOOL;
+					cins->mDst.mTemp = proc->AddTemporary(cins->mDst.mType);
+					sblock->Append(cins);
+
+					InterInstruction* bins = new InterInstruction();
+					bins->mCode = IC_BRANCH;
+					bins->mSrc[0].mType = IT_BOOL;
+					bins->mSrc[0].mTemp = cins->mDst.mTemp;
+					sblock->Append(bins);
+
+					InterCodeBasicBlock* rblock = new InterCodeBasicBlock();
+					proc->Append(rblock);
+
+					sblock->Close(tblock, rblock);
+					sblock = rblock;
+
+					InterInstruction* xins = new InterInstruction();
+					xins->mCode = IC_CONVERSION_OPERATOR;
+					xins->mOperator = IA_EXT8TO16U;
+					xins->mSrc[0].mType = IT_INT8;
+					xins->mSrc[0].mTemp = vl.mTemp;
+					xins->mDst.mType = IT_INT16;
+					xins->mDst.mTemp = proc->AddTemporary(IT_INT16);
+					sblock->Append(xins);
+
+					vl.mTemp = xins->mDst.mTemp;
+				}
+			}
+
+			BuildSwitchTree(proc, sblock, vl, switchNodes, 0, ncases, tblock);
 
 			if (block)
 			{
@@ -3623,10 +3710,51 @@ void InterCodeGenerator::TranslateLogic(Declaration* procType, InterCodeProcedur
 	}
 }
 
+void InterCodeGenerator::LimitArgumentRanges(InterCodeProcedure* proc, Declaration* procType)
+{
+	for (int i = 0; i < proc->mBlocks.Size(); i++)
+	{
+		InterCodeBasicBlock* block = proc->mBlocks[i];
+		for (int j = 1; j < block->mInstructions.Size(); j++)
+		{
+			InterInstruction* ins = block->mInstructions[j];
+			if (ins->mCode == IC_LOAD && ins->mSrc[0].mTemp >= 0)
+			{
+				int k = j - 1;
+				while (k >= 0 && block->mInstructions[k]->mDst.mTemp != ins->mSrc[0].mTemp)
+					k--;
+
+				if (k >= 0)
+				{
+					InterInstruction* cins = block->mInstructions[k];
+					if (cins->mCode == IC_CONSTANT && (cins->mConst.mMemory == IM_PARAM || cins->mConst.mMemory == IM_FPARAM) && cins->mConst.mIntConst == 0)
+					{
+						int	vindex = cins->mConst.mVarIndex;
+						if (cins->mConst.mMemory == IM_FPARAM)
+							vindex -= procType->mFastCallBase;
+
+						Declaration* pdec = procType->mParams;
+						while (pdec && pdec->mVarIndex != vindex)
+							pdec = pdec->mNext;
+
+						if (pdec && (pdec->mFlags & DTF_VAR_RANGE) && pdec->mSize == ins->mSrc[0].mOperandSize)
+						{
+							ins->mDst.mRange.LimitMin(pdec->mMinValue);
+							ins->mDst.mRange.LimitMax(pdec->mMaxValue);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
 InterCodeProcedure* InterCodeGenerator::TranslateProcedure(InterCodeModule * mod, Expression* exp, Declaration * dec)
 {
 	InterCodeProcedure* proc = new InterCodeProcedure(mod, dec->mLocation, dec->mIdent, mLinker->AddObject(dec->mLocation, dec->mIdent, dec->mSection, LOT_BYTE_CODE));
 
+	ArenaScope	scope(proc->mArena);
+
 	dec->mVarIndex = proc->mID;
 	dec->mLinkerObject = proc->mLinkerObject;
 	proc->mNumLocals = dec->mNumVars;
@@ -3643,6 +3771,17 @@ InterCodeProcedure* InterCodeGenerator::TranslateProcedure(InterCodeModule * mod
 	if (dec->mFlags & DTF_FUNC_INTRCALLED)
 		proc->mInterruptCalled = true;
 
+	if (dec->mFlags & DTF_FUNC_HOT)
+	{
+		proc->mHotProcedure = true;
+		proc->mCompilerOptions = (proc->mCompilerOptions | COPT_OPTIMIZE_AUTO_UNROLL) & ~COPT_OPTIMIZE_CODE_SIZE;
+	}
+	else if (dec->mFlags & DTF_FUNC_COLD)
+	{
+		proc->mColdProcedure = true;
+		proc->mCompilerOptions = (proc->mCompilerOptions | COPT_OPTIMIZE_CODE_SIZE) & ~COPT_OPTIMIZE_AUTO_UNROLL;
+	}
+
 	if (dec->mBase->mFlags & DTF_FASTCALL)
 	{
 		proc->mFastCallProcedure = true;
@@ -3664,6 +3803,9 @@ InterCodeProcedure* InterCodeGenerator::TranslateProcedure(InterCodeModule * mod
 			printf("Generate intermediate code <%s>\n", proc->mIdent->mString);
 
 		TranslateExpression(dec->mBase, proc, exitBlock, exp, nullptr, nullptr, nullptr);
+
+		if (mCompilerOptions & COPT_OPTIMIZE_BASIC)
+			LimitArgumentRanges(proc, dec->mBase);
 	}
 	else
 		mErrors->Error(dec->mLocation, EERR_UNDEFINED_OBJECT, "Calling undefined function", dec->mIdent->mString);
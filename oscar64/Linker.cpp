@@ -2,13 +2,15 @@
 #include <string.h>
 #include <stdio.h>
 #include "CompilerTypes.h"
+#include "Assembler.h"
+#include "NumberSet.h"
 
 LinkerRegion::LinkerRegion(void)
-	: mSections(nullptr), mFreeChunks(FreeChunk{ 0, 0 } )
+	: mIdent(nullptr), mFlags(0), mStart(0), mEnd(0), mUsed(0), mNonzero(0), mReloc(0), mCartridgeBanks(0), mSections(nullptr), mFreeChunks(FreeChunk{ 0, 0 } ), mCrossPadding(FreeChunk{ 0, 0 })
 {}
 
 LinkerSection::LinkerSection(void)
-	: mObjects(nullptr), mSections(nullptr)
+	: mIdent(nullptr), mObjects(nullptr), mSections(nullptr), mStart(0), mEnd(0), mSize(0), mType(LST_NONE)
 {}
 
 
@@ -29,12 +31,18 @@ void LinkerSection::AddObject(LinkerObject* obj)
 }
 
 LinkerObject::LinkerObject(void)
-	: mReferences(nullptr), mNumTemporaries(0), mSize(0), mAlignment(1), mStackSection(nullptr)
-{}
+	: mIdent(nullptr), mType(LOT_NONE), mID(-1), mAddress(0), mRefAddress(0), mSize(0), mAlignment(1), mSection(nullptr), mRegion(nullptr), mData(nullptr), mProc(nullptr), mFlags(0),
+	mNumTemporaries(0), mStackSection(nullptr), mReferences(nullptr), mNoCrossRanges(LinkerRange{ 0, 0 })
+{
+	for (int i = 0; i < 16; i++)
+		mTemporaries[i] = mTempSizes[i] = 0;
+}
 
 LinkerObject::~LinkerObject(void)
 {
-
+	for (int i = 0; i < mReferences.Size(); i++)
+		delete mReferences[i];
+	delete[] mData;
 }
 
 void LinkerObject::AddReference(const LinkerReference& ref)
@@ -43,6 +51,92 @@ void LinkerObject::AddReference(const LinkerReference& ref)
 	mReferences.Push(nref);
 }
 
+int LinkerObject::PageCrossings(int address) const
+{
+	int	n = 0;
+
+	if ((mFlags & LOBJF_NO_CROSS) && mSize > 0 && mSize <= 256 && (address & 0xff00) != ((address + mSize - 1) & 0xff00))
+		n++;
+
+	for (int i = 0; i < mNoCrossRanges.Size(); i++)
+	{
+		const LinkerRange& r(mNoCrossRanges[i]);
+		if (((address + r.mStart) & 0xff00) != ((address + r.mEnd) & 0xff00))
+			n++;
+	}
+
+	return n;
+}
+
+void LinkerObject::FindHotLoops(void)
+{
+	// Backward branches close the loops of native code, the branches inside
+	// a loop should not cross a page and neither should the tables read with
+	// an index in the loop
+
+	mNoCrossRanges.SetSize(0);
+
+	GrowingArray<LinkerRange>	loops(LinkerRange{ 0, 0 });
+
+	int	ip = 0;
+	while (ip < mSize)
+	{
+		AsmInsData	d = DecInsData[mData[ip]];
+		int			next = ip + AsmInsSize(d.mType, d.mMode);
+
+		if (d.mMode == ASMIM_RELATIVE && next <= mSize)
+		{
+			int	target = next + int8(mData[ip + 1]);
+			if (target >= 0 && target <= ip)
+				loops.Push(LinkerRange{ target, next });
+		}
+
+		ip = next;
+	}
+
+	if (loops.Size() > 0)
+	{
+		NumberSet	hot(mSize + 2);
+
+		ip = 0;
+		while (ip < mSize)
+		{
+			AsmInsData	d = DecInsData[mData[ip]];
+			int			next = ip + AsmInsSize(d.mType, d.mMode);
+
+			int	i = 0;
+			while (i < loops.Size() && (ip < loops[i].mStart || ip >= loops[i].mEnd))
+				i++;
+
+			if (i < loops.Size() && next <= mSize)
+			{
+				if (d.mMode == ASMIM_RELATIVE)
+				{
+					int	target = next + int8(mData[ip + 1]);
+					if (target < next)
+						mNoCrossRanges.Push(LinkerRange{ target, next });
+					else
+						mNoCrossRanges.Push(LinkerRange{ next, target });
+				}
+				else if ((d.mMode == ASMIM_ABSOLUTE_X || d.mMode == ASMIM_ABSOLUTE_Y) && AsmInsPageCrossPenalty(d.mType, d.mMode))
+				{
+					hot += ip + 1;
+					hot += ip + 2;
+				}
+			}
+
+			ip = next;
+		}
+
+		for (int i = 0; i < mReferences.Size(); i++)
+		{
+			LinkerReference* ref = mReferences[i];
+			if (hot[ref->mOffset] && ref->mRefObject && ref->mRefObject != this)
+				ref->mRefObject->mFlags |= LOBJF_NO_CROSS;
+		}
+	}
+}
+
 void LinkerObject::MoveToSection(LinkerSection* section)
 {
 	if (section != mSection)
@@ -72,7 +166,8 @@ uint8* LinkerObject::AddSpace(int size)
 }
 
 Linker::Linker(Errors* errors)
-	: mErrors(errors), mSections(nullptr), mReferences(nullptr), mObjects(nullptr), mRegions(nullptr), mCompilerOptions(COPT_DEFAULT)
+	: mErrors(errors), mSections(nullptr), mReferences(nullptr), mObjects(nullptr), mRegions(nullptr), mCompilerOptions(COPT_DEFAULT),
+	  mObjectReferences(nullptr), mObjectReferenceStart(0), mObjectByAddr(nullptr)
 {
 	for (int i = 0; i < 64; i++)
 	{
@@ -84,7 +179,7 @@ Linker::Linker(Errors* errors)
 
 Linker::~Linker(void)
 {
-
+	delete[] mObjectByAddr;
 }
 
 
@@ -148,26 +243,53 @@ bool Linker::IsSectionPlaced(LinkerSection* section)
 	return false;
 }
 
-LinkerObject* Linker::FindObjectByAddr(int addr)
+void Linker::BuildObjectByAddr(void)
 {
-	for (int i = 0; i < mObjects.Size(); i++)
+	mObjectByAddr = new LinkerObject * [0x10000];
+	for (int i = 0; i < 0x10000; i++)
+		mObjectByAddr[i] = nullptr;
+
+	// Fill in reverse order, so the first of several overlapping objects wins
+
+	for (int i = mObjects.Size() - 1; i >= 0; i--)
 	{
 		LinkerObject* lobj = mObjects[i];
 		if (lobj->mFlags & LOBJF_PLACED)
 		{
-			if (addr >= lobj->mAddress && addr < lobj->mAddress + lobj->mSize)
-				return lobj;
+			int	start = lobj->mAddress, end = lobj->mAddress + lobj->mSize;
+			if (start < 0)
+				start = 0;
+			if (end > 0x10000)
+				end = 0x10000;
+			for (int j = start; j < end; j++)
+				mObjectByAddr[j] = lobj;
 		}
 	}
+}
 
-	return nullptr;
+LinkerObject* Linker::FindObjectByAddr(int addr)
+{
+	if (addr < 0 || addr >= 0x10000)
+		return nullptr;
+
+	if (!mObjectByAddr)
+		BuildObjectByAddr();
+
+	return mObjectByAddr[addr];
 }
 
 LinkerObject * Linker::AddObject(const Location& location, const Ident* ident, LinkerSection * section, LinkerObjectType type, int alignment)
+{
+	LinkerObject* obj = NewObject(location, ident, section, type, alignment);
+	AddObject(obj);
+	return obj;
+}
+
+LinkerObject* Linker::NewObject(const Location& location, const Ident* ident, LinkerSection* section, LinkerObjectType type, int alignment)
 {
 	LinkerObject* obj = new LinkerObject;
 	obj->mLocation = location;
-	obj->mID = mObjects.Size();
+	obj->mID = -1;
 	obj->mType = type;
 	obj->mData = nullptr;
 	obj->mSize = 0;
@@ -177,11 +299,16 @@ LinkerObject * Linker::AddObject(const Location& location, const Ident* ident, L
 	obj->mProc = nullptr;
 	obj->mFlags = 0;
 	obj->mAlignment = alignment;
-	section->mObjects.Push(obj);
-	mObjects.Push(obj);
 	return obj;
 }
 
+void Linker::AddObject(LinkerObject* obj)
+{
+	obj->mID = mObjects.Size();
+	obj->mSection->mObjects.Push(obj);
+	mObjects.Push(obj);
+}
+
 void Linker::CollectReferences(void) 
 {
 	for (int i = 0; i < mObjects.Size(); i++)
@@ -190,6 +317,26 @@ void Linker::CollectReferences(void)
 		for (int j = 0; j < lobj->mReferences.Size(); j++)
 			mReferences.Push(lobj->mReferences[j]);
 	}
+
+	// Group the references by source object with a counting sort
+
+	mObjectReferenceStart.SetSize(mObjects.Size() + 1, true);
+	for (int i = 0; i < mReferences.Size(); i++)
+	{
+		if (mReferences[i]->mObject)
+			mObjectReferenceStart[mReferences[i]->mObject->mID + 1]++;
+	}
+	for (int i = 0; i < mObjects.Size(); i++)
+		mObjectReferenceStart[i + 1] += mObjectReferenceStart[i];
+
+	GrowingArray<int>	pos(mObjectReferenceStart);
+	mObjectReferences.SetSize(mObjectReferenceStart[mObjects.Size()]);
+	for (int i = 0; i < mReferences.Size(); i++)
+	{
+		LinkerReference* ref = mReferences[i];
+		if (ref->mObject)
+			mObjectReferences[pos[ref->mObject->mID]++] = ref;
+	}
 }
 
 void Linker::ReferenceObject(LinkerObject* obj)
@@ -197,69 +344,147 @@ void Linker::ReferenceObject(LinkerObject* obj)
 	if (!(obj->mFlags & LOBJF_REFERENCED))
 	{
 		obj->mFlags |= LOBJF_REFERENCED;
-		for (int i = 0; i < mReferences.Size(); i++)
+
+		GrowingArray<LinkerObject*>	stack(nullptr);
+		stack.Push(obj);
+
+		while (stack.Size() > 0)
 		{
-			LinkerReference* ref = mReferences[i];
-			if (ref->mObject == obj)
-				ReferenceObject(ref->mRefObject);
+			LinkerObject* lobj = stack.Pop();
+			if (lobj->mID + 1 < mObjectReferenceStart.Size())
+			{
+				for (int i = mObjectReferenceStart[lobj->mID]; i < mObjectReferenceStart[lobj->mID + 1]; i++)
+				{
+					LinkerObject* robj = mObjectReferences[i]->mRefObject;
+					if (!(robj->mFlags & LOBJF_REFERENCED))
+					{
+						robj->mFlags |= LOBJF_REFERENCED;
+						stack.Push(robj);
+					}
+				}
+			}
 		}
 	}
 }
 
+int LinkerRegion::BestStart(LinkerObject* lobj, int start, int end, int maxPadding, int& crossings) const
+{
+	int	best = -1;
+	for (int i = start; i < start + maxPadding && i + lobj->mSize <= end && crossings > 0; i += lobj->mAlignment)
+	{
+		int	c = lobj->PageCrossings(i);
+		if (best < 0 || c < crossings)
+		{
+			best = i;
+			crossings = c;
+		}
+	}
+
+	return best;
+}
+
 bool LinkerRegion::Allocate(Linker * linker, LinkerObject* lobj)
 {
-	int i = 0;
-	while (i < mFreeChunks.Size())
+	// Objects with hot ranges are moved up to the address with the fewest
+	// page crossings, unless optimizing for size.  Indexed tables may move
+	// by up to a page, code by a few bytes.  A free chunk is only used if
+	// it is as good as the end of the region.
+
+	int	maxPadding = 1, crossings = 0;
+	if (!(linker->mCompilerOptions & COPT_OPTIMIZE_CODE_SIZE))
 	{
-		int start = (mFreeChunks[i].mStart + lobj->mAlignment - 1) & ~(lobj->mAlignment - 1);
-		int end = start + lobj->mSize;
+		if (lobj->mFlags & LOBJF_NO_CROSS)
+			maxPadding = 256;
+		else if (lobj->mNoCrossRanges.Size() > 0)
+			maxPadding = 32;
+	}
+
+	int	tstart = (mStart + mUsed + lobj->mAlignment - 1) & ~(lobj->mAlignment - 1);
+	int	tcrossings = 0x10000;
+	int	start = -1;
+	if (maxPadding > 1)
+		start = BestStart(lobj, tstart, mEnd, maxPadding, tcrossings);
 
-		if (!(linker->mCompilerOptions & COPT_OPTIMIZE_CODE_SIZE) && (lobj->mFlags & LOBJF_NO_CROSS) && lobj->mSize <= 256 && (start & 0xff00) != ((end - 1) & 0xff00))
-			;
-		else if (end <= mFreeChunks[i].mEnd)
+	// First fit takes the first free chunk the object fits into, best fit
+	// the one with the fewest bytes left behind the aligned object and in
+	// the gap in front of it
+
+	int	bi = -1, bstart = 0, bastart = 0, bleft = 0;
+
+	for (int i = 0; i < mFreeChunks.Size(); i++)
+	{
+		int astart = (mFreeChunks[i].mStart + lobj->mAlignment - 1) & ~(lobj->mAlignment - 1);
+		int	fstart = astart;
+		if (maxPadding > 1)
 		{
-			lobj->mFlags |= LOBJF_PLACED;
-			lobj->mAddress = start;
-			lobj->mRefAddress = start + mReloc;
-			lobj->mRegion = this;
+			crossings = 0x10000;
+			fstart = BestStart(lobj, astart, mFreeChunks[i].mEnd, maxPadding, crossings);
+			if (crossings > tcrossings)
+				fstart = -1;
+		}
+		int end = fstart + lobj->mSize;
 
-			if (start == mFreeChunks[i].mStart)
-			{
-				if (end == mFreeChunks[i].mEnd)
-					mFreeChunks.Remove(i);
-				else
-					mFreeChunks[i].mStart = end;
-			}
-			else if (end == mFreeChunks[i].mEnd)
-			{
-				mFreeChunks[i].mEnd = start;
-			}
-			else
+		if (fstart >= 0 && end <= mFreeChunks[i].mEnd)
+		{
+			int	left = (mFreeChunks[i].mEnd - end) + (fstart - mFreeChunks[i].mStart);
+			if (bi < 0 || left < bleft)
 			{
-				mFreeChunks.Insert(i + 1, FreeChunk{ end, mFreeChunks[i].mEnd } );
-				mFreeChunks[i].mEnd = start;
+				bi = i;
+				bstart = fstart;
+				bastart = astart;
+				bleft = left;
 			}
 
-			return true;
+			if (!(mFlags & LREGF_BEST_FIT) || left == 0)
+				break;
 		}
-		i++;
 	}
 
-	int start = (mStart + mUsed + lobj->mAlignment - 1) & ~(lobj->mAlignment - 1);
-	int end = start + lobj->mSize;
-
-	if (!(linker->mCompilerOptions & COPT_OPTIMIZE_CODE_SIZE) && (lobj->mFlags & LOBJF_NO_CROSS) && lobj->mSize <= 256 && (start & 0xff00) != ((end - 1) & 0xff00))
+	if (bi >= 0)
 	{
-		start = (start + 0x00ff) & 0xff00;
-		end = start + lobj->mSize;
+		int	end = bstart + lobj->mSize;
+
+		lobj->mFlags |= LOBJF_PLACED;
+		lobj->mAddress = bstart;
+		lobj->mRefAddress = bstart + mReloc;
+		lobj->mRegion = this;
+
+		if (bstart > bastart)
+			mCrossPadding.Push(FreeChunk{ bastart, bstart });
+
+		if (bstart == mFreeChunks[bi].mStart)
+		{
+			if (end == mFreeChunks[bi].mEnd)
+				mFreeChunks.Remove(bi);
+			else
+				mFreeChunks[bi].mStart = end;
+		}
+		else if (end == mFreeChunks[bi].mEnd)
+		{
+			mFreeChunks[bi].mEnd = bstart;
+		}
+		else
+		{
+			mFreeChunks.Insert(bi + 1, FreeChunk{ end, mFreeChunks[bi].mEnd } );
+			mFreeChunks[bi].mEnd = bstart;
+		}
+
+		return true;
 	}
 
+	if (start < 0)
+		start = tstart;
+	int end = start + lobj->mSize;
+
 	if (end <= mEnd)
 	{
 		lobj->mFlags |= LOBJF_PLACED;
 		lobj->mAddress = start;
 		lobj->mRefAddress = start + mReloc;
 		lobj->mRegion = this;
+
+		if (start > tstart)
+			mCrossPadding.Push(FreeChunk{ tstart, start });
 #if 1
 		if (start != mStart + mUsed)
 			mFreeChunks.Push( FreeChunk{ mStart + mUsed, start } );
@@ -310,6 +535,9 @@ void LinkerRegion::PlaceStackSection(LinkerSection* stackSection, LinkerSection*
 
 void Linker::Link(void)
 {
+	delete[] mObjectByAddr;
+	mObjectByAddr = nullptr;
+
 	if (mErrors->mErrorCount == 0)
 	{
 
@@ -320,6 +548,18 @@ void Linker::Link(void)
 			lsec->mEnd = 0x0000;
 		}
 
+		// Find the hot loops of native code and the tables they index
+
+		if (!(mCompilerOptions & COPT_OPTIMIZE_CODE_SIZE))
+		{
+			for (int i = 0; i < mObjects.Size(); i++)
+			{
+				LinkerObject* lobj = mObjects[i];
+				if ((lobj->mFlags & LOBJF_REFERENCED) && lobj->mType == LOT_NATIVE_CODE)
+					lobj->FindHotLoops();
+			}
+		}
+
 		// Move objects into regions
 
 		for (int i = 0; i < mRegions.Size(); i++)
@@ -328,9 +568,23 @@ void Linker::Link(void)
 			for (int j = 0; j < lrgn->mSections.Size(); j++)
 			{
 				LinkerSection* lsec = lrgn->mSections[j];
+
+				GrowingArray<LinkerObject*>	objects(nullptr);
 				for (int k = 0; k < lsec->mObjects.Size(); k++)
 				{
 					LinkerObject* lobj = lsec->mObjects[k];
+					int	l = objects.Size();
+					if (lrgn->mFlags & LREGF_BEST_FIT)
+					{
+						while (l > 0 && (objects[l - 1]->mSize < lobj->mSize || objects[l - 1]->mSize == lobj->mSize && objects[l - 1]->mAlignment < lobj->mAlignment))
+							l--;
+					}
+					objects.Insert(l, lobj);
+				}
+
+				for (int k = 0; k < objects.Size(); k++)
+				{
+					LinkerObject* lobj = objects[k];
 					if ((lobj->mFlags & LOBJF_REFERENCED) && !(lobj->mFlags & LOBJF_PLACED) && lrgn->Allocate(this, lobj))
 					{
 						if (lobj->mIdent && lobj->mIdent->mString && (mCompilerOptions & COPT_VERBOSE2))
@@ -693,6 +947,66 @@ bool Linker::WriteMapFile(const char* filename)
 			fprintf(file, "%04x - %04x : %04x, %04x, %s\n", lrgn->mStart, lrgn->mEnd, lrgn->mNonzero, lrgn->mUsed, lrgn->mIdent->mString);
 		}
 
+		fprintf(file, "\nregion usage\n");
+
+		for (int i = 0; i < mRegions.Size(); i++)
+		{
+			LinkerRegion* lrgn = mRegions[i];
+
+			int	size = lrgn->mEnd - lrgn->mStart, filled = 0;
+			int	largest = lrgn->mEnd - lrgn->mStart - lrgn->mUsed;
+
+			for (int j = 0; j < lrgn->mFreeChunks.Size(); j++)
+			{
+				int	csize = lrgn->mFreeChunks[j].mEnd - lrgn->mFreeChunks[j].mStart;
+				if (csize > largest)
+					largest = csize;
+			}
+
+			for (int j = 0; j < mObjects.Size(); j++)
+			{
+				LinkerObject* obj = mObjects[j];
+				if ((obj->mFlags & LOBJF_REFERENCED) && obj->mRegion == lrgn && obj->mAddress >= lrgn->mStart && obj->mAddress < lrgn->mEnd)
+					filled += obj->mSize;
+			}
+
+			if (size > 0)
+				fprintf(file, "%s : %d of %d bytes filled (%d%%), largest free chunk %d bytes%s\n", lrgn->mIdent->mString, filled, size, int(100LL * filled / size), largest, (lrgn->mFlags & LREGF_BEST_FIT) ? ", best fit" : "");
+		}
+
+		fprintf(file, "\npage crossings\n");
+
+		for (int i = 0; i < mRegions.Size(); i++)
+		{
+			LinkerRegion* lrgn = mRegions[i];
+
+			int	padding = 0, unused = 0, crossings = 0;
+			for (int j = 0; j < lrgn->mCrossPadding.Size(); j++)
+			{
+				const LinkerRegion::FreeChunk& pc(lrgn->mCrossPadding[j]);
+				padding += pc.mEnd - pc.mStart;
+
+				for (int k = 0; k < lrgn->mFreeChunks.Size(); k++)
+				{
+					const LinkerRegion::FreeChunk& fc(lrgn->mFreeChunks[k]);
+					int	start = fc.mStart > pc.mStart ? fc.mStart : pc.mStart;
+					int	end = fc.mEnd < pc.mEnd ? fc.mEnd : pc.mEnd;
+					if (end > start)
+						unused += end - start;
+				}
+			}
+
+			for (int j = 0; j < mObjects.Size(); j++)
+			{
+				LinkerObject* obj = mObjects[j];
+				if ((obj->mFlags & LOBJF_REFERENCED) && obj->mRegion == lrgn)
+					crossings += obj->PageCrossings(obj->mAddress);
+			}
+
+			if (padding || crossings)
+				fprintf(file, "%s : %d bytes padding, %d bytes wasted, %d hot crossings left\n", lrgn->mIdent->mString, padding, unused, crossings);
+		}
+
 		fprintf(file, "\nobjects\n");
 
 		for (int i = 0; i < mObjects.Size(); i++)
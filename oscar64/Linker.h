@@ -6,6 +6,7 @@
 #include "Errors.h"
 #include "Disassembler.h"
 #include "DiskImage.h"
+#include "Arena.h"
 
 class InterCodeProcedure;
 
@@ -73,7 +74,12 @@ struct ZeroPageSet
 class LinkerObject;
 class LinkerSection;
 
-class LinkerRegion
+// Place the objects of each section in order of decreasing size into the
+// free chunk that fits best, instead of in creation order at the first fit
+
+static const uint32 LREGF_BEST_FIT	= 0x00000001;
+
+class LinkerRegion : public GlobalArenaObject<LinkerRegion>
 {
 public:
 	const Ident* mIdent;
@@ -92,8 +98,13 @@ public:
 	};
 
 	GrowingArray<FreeChunk>		mFreeChunks;
+
+	// Gaps left before objects to avoid page crossings
+
+	GrowingArray<FreeChunk>		mCrossPadding;
 	
 	bool Allocate(Linker * linker, LinkerObject* obj);
+	int BestStart(LinkerObject* lobj, int start, int end, int maxPadding, int& crossings) const;
 	void PlaceStackSection(LinkerSection* stackSection, LinkerSection* section);
 };
 
@@ -110,7 +121,7 @@ public:
 	uint32	mFlags;
 };
 
-class LinkerSection
+class LinkerSection : public GlobalArenaObject<LinkerSection>
 {
 public:
 	const Ident* mIdent;
@@ -137,7 +148,12 @@ static const uint32 LOBJF_STATIC_STACK	= 0x00000040;
 static const uint32 LOBJF_NO_CROSS		= 0x00000080;
 static const uint32 LOBJF_ZEROPAGE		= 0x00000100;
 
-class LinkerObject
+struct LinkerRange
+{
+	int	mStart, mEnd;
+};
+
+class LinkerObject : public GlobalArenaObject<LinkerObject>
 {
 public:
 	Location						mLocation;
@@ -164,8 +180,16 @@ public:
 
 	GrowingArray<LinkerReference*>	mReferences;
 
+	// Offset ranges of hot branches, that cost an extra cycle when their
+	// first and last byte are placed in different pages
+
+	GrowingArray<LinkerRange>		mNoCrossRanges;
+
 	void AddReference(const LinkerReference& ref);
 
+	int PageCrossings(int address) const;
+	void FindHotLoops(void);
+
 	void MoveToSection(LinkerSection* section);
 };
 
@@ -187,6 +211,10 @@ public:
 
 	LinkerObject * AddObject(const Location & location, const Ident* ident, LinkerSection * section, LinkerObjectType type, int alignment = 1);
 
+	// Objects created by NewObject are not part of the link until added
+	LinkerObject * NewObject(const Location& location, const Ident* ident, LinkerSection* section, LinkerObjectType type, int alignment = 1);
+	void AddObject(LinkerObject* obj);
+
 //	void AddReference(const LinkerReference& ref);
 
 	bool WritePrgFile(DiskImage * image);
@@ -219,5 +247,18 @@ protected:
 	NativeCodeDisassembler	mNativeDisassembler;
 	ByteCodeDisassembler	mByteCodeDisassembler;
 
+	// References grouped by their source object, the references of the
+	// object with mID i are mObjectReferences[mObjectReferenceStart[i]]
+	// up to mObjectReferences[mObjectReferenceStart[i + 1]]
+
+	GrowingArray<LinkerReference*>	mObjectReferences;
+	GrowingArray<int>				mObjectReferenceStart;
+
+	// Placed object for each address, built on first use after linking
+
+	LinkerObject				**	mObjectByAddr;
+
+	void BuildObjectByAddr(void);
+
 	Errors* mErrors;
 };
@@ -0,0 +1,558 @@
+#include "NativeCodeCache.h"
+#include "NativeCodeGenerator.h"
+#include "InterCode.h"
+#include "Linker.h"
+#include "CompilerTypes.h"
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+// Format of the key and the cached blocks, the version of the compiler
+// and a hash of its executable are added to the key, so entries of a
+// different release or build are not used
+
+static const char CacheVersion[] = "oscar64 native code cache 2";
+
+// Linker object flags that are inspected by the native code optimizer
+
+static const uint32 CacheObjectFlags = LOBJF_INLINE | LOBJF_ZEROPAGE;
+
+// Flags at the end of a block, used to replace jumps with branches
+
+static const int CPU_REG_C = 259;
+static const int CPU_REG_Z = 260;
+
+NativeCodeCacheKey::NativeCodeCacheKey(void)
+	: mData(0), mObjects(nullptr), mHash(0)
+{
+}
+
+void NativeCodeCacheKey::PutByte(uint8 b)
+{
+	mData.Push(b);
+}
+
+void NativeCodeCacheKey::PutInt(int i)
+{
+	PutByte(uint8(i));
+	PutByte(uint8(i >> 8));
+	PutByte(uint8(i >> 16));
+	PutByte(uint8(i >> 24));
+}
+
+void NativeCodeCacheKey::PutString(const char* str)
+{
+	int	i = 0;
+	while (str[i])
+		PutByte(str[i++]);
+	PutByte(0);
+}
+
+void NativeCodeCacheKey::PutObject(LinkerObject* obj)
+{
+	if (obj)
+	{
+		int	i = mObjects.IndexOf(obj);
+		if (i < 0)
+		{
+			i = mObjects.Size();
+			mObjects.Push(obj);
+		}
+		PutInt(i);
+	}
+	else
+		PutInt(-1);
+}
+
+class NativeCodeCacheReader
+{
+public:
+	NativeCodeCacheReader(const uint8* data, int size)
+		: mData(data), mSize(size), mPos(0), mFailed(false)
+	{
+	}
+
+	const uint8	*	mData;
+	int				mSize, mPos;
+	bool			mFailed;
+
+	uint8 GetByte(void)
+	{
+		if (mPos < mSize)
+			return mData[mPos++];
+		mFailed = true;
+		return 0;
+	}
+
+	int GetInt(void)
+	{
+		int	i = GetByte();
+		i |= GetByte() << 8;
+		i |= GetByte() << 16;
+		i |= GetByte() << 24;
+		return i;
+	}
+};
+
+NativeCodeCache::NativeCodeCache(const char* path, const char* version, uint64 build)
+	: mHits(0), mMisses(0), mStores(0), mBuild(build), mTempCount(0)
+{
+	for (int i = 0; i < NumBuckets; i++)
+		mEntries[i] = nullptr;
+
+	strcpy_s(mVersion, version);
+
+	mPath[0] = 0;
+	if (path)
+	{
+		strcpy_s(mPath, path);
+
+		int	n = int(strlen(mPath));
+		if (n > 0 && mPath[n - 1] != '/' && mPath[n - 1] != '\\')
+			strcat_s(mPath, "/");
+
+#ifdef _WIN32
+		_mkdir(path);
+#else
+		mkdir(path, 0777);
+#endif
+	}
+}
+
+NativeCodeCache::~NativeCodeCache(void)
+{
+	for (int i = 0; i < NumBuckets; i++)
+	{
+		while (mEntries[i])
+		{
+			Entry* e = mEntries[i];
+			mEntries[i] = e->mNext;
+			delete[] e->mData;
+			delete e;
+		}
+	}
+}
+
+void NativeCodeCache::BuildFileName(char* name, const NativeCodeCacheKey& key)
+{
+	sprintf_s(name, MAXPATHLEN, "%s%08x%08x.ncc", mPath, uint32(key.mHash >> 32), uint32(key.mHash));
+}
+
+void NativeCodeCache::CollectBlocks(NativeCodeBasicBlock* block, GrowingArray<NativeCodeBasicBlock*>& blocks)
+{
+	if (!block->mVisited)
+	{
+		block->mVisited = true;
+		block->mDataFlowIndex = blocks.Size();
+		blocks.Push(block);
+
+		if (block->mTrueJump) CollectBlocks(block->mTrueJump, blocks);
+		if (block->mFalseJump) CollectBlocks(block->mFalseJump, blocks);
+	}
+}
+
+void NativeCodeCache::PutInstruction(NativeCodeCacheKey& key, const NativeCodeInstruction& ins)
+{
+	key.PutByte(uint8(ins.mType));
+	key.PutByte(uint8(ins.mMode));
+	key.PutInt(ins.mAddress);
+	key.PutInt(ins.mParam);
+	key.PutInt(ins.mFlags);
+	key.PutInt(ins.mLive);
+	key.PutObject(ins.mLinkerObject);
+}
+
+bool NativeCodeCache::Load(NativeCodeProcedure* proc, NativeCodeCacheKey& key)
+{
+	InterCodeProcedure* iproc = proc->mInterProc;
+
+	key.PutString(CacheVersion);
+	key.PutString(mVersion);
+	key.PutInt(int(mBuild));
+	key.PutInt(int(mBuild >> 32));
+	uint64	options = iproc->mCompilerOptions & ~(COPT_VERBOSE | COPT_VERBOSE2 | COPT_TIME_REPORT);
+	key.PutInt(int(options));
+	key.PutInt(int(options >> 32));
+
+	key.PutByte(proc->mNoFrame);
+	key.PutInt(proc->mFrameOffset);
+	key.PutInt(proc->mStackExpand);
+	key.PutInt(proc->mTempSave);
+	key.PutInt(proc->mCommonFrameSize);
+
+	key.PutByte(iproc->mInterrupt);
+	key.PutByte(iproc->mHardwareInterrupt);
+	key.PutByte(iproc->mLeafProcedure);
+	key.PutInt(iproc->mTempSize);
+	key.PutInt(iproc->mCallerSavedTemps);
+	key.PutInt(iproc->mFreeCallerSavedTemps);
+	key.PutObject(iproc->mSaveTempsLinkerObject);
+	key.PutInt(iproc->mTempOffset.Size());
+	for (int i = 0; i < iproc->mTempOffset.Size(); i++)
+	{
+		key.PutInt(iproc->mTempOffset[i]);
+		key.PutInt(iproc->mTempSizes[i]);
+	}
+
+	GrowingArray<NativeCodeBasicBlock*>	blocks(nullptr);
+	proc->ResetVisited();
+	CollectBlocks(proc->mEntryBlock, blocks);
+	if (!proc->mExitBlock->mVisited)
+		CollectBlocks(proc->mExitBlock, blocks);
+
+	key.PutInt(blocks.Size());
+	key.PutInt(proc->mExitBlock->mDataFlowIndex);
+	for (int i = 0; i < blocks.Size(); i++)
+	{
+		NativeCodeBasicBlock* block = blocks[i];
+		key.PutByte(uint8(block->mBranch));
+		key.PutByte(block->mLocked);
+		key.PutInt(block->mTrueJump ? block->mTrueJump->mDataFlowIndex : -1);
+		key.PutInt(block->mFalseJump ? block->mFalseJump->mDataFlowIndex : -1);
+		key.PutInt(block->mIns.Size());
+		for (int j = 0; j < block->mIns.Size(); j++)
+			PutInstruction(key, block->mIns[j]);
+	}
+
+	for (int i = 0; i < key.mObjects.Size(); i++)
+	{
+		LinkerObject* obj = key.mObjects[i];
+		key.PutInt(obj->mFlags & CacheObjectFlags);
+		key.PutInt(obj->mAlignment);
+		key.PutInt(obj->mNumTemporaries);
+		for (int j = 0; j < obj->mNumTemporaries; j++)
+		{
+			key.PutByte(obj->mTemporaries[j]);
+			key.PutByte(obj->mTempSizes[j]);
+		}
+		key.PutInt(obj->mProc ? obj->mProc->mCallerSavedTemps : -1);
+		for (int j = 0; j < 8; j++)
+			key.PutInt(obj->mZeroPageSet.mBits[j]);
+	}
+
+	// FNV-1a hash of the key, the full key is stored with the value to
+	// rule out collisions
+
+	uint64	hash = 14695981039346656037ULL;
+	for (int i = 0; i < key.mData.Size(); i++)
+	{
+		hash ^= key.mData[i];
+		hash *= 1099511628211ULL;
+	}
+	key.mHash = hash;
+
+	const uint8	*	data = nullptr;
+	uint8		*	buffer = nullptr;
+	int				size = 0;
+
+	if (mPath[0])
+	{
+		char	name[MAXPATHLEN];
+		BuildFileName(name, key);
+
+		FILE* file;
+		if (fopen_s(&file, name, "rb") == 0)
+		{
+			fseek(file, 0, SEEK_END);
+			size = int(ftell(file));
+			fseek(file, 0, SEEK_SET);
+
+			buffer = new uint8[size > 0 ? size : 1];
+			if (size > 0 && int(fread(buffer, 1, size, file)) == size)
+				data = buffer;
+			fclose(file);
+		}
+	}
+	else
+	{
+		// Entries are never changed once they are in the table
+
+		std::lock_guard<std::mutex>	lock(mEntryLock);
+
+		Entry* e = mEntries[key.mHash % NumBuckets];
+		while (e && e->mHash != key.mHash)
+			e = e->mNext;
+		if (e)
+		{
+			data = e->mData;
+			size = e->mSize;
+		}
+	}
+
+	bool	valid = data != nullptr;
+
+	NativeCodeCacheReader	reader(data, size);
+
+	if (valid)
+	{
+		valid = size >= 4 && reader.GetInt() == key.mData.Size() && key.mData.Size() + 4 <= size && !memcmp(data + 4, &key.mData[0], key.mData.Size());
+		reader.mPos = key.mData.Size() + 4;
+	}
+
+	if (valid)
+	{
+		int	stackExpand = reader.GetInt();
+		int	tempSave = reader.GetInt();
+		int	commonFrameSize = reader.GetInt();
+
+		int	tempSize = reader.GetInt();
+		int	callerSavedTemps = reader.GetInt();
+
+		GrowingIntArray	tempOffset(0), tempSizes(0);
+		int	ntemps = reader.GetInt();
+		for (int i = 0; i < ntemps && !reader.mFailed; i++)
+		{
+			tempOffset.Push(reader.GetInt());
+			tempSizes.Push(reader.GetInt());
+		}
+
+		int	nblocks = reader.GetInt();
+		int	exitIndex = reader.GetInt();
+
+		valid = !reader.mFailed && ntemps == iproc->mTempOffset.Size() && nblocks > 0 && exitIndex >= 0 && exitIndex < nblocks;
+
+		// The blocks are only added to the procedure if the complete entry
+		// is valid, otherwise they remain unused in the arena
+
+		GrowingArray<NativeCodeBasicBlock*>	rblocks(nullptr);
+		for (int i = 0; valid && i < nblocks; i++)
+		{
+			NativeCodeBasicBlock* block = new NativeCodeBasicBlock();
+			block->mNoFrame = proc->mNoFrame;
+			block->mFrameOffset = proc->mFrameOffset;
+			rblocks.Push(block);
+		}
+
+		for (int i = 0; valid && i < nblocks; i++)
+		{
+			NativeCodeBasicBlock* block = rblocks[i];
+
+			block->mIndex = reader.GetInt();
+			block->mNumEntries = reader.GetInt();
+			block->mLocked = reader.GetByte() != 0;
+			block->mBranch = AsmInsType(reader.GetByte());
+			block->mNDataSet.SetMode(CPU_REG_C, NativeRegisterDataMode(reader.GetByte()));
+			block->mNDataSet.mRegs[CPU_REG_C].mValue = reader.GetInt();
+			block->mNDataSet.SetMode(CPU_REG_Z, NativeRegisterDataMode(reader.GetByte()));
+			block->mNDataSet.mRegs[CPU_REG_Z].mValue = reader.GetInt();
+
+			int	ti = reader.GetInt(), fi = reader.GetInt();
+			if (ti >= -1 && ti < nblocks && fi >= -1 && fi < nblocks)
+			{
+				block->mTrueJump = ti >= 0 ? rblocks[ti] : nullptr;
+				block->mFalseJump = fi >= 0 ? rblocks[fi] : nullptr;
+			}
+			else
+				valid = false;
+
+			int	nins = reader.GetInt();
+			for (int j = 0; j < nins && !reader.mFailed; j++)
+			{
+				NativeCodeInstruction	ins;
+				ins.mType = AsmInsType(reader.GetByte());
+				ins.mMode = AsmInsMode(reader.GetByte());
+				ins.mAddress = reader.GetInt();
+				ins.mParam = reader.GetInt();
+				ins.mFlags = reader.GetInt();
+				ins.mLive = reader.GetInt();
+
+				int	oi = reader.GetInt();
+				if (oi >= 0 && oi < key.mObjects.Size())
+					ins.mLinkerObject = key.mObjects[oi];
+				else if (oi != -1)
+					valid = false;
+
+				block->mIns.Push(ins);
+			}
+
+			if (reader.mFailed)
+				valid = false;
+		}
+
+		GrowingArray<uint8>	temporaries(0);
+		for (int i = 0; valid && i < key.mObjects.Size(); i++)
+		{
+			if (reader.GetInt() == key.mObjects[i]->mNumTemporaries)
+			{
+				for (int j = 0; j < key.mObjects[i]->mNumTemporaries; j++)
+					temporaries.Push(reader.GetByte());
+			}
+			else
+				valid = false;
+		}
+
+		if (reader.mFailed)
+			valid = false;
+
+		if (valid)
+		{
+			proc->mBlocks.SetSize(0);
+			for (int i = 0; i < nblocks; i++)
+				proc->mBlocks.Push(rblocks[i]);
+
+			proc->mEntryBlock = rblocks[0];
+			proc->mExitBlock = rblocks[exitIndex];
+
+			proc->mStackExpand = stackExpand;
+			proc->mTempSave = tempSave;
+			proc->mCommonFrameSize = commonFrameSize;
+
+			iproc->mTempSize = tempSize;
+			iproc->mCallerSavedTemps = callerSavedTemps;
+			for (int i = 0; i < ntemps; i++)
+			{
+				iproc->mTempOffset[i] = tempOffset[i];
+				iproc->mTempSizes[i] = tempSizes[i];
+			}
+
+			int	k = 0;
+			for (int i = 0; i < key.mObjects.Size(); i++)
+			{
+				LinkerObject* obj = key.mObjects[i];
+				for (int j = 0; j < obj->mNumTemporaries; j++)
+				{
+					if (obj->mTemporaries[j] != temporaries[k])
+						obj->mTemporaries[j] = temporaries[k];
+					k++;
+				}
+			}
+		}
+	}
+
+	delete[] buffer;
+
+	if (valid)
+		mHits++;
+	else
+		mMisses++;
+
+	return valid;
+}
+
+void NativeCodeCache::Store(NativeCodeProcedure* proc, const NativeCodeCacheKey& key)
+{
+	InterCodeProcedure* iproc = proc->mInterProc;
+
+	NativeCodeCacheKey	value;
+
+	value.PutInt(key.mData.Size());
+	for (int i = 0; i < key.mData.Size(); i++)
+		value.PutByte(key.mData[i]);
+
+	value.PutInt(proc->mStackExpand);
+	value.PutInt(proc->mTempSave);
+	value.PutInt(proc->mCommonFrameSize);
+
+	value.PutInt(iproc->mTempSize);
+	value.PutInt(iproc->mCallerSavedTemps);
+	value.PutInt(iproc->mTempOffset.Size());
+	for (int i = 0; i < iproc->mTempOffset.Size(); i++)
+	{
+		value.PutInt(iproc->mTempOffset[i]);
+		value.PutInt(iproc->mTempSizes[i]);
+	}
+
+	GrowingArray<NativeCodeBasicBlock*>	blocks(nullptr);
+	proc->ResetVisited();
+	CollectBlocks(proc->mEntryBlock, blocks);
+	if (!proc->mExitBlock->mVisited)
+		CollectBlocks(proc->mExitBlock, blocks);
+
+	value.PutInt(blocks.Size());
+	value.PutInt(proc->mExitBlock->mDataFlowIndex);
+	for (int i = 0; i < blocks.Size(); i++)
+	{
+		NativeCodeBasicBlock* block = blocks[i];
+		value.PutInt(block->mIndex);
+		value.PutInt(block->mNumEntries);
+		value.PutByte(block->mLocked);
+		value.PutByte(uint8(block->mBranch));
+		value.PutByte(uint8(block->mNDataSet.mRegs[CPU_REG_C].mMode));
+		value.PutInt(block->mNDataSet.mRegs[CPU_REG_C].mValue);
+		value.PutByte(uint8(block->mNDataSet.mRegs[CPU_REG_Z].mMode));
+		value.PutInt(block->mNDataSet.mRegs[CPU_REG_Z].mValue);
+		value.PutInt(block->mTrueJump ? block->mTrueJump->mDataFlowIndex : -1);
+		value.PutInt(block->mFalseJump ? block->mFalseJump->mDataFlowIndex : -1);
+		value.PutInt(block->mIns.Size());
+		for (int j = 0; j < block->mIns.Size(); j++)
+		{
+			const NativeCodeInstruction& ins(block->mIns[j]);
+
+			// Objects that were not part of the key can not be restored
+
+			int	oi = -1;
+			if (ins.mLinkerObject)
+			{
+				oi = key.mObjects.IndexOf(ins.mLinkerObject);
+				if (oi < 0)
+					return;
+			}
+
+			value.PutByte(uint8(ins.mType));
+			value.PutByte(uint8(ins.mMode));
+			value.PutInt(ins.mAddress);
+			value.PutInt(ins.mParam);
+			value.PutInt(ins.mFlags);
+			value.PutInt(ins.mLive);
+			value.PutInt(oi);
+		}
+	}
+
+	// The optimizer remaps the temporaries of inline assembler objects
+
+	for (int i = 0; i < key.mObjects.Size(); i++)
+	{
+		LinkerObject* obj = key.mObjects[i];
+		value.PutInt(obj->mNumTemporaries);
+		for (int j = 0; j < obj->mNumTemporaries; j++)
+			value.PutByte(obj->mTemporaries[j]);
+	}
+
+	if (mPath[0])
+	{
+		// Write to a file of its own and rename it, so concurrent compiles
+		// never see a partial entry
+
+		char	name[MAXPATHLEN], tname[MAXPATHLEN];
+		BuildFileName(name, key);
+#ifdef _WIN32
+		sprintf_s(tname, MAXPATHLEN, "%s.%d.%d.tmp", name, _getpid(), int(mTempCount++));
+#else
+		sprintf_s(tname, MAXPATHLEN, "%s.%d.%d.tmp", name, int(getpid()), int(mTempCount++));
+#endif
+
+		FILE* file;
+		if (fopen_s(&file, tname, "wb") == 0)
+		{
+			bool	written = int(fwrite(&value.mData[0], 1, value.mData.Size(), file)) == value.mData.Size();
+			if (fclose(file) == 0 && written && rename(tname, name) == 0)
+				mStores++;
+			else
+				remove(tname);
+		}
+	}
+	else
+	{
+		std::lock_guard<std::mutex>	lock(mEntryLock);
+
+		Entry* e = mEntries[key.mHash % NumBuckets];
+		while (e && e->mHash != key.mHash)
+			e = e->mNext;
+
+		if (!e)
+		{
+			e = new Entry();
+			e->mHash = key.mHash;
+			e->mSize = value.mData.Size();
+			e->mData = new uint8[e->mSize];
+			memcpy(e->mData, &value.mData[0], e->mSize);
+			e->mNext = mEntries[key.mHash % NumBuckets];
+			mEntries[key.mHash % NumBuckets] = e;
+			mStores++;
+		}
+	}
+}
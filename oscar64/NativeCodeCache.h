@@ -0,0 +1,77 @@
+#pragma once
+
+#include "MachineTypes.h"
+#include "Array.h"
+#include <atomic>
+#include <mutex>
+
+class NativeCodeProcedure;
+class NativeCodeBasicBlock;
+class NativeCodeInstruction;
+class LinkerObject;
+
+// Serialized state of a procedure before native code optimization, the
+// linker objects are referenced by their index in mObjects
+
+class NativeCodeCacheKey
+{
+public:
+	NativeCodeCacheKey(void);
+
+	GrowingArray<uint8>				mData;
+	GrowingArray<LinkerObject*>		mObjects;
+	uint64							mHash;
+
+	void PutByte(uint8 b);
+	void PutInt(int i);
+	void PutString(const char* str);
+	void PutObject(LinkerObject* obj);
+};
+
+// On disk cache of optimized native code.  Parsing, inlining and the global
+// analysis always see the whole program, but the optimization of the
+// native code of a procedure only depends on its translated code, the
+// compiler options and a few properties of the referenced linker objects.
+// These form the key, the value is the optimized block graph.
+//
+// Without a path the entries are kept in memory, which is used by the
+// server mode to carry unchanged procedures from one build to the next.
+
+class NativeCodeCache
+{
+public:
+	NativeCodeCache(const char* path, const char* version, uint64 build);
+	~NativeCodeCache(void);
+
+	// Build the key for the translated procedure and replace its blocks
+	// with the cached result if present
+
+	bool Load(NativeCodeProcedure* proc, NativeCodeCacheKey& key);
+
+	// Store the optimized blocks of the procedure under the key
+
+	void Store(NativeCodeProcedure* proc, const NativeCodeCacheKey& key);
+
+	std::atomic<int>	mHits, mMisses, mStores;
+protected:
+	char				mPath[MAXPATHLEN], mVersion[100];
+	uint64				mBuild;
+	std::atomic<int>	mTempCount;
+
+	struct Entry
+	{
+		uint64		mHash;
+		uint8	*	mData;
+		int			mSize;
+		Entry	*	mNext;
+	};
+
+	static const int	NumBuckets = 1024;
+
+	Entry			*	mEntries[NumBuckets];
+	std::mutex			mEntryLock;
+
+	void BuildFileName(char* name, const NativeCodeCacheKey& key);
+	void CollectBlocks(NativeCodeBasicBlock* block, GrowingArray<NativeCodeBasicBlock*>& blocks);
+	void PutInstruction(NativeCodeCacheKey& key, const NativeCodeInstruction& ins);
+};
@@ -1,5 +1,8 @@
 #include "NativeCodeGenerator.h"
 #include "CompilerTypes.h"
+#include "DataFlow.h"
+#include "NativeCodeCache.h"
+#include <atomic>
 
 static const int CPU_REG_A = 256;
 static const int CPU_REG_X = 257;
@@ -18,10 +21,25 @@ static const uint32 LIVE_MEM	   = 0x00000020;
 
 static const uint32 LIVE_ALL	   = 0x000000ff;
 
-static int GlobalValueNumber = 0;
+// Unknown register values are numbered uniquely, each thread takes chunks of
+// numbers from the global counter to avoid contention when compiling in parallel
+
+static std::atomic<int>		GlobalValueNumber(0);
+static thread_local int		LocalValueNumber = 0, LocalValueNumberEnd = 0;
+
+static inline int NextValueNumber(void)
+{
+	if (LocalValueNumber == LocalValueNumberEnd)
+	{
+		LocalValueNumber = GlobalValueNumber.fetch_add(0x10000);
+		LocalValueNumberEnd = LocalValueNumber + 0x10000;
+	}
+
+	return LocalValueNumber++;
+}
 
 NativeRegisterData::NativeRegisterData(void)
-	: mMode(NRDM_UNKNOWN), mValue(GlobalValueNumber++), mMask(0)
+	: mMode(NRDM_UNKNOWN), mValue(NextValueNumber()), mMask(0)
 {
 
 }
@@ -29,7 +47,7 @@ NativeRegisterData::NativeRegisterData(void)
 void NativeRegisterData::Reset(void)
 {
 	mMode = NRDM_UNKNOWN;
-	mValue = GlobalValueNumber++;
+	mValue = NextValueNumber();
 }
 
 void NativeRegisterData::ResetMask(void)
@@ -55,10 +73,18 @@ bool NativeRegisterData::SameData(const NativeRegisterData& d) const
 	}
 }
 
+NativeRegisterDataSet::NativeRegisterDataSet(void)
+{
+	for (int i = 0; i < 9; i++)
+		mCopies[i] = 0;
+}
+
 void NativeRegisterDataSet::Reset(void)
 {
 	for (int i = 0; i < NUM_REGS; i++)
 		mRegs[i].Reset();
+	for (int i = 0; i < 9; i++)
+		mCopies[i] = 0;
 }
 
 void NativeRegisterDataSet::ResetMask(void)
@@ -67,33 +93,87 @@ void NativeRegisterDataSet::ResetMask(void)
 		mRegs[i].ResetMask();
 }
 
+void NativeRegisterDataSet::SetMode(int reg, NativeRegisterDataMode mode)
+{
+	mRegs[reg].mMode = mode;
+	if (mode == NRDM_ZERO_PAGE || mode == NRDM_ABSOLUTE)
+		mCopies[reg >> 5] |= 1U << (reg & 31);
+}
 
+void NativeRegisterDataSet::Copy(int dst, int src)
+{
+	mRegs[dst] = mRegs[src];
+	if (mCopies[src >> 5] & (1U << (src & 31)))
+		mCopies[dst >> 5] |= 1U << (dst & 31);
+}
 
 void NativeRegisterDataSet::ResetZeroPage(int addr)
 {
 	mRegs[addr].Reset();
-	for (int i = 0; i < NUM_REGS; i++)
+	for (int w = 0; w < 9; w++)
 	{
-		if (mRegs[i].mMode == NRDM_ZERO_PAGE && mRegs[i].mValue == addr)
-			mRegs[i].Reset();
+		uint32	bits = mCopies[w];
+		for (int i = w * 32; bits; i++, bits >>= 1)
+		{
+			if (bits & 1)
+			{
+				if (mRegs[i].mMode == NRDM_ZERO_PAGE)
+				{
+					if (mRegs[i].mValue == addr)
+					{
+						mRegs[i].Reset();
+						mCopies[w] &= ~(1U << (i & 31));
+					}
+				}
+				else if (mRegs[i].mMode != NRDM_ABSOLUTE)
+					mCopies[w] &= ~(1U << (i & 31));
+			}
+		}
 	}
 }
 
 void NativeRegisterDataSet::ResetAbsolute(LinkerObject* linkerObject, int addr)
 {
-	for (int i = 0; i < NUM_REGS; i++)
+	for (int w = 0; w < 9; w++)
 	{
-		if (mRegs[i].mMode == NRDM_ABSOLUTE && mRegs[i].mLinkerObject == linkerObject && mRegs[i].mValue == addr)
-			mRegs[i].Reset();
+		uint32	bits = mCopies[w];
+		for (int i = w * 32; bits; i++, bits >>= 1)
+		{
+			if (bits & 1)
+			{
+				if (mRegs[i].mMode == NRDM_ABSOLUTE)
+				{
+					if (mRegs[i].mLinkerObject == linkerObject && mRegs[i].mValue == addr)
+					{
+						mRegs[i].Reset();
+						mCopies[w] &= ~(1U << (i & 31));
+					}
+				}
+				else if (mRegs[i].mMode != NRDM_ZERO_PAGE)
+					mCopies[w] &= ~(1U << (i & 31));
+			}
+		}
 	}
 }
 
 void NativeRegisterDataSet::ResetIndirect(void)
 {
-	for (int i = 0; i < NUM_REGS; i++)
+	for (int w = 0; w < 9; w++)
 	{
-		if (mRegs[i].mMode == NRDM_ABSOLUTE)
-			mRegs[i].Reset();
+		uint32	bits = mCopies[w];
+		for (int i = w * 32; bits; i++, bits >>= 1)
+		{
+			if (bits & 1)
+			{
+				if (mRegs[i].mMode == NRDM_ABSOLUTE)
+				{
+					mRegs[i].Reset();
+					mCopies[w] &= ~(1U << (i & 31));
+				}
+				else if (mRegs[i].mMode != NRDM_ZERO_PAGE)
+					mCopies[w] &= ~(1U << (i & 31));
+			}
+		}
 	}
 }
 
@@ -129,32 +209,45 @@ void NativeRegisterDataSet::Intersect(const NativeRegisterDataSet& set)
 		}
 	}
 
+	// Only the copies of this set can survive the intersection, so the
+	// other registers need not be visited again
+
 	bool	changed;
 	do
 	{
 		changed = false;
 
-		for (int i = 0; i < NUM_REGS; i++)
+		for (int w = 0; w < 9; w++)
 		{
-			if (mRegs[i].mMode == NRDM_ZERO_PAGE)
-			{
-				if (set.mRegs[i].mMode != NRDM_ZERO_PAGE || mRegs[i].mValue != set.mRegs[i].mValue)
-				{
-					mRegs[i].Reset();
-					changed = true;
-				}
-				else if (mRegs[mRegs[i].mValue].mValue != set.mRegs[set.mRegs[i].mValue].mValue)
-				{
-					mRegs[i].Reset();
-					changed = true;
-				}
-			}
-			else if (mRegs[i].mMode == NRDM_ABSOLUTE)
+			uint32	bits = mCopies[w];
+			for (int i = w * 32; bits; i++, bits >>= 1)
 			{
-				if (set.mRegs[i].mMode != NRDM_ABSOLUTE || mRegs[i].mValue != set.mRegs[i].mValue || mRegs[i].mLinkerObject != set.mRegs[i].mLinkerObject)
+				if (bits & 1)
 				{
-					mRegs[i].Reset();
-					changed = true;
+					if (mRegs[i].mMode == NRDM_ZERO_PAGE)
+					{
+						if (set.mRegs[i].mMode != NRDM_ZERO_PAGE || mRegs[i].mValue != set.mRegs[i].mValue)
+						{
+							mRegs[i].Reset();
+							changed = true;
+						}
+						else if (mRegs[mRegs[i].mValue].mValue != set.mRegs[set.mRegs[i].mValue].mValue)
+						{
+							mRegs[i].Reset();
+							changed = true;
+						}
+					}
+					else if (mRegs[i].mMode == NRDM_ABSOLUTE)
+					{
+						if (set.mRegs[i].mMode != NRDM_ABSOLUTE || mRegs[i].mValue != set.mRegs[i].mValue || mRegs[i].mLinkerObject != set.mRegs[i].mLinkerObject)
+						{
+							mRegs[i].Reset();
+							changed = true;
+						}
+					}
+
+					if (mRegs[i].mMode != NRDM_ZERO_PAGE && mRegs[i].mMode != NRDM_ABSOLUTE)
+						mCopies[w] &= ~(1U << (i & 31));
 				}
 			}
 		}
@@ -1083,6 +1176,36 @@ bool NativeCodeInstruction::IsSimpleJSR(void) const
 	return mType == ASMIT_JSR && mMode == ASMIM_ABSOLUTE && !(mLinkerObject && (mLinkerObject->mFlags & LOBJF_INLINE));
 }
 
+int NativeCodeInstruction::Cycles(void) const
+{
+	if (mMode == ASMIM_IMMEDIATE_ADDRESS)
+		return AsmInsCycles(mType, ASMIM_IMMEDIATE);
+	else if (IsZeroPageAbsolute())
+	{
+		if (mMode == ASMIM_ABSOLUTE && HasAsmInstructionMode(mType, ASMIM_ZERO_PAGE))
+			return AsmInsCycles(mType, ASMIM_ZERO_PAGE);
+		else if (mMode == ASMIM_ABSOLUTE_X && HasAsmInstructionMode(mType, ASMIM_ZERO_PAGE_X))
+			return AsmInsCycles(mType, ASMIM_ZERO_PAGE_X);
+		else if (mMode == ASMIM_ABSOLUTE_Y && HasAsmInstructionMode(mType, ASMIM_ZERO_PAGE_Y))
+			return AsmInsCycles(mType, ASMIM_ZERO_PAGE_Y);
+	}
+
+	return AsmInsCycles(mType, mMode);
+}
+
+bool NativeCodeInstruction::IsZeroPageAbsolute(void) const
+{
+	if (mMode == ASMIM_ABSOLUTE || mMode == ASMIM_ABSOLUTE_X || mMode == ASMIM_ABSOLUTE_Y)
+	{
+		if (mLinkerObject)
+			return (mLinkerObject->mFlags & LOBJF_ZEROPAGE) != 0;
+		else
+			return mAddress < 256;
+	}
+	else
+		return false;
+}
+
 bool NativeCodeInstruction::IsShift(void) const
 {
 	return mType == ASMIT_ASL || mType == ASMIT_LSR || mType == ASMIT_ROL || mType == ASMIT_ROR;
@@ -1328,6 +1451,7 @@ void NativeCodeInstruction::Simulate(NativeRegisterDataSet& data)
 		{
 			data.mRegs[BC_REG_ACCU + i].Reset();
 			data.mRegs[BC_REG_WORK + i].Reset();
+			data.mRegs[BC_REG_WORK + 4 + i].Reset();
 			data.mRegs[BC_REG_ADDR + i].Reset();
 		}
 		data.mRegs[BC_REG_WORK_Y].Reset();
@@ -1933,7 +2057,7 @@ void NativeCodeInstruction::Simulate(NativeRegisterDataSet& data)
 		{
 			if (data.mRegs[CPU_REG_A].mMode == NRDM_IMMEDIATE || data.mRegs[CPU_REG_A].mMode == NRDM_IMMEDIATE_ADDRESS)
 			{
-				data.mRegs[reg] = data.mRegs[CPU_REG_A];
+				data.Copy(reg, CPU_REG_A);
 			}
 			else
 			{
@@ -2300,6 +2424,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 		{
 			data.ResetZeroPage(BC_REG_ACCU + i);
 			data.ResetZeroPage(BC_REG_WORK + i);
+			data.ResetZeroPage(BC_REG_WORK + 4 + i);
 			data.ResetZeroPage(BC_REG_ADDR + i);
 		}
 		data.ResetZeroPage(BC_REG_WORK_Y);
@@ -2669,7 +2794,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 		break;
 
 	case ASMIT_TXA:
-		data.mRegs[CPU_REG_A] = data.mRegs[CPU_REG_X];
+		data.Copy(CPU_REG_A, CPU_REG_X);
 		if (data.mRegs[CPU_REG_A].mMode == NRDM_IMMEDIATE)
 		{
 			data.mRegs[CPU_REG_Z].mMode = NRDM_IMMEDIATE;
@@ -2679,7 +2804,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 			data.mRegs[CPU_REG_Z].Reset();
 		break;
 	case ASMIT_TYA:
-		data.mRegs[CPU_REG_A] = data.mRegs[CPU_REG_Y];
+		data.Copy(CPU_REG_A, CPU_REG_Y);
 		if (data.mRegs[CPU_REG_A].mMode == NRDM_IMMEDIATE)
 		{
 			data.mRegs[CPU_REG_Z].mMode = NRDM_IMMEDIATE;
@@ -2689,7 +2814,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 			data.mRegs[CPU_REG_Z].Reset();
 		break;
 	case ASMIT_TAX:
-		data.mRegs[CPU_REG_X] = data.mRegs[CPU_REG_A];
+		data.Copy(CPU_REG_X, CPU_REG_A);
 		if (data.mRegs[CPU_REG_A].mMode == NRDM_IMMEDIATE)
 		{
 			data.mRegs[CPU_REG_Z].mMode = NRDM_IMMEDIATE;
@@ -2699,7 +2824,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 			data.mRegs[CPU_REG_Z].Reset();
 		break;
 	case ASMIT_TAY:
-		data.mRegs[CPU_REG_Y] = data.mRegs[CPU_REG_A];
+		data.Copy(CPU_REG_Y, CPU_REG_A);
 		if (data.mRegs[CPU_REG_A].mMode == NRDM_IMMEDIATE)
 		{
 			data.mRegs[CPU_REG_Z].mMode = NRDM_IMMEDIATE;
@@ -2754,14 +2879,14 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 			}
 			else if (data.mRegs[mAddress].mMode == NRDM_IMMEDIATE)
 			{
-				data.mRegs[CPU_REG_A] = data.mRegs[mAddress];
+				data.Copy(CPU_REG_A, mAddress);
 				mAddress = data.mRegs[CPU_REG_A].mValue;
 				mMode = ASMIM_IMMEDIATE;
 				changed = true;
 			}
 			else if (data.mRegs[mAddress].mMode == NRDM_IMMEDIATE_ADDRESS)
 			{
-				data.mRegs[CPU_REG_A] = data.mRegs[mAddress];
+				data.Copy(CPU_REG_A, mAddress);
 				mAddress = data.mRegs[CPU_REG_A].mValue;
 				mLinkerObject = data.mRegs[CPU_REG_A].mLinkerObject;
 				mFlags = (mFlags & ~(NCIF_LOWER | NCIF_UPPER)) | (data.mRegs[CPU_REG_A].mFlags & (NCIF_LOWER | NCIF_UPPER));
@@ -2785,7 +2910,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 			}
 			else if (data.mRegs[mAddress].mMode == NRDM_ZERO_PAGE)
 			{
-				data.mRegs[CPU_REG_A] = data.mRegs[mAddress];
+				data.Copy(CPU_REG_A, mAddress);
 				mAddress = data.mRegs[CPU_REG_A].mValue;
 				changed = true;
 			}
@@ -2793,7 +2918,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 			{
 				mType = ASMIT_TXA;
 				mMode = ASMIM_IMPLIED;
-				data.mRegs[CPU_REG_A] = data.mRegs[CPU_REG_X];
+				data.Copy(CPU_REG_A, CPU_REG_X);
 				changed = true;
 			}
 #if 1
@@ -2801,7 +2926,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 			{	
 				mType = ASMIT_TYA;
 				mMode = ASMIM_IMPLIED;
-				data.mRegs[CPU_REG_A] = data.mRegs[CPU_REG_Y];
+				data.Copy(CPU_REG_A, CPU_REG_Y);
 				changed = true;
 			}
 #endif
@@ -2819,7 +2944,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 				}
 				else
 				{
-					data.mRegs[CPU_REG_A].mMode = NRDM_ZERO_PAGE;
+					data.SetMode(CPU_REG_A, NRDM_ZERO_PAGE);
 					data.mRegs[CPU_REG_A].mValue = mAddress;
 				}
 			}
@@ -2834,7 +2959,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 			}
 			else if (data.mRegs[mAddress].mMode == NRDM_IMMEDIATE)
 			{
-				data.mRegs[CPU_REG_X] = data.mRegs[mAddress];
+				data.Copy(CPU_REG_X, mAddress);
 				mAddress = data.mRegs[CPU_REG_X].mValue;
 				mMode = ASMIM_IMMEDIATE;
 				changed = true;
@@ -2843,20 +2968,20 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 			{
 				mType = ASMIT_TAX;
 				mMode = ASMIM_IMPLIED;
-				data.mRegs[CPU_REG_X] = data.mRegs[CPU_REG_A];
+				data.Copy(CPU_REG_X, CPU_REG_A);
 				changed = true;
 			}
 			else if (data.mRegs[mAddress].SameData(data.mRegs[CPU_REG_A]))
 			{
 				mType = ASMIT_TAX;
 				mMode = ASMIM_IMPLIED;
-				data.mRegs[CPU_REG_X] = data.mRegs[CPU_REG_A];
+				data.Copy(CPU_REG_X, CPU_REG_A);
 				changed = true;
 			}
 #if 1
 			else if (data.mRegs[mAddress].mMode == NRDM_ZERO_PAGE)
 			{
-				data.mRegs[CPU_REG_X] = data.mRegs[mAddress];
+				data.Copy(CPU_REG_X, mAddress);
 				mAddress = data.mRegs[CPU_REG_X].mValue;
 				changed = true;
 			}
@@ -2871,7 +2996,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 				}
 				else
 				{
-					data.mRegs[CPU_REG_X].mMode = NRDM_ZERO_PAGE;
+					data.SetMode(CPU_REG_X, NRDM_ZERO_PAGE);
 					data.mRegs[CPU_REG_X].mValue = mAddress;
 				}
 			}
@@ -2886,7 +3011,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 			}
 			else if (data.mRegs[mAddress].mMode == NRDM_IMMEDIATE)
 			{
-				data.mRegs[CPU_REG_Y] = data.mRegs[mAddress];
+				data.Copy(CPU_REG_Y, mAddress);
 				mAddress = data.mRegs[CPU_REG_Y].mValue;
 				mMode = ASMIM_IMMEDIATE;
 				changed = true;
@@ -2895,20 +3020,20 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 			{
 				mType = ASMIT_TAY;
 				mMode = ASMIM_IMPLIED;
-				data.mRegs[CPU_REG_Y] = data.mRegs[CPU_REG_A];
+				data.Copy(CPU_REG_Y, CPU_REG_A);
 				changed = true;
 			}
 			else if (data.mRegs[mAddress].SameData(data.mRegs[CPU_REG_A]))
 			{
 				mType = ASMIT_TAY;
 				mMode = ASMIM_IMPLIED;
-				data.mRegs[CPU_REG_Y] = data.mRegs[CPU_REG_A];
+				data.Copy(CPU_REG_Y, CPU_REG_A);
 				changed = true;
 			}
 #if 1
 			else if (data.mRegs[mAddress].mMode == NRDM_ZERO_PAGE)
 			{
-				data.mRegs[CPU_REG_Y] = data.mRegs[mAddress];
+				data.Copy(CPU_REG_Y, mAddress);
 				mAddress = data.mRegs[CPU_REG_Y].mValue;
 				changed = true;
 			}
@@ -2923,7 +3048,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 				}
 				else
 				{
-					data.mRegs[CPU_REG_Y].mMode = NRDM_ZERO_PAGE;
+					data.SetMode(CPU_REG_Y, NRDM_ZERO_PAGE);
 					data.mRegs[CPU_REG_Y].mValue = mAddress;
 				}
 			}
@@ -2961,7 +3086,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 			data.ResetZeroPage(mAddress);
 			if (data.mRegs[CPU_REG_A].mMode == NRDM_IMMEDIATE || data.mRegs[CPU_REG_A].mMode == NRDM_IMMEDIATE_ADDRESS)
 			{
-				data.mRegs[mAddress] = data.mRegs[CPU_REG_A];
+				data.Copy(mAddress, CPU_REG_A);
 			}
 			else if (data.mRegs[CPU_REG_A].mMode == NRDM_ZERO_PAGE)
 			{
@@ -2970,25 +3095,25 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 					(mAddress >= BC_REG_FPARAMS && mAddress < BC_REG_FPARAMS_END) &&
 					!(data.mRegs[CPU_REG_A].mValue >= BC_REG_FPARAMS && data.mRegs[CPU_REG_A].mValue < BC_REG_FPARAMS_END))
 				{
-					data.mRegs[data.mRegs[CPU_REG_A].mValue].mMode = NRDM_ZERO_PAGE;
+					data.SetMode(data.mRegs[CPU_REG_A].mValue, NRDM_ZERO_PAGE);
 					data.mRegs[data.mRegs[CPU_REG_A].mValue].mValue = mAddress;
 					data.mRegs[mAddress].mMode = NRDM_UNKNOWN;
 				}
 				else
 #endif	
 				{
-					data.mRegs[mAddress].mMode = NRDM_ZERO_PAGE;
+					data.SetMode(mAddress, NRDM_ZERO_PAGE);
 					data.mRegs[mAddress].mValue = data.mRegs[CPU_REG_A].mValue;
 				}
 
 			}
 			else if (data.mRegs[CPU_REG_A].mMode == NRDM_ABSOLUTE)
 			{
-				data.mRegs[mAddress] = data.mRegs[CPU_REG_A];
+				data.Copy(mAddress, CPU_REG_A);
 			}
 			else
 			{
-				data.mRegs[CPU_REG_A].mMode = NRDM_ZERO_PAGE;
+				data.SetMode(CPU_REG_A, NRDM_ZERO_PAGE);
 				data.mRegs[CPU_REG_A].mValue = mAddress;
 			}
 			break;
@@ -3001,16 +3126,16 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 			}
 			else if (data.mRegs[CPU_REG_X].mMode == NRDM_ZERO_PAGE)
 			{
-				data.mRegs[mAddress].mMode = NRDM_ZERO_PAGE;
+				data.SetMode(mAddress, NRDM_ZERO_PAGE);
 				data.mRegs[mAddress].mValue = data.mRegs[CPU_REG_X].mValue;
 			}
 			else if (data.mRegs[CPU_REG_X].mMode == NRDM_ABSOLUTE)
 			{
-				data.mRegs[mAddress] = data.mRegs[CPU_REG_X];
+				data.Copy(mAddress, CPU_REG_X);
 			}
 			else
 			{
-				data.mRegs[CPU_REG_X].mMode = NRDM_ZERO_PAGE;
+				data.SetMode(CPU_REG_X, NRDM_ZERO_PAGE);
 				data.mRegs[CPU_REG_X].mValue = mAddress;
 			}
 			break;
@@ -3023,16 +3148,16 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 			}
 			else if (data.mRegs[CPU_REG_Y].mMode == NRDM_ZERO_PAGE)
 			{
-				data.mRegs[mAddress].mMode = NRDM_ZERO_PAGE;
+				data.SetMode(mAddress, NRDM_ZERO_PAGE);
 				data.mRegs[mAddress].mValue = data.mRegs[CPU_REG_Y].mValue;
 			}
 			else if (data.mRegs[CPU_REG_Y].mMode == NRDM_ABSOLUTE)
 			{
-				data.mRegs[mAddress] = data.mRegs[CPU_REG_Y];
+				data.Copy(mAddress, CPU_REG_Y);
 			}
 			else
 			{
-				data.mRegs[CPU_REG_Y].mMode = NRDM_ZERO_PAGE;
+				data.SetMode(CPU_REG_Y, NRDM_ZERO_PAGE);
 				data.mRegs[CPU_REG_Y].mValue = mAddress;
 			}
 			break;
@@ -3054,14 +3179,14 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 		case ASMIT_LDA:
 			if (data.mRegs[CPU_REG_Y].mMode == NRDM_IMMEDIATE && data.mRegs[CPU_REG_Y].mValue == mAddress)
 			{
-				data.mRegs[CPU_REG_A] = data.mRegs[CPU_REG_Y];
+				data.Copy(CPU_REG_A, CPU_REG_Y);
 				mType = ASMIT_TYA;
 				mMode = ASMIM_IMPLIED;
 				changed = true;
 			}
 			else if (data.mRegs[CPU_REG_X].mMode == NRDM_IMMEDIATE && data.mRegs[CPU_REG_X].mValue == mAddress)
 			{
-				data.mRegs[CPU_REG_A] = data.mRegs[CPU_REG_X];
+				data.Copy(CPU_REG_A, CPU_REG_X);
 				mType = ASMIT_TXA;
 				mMode = ASMIM_IMPLIED;
 				changed = true;
@@ -3070,7 +3195,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 		case ASMIT_LDX:
 			if (data.mRegs[CPU_REG_A].mMode == NRDM_IMMEDIATE && data.mRegs[CPU_REG_A].mValue == mAddress)
 			{
-				data.mRegs[CPU_REG_X] = data.mRegs[CPU_REG_A];
+				data.Copy(CPU_REG_X, CPU_REG_A);
 				mType = ASMIT_TAX;
 				mMode = ASMIM_IMPLIED;
 				changed = true;
@@ -3079,7 +3204,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 		case ASMIT_LDY:
 			if (data.mRegs[CPU_REG_A].mMode == NRDM_IMMEDIATE && data.mRegs[CPU_REG_A].mValue == mAddress)
 			{
-				data.mRegs[CPU_REG_Y] = data.mRegs[CPU_REG_A];
+				data.Copy(CPU_REG_Y, CPU_REG_A);
 				mType = ASMIT_TAY;
 				mMode = ASMIM_IMPLIED;
 				changed = true;
@@ -3128,7 +3253,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 				}
 				else
 				{
-					data.mRegs[CPU_REG_A].mMode = NRDM_ABSOLUTE;
+					data.SetMode(CPU_REG_A, NRDM_ABSOLUTE);
 					data.mRegs[CPU_REG_A].mLinkerObject = mLinkerObject;
 					data.mRegs[CPU_REG_A].mValue = mAddress;
 					data.mRegs[CPU_REG_A].mFlags = mFlags;
@@ -3151,7 +3276,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 				}
 				else
 				{
-					data.mRegs[CPU_REG_Y].mMode = NRDM_ABSOLUTE;
+					data.SetMode(CPU_REG_Y, NRDM_ABSOLUTE);
 					data.mRegs[CPU_REG_Y].mLinkerObject = mLinkerObject;
 					data.mRegs[CPU_REG_Y].mValue = mAddress;
 					data.mRegs[CPU_REG_Y].mFlags = mFlags;
@@ -3174,7 +3299,7 @@ bool NativeCodeInstruction::ValueForwarding(NativeRegisterDataSet& data, AsmInsT
 				}
 				else
 				{
-					data.mRegs[CPU_REG_X].mMode = NRDM_ABSOLUTE;
+					data.SetMode(CPU_REG_X, NRDM_ABSOLUTE);
 					data.mRegs[CPU_REG_X].mLinkerObject = mLinkerObject;
 					data.mRegs[CPU_REG_X].mValue = mAddress;
 					data.mRegs[CPU_REG_X].mFlags = mFlags;
@@ -3663,7 +3788,7 @@ void NativeCodeInstruction::Assemble(NativeCodeBasicBlock* block)
 					rl.mOffset++;
 				}
 
-				if (mode != ASMIM_ABSOLUTE)
+				if (mode == ASMIM_INDIRECT)
 					mLinkerObject->mFlags |= LOBJF_NO_CROSS;
 
 				block->mRelocations.Push(rl);
@@ -5866,9 +5991,9 @@ NativeCodeBasicBlock * NativeCodeBasicBlock::CopyValue(InterCodeProcedure* proc,
 	if (ins->mVolatile)
 		flags |= NCIF_VOLATILE;
 
-	if (nproc->mGenerator->mCompilerOptions & COPT_OPTIMIZE_AUTO_UNROLL)
+	if (nproc->mInterProc->mCompilerOptions & COPT_OPTIMIZE_AUTO_UNROLL)
 		msize = 8;
-	else if (nproc->mGenerator->mCompilerOptions & COPT_OPTIMIZE_CODE_SIZE)
+	else if (nproc->mInterProc->mCompilerOptions & COPT_OPTIMIZE_CODE_SIZE)
 		msize = 2;
 #if 1
 	if (ins->mSrc[0].mTemp < 0 && ins->mSrc[1].mTemp < 0)
@@ -10133,34 +10258,14 @@ void NativeCodeBasicBlock::BuildGlobalProvidedRegSet(NumberSet fromProvidedRegs)
 
 }
 
-bool NativeCodeBasicBlock::BuildGlobalRequiredRegSet(NumberSet& fromRequiredRegs)
+bool NativeCodeBasicBlock::BuildGlobalRequiredRegSet(void)
 {
-	bool revisit = false;
-
-	if (!mVisited)
-	{
-		mVisited = true;
-
-		NumberSet	newRequiredRegs(mExitRequiredRegs);
-
-		if (mTrueJump && mTrueJump->BuildGlobalRequiredRegSet(newRequiredRegs)) revisit = true;
-		if (mFalseJump && mFalseJump->BuildGlobalRequiredRegSet(newRequiredRegs)) revisit = true;
-
-		if (!(newRequiredRegs <= mExitRequiredRegs))
-		{
-			revisit = true;
-
-			mExitRequiredRegs = newRequiredRegs;
-			newRequiredRegs -= mLocalProvidedRegs;
-			mEntryRequiredRegs |= newRequiredRegs;
-		}
-
-	}
-
-	fromRequiredRegs |= mEntryRequiredRegs;
+	bool	changed = false;
 
-	return revisit;
+	if (mTrueJump && mExitRequiredRegs.Union(mTrueJump->mEntryRequiredRegs)) changed = true;
+	if (mFalseJump && mExitRequiredRegs.Union(mFalseJump->mEntryRequiredRegs)) changed = true;
 
+	return changed && mEntryRequiredRegs.UnionExcept(mExitRequiredRegs, mLocalProvidedRegs);
 }
 
 bool NativeCodeBasicBlock::RemoveUnusedResultInstructions(void)
@@ -10286,6 +10391,8 @@ void NativeCodeBasicBlock::CountEntries(NativeCodeBasicBlock * fromJump)
 			mTrueJump->CountEntries(this);
 		if (mFalseJump)
 			mFalseJump->CountEntries(this);
+		for (int i = 0; i < mCaseJumps.Size(); i++)
+			mCaseJumps[i]->CountEntries(this);
 
 		mVisiting = false;
 	}
@@ -10586,6 +10693,10 @@ void NativeCodeBasicBlock::BuildEntryDataSet(const NativeRegisterDataSet& set)
 			mTrueJump->BuildEntryDataSet(mNDataSet);
 		if (mFalseJump)
 			mFalseJump->BuildEntryDataSet(mNDataSet);
+
+		NativeRegisterDataSet	unknown;
+		for (int i = 0; i < mCaseJumps.Size(); i++)
+			mCaseJumps[i]->BuildEntryDataSet(unknown);
 	}
 }
 
@@ -14495,10 +14606,17 @@ bool NativeCodeBasicBlock::CheckSingleUseGlobalLoad(const NativeCodeBasicBlock*
 						return false;
 					if (!HasAsmInstructionMode(ins.mType, ains.mMode))
 						return false;
+
+					// Each use pays the difference to the zero page access, the
+					// budget is the cycles of the removed load and store
+
+					cycles -= AsmInsCycles(ins.mType, ains.mMode) - ins.Cycles();
+					if (cycles <= 0)
+						return false;
+
 					if (ins.mLive & LIVE_MEM)
 					{
-						cycles--;
-						if (cycles == 0)
+						if (ains.mFlags & NCIF_VOLATILE)
 							return false;
 					}
 					else
@@ -14613,10 +14731,10 @@ bool NativeCodeBasicBlock::CheckForwardSumYPointer(const NativeCodeBasicBlock* b
 {
 	if (!mPatched)
 	{
-		mPatched = true;
-
 		if (at == 0)
 		{
+			mPatched = true;
+
 			if (!mEntryRequiredRegs[reg] && !mEntryRequiredRegs[reg + 1])
 				return true;
 
@@ -14780,10 +14898,10 @@ bool NativeCodeBasicBlock::CheckGlobalAddressSumYPointer(const NativeCodeBasicBl
 {
 	if (!mPatched)
 	{
-		mPatched = true;
-
 		if (at == 0)
 		{
+			mPatched = true;
+
 			if (!mEntryRequiredRegs[reg] && !mEntryRequiredRegs[reg + 1])
 				return true;
 
@@ -18008,6 +18126,7 @@ bool NativeCodeBasicBlock::ValueForwarding(const NativeRegisterDataSet& data, bo
 						{
 							mNDataSet.ResetZeroPage(BC_REG_ACCU + i);
 							mNDataSet.ResetZeroPage(BC_REG_WORK + i);
+							mNDataSet.ResetZeroPage(BC_REG_WORK + 4 + i);
 							mNDataSet.ResetZeroPage(BC_REG_ADDR + i);
 						}
 						mNDataSet.ResetZeroPage(BC_REG_WORK_Y);
@@ -18036,12 +18155,12 @@ bool NativeCodeBasicBlock::ValueForwarding(const NativeRegisterDataSet& data, bo
 
 				if (loopy)
 				{
-					mNDataSet.mRegs[CPU_REG_Y].mMode = NRDM_ZERO_PAGE;
+					mNDataSet.SetMode(CPU_REG_Y, NRDM_ZERO_PAGE);
 					mNDataSet.mRegs[CPU_REG_Y].mValue = loopya;
 				}
 				if (loopx)
 				{
-					mNDataSet.mRegs[CPU_REG_X].mMode = NRDM_ZERO_PAGE;
+					mNDataSet.SetMode(CPU_REG_X, NRDM_ZERO_PAGE);
 					mNDataSet.mRegs[CPU_REG_X].mValue = loopxa;
 				}
 
@@ -19176,6 +19295,14 @@ bool NativeCodeBasicBlock::SimpleLoopReversal(NativeCodeProcedure* proc)
 	return changed;
 }
 
+int NativeCodeBasicBlock::InstructionCycles(void) const
+{
+	int	cycles = 0;
+	for (int i = 0; i < mIns.Size(); i++)
+		cycles += mIns[i].Cycles();
+	return cycles;
+}
+
 bool NativeCodeBasicBlock::OptimizeSimpleLoop(NativeCodeProcedure * proc)
 {
 	if (!mVisited)
@@ -19243,6 +19370,9 @@ bool NativeCodeBasicBlock::OptimizeSimpleLoop(NativeCodeProcedure * proc)
 
 			if (simple)
 			{
+				// The counter moves into an index register, if the cycles of the
+				// new loop body are not above the cycles of the original body
+
 				if ((mIns[sz - 3].mType == ASMIT_INC || mIns[sz - 3].mType == ASMIT_DEC) && mIns[sz - 3].mMode == ASMIM_ZERO_PAGE &&
 					mIns[sz - 2].mType == ASMIT_LDA && mIns[sz - 2].mMode == ASMIM_ZERO_PAGE && mIns[sz - 3].mAddress == mIns[sz - 2].mAddress &&
 					mIns[sz - 1].mType == ASMIT_CMP && mIns[sz - 1].mMode == ASMIM_IMMEDIATE && !(mIns[sz - 1].mLive & LIVE_CPU_REG_A) &&
@@ -19316,8 +19446,6 @@ bool NativeCodeBasicBlock::OptimizeSimpleLoop(NativeCodeProcedure * proc)
 						yinc = 0;
 						for (int i = 0; i + 3 < sz; i++)
 						{
-							mIns[i].mLive |= LIVE_CPU_REG_Y;
-
 							if (mIns[i].mType == ASMIT_LDA && mIns[i].mMode == ASMIM_ZERO_PAGE && mIns[i].mAddress == zreg)
 								lblock->mIns.Push(NativeCodeInstruction(ASMIT_TYA, ASMIM_IMPLIED));
 							else if (mIns[i].mType == ASMIT_LDY)
@@ -19350,29 +19478,37 @@ bool NativeCodeBasicBlock::OptimizeSimpleLoop(NativeCodeProcedure * proc)
 						}
 
 						lblock->mIns.Push(NativeCodeInstruction(ASMIT_CPY, ASMIM_IMMEDIATE, limit));
-						lblock->mBranch = mBranch;
-						lblock->mTrueJump = lblock;
-						lblock->mFalseJump = eblock;
+						for (int i = 0; i < lblock->mIns.Size(); i++)
+							lblock->mIns[i].mLive |= LIVE_CPU_REG_Y;
 
-						eblock->mIns.Push(NativeCodeInstruction(ASMIT_STY, ASMIM_ZERO_PAGE, zreg));
-						eblock->mBranch = ASMIT_JMP;
-						eblock->mTrueJump = mFalseJump;
-						eblock->mFalseJump = nullptr;
+						// Keep the loop if the index register version is slower
 
+						if (lblock->InstructionCycles() <= InstructionCycles())
+						{
+							lblock->mBranch = mBranch;
+							lblock->mTrueJump = lblock;
+							lblock->mFalseJump = eblock;
 
-						mIns.SetSize(0);
-						mIns.Push(NativeCodeInstruction(ASMIT_LDY, ASMIM_ZERO_PAGE, zreg));
-						mBranch = ASMIT_JMP;
-						mTrueJump = lblock;
-						mFalseJump = nullptr;
+							eblock->mIns.Push(NativeCodeInstruction(ASMIT_STY, ASMIM_ZERO_PAGE, zreg));
+							eblock->mBranch = ASMIT_JMP;
+							eblock->mTrueJump = mFalseJump;
+							eblock->mFalseJump = nullptr;
 
-						lblock->OptimizeSimpleLoopInvariant(proc, this, eblock);
 
-						lblock->CheckLive();
+							mIns.SetSize(0);
+							mIns.Push(NativeCodeInstruction(ASMIT_LDY, ASMIM_ZERO_PAGE, zreg));
+							mBranch = ASMIT_JMP;
+							mTrueJump = lblock;
+							mFalseJump = nullptr;
 
-						changed = true;
+							lblock->OptimizeSimpleLoopInvariant(proc, this, eblock);
 
-						assert(mIns.Size() == 0 || mIns[0].mType != ASMIT_INV);
+							lblock->CheckLive();
+
+							changed = true;
+
+							assert(mIns.Size() == 0 || mIns[0].mType != ASMIT_INV);
+						}
 					}
 					else if (!xother)
 					{
@@ -19388,8 +19524,6 @@ bool NativeCodeBasicBlock::OptimizeSimpleLoop(NativeCodeProcedure * proc)
 						xinc = 0;
 						for (int i = 0; i + 3 < sz; i++)
 						{
-							mIns[i].mLive |= LIVE_CPU_REG_X;
-
 							if (mIns[i].mType == ASMIT_LDA && mIns[i].mMode == ASMIM_ZERO_PAGE && mIns[i].mAddress == zreg)
 								lblock->mIns.Push(NativeCodeInstruction(ASMIT_TXA, ASMIM_IMPLIED));
 							else if (mIns[i].mType == ASMIT_LDX)
@@ -19422,30 +19556,38 @@ bool NativeCodeBasicBlock::OptimizeSimpleLoop(NativeCodeProcedure * proc)
 						}
 
 						lblock->mIns.Push(NativeCodeInstruction(ASMIT_CPX, ASMIM_IMMEDIATE, limit));
-						lblock->mBranch = mBranch;
-						lblock->mTrueJump = lblock;
-						lblock->mFalseJump = eblock;
+						for (int i = 0; i < lblock->mIns.Size(); i++)
+							lblock->mIns[i].mLive |= LIVE_CPU_REG_X;
 
-						eblock->mIns.Push(NativeCodeInstruction(ASMIT_STX, ASMIM_ZERO_PAGE, zreg));
-						eblock->mBranch = ASMIT_JMP;
-						eblock->mTrueJump = mFalseJump;
-						eblock->mFalseJump = nullptr;
+						// Keep the loop if the index register version is slower
 
-						mIns.SetSize(0);
-						mIns.Push(NativeCodeInstruction(ASMIT_LDX, ASMIM_ZERO_PAGE, zreg));
-						mBranch = ASMIT_JMP;
-						mTrueJump = lblock;
-						mFalseJump = nullptr;
+						if (lblock->InstructionCycles() <= InstructionCycles())
+						{
+							lblock->mBranch = mBranch;
+							lblock->mTrueJump = lblock;
+							lblock->mFalseJump = eblock;
 
-						lblock->CheckLive();
+							eblock->mIns.Push(NativeCodeInstruction(ASMIT_STX, ASMIM_ZERO_PAGE, zreg));
+							eblock->mBranch = ASMIT_JMP;
+							eblock->mTrueJump = mFalseJump;
+							eblock->mFalseJump = nullptr;
 
-						lblock->OptimizeSimpleLoopInvariant(proc, this, eblock);
+							mIns.SetSize(0);
+							mIns.Push(NativeCodeInstruction(ASMIT_LDX, ASMIM_ZERO_PAGE, zreg));
+							mBranch = ASMIT_JMP;
+							mTrueJump = lblock;
+							mFalseJump = nullptr;
 
-						lblock->CheckLive();
+							lblock->CheckLive();
 
-						changed = true;
+							lblock->OptimizeSimpleLoopInvariant(proc, this, eblock);
+
+							lblock->CheckLive();
+
+							changed = true;
 
-						assert(mIns.Size() == 0 || mIns[0].mType != ASMIT_INV);
+							assert(mIns.Size() == 0 || mIns[0].mType != ASMIT_INV);
+						}
 					}
 				}
 				else if (mIns[sz - 1].mType == ASMIT_DEC && mIns[sz - 1].mMode == ASMIM_ZERO_PAGE && mBranch == ASMIT_BNE)
@@ -19490,8 +19632,6 @@ bool NativeCodeBasicBlock::OptimizeSimpleLoop(NativeCodeProcedure * proc)
 						yinc = 0;
 						for (int i = 0; i + 1 < sz; i++)
 						{
-							mIns[i].mLive |= LIVE_CPU_REG_Y;
-
 							if (mIns[i].mType == ASMIT_LDA && mIns[i].mMode == ASMIM_ZERO_PAGE && mIns[i].mAddress == zreg)
 								lblock->mIns.Push(NativeCodeInstruction(ASMIT_TYA, ASMIM_IMPLIED));
 							else if (mIns[i].mType == ASMIT_LDY)
@@ -19530,28 +19670,36 @@ bool NativeCodeBasicBlock::OptimizeSimpleLoop(NativeCodeProcedure * proc)
 							}
 						}
 
-						lblock->mBranch = mBranch;
-						lblock->mTrueJump = lblock;
-						lblock->mFalseJump = eblock;
+						for (int i = 0; i < lblock->mIns.Size(); i++)
+							lblock->mIns[i].mLive |= LIVE_CPU_REG_Y;
 
-						eblock->mIns.Push(NativeCodeInstruction(ASMIT_STY, ASMIM_ZERO_PAGE, zreg));
-						eblock->mBranch = ASMIT_JMP;
-						eblock->mTrueJump = mFalseJump;
-						eblock->mFalseJump = nullptr;
+						// Keep the loop if the index register version is slower
 
-						mIns.SetSize(0);
-						mIns.Push(NativeCodeInstruction(ASMIT_LDY, ASMIM_ZERO_PAGE, zreg));
-						mBranch = ASMIT_JMP;
-						mTrueJump = lblock;
-						mFalseJump = nullptr;
+						if (lblock->InstructionCycles() <= InstructionCycles())
+						{
+							lblock->mBranch = mBranch;
+							lblock->mTrueJump = lblock;
+							lblock->mFalseJump = eblock;
 
-						lblock->OptimizeSimpleLoopInvariant(proc, this, eblock);
+							eblock->mIns.Push(NativeCodeInstruction(ASMIT_STY, ASMIM_ZERO_PAGE, zreg));
+							eblock->mBranch = ASMIT_JMP;
+							eblock->mTrueJump = mFalseJump;
+							eblock->mFalseJump = nullptr;
 
-						lblock->CheckLive();
+							mIns.SetSize(0);
+							mIns.Push(NativeCodeInstruction(ASMIT_LDY, ASMIM_ZERO_PAGE, zreg));
+							mBranch = ASMIT_JMP;
+							mTrueJump = lblock;
+							mFalseJump = nullptr;
 
-						changed = true;
+							lblock->OptimizeSimpleLoopInvariant(proc, this, eblock);
 
-						assert(mIns.Size() == 0 || mIns[0].mType != ASMIT_INV);
+							lblock->CheckLive();
+
+							changed = true;
+
+							assert(mIns.Size() == 0 || mIns[0].mType != ASMIT_INV);
+						}
 					}
 				}
 				else if (mIns[sz - 3].mType == ASMIT_INC && mIns[sz - 3].mMode == ASMIM_ZERO_PAGE &&
@@ -19613,8 +19761,6 @@ bool NativeCodeBasicBlock::OptimizeSimpleLoop(NativeCodeProcedure * proc)
 						NativeCodeBasicBlock* eblock = proc->AllocateBlock();
 						for (int i = 0; i + 3 < sz; i++)
 						{
-							mIns[i].mLive |= LIVE_CPU_REG_Y;
-
 							if (mIns[i].mType == ASMIT_LDA && mIns[i].mMode == ASMIM_ZERO_PAGE && mIns[i].mAddress == zreg)
 								lblock->mIns.Push(NativeCodeInstruction(ASMIT_TYA, ASMIM_IMPLIED));
 							else if (mIns[i].mType != ASMIT_LDY)
@@ -19622,28 +19768,36 @@ bool NativeCodeBasicBlock::OptimizeSimpleLoop(NativeCodeProcedure * proc)
 						}
 						lblock->mIns.Push(NativeCodeInstruction(ASMIT_INY, ASMIM_IMPLIED));
 						lblock->mIns.Push(NativeCodeInstruction(ASMIT_CPY, lins));
-						lblock->mBranch = mBranch;
-						lblock->mTrueJump = lblock;
-						lblock->mFalseJump = eblock;
+						for (int i = 0; i < lblock->mIns.Size(); i++)
+							lblock->mIns[i].mLive |= LIVE_CPU_REG_Y;
 
-						eblock->mIns.Push(NativeCodeInstruction(ASMIT_STY, ASMIM_ZERO_PAGE, zreg));
-						eblock->mBranch = ASMIT_JMP;
-						eblock->mTrueJump = mFalseJump;
-						eblock->mFalseJump = nullptr;
+						// Keep the loop if the index register version is slower
 
-						mIns.SetSize(0);
-						mIns.Push(NativeCodeInstruction(ASMIT_LDY, ASMIM_ZERO_PAGE, zreg));
-						mBranch = ASMIT_JMP;
-						mTrueJump = lblock;
-						mFalseJump = nullptr;
+						if (lblock->InstructionCycles() <= InstructionCycles())
+						{
+							lblock->mBranch = mBranch;
+							lblock->mTrueJump = lblock;
+							lblock->mFalseJump = eblock;
 
-						lblock->OptimizeSimpleLoopInvariant(proc, this, eblock);
+							eblock->mIns.Push(NativeCodeInstruction(ASMIT_STY, ASMIM_ZERO_PAGE, zreg));
+							eblock->mBranch = ASMIT_JMP;
+							eblock->mTrueJump = mFalseJump;
+							eblock->mFalseJump = nullptr;
 
-						lblock->CheckLive();
+							mIns.SetSize(0);
+							mIns.Push(NativeCodeInstruction(ASMIT_LDY, ASMIM_ZERO_PAGE, zreg));
+							mBranch = ASMIT_JMP;
+							mTrueJump = lblock;
+							mFalseJump = nullptr;
 
-						changed = true;
+							lblock->OptimizeSimpleLoopInvariant(proc, this, eblock);
+
+							lblock->CheckLive();
+
+							changed = true;
 
-						assert(mIns.Size() == 0 || mIns[0].mType != ASMIT_INV);
+							assert(mIns.Size() == 0 || mIns[0].mType != ASMIT_INV);
+						}
 					}
 					else if (!xother && !lchanged)
 					{
@@ -19651,8 +19805,6 @@ bool NativeCodeBasicBlock::OptimizeSimpleLoop(NativeCodeProcedure * proc)
 						NativeCodeBasicBlock* eblock = proc->AllocateBlock();
 						for (int i = 0; i + 3 < sz; i++)
 						{
-							mIns[i].mLive |= LIVE_CPU_REG_X;
-
 							if (mIns[i].mType == ASMIT_LDA && mIns[i].mMode == ASMIM_ZERO_PAGE && mIns[i].mAddress == zreg)
 								lblock->mIns.Push(NativeCodeInstruction(ASMIT_TXA, ASMIM_IMPLIED));
 							else if (mIns[i].mType != ASMIT_LDX)
@@ -19660,28 +19812,36 @@ bool NativeCodeBasicBlock::OptimizeSimpleLoop(NativeCodeProcedure * proc)
 						}
 						lblock->mIns.Push(NativeCodeInstruction(ASMIT_INX, ASMIM_IMPLIED));
 						lblock->mIns.Push(NativeCodeInstruction(ASMIT_CPX, lins));
-						lblock->mBranch = mBranch;
-						lblock->mTrueJump = lblock;
-						lblock->mFalseJump = eblock;
+						for (int i = 0; i < lblock->mIns.Size(); i++)
+							lblock->mIns[i].mLive |= LIVE_CPU_REG_X;
 
-						eblock->mIns.Push(NativeCodeInstruction(ASMIT_STX, ASMIM_ZERO_PAGE, zreg));
-						eblock->mBranch = ASMIT_JMP;
-						eblock->mTrueJump = mFalseJump;
-						eblock->mFalseJump = nullptr;
+						// Keep the loop if the index register version is slower
 
-						mIns.SetSize(0);
-						mIns.Push(NativeCodeInstruction(ASMIT_LDX, ASMIM_ZERO_PAGE, zreg));
-						mBranch = ASMIT_JMP;
-						mTrueJump = lblock;
-						mFalseJump = nullptr;
+						if (lblock->InstructionCycles() <= InstructionCycles())
+						{
+							lblock->mBranch = mBranch;
+							lblock->mTrueJump = lblock;
+							lblock->mFalseJump = eblock;
 
-						lblock->OptimizeSimpleLoopInvariant(proc, this, eblock);
+							eblock->mIns.Push(NativeCodeInstruction(ASMIT_STX, ASMIM_ZERO_PAGE, zreg));
+							eblock->mBranch = ASMIT_JMP;
+							eblock->mTrueJump = mFalseJump;
+							eblock->mFalseJump = nullptr;
 
-						lblock->CheckLive();
+							mIns.SetSize(0);
+							mIns.Push(NativeCodeInstruction(ASMIT_LDX, ASMIM_ZERO_PAGE, zreg));
+							mBranch = ASMIT_JMP;
+							mTrueJump = lblock;
+							mFalseJump = nullptr;
 
-						changed = true;
+							lblock->OptimizeSimpleLoopInvariant(proc, this, eblock);
 
-						assert(mIns.Size() == 0 || mIns[0].mType != ASMIT_INV);
+							lblock->CheckLive();
+
+							changed = true;
+
+							assert(mIns.Size() == 0 || mIns[0].mType != ASMIT_INV);
+						}
 					}
 				}
 			}
@@ -20066,7 +20226,7 @@ static bool CheckBlockCopySequence(const GrowingArray<NativeCodeInstruction>& in
 
 bool NativeCodeBasicBlock::BlockSizeCopyReduction(NativeCodeProcedure* proc, int& si, int& di) 
 {
-	if ((proc->mGenerator->mCompilerOptions & COPT_OPTIMIZE_CODE_SIZE))
+	if ((proc->mInterProc->mCompilerOptions & COPT_OPTIMIZE_CODE_SIZE))
 	{
 		if (si + 1 < mIns.Size() &&
 			mIns[si + 0].mType == ASMIT_LDA && (mIns[si + 0].mMode == ASMIM_ZERO_PAGE || mIns[si + 0].mMode == ASMIM_ABSOLUTE) &&
@@ -20100,15 +20260,17 @@ bool NativeCodeBasicBlock::BlockSizeCopyReduction(NativeCodeProcedure* proc, int
 							lins.mMode = ASMIM_ZERO_PAGE_X;
 						else
 						{
+							if (!lins.IsZeroPageAbsolute())
+								sz++;
 							lins.mMode = ASMIM_ABSOLUTE_X;
-							sz++;
 						}
 						if (sins.mMode == ASMIM_ZERO_PAGE)
 							sins.mMode = ASMIM_ZERO_PAGE_X;
 						else
 						{
+							if (!sins.IsZeroPageAbsolute())
+								sz++;
 							sins.mMode = ASMIM_ABSOLUTE_X;
-							sz++;
 						}
 
 						if (j == 0)
@@ -20156,22 +20318,25 @@ bool NativeCodeBasicBlock::BlockSizeCopyReduction(NativeCodeProcedure* proc, int
 						lins.mMode = ASMIM_ZERO_PAGE_X;
 					else
 					{
+						if (!lins.IsZeroPageAbsolute())
+							sz++;
 						lins.mMode = ASMIM_ABSOLUTE_X;
-						sz++;
 					}
 					if (sins0.mMode == ASMIM_ZERO_PAGE)
 						sins0.mMode = ASMIM_ZERO_PAGE_X;
 					else
 					{
+						if (!sins0.IsZeroPageAbsolute())
+							sz++;
 						sins0.mMode = ASMIM_ABSOLUTE_X;
-						sz++;
 					}
 					if (sins1.mMode == ASMIM_ZERO_PAGE)
 						sins1.mMode = ASMIM_ZERO_PAGE_X;
 					else
 					{
+						if (!sins1.IsZeroPageAbsolute())
+							sz++;
 						sins1.mMode = ASMIM_ABSOLUTE_X;
-						sz++;
 					}
 
 					mIns[di++] = NativeCodeInstruction(ASMIT_LDX, ASMIM_IMMEDIATE, i - 1);
@@ -21143,71 +21308,584 @@ bool NativeCodeBasicBlock::RemoveNops(void)
 	return changed;
 }
 
-bool NativeCodeBasicBlock::PeepHoleOptimizer(NativeCodeProcedure* proc, int pass)
+// Declarative peephole patterns over a window of consecutive instructions.  Each
+// instruction of the window must match type, mode and immediate value, unless
+// they are NUM_ASM_INS_TYPES, NUM_ASM_INS_MODES or -1, and none of its dead
+// flags may be live.  The patterns of one size are tried in table order, but
+// dispatched by the type of the first instruction, so only the candidates for
+// this opcode are checked.
+
+static const uint32 NPPF_SAME_ADDRESS = 0x00000001;
+static const uint32 NPPF_NOT_VOLATILE = 0x00000002;
+static const uint32 NPPF_CHANGES_ACCU = 0x00000004;
+static const uint32 NPPF_OTHER_ADDRESS = 0x00000008;
+static const uint32 NPPF_SAME_ADDRESS_02 = 0x00000010;
+static const uint32 NPPF_SAME_ADDRESS_12 = 0x00000020;
+static const uint32 NPPF_NO_X_REG = 0x00000040;
+static const uint32 NPPF_NO_Y_REG = 0x00000080;
+static const uint32 NPPF_CLEAR_BIT0 = 0x00000100;
+static const uint32 NPPF_CLEAR_BIT7 = 0x00000200;
+
+struct NativePeepHoleMatch
 {
-	if (!mVisited)
-	{
-		assert(mBranch != ASMIT_JMP || mFalseJump == nullptr);
-		assert(mIns.Size() == 0 || mIns[0].mType != ASMIT_INV);
+	AsmInsType	mType;
+	AsmInsMode	mMode;
+	int			mAddress;
+	uint32		mDead;
+};
 
-		assert(mIndex == 1000 || mNumEntries == mEntryBlocks.Size());
+struct NativePeepHolePattern
+{
+	int						mSize;
+	NativePeepHoleMatch		mMatch[3];
+	uint32					mFlags;
+	void				(*	mReplace)(NativeCodeInstruction* ins);
 
-		bool	changed = RemoveNops();
+	bool Match(const NativeCodeInstruction* ins) const;
+};
 
-		mVisited = true;
+bool NativePeepHolePattern::Match(const NativeCodeInstruction* ins) const
+{
+	for (int i = 0; i < mSize; i++)
+	{
+		const NativePeepHoleMatch& m(mMatch[i]);
+		if (m.mType != NUM_ASM_INS_TYPES && ins[i].mType != m.mType)
+			return false;
+		if (m.mMode != NUM_ASM_INS_MODES && ins[i].mMode != m.mMode)
+			return false;
+		if (m.mAddress >= 0 && ins[i].mAddress != m.mAddress)
+			return false;
+		if (ins[i].mLive & m.mDead)
+			return false;
+	}
 
-		CheckLive();
+	if ((mFlags & NPPF_SAME_ADDRESS) && !ins[1].SameEffectiveAddress(ins[0]))
+		return false;
+	if ((mFlags & NPPF_OTHER_ADDRESS) && ins[1].SameEffectiveAddress(ins[0]))
+		return false;
+	if ((mFlags & NPPF_SAME_ADDRESS_02) && !ins[2].SameEffectiveAddress(ins[0]))
+		return false;
+	if ((mFlags & NPPF_SAME_ADDRESS_12) && !ins[2].SameEffectiveAddress(ins[1]))
+		return false;
+	if ((mFlags & NPPF_NOT_VOLATILE) && (ins[1].mFlags & NCIF_VOLATILE))
+		return false;
+	if ((mFlags & NPPF_CHANGES_ACCU) && !ins[0].ChangesAccuAndFlag())
+		return false;
+	if ((mFlags & NPPF_NO_X_REG) && ins[1].RequiresXReg())
+		return false;
+	if ((mFlags & NPPF_NO_Y_REG) && ins[1].RequiresYReg())
+		return false;
+	if ((mFlags & NPPF_CLEAR_BIT0) && (ins[1].mAddress & 0x01))
+		return false;
+	if ((mFlags & NPPF_CLEAR_BIT7) && (ins[1].mAddress & 0x80))
+		return false;
 
-#if 1
-#if 1
-		// move load store pairs up to initial store
+	return true;
+}
 
-		for (int i = 2; i + 1 < mIns.Size(); i++)
-		{
-			if (mIns[i].mType == ASMIT_LDA && mIns[i].mMode == ASMIM_ZERO_PAGE && mIns[i + 1].mType == ASMIT_STA && mIns[i + 1].mMode == ASMIM_ZERO_PAGE)
-			{
-				if (MoveLoadStoreUp(i))
-					changed = true;
-			}
-		}
-		CheckLive();
+static void PeepHoleNop(NativeCodeInstruction& ins)
+{
+	ins.mType = ASMIT_NOP; ins.mMode = ASMIM_IMPLIED;
+}
 
-#endif
+static void PeepHoleToLDA(NativeCodeInstruction* ins)
+{
+	ins[0].mType = ASMIT_LDA;
+}
 
-#if 1
-		// replace zero page up
+static void PeepHoleToLSR(NativeCodeInstruction* ins)
+{
+	ins[0].mType = ASMIT_LSR;
+}
 
-		for (int i = 1; i + 1 < mIns.Size(); i++)
-		{
-			if (mIns[i].mType == ASMIT_LDA && mIns[i].mMode == ASMIM_ZERO_PAGE && mIns[i + 1].mType == ASMIT_STA && mIns[i + 1].mMode == ASMIM_ZERO_PAGE && !(mIns[i + 1].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Z)) && !(mIns[i + 0].mLive & LIVE_MEM))
-			{
-				if (ReplaceZeroPageUp(i))
-					changed = true;
-			}
-		}
-		CheckLive();
+static void PeepHoleToASL(NativeCodeInstruction* ins)
+{
+	ins[0].mType = ASMIT_ASL;
+}
 
-#endif
+static void PeepHoleRemove0(NativeCodeInstruction* ins)
+{
+	PeepHoleNop(ins[0]);
+}
 
+static void PeepHoleRemove1(NativeCodeInstruction* ins)
+{
+	PeepHoleNop(ins[1]);
+}
 
-#if 1
-		// move load store pairs up to initial store
+static void PeepHoleRemoveLoad1(NativeCodeInstruction* ins)
+{
+	ins[1].mLive |= LIVE_CPU_REG_A;
+	PeepHoleNop(ins[1]);
+}
 
-		for (int i = 2; i + 1 < mIns.Size(); i++)
-		{
-			if (mIns[i].mType == ASMIT_LDX && mIns[i].mMode == ASMIM_ZERO_PAGE && mIns[i + 1].mType == ASMIT_STX && mIns[i + 1].mMode == ASMIM_ZERO_PAGE && !(mIns[i + 1].mLive & (LIVE_CPU_REG_X | LIVE_CPU_REG_Z)))
-			{
-				if (MoveLoadStoreXUp(i))
-					changed = true;
-			}
-		}
-		CheckLive();
+static void PeepHoleRemoveFlags1(NativeCodeInstruction* ins)
+{
+	ins[0].mLive |= (ins[1].mLive & LIVE_CPU_REG_Z);
+	PeepHoleNop(ins[1]);
+}
 
-#endif
+static void PeepHoleMergeAND(NativeCodeInstruction* ins)
+{
+	ins[0].mAddress &= ins[1].mAddress;
+	PeepHoleRemoveFlags1(ins);
+}
 
-		// move sta zp, tax, lda abs,x , sta zp down to use
-#if 1
-		for (int i = 0; i + 4 < mIns.Size(); i++)
+static void PeepHoleMergeORA(NativeCodeInstruction* ins)
+{
+	ins[0].mAddress |= ins[1].mAddress;
+	PeepHoleRemoveFlags1(ins);
+}
+
+static void PeepHoleMergeEOR(NativeCodeInstruction* ins)
+{
+	ins[0].mAddress ^= ins[1].mAddress;
+	PeepHoleRemoveFlags1(ins);
+}
+
+static void PeepHoleClearRotate(NativeCodeInstruction* ins)
+{
+	PeepHoleNop(ins[0]);
+	ins[1].mType = ASMIT_LSR;
+}
+
+static void PeepHoleZeroShift(NativeCodeInstruction* ins)
+{
+	ins[1].mType = ASMIT_CLC;
+}
+
+static void PeepHoleSetCarryAdd(NativeCodeInstruction* ins)
+{
+	ins[0].mType = ASMIT_CLC;
+	ins[1].mAddress++;
+}
+
+static void PeepHoleDoubleAdd(NativeCodeInstruction* ins)
+{
+	ins[1].mType = ASMIT_ROL;
+	ins[1].mMode = ASMIM_IMPLIED;
+}
+
+static void PeepHoleZeroCompare(NativeCodeInstruction* ins)
+{
+	PeepHoleNop(ins[0]);
+	ins[1].mType = ASMIT_LDA;
+}
+
+static void PeepHoleImmediateShift(NativeCodeInstruction* ins)
+{
+	int	aval = ins[0].mAddress << 1;
+	ins[0].mAddress = aval & 0xff;
+	if (aval & 0x100)
+		ins[1].mType = ASMIT_SEC;
+	else
+		ins[1].mType = ASMIT_CLC;
+	ins[1].mMode = ASMIM_IMPLIED;
+}
+
+static void PeepHoleShiftAccu(NativeCodeInstruction* ins)
+{
+	ins[0].mType = ins[1].mType;
+	ins[0].mMode = ASMIM_IMPLIED;
+	ins[0].mLive |= LIVE_CPU_REG_A | LIVE_CPU_REG_C;
+	ins[1].mType = ASMIT_STA;
+}
+
+static void PeepHoleRemoveBoth(NativeCodeInstruction* ins)
+{
+	PeepHoleNop(ins[0]);
+	PeepHoleNop(ins[1]);
+}
+
+static void PeepHoleStoreToTAY(NativeCodeInstruction* ins)
+{
+	ins[1].mType = ASMIT_TAY;
+	ins[1].mMode = ASMIM_IMPLIED;
+	ins[0].mLive |= LIVE_CPU_REG_A;
+}
+
+static void PeepHoleStoreToTAX(NativeCodeInstruction* ins)
+{
+	ins[1].mType = ASMIT_TAX;
+	ins[1].mMode = ASMIM_IMPLIED;
+	ins[0].mLive |= LIVE_CPU_REG_A;
+}
+
+static void PeepHoleToSTX(NativeCodeInstruction* ins)
+{
+	ins[0].mLive |= LIVE_CPU_REG_X;
+	ins[1].mType = ASMIT_STX;
+}
+
+static void PeepHoleToSTY(NativeCodeInstruction* ins)
+{
+	ins[0].mLive |= LIVE_CPU_REG_Y;
+	ins[1].mType = ASMIT_STY;
+}
+
+static void PeepHoleToSTA(NativeCodeInstruction* ins)
+{
+	ins[0].mLive |= LIVE_CPU_REG_A;
+	ins[1].mType = ASMIT_STA;
+}
+
+static void PeepHoleSwap(NativeCodeInstruction* ins, uint32 live)
+{
+	NativeCodeInstruction	tins(ins[0]);
+	ins[0] = ins[1]; ins[0].mLive |= live;
+	ins[1] = tins;
+}
+
+static void PeepHoleSwapX(NativeCodeInstruction* ins)
+{
+	PeepHoleSwap(ins, LIVE_CPU_REG_X);
+}
+
+static void PeepHoleSwapY(NativeCodeInstruction* ins)
+{
+	PeepHoleSwap(ins, LIVE_CPU_REG_Y);
+}
+
+static void PeepHoleSwapA(NativeCodeInstruction* ins)
+{
+	PeepHoleSwap(ins, LIVE_CPU_REG_A);
+}
+
+static void PeepHoleSwapLoad(NativeCodeInstruction* ins)
+{
+	PeepHoleSwap(ins, ins[0].mLive);
+}
+
+static void PeepHoleKeepX(NativeCodeInstruction* ins)
+{
+	ins[0].mLive |= LIVE_CPU_REG_X;
+	PeepHoleNop(ins[1]);
+}
+
+static void PeepHoleKeepY(NativeCodeInstruction* ins)
+{
+	ins[0].mLive |= LIVE_CPU_REG_Y;
+	PeepHoleNop(ins[1]);
+}
+
+static void PeepHoleKeepA(NativeCodeInstruction* ins)
+{
+	ins[0].mLive |= LIVE_CPU_REG_A;
+	PeepHoleNop(ins[1]);
+}
+
+static void PeepHoleLoadTransfer(NativeCodeInstruction* ins, AsmInsType type)
+{
+	ins[0].mType = type; ins[0].mLive |= ins[1].mLive;
+	PeepHoleNop(ins[1]);
+}
+
+static void PeepHoleLoadToY(NativeCodeInstruction* ins)
+{
+	PeepHoleLoadTransfer(ins, ASMIT_LDY);
+}
+
+static void PeepHoleLoadToX(NativeCodeInstruction* ins)
+{
+	PeepHoleLoadTransfer(ins, ASMIT_LDX);
+}
+
+static void PeepHoleLoadToA(NativeCodeInstruction* ins)
+{
+	PeepHoleLoadTransfer(ins, ASMIT_LDA);
+}
+
+static void PeepHoleToCPX(NativeCodeInstruction* ins)
+{
+	ins[1].mType = ASMIT_CPX;
+	ins[0].mLive |= LIVE_CPU_REG_X;
+}
+
+static void PeepHoleToCPY(NativeCodeInstruction* ins)
+{
+	ins[1].mType = ASMIT_CPY;
+	ins[0].mLive |= LIVE_CPU_REG_Y;
+}
+
+static void PeepHoleLoadStoreA(NativeCodeInstruction* ins)
+{
+	ins[0].mType = ASMIT_LDA; ins[0].mLive |= LIVE_CPU_REG_A;
+	ins[1].mType = ASMIT_STA;
+}
+
+static void PeepHoleIndexOffset(NativeCodeInstruction* ins)
+{
+	PeepHoleNop(ins[0]);
+	ins[1].mAddress++;
+}
+
+static void PeepHoleShiftLoad(NativeCodeInstruction* ins)
+{
+	ins[1].mType = ins[0].mType;
+	ins[1].mMode = ASMIM_IMPLIED;
+	ins[1].mLive |= LIVE_CPU_REG_A;
+	ins[0].mLive |= LIVE_CPU_REG_A | LIVE_CPU_REG_C;
+	ins[0].mType = ASMIT_LDA;
+}
+
+static void PeepHoleIncrementToAdd(NativeCodeInstruction* ins)
+{
+	ins[0].mType = ASMIT_CLC;
+	ins[0].mMode = ASMIM_IMPLIED;
+	ins[0].mLive |= LIVE_CPU_REG_C;
+	ins[1].mType = ASMIT_ADC;
+	ins[1].mMode = ASMIM_IMMEDIATE;
+	ins[1].mAddress = 1;
+	ins[2].mType = ASMIT_STA;
+}
+
+static void PeepHoleDecrementToSub(NativeCodeInstruction* ins)
+{
+	ins[0].mType = ASMIT_SEC; ins[0].mMode = ASMIM_IMPLIED; ins[0].mLive |= LIVE_CPU_REG_C;
+	ins[1].mType = ASMIT_SBC; ins[1].mMode = ASMIM_IMMEDIATE; ins[1].mAddress = 1;
+	ins[2].mType = ASMIT_STA;
+}
+
+static void PeepHoleRemoveFlags2(NativeCodeInstruction* ins)
+{
+	ins[0].mLive |= ins[2].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Z);
+	ins[1].mLive |= ins[2].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Z);
+	PeepHoleNop(ins[2]);
+}
+
+static void PeepHoleZeroCompareRotate(NativeCodeInstruction* ins)
+{
+	PeepHoleNop(ins[1]);
+	ins[2].mType = ASMIT_CLC; ins[2].mMode = ASMIM_IMPLIED;
+}
+
+#define	NPPM_ANY		{NUM_ASM_INS_TYPES, NUM_ASM_INS_MODES, -1, 0}
+#define	NPPM_INS(t)		{t, NUM_ASM_INS_MODES, -1, 0}
+#define	NPPM_MODE(t, m)	{t, m, -1, 0}
+
+static const NativePeepHolePattern NativePeepHolePatterns[] =
+{
+	{1, {{ASMIT_AND, ASMIM_IMMEDIATE, 0x00, 0}}, 0, PeepHoleToLDA},
+	{1, {{ASMIT_AND, ASMIM_IMMEDIATE, 0xff, LIVE_CPU_REG_Z}}, 0, PeepHoleRemove0},
+	{1, {{ASMIT_ORA, ASMIM_IMMEDIATE, 0xff, 0}}, 0, PeepHoleToLDA},
+	{1, {{ASMIT_ORA, ASMIM_IMMEDIATE, 0x00, LIVE_CPU_REG_Z}}, 0, PeepHoleRemove0},
+	{1, {{ASMIT_EOR, ASMIM_IMMEDIATE, 0x00, LIVE_CPU_REG_Z}}, 0, PeepHoleRemove0},
+	{1, {{ASMIT_ROR, ASMIM_IMPLIED, -1, LIVE_CPU_REG_A | LIVE_CPU_REG_Z}}, 0, PeepHoleToLSR},
+	{1, {{ASMIT_ROL, ASMIM_IMPLIED, -1, LIVE_CPU_REG_A | LIVE_CPU_REG_Z}}, 0, PeepHoleToASL},
+
+	{2, {NPPM_INS(ASMIT_LDA), NPPM_INS(ASMIT_LDA)}, 0, PeepHoleRemove0},
+	{2, {NPPM_INS(ASMIT_LDA), NPPM_INS(ASMIT_STA)}, NPPF_SAME_ADDRESS | NPPF_NOT_VOLATILE, PeepHoleRemove1},
+	{2, {{ASMIT_STA, ASMIM_ZERO_PAGE, -1, 0}, {ASMIT_LDA, ASMIM_ZERO_PAGE, -1, LIVE_CPU_REG_Z}}, NPPF_SAME_ADDRESS, PeepHoleRemoveLoad1},
+	{2, {NPPM_INS(ASMIT_STA), {ASMIT_LDA, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_Z}}, NPPF_SAME_ADDRESS | NPPF_NOT_VOLATILE, PeepHoleRemoveLoad1},
+	{2, {{ASMIT_AND, ASMIM_IMMEDIATE, -1, 0}, {ASMIT_AND, ASMIM_IMMEDIATE, -1, 0}}, 0, PeepHoleMergeAND},
+	{2, {{ASMIT_ORA, ASMIM_IMMEDIATE, -1, 0}, {ASMIT_ORA, ASMIM_IMMEDIATE, -1, 0}}, 0, PeepHoleMergeORA},
+	{2, {{ASMIT_EOR, ASMIM_IMMEDIATE, -1, 0}, {ASMIT_EOR, ASMIM_IMMEDIATE, -1, 0}}, 0, PeepHoleMergeEOR},
+	{2, {NPPM_INS(ASMIT_LDA), {ASMIT_ORA, ASMIM_IMMEDIATE, 0x00, 0}}, 0, PeepHoleRemoveFlags1},
+	{2, {NPPM_INS(ASMIT_LDA), {ASMIT_EOR, ASMIM_IMMEDIATE, 0x00, 0}}, 0, PeepHoleRemoveFlags1},
+	{2, {NPPM_INS(ASMIT_LDA), {ASMIT_AND, ASMIM_IMMEDIATE, 0xff, 0}}, 0, PeepHoleRemoveFlags1},
+	{2, {NPPM_INS(ASMIT_CLC), NPPM_INS(ASMIT_ROR)}, 0, PeepHoleClearRotate},
+	{2, {{ASMIT_LDA, ASMIM_IMMEDIATE, 0x00, 0}, {ASMIT_LSR, ASMIM_IMPLIED, -1, 0}}, 0, PeepHoleZeroShift},
+	{2, {NPPM_INS(ASMIT_CLC), {ASMIT_ADC, ASMIM_IMMEDIATE, 0x00, LIVE_CPU_REG_Z}}, 0, PeepHoleRemove1},
+	{2, {NPPM_INS(ASMIT_SEC), {ASMIT_SBC, ASMIM_IMMEDIATE, 0x00, LIVE_CPU_REG_Z}}, 0, PeepHoleRemove1},
+	{2, {NPPM_INS(ASMIT_SEC), {ASMIT_ADC, ASMIM_IMMEDIATE, -1, LIVE_CPU_REG_C}}, 0, PeepHoleSetCarryAdd},
+	{2, {NPPM_INS(ASMIT_LDA), NPPM_INS(ASMIT_ADC)}, NPPF_SAME_ADDRESS, PeepHoleDoubleAdd},
+	{2, {NPPM_ANY, {ASMIT_ORA, ASMIM_IMMEDIATE, 0x00, 0}}, NPPF_CHANGES_ACCU, PeepHoleRemoveFlags1},
+	{2, {NPPM_ANY, {ASMIT_CMP, ASMIM_IMMEDIATE, 0x00, LIVE_CPU_REG_C}}, NPPF_CHANGES_ACCU, PeepHoleRemoveFlags1},
+	{2, {{ASMIT_LDA, ASMIM_IMMEDIATE, 0x00, 0}, {ASMIT_CMP, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_C | LIVE_CPU_REG_A}}, 0, PeepHoleZeroCompare},
+	{2, {{ASMIT_LDA, ASMIM_IMMEDIATE, -1, 0}, {ASMIT_ASL, ASMIM_IMPLIED, -1, 0}}, 0, PeepHoleImmediateShift},
+	{2, {{ASMIT_STA, ASMIM_ZERO_PAGE, -1, LIVE_CPU_REG_A}, {ASMIT_LSR, ASMIM_ZERO_PAGE, -1, 0}}, NPPF_SAME_ADDRESS, PeepHoleShiftAccu},
+	{2, {{ASMIT_STA, ASMIM_ZERO_PAGE, -1, LIVE_CPU_REG_A}, {ASMIT_ASL, ASMIM_ZERO_PAGE, -1, 0}}, NPPF_SAME_ADDRESS, PeepHoleShiftAccu},
+	{2, {{ASMIT_STA, ASMIM_ZERO_PAGE, -1, LIVE_CPU_REG_A}, {ASMIT_ROL, ASMIM_ZERO_PAGE, -1, 0}}, NPPF_SAME_ADDRESS, PeepHoleShiftAccu},
+	{2, {{ASMIT_STA, ASMIM_ZERO_PAGE, -1, LIVE_CPU_REG_A}, {ASMIT_ROR, ASMIM_ZERO_PAGE, -1, 0}}, NPPF_SAME_ADDRESS, PeepHoleShiftAccu},
+	{2, {NPPM_INS(ASMIT_STA), NPPM_INS(ASMIT_LDY)}, NPPF_SAME_ADDRESS, PeepHoleStoreToTAY},
+	{2, {NPPM_INS(ASMIT_STA), NPPM_INS(ASMIT_LDX)}, NPPF_SAME_ADDRESS, PeepHoleStoreToTAX},
+	{2, {NPPM_INS(ASMIT_TXA), NPPM_MODE(ASMIT_STA, ASMIM_ZERO_PAGE)}, 0, PeepHoleToSTX},
+	{2, {NPPM_INS(ASMIT_TXA), NPPM_MODE(ASMIT_STA, ASMIM_ABSOLUTE)}, 0, PeepHoleToSTX},
+	{2, {NPPM_INS(ASMIT_TYA), NPPM_MODE(ASMIT_STA, ASMIM_ZERO_PAGE)}, 0, PeepHoleToSTY},
+	{2, {NPPM_INS(ASMIT_TYA), NPPM_MODE(ASMIT_STA, ASMIM_ABSOLUTE)}, 0, PeepHoleToSTY},
+	{2, {NPPM_INS(ASMIT_TAX), NPPM_MODE(ASMIT_STX, ASMIM_ZERO_PAGE)}, 0, PeepHoleToSTA},
+	{2, {NPPM_INS(ASMIT_TAX), NPPM_MODE(ASMIT_STX, ASMIM_ABSOLUTE)}, 0, PeepHoleToSTA},
+	{2, {NPPM_INS(ASMIT_TAY), NPPM_MODE(ASMIT_STY, ASMIM_ZERO_PAGE)}, 0, PeepHoleToSTA},
+	{2, {NPPM_INS(ASMIT_TAY), NPPM_MODE(ASMIT_STY, ASMIM_ABSOLUTE)}, 0, PeepHoleToSTA},
+	{2, {NPPM_INS(ASMIT_TXA), NPPM_INS(ASMIT_STX)}, 0, PeepHoleSwapX},
+	{2, {NPPM_INS(ASMIT_TYA), NPPM_INS(ASMIT_STY)}, 0, PeepHoleSwapY},
+	{2, {NPPM_INS(ASMIT_TAX), NPPM_INS(ASMIT_STA)}, NPPF_NO_X_REG, PeepHoleSwapA},
+	{2, {NPPM_INS(ASMIT_TAY), NPPM_INS(ASMIT_STA)}, NPPF_NO_Y_REG, PeepHoleSwapA},
+	{2, {NPPM_MODE(ASMIT_ROL, ASMIM_IMPLIED), {ASMIT_LSR, ASMIM_IMPLIED, -1, LIVE_CPU_REG_A | LIVE_CPU_REG_Z}}, 0, PeepHoleRemoveBoth},
+	{2, {NPPM_MODE(ASMIT_ROR, ASMIM_IMPLIED), {ASMIT_ASL, ASMIM_IMPLIED, -1, LIVE_CPU_REG_A | LIVE_CPU_REG_Z}}, 0, PeepHoleRemoveBoth},
+	{2, {NPPM_INS(ASMIT_TXA), NPPM_INS(ASMIT_TAX)}, 0, PeepHoleKeepX},
+	{2, {NPPM_INS(ASMIT_TYA), NPPM_INS(ASMIT_TAY)}, 0, PeepHoleKeepY},
+	{2, {NPPM_INS(ASMIT_TAX), NPPM_INS(ASMIT_TXA)}, 0, PeepHoleKeepA},
+	{2, {NPPM_INS(ASMIT_TAY), NPPM_INS(ASMIT_TYA)}, 0, PeepHoleKeepA},
+	{2, {NPPM_INS(ASMIT_INX), {ASMIT_DEX, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_Z}}, 0, PeepHoleRemoveBoth},
+	{2, {NPPM_INS(ASMIT_DEX), {ASMIT_INX, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_Z}}, 0, PeepHoleRemoveBoth},
+	{2, {NPPM_INS(ASMIT_INY), {ASMIT_DEY, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_Z}}, 0, PeepHoleRemoveBoth},
+	{2, {NPPM_INS(ASMIT_DEY), {ASMIT_INY, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_Z}}, 0, PeepHoleRemoveBoth},
+	{2, {NPPM_MODE(ASMIT_LDA, ASMIM_IMMEDIATE), {ASMIT_TAY, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_A}}, 0, PeepHoleLoadToY},
+	{2, {NPPM_MODE(ASMIT_LDA, ASMIM_ZERO_PAGE), {ASMIT_TAY, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_A}}, 0, PeepHoleLoadToY},
+	{2, {NPPM_MODE(ASMIT_LDA, ASMIM_ABSOLUTE), {ASMIT_TAY, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_A}}, 0, PeepHoleLoadToY},
+	{2, {NPPM_MODE(ASMIT_LDA, ASMIM_ABSOLUTE_X), {ASMIT_TAY, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_A}}, 0, PeepHoleLoadToY},
+	{2, {NPPM_MODE(ASMIT_LDA, ASMIM_IMMEDIATE), {ASMIT_TAX, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_A}}, 0, PeepHoleLoadToX},
+	{2, {NPPM_MODE(ASMIT_LDA, ASMIM_ZERO_PAGE), {ASMIT_TAX, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_A}}, 0, PeepHoleLoadToX},
+	{2, {NPPM_MODE(ASMIT_LDA, ASMIM_ABSOLUTE), {ASMIT_TAX, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_A}}, 0, PeepHoleLoadToX},
+	{2, {NPPM_MODE(ASMIT_LDA, ASMIM_ABSOLUTE_Y), {ASMIT_TAX, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_A}}, 0, PeepHoleLoadToX},
+	{2, {NPPM_MODE(ASMIT_LDY, ASMIM_IMMEDIATE), {ASMIT_TYA, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_Y}}, 0, PeepHoleLoadToA},
+	{2, {NPPM_MODE(ASMIT_LDY, ASMIM_ZERO_PAGE), {ASMIT_TYA, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_Y}}, 0, PeepHoleLoadToA},
+	{2, {NPPM_MODE(ASMIT_LDY, ASMIM_ABSOLUTE), {ASMIT_TYA, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_Y}}, 0, PeepHoleLoadToA},
+	{2, {NPPM_MODE(ASMIT_LDY, ASMIM_ABSOLUTE_X), {ASMIT_TYA, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_Y}}, 0, PeepHoleLoadToA},
+	{2, {NPPM_MODE(ASMIT_LDX, ASMIM_IMMEDIATE), {ASMIT_TXA, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_X}}, 0, PeepHoleLoadToA},
+	{2, {NPPM_MODE(ASMIT_LDX, ASMIM_ZERO_PAGE), {ASMIT_TXA, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_X}}, 0, PeepHoleLoadToA},
+	{2, {NPPM_MODE(ASMIT_LDX, ASMIM_ABSOLUTE), {ASMIT_TXA, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_X}}, 0, PeepHoleLoadToA},
+	{2, {NPPM_MODE(ASMIT_LDX, ASMIM_ABSOLUTE_Y), {ASMIT_TXA, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_X}}, 0, PeepHoleLoadToA},
+	{2, {NPPM_INS(ASMIT_TXA), NPPM_MODE(ASMIT_CMP, ASMIM_IMMEDIATE)}, 0, PeepHoleToCPX},
+	{2, {NPPM_INS(ASMIT_TXA), NPPM_MODE(ASMIT_CMP, ASMIM_ZERO_PAGE)}, 0, PeepHoleToCPX},
+	{2, {NPPM_INS(ASMIT_TXA), NPPM_MODE(ASMIT_CMP, ASMIM_ABSOLUTE)}, 0, PeepHoleToCPX},
+	{2, {NPPM_INS(ASMIT_TYA), NPPM_MODE(ASMIT_CMP, ASMIM_IMMEDIATE)}, 0, PeepHoleToCPY},
+	{2, {NPPM_INS(ASMIT_TYA), NPPM_MODE(ASMIT_CMP, ASMIM_ZERO_PAGE)}, 0, PeepHoleToCPY},
+	{2, {NPPM_INS(ASMIT_TYA), NPPM_MODE(ASMIT_CMP, ASMIM_ABSOLUTE)}, 0, PeepHoleToCPY},
+	{2, {NPPM_INS(ASMIT_LDX), {ASMIT_STX, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_A | LIVE_CPU_REG_X}}, 0, PeepHoleLoadStoreA},
+	{2, {NPPM_INS(ASMIT_LDY), {ASMIT_STY, NUM_ASM_INS_MODES, -1, LIVE_CPU_REG_A | LIVE_CPU_REG_Y}}, 0, PeepHoleLoadStoreA},
+	{2, {NPPM_MODE(ASMIT_LDX, ASMIM_ZERO_PAGE), NPPM_MODE(ASMIT_STA, ASMIM_ZERO_PAGE)}, NPPF_OTHER_ADDRESS, PeepHoleSwapLoad},
+	{2, {NPPM_MODE(ASMIT_LDY, ASMIM_ZERO_PAGE), NPPM_MODE(ASMIT_STA, ASMIM_ZERO_PAGE)}, NPPF_OTHER_ADDRESS, PeepHoleSwapLoad},
+	{2, {NPPM_INS(ASMIT_INY), {NUM_ASM_INS_TYPES, ASMIM_ABSOLUTE_Y, -1, LIVE_CPU_REG_Y}}, 0, PeepHoleIndexOffset},
+	{2, {NPPM_INS(ASMIT_INX), {NUM_ASM_INS_TYPES, ASMIM_ABSOLUTE_X, -1, LIVE_CPU_REG_X}}, 0, PeepHoleIndexOffset},
+	{2, {NPPM_MODE(ASMIT_ROL, ASMIM_IMPLIED), {ASMIT_AND, ASMIM_IMMEDIATE, -1, LIVE_CPU_REG_C}}, NPPF_CLEAR_BIT0, PeepHoleToASL},
+	{2, {NPPM_MODE(ASMIT_ROR, ASMIM_IMPLIED), {ASMIT_AND, ASMIM_IMMEDIATE, -1, LIVE_CPU_REG_C}}, NPPF_CLEAR_BIT7, PeepHoleToLSR},
+	{2, {NPPM_MODE(ASMIT_ASL, ASMIM_ZERO_PAGE), {ASMIT_LDA, ASMIM_ZERO_PAGE, -1, LIVE_MEM}}, NPPF_SAME_ADDRESS, PeepHoleShiftLoad},
+	{2, {NPPM_MODE(ASMIT_LSR, ASMIM_ZERO_PAGE), {ASMIT_LDA, ASMIM_ZERO_PAGE, -1, LIVE_MEM}}, NPPF_SAME_ADDRESS, PeepHoleShiftLoad},
+	{2, {NPPM_MODE(ASMIT_ROL, ASMIM_ZERO_PAGE), {ASMIT_LDA, ASMIM_ZERO_PAGE, -1, LIVE_MEM}}, NPPF_SAME_ADDRESS, PeepHoleShiftLoad},
+	{2, {NPPM_MODE(ASMIT_ROR, ASMIM_ZERO_PAGE), {ASMIT_LDA, ASMIM_ZERO_PAGE, -1, LIVE_MEM}}, NPPF_SAME_ADDRESS, PeepHoleShiftLoad},
+
+	{3, {NPPM_INS(ASMIT_LDA), NPPM_INS(ASMIT_CLC), NPPM_INS(ASMIT_LDA)}, 0, PeepHoleRemove0},
+	{3, {NPPM_INS(ASMIT_LDA), NPPM_INS(ASMIT_SEC), NPPM_INS(ASMIT_LDA)}, 0, PeepHoleRemove0},
+	{3, {NPPM_MODE(ASMIT_STA, ASMIM_ZERO_PAGE), NPPM_MODE(ASMIT_INC, ASMIM_ZERO_PAGE), {ASMIT_LDA, ASMIM_ZERO_PAGE, -1, LIVE_CPU_REG_C}}, NPPF_SAME_ADDRESS | NPPF_SAME_ADDRESS_02, PeepHoleIncrementToAdd},
+	{3, {NPPM_ANY, NPPM_INS(ASMIT_STA), NPPM_INS(ASMIT_LDA)}, NPPF_CHANGES_ACCU | NPPF_SAME_ADDRESS_12, PeepHoleRemoveFlags2},
+	{3, {NPPM_MODE(ASMIT_STA, ASMIM_ZERO_PAGE), NPPM_MODE(ASMIT_DEC, ASMIM_ZERO_PAGE), {ASMIT_LDA, ASMIM_ZERO_PAGE, -1, LIVE_CPU_REG_C}}, NPPF_SAME_ADDRESS | NPPF_SAME_ADDRESS_02, PeepHoleDecrementToSub},
+	{3, {{ASMIT_LDA, ASMIM_IMMEDIATE, 0x00, 0}, NPPM_MODE(ASMIT_CMP, ASMIM_IMMEDIATE), NPPM_MODE(ASMIT_ROR, ASMIM_IMPLIED)}, 0, PeepHoleZeroCompareRotate},
+	{3, {NPPM_ANY, NPPM_INS(ASMIT_STA), {ASMIT_ORA, ASMIM_IMMEDIATE, 0x00, 0}}, NPPF_CHANGES_ACCU, PeepHoleRemoveFlags2},
+	{3, {NPPM_ANY, NPPM_INS(ASMIT_STA), {ASMIT_CMP, ASMIM_IMMEDIATE, 0x00, LIVE_CPU_REG_C}}, NPPF_CHANGES_ACCU, PeepHoleRemoveFlags2},
+};
+
+#undef NPPM_ANY
+#undef NPPM_INS
+#undef NPPM_MODE
+
+static const int NumNativePeepHolePatterns = sizeof(NativePeepHolePatterns) / sizeof(NativePeepHolePatterns[0]);
+
+// Pattern indices per window size and type of first instruction, in table order, terminated by -1
+
+struct NativePeepHoleDispatch
+{
+	short	mPatterns[3][NUM_ASM_INS_TYPES][NumNativePeepHolePatterns + 1];
+
+	NativePeepHoleDispatch(void)
+	{
+		for (int s = 0; s < 3; s++)
+		{
+			for (int t = 0; t < NUM_ASM_INS_TYPES; t++)
+			{
+				int	n = 0;
+				for (int i = 0; i < NumNativePeepHolePatterns; i++)
+				{
+					const NativePeepHolePattern& p(NativePeepHolePatterns[i]);
+					if (p.mSize == s + 1 && (p.mMatch[0].mType == t || p.mMatch[0].mType == NUM_ASM_INS_TYPES))
+						mPatterns[s][t][n++] = i;
+				}
+				mPatterns[s][t][n] = -1;
+			}
+		}
+	}
+};
+
+static const NativePeepHoleDispatch	NativePeepHoleDispatcher;
+
+bool NativeCodeBasicBlock::PatternPeepHole(int at, int size)
+{
+	if (at + size > mIns.Size())
+		return false;
+
+	NativeCodeInstruction* ins = &(mIns[at]);
+
+	const short* pp = NativePeepHoleDispatcher.mPatterns[size - 1][ins->mType];
+	while (*pp >= 0)
+	{
+		const NativePeepHolePattern& p(NativePeepHolePatterns[*pp]);
+		if (p.Match(ins))
+		{
+			p.mReplace(ins);
+			return true;
+		}
+		pp++;
+	}
+
+	return false;
+}
+
+bool NativeCodeBasicBlock::PeepHoleOptimizer(NativeCodeProcedure* proc, int pass)
+{
+	if (!mVisited)
+	{
+		assert(mBranch != ASMIT_JMP || mFalseJump == nullptr);
+		assert(mIns.Size() == 0 || mIns[0].mType != ASMIT_INV);
+
+		assert(mIndex == 1000 || mNumEntries == mEntryBlocks.Size());
+
+		bool	changed = RemoveNops();
+
+		mVisited = true;
+
+		CheckLive();
+
+#if 1
+#if 1
+		// move load store pairs up to initial store
+
+		for (int i = 2; i + 1 < mIns.Size(); i++)
+		{
+			if (mIns[i].mType == ASMIT_LDA && mIns[i].mMode == ASMIM_ZERO_PAGE && mIns[i + 1].mType == ASMIT_STA && mIns[i + 1].mMode == ASMIM_ZERO_PAGE)
+			{
+				if (MoveLoadStoreUp(i))
+					changed = true;
+			}
+		}
+		CheckLive();
+
+#endif
+
+#if 1
+		// replace zero page up
+
+		for (int i = 1; i + 1 < mIns.Size(); i++)
+		{
+			if (mIns[i].mType == ASMIT_LDA && mIns[i].mMode == ASMIM_ZERO_PAGE && mIns[i + 1].mType == ASMIT_STA && mIns[i + 1].mMode == ASMIM_ZERO_PAGE && !(mIns[i + 1].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Z)) && !(mIns[i + 0].mLive & LIVE_MEM))
+			{
+				if (ReplaceZeroPageUp(i))
+					changed = true;
+			}
+		}
+		CheckLive();
+
+#endif
+
+
+#if 1
+		// move load store pairs up to initial store
+
+		for (int i = 2; i + 1 < mIns.Size(); i++)
+		{
+			if (mIns[i].mType == ASMIT_LDX && mIns[i].mMode == ASMIM_ZERO_PAGE && mIns[i + 1].mType == ASMIT_STX && mIns[i + 1].mMode == ASMIM_ZERO_PAGE && !(mIns[i + 1].mLive & (LIVE_CPU_REG_X | LIVE_CPU_REG_Z)))
+			{
+				if (MoveLoadStoreXUp(i))
+					changed = true;
+			}
+		}
+		CheckLive();
+
+#endif
+
+		// move sta zp, tax, lda abs,x , sta zp down to use
+#if 1
+		for (int i = 0; i + 4 < mIns.Size(); i++)
 		{
 			if (mIns[i + 0].mType == ASMIT_STA && mIns[i + 0].mMode == ASMIM_ZERO_PAGE &&
 				mIns[i + 1].mType == ASMIT_TAX &&
@@ -22013,41 +22691,8 @@ bool NativeCodeBasicBlock::PeepHoleOptimizer(NativeCodeProcedure* proc, int pass
 		{
 #if 1
 #if 1
-				if (mIns[i].mType == ASMIT_AND && mIns[i].mMode == ASMIM_IMMEDIATE && mIns[i].mAddress == 0)
-				{
-					mIns[i].mType = ASMIT_LDA;
-					progress = true;
-				}
-				else if (mIns[i].mType == ASMIT_AND && mIns[i].mMode == ASMIM_IMMEDIATE && mIns[i].mAddress == 0xff && (mIns[i].mLive & LIVE_CPU_REG_Z) == 0)
-				{
-					mIns[i].mType = ASMIT_NOP; mIns[i].mMode = ASMIM_IMPLIED;;
-					progress = true;
-				}
-				else if (mIns[i].mType == ASMIT_ORA && mIns[i].mMode == ASMIM_IMMEDIATE && mIns[i].mAddress == 0xff)
-				{
-					mIns[i].mType = ASMIT_LDA;
+				if (PatternPeepHole(i, 1))
 					progress = true;
-				}
-				else if (mIns[i].mType == ASMIT_ORA && mIns[i].mMode == ASMIM_IMMEDIATE && mIns[i].mAddress == 0x00 && (mIns[i].mLive & LIVE_CPU_REG_Z) == 0)
-				{
-					mIns[i].mType = ASMIT_NOP; mIns[i].mMode = ASMIM_IMPLIED;;
-					progress = true;
-				}
-				else if (mIns[i].mType == ASMIT_EOR && mIns[i].mMode == ASMIM_IMMEDIATE && mIns[i].mAddress == 0x00 && (mIns[i].mLive & LIVE_CPU_REG_Z) == 0)
-				{
-					mIns[i].mType = ASMIT_NOP; mIns[i].mMode = ASMIM_IMPLIED;;
-					progress = true;
-				}
-				else if (mIns[i].mType == ASMIT_ROR && mIns[i].mMode == ASMIM_IMPLIED && (mIns[i].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Z)) == 0)
-				{
-					mIns[i].mType = ASMIT_LSR;
-					progress = true;
-				}
-				else if (mIns[i].mType == ASMIT_ROL && mIns[i].mMode == ASMIM_IMPLIED && (mIns[i].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Z)) == 0)
-				{
-					mIns[i].mType = ASMIT_ASL;
-					progress = true;
-				}
 #endif
 #if 1
 				int	apos;
@@ -22252,427 +22897,19 @@ bool NativeCodeBasicBlock::PeepHoleOptimizer(NativeCodeProcedure* proc, int pass
 #if 1
 				if (i + 1 < mIns.Size())
 				{
-					if (mIns[i].mType == ASMIT_LDA && mIns[i + 1].mType == ASMIT_LDA)
-					{
-						mIns[i].mType = ASMIT_NOP; mIns[i].mMode = ASMIM_IMPLIED;;
-						progress = true;
-					}
-					else if (mIns[i].mType == ASMIT_LDA && mIns[i + 1].mType == ASMIT_STA && mIns[i].SameEffectiveAddress(mIns[i + 1]) && !(mIns[i + 1].mFlags & NCIF_VOLATILE))
-					{
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;;
-						progress = true;
-					}
-					else if (mIns[i].mType == ASMIT_STA && mIns[i + 1].mType == ASMIT_LDA && mIns[i].mMode == ASMIM_ZERO_PAGE && mIns[i + 1].mMode == ASMIM_ZERO_PAGE && mIns[i].mAddress == mIns[i + 1].mAddress && (mIns[i + 1].mLive & LIVE_CPU_REG_Z) == 0)
-					{
-						mIns[i + 1].mLive |= LIVE_CPU_REG_A;
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (mIns[i].mType == ASMIT_STA && mIns[i + 1].mType == ASMIT_LDA && mIns[i].SameEffectiveAddress(mIns[i + 1]) && !(mIns[i + 1].mFlags & NCIF_VOLATILE) && (mIns[i + 1].mLive & LIVE_CPU_REG_Z) == 0)
-					{
-						mIns[i + 1].mLive |= LIVE_CPU_REG_A;
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (mIns[i].mType == ASMIT_AND && mIns[i + 1].mType == ASMIT_AND && mIns[i].mMode == ASMIM_IMMEDIATE && mIns[i + 1].mMode == ASMIM_IMMEDIATE)
-					{
-						mIns[i].mAddress &= mIns[i + 1].mAddress;
-						mIns[i + 0].mLive |= (mIns[i + 1].mLive & LIVE_CPU_REG_Z);
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (mIns[i].mType == ASMIT_ORA && mIns[i + 1].mType == ASMIT_ORA && mIns[i].mMode == ASMIM_IMMEDIATE && mIns[i + 1].mMode == ASMIM_IMMEDIATE)
-					{
-						mIns[i].mAddress |= mIns[i + 1].mAddress;
-						mIns[i + 0].mLive |= (mIns[i + 1].mLive & LIVE_CPU_REG_Z);
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (mIns[i].mType == ASMIT_EOR && mIns[i + 1].mType == ASMIT_EOR && mIns[i].mMode == ASMIM_IMMEDIATE && mIns[i + 1].mMode == ASMIM_IMMEDIATE)
-					{
-						mIns[i].mAddress ^= mIns[i + 1].mAddress;
-						mIns[i + 0].mLive |= (mIns[i + 1].mLive & LIVE_CPU_REG_Z);
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (mIns[i].mType == ASMIT_LDA && mIns[i + 1].mType == ASMIT_ORA && mIns[i + 1].mMode == ASMIM_IMMEDIATE && mIns[i + 1].mAddress == 0)
-					{
-						mIns[i + 0].mLive |= (mIns[i + 1].mLive & LIVE_CPU_REG_Z);
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (mIns[i].mType == ASMIT_LDA && mIns[i + 1].mType == ASMIT_EOR && mIns[i + 1].mMode == ASMIM_IMMEDIATE && mIns[i + 1].mAddress == 0)
-					{
-						mIns[i + 0].mLive |= (mIns[i + 1].mLive & LIVE_CPU_REG_Z);
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
+					if (PatternPeepHole(i, 2))
 						progress = true;
-					}
-					else if (mIns[i].mType == ASMIT_LDA && mIns[i + 1].mType == ASMIT_AND && mIns[i + 1].mMode == ASMIM_IMMEDIATE && mIns[i + 1].mAddress == 0xff)
-					{
-						mIns[i + 0].mLive |= (mIns[i + 1].mLive & LIVE_CPU_REG_Z);
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (mIns[i].mType == ASMIT_CLC && mIns[i + 1].mType == ASMIT_ROR)
-					{
-						mIns[i + 0].mType = ASMIT_NOP; mIns[i + 0].mMode = ASMIM_IMPLIED;
-						mIns[i + 1].mType = ASMIT_LSR;
-						progress = true;
-					}
-					else if (mIns[i].mType == ASMIT_LDA && mIns[i].mMode == ASMIM_IMMEDIATE && mIns[i].mAddress == 0 && mIns[i + 1].mType == ASMIT_LSR && mIns[i + 1].mMode == ASMIM_IMPLIED)
-					{
-						mIns[i + 1].mType = ASMIT_CLC;
-						progress = true;
-					}
-					else if (mIns[i].mType == ASMIT_CLC && mIns[i + 1].mType == ASMIT_ADC && mIns[i + 1].mMode == ASMIM_IMMEDIATE && mIns[i + 1].mAddress == 0 && !(mIns[i + 1].mLive & LIVE_CPU_REG_Z))
-					{
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (mIns[i].mType == ASMIT_SEC && mIns[i + 1].mType == ASMIT_SBC && mIns[i + 1].mMode == ASMIM_IMMEDIATE && mIns[i + 1].mAddress == 0 && !(mIns[i + 1].mLive & LIVE_CPU_REG_Z))
-					{
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (mIns[i].mType == ASMIT_SEC && mIns[i + 1].mType == ASMIT_ADC && mIns[i + 1].mMode == ASMIM_IMMEDIATE && !(mIns[i + 1].mLive & LIVE_CPU_REG_C))
-					{
-						mIns[i + 0].mType = ASMIT_CLC;
-						mIns[i + 1].mAddress++;
-						progress = true;
-					}
-					else if (mIns[i + 0].mType == ASMIT_LDA && mIns[i + 1].mType == ASMIT_ADC && mIns[i + 1].SameEffectiveAddress(mIns[i + 0]))
-					{
-						mIns[i + 1].mType = ASMIT_ROL;
-						mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (mIns[i + 1].mType == ASMIT_ORA && mIns[i + 1].mMode == ASMIM_IMMEDIATE && mIns[i + 1].mAddress == 0 && mIns[i].ChangesAccuAndFlag())
-					{
-						mIns[i + 0].mLive |= (mIns[i + 1].mLive & LIVE_CPU_REG_Z);
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (mIns[i + 1].mType == ASMIT_CMP && mIns[i + 1].mMode == ASMIM_IMMEDIATE && mIns[i + 1].mAddress == 0 && mIns[i].ChangesAccuAndFlag() && !(mIns[i + 1].mLive & LIVE_CPU_REG_C))
-					{
-						mIns[i + 0].mLive |= (mIns[i + 1].mLive & LIVE_CPU_REG_Z);
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (mIns[i + 0].mType == ASMIT_LDA && mIns[i + 0].mMode == ASMIM_IMMEDIATE && mIns[i + 0].mAddress == 0 &&
-						mIns[i + 1].mType == ASMIT_CMP && !(mIns[i + 1].mLive & (LIVE_CPU_REG_C | LIVE_CPU_REG_A)))
-					{
-						mIns[i + 0].mType = ASMIT_NOP; mIns[i + 0].mMode = ASMIM_IMPLIED;
-						mIns[i + 1].mType = ASMIT_LDA;
-						progress = true;
-					}
-					else if (mIns[i + 0].mType == ASMIT_LDA && mIns[i + 0].mMode == ASMIM_IMMEDIATE && mIns[i + 1].mType == ASMIT_ASL && mIns[i + 1].mMode == ASMIM_IMPLIED)
-					{
-						int	aval = mIns[i + 0].mAddress << 1;
-						mIns[i + 0].mAddress = aval & 0xff;
-						if (aval & 0x100)
-							mIns[i + 1].mType = ASMIT_SEC;
-						else
-							mIns[i + 1].mType = ASMIT_CLC;
-						mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_STA && mIns[i + 0].mMode == ASMIM_ZERO_PAGE && mIns[i + 1].mMode == ASMIM_ZERO_PAGE && mIns[i].mAddress == mIns[i + 1].mAddress &&
-						(mIns[i + 1].mType == ASMIT_LSR || mIns[i + 1].mType == ASMIT_ASL || mIns[i + 1].mType == ASMIT_ROL || mIns[i + 1].mType == ASMIT_ROR) && !(mIns[i + 0].mLive & LIVE_CPU_REG_A))
-					{
-						mIns[i + 0].mType = mIns[i + 1].mType;
-						mIns[i + 0].mMode = ASMIM_IMPLIED;
-						mIns[i + 0].mLive |= LIVE_CPU_REG_A | LIVE_CPU_REG_C;
-						mIns[i + 1].mType = ASMIT_STA;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_ASL && mIns[i + 0].mMode == ASMIM_ZERO_PAGE &&
-						mIns[i + 1].mType == ASMIT_LDY && mIns[i + 1].mMode == ASMIM_ZERO_PAGE && mIns[i + 0].mAddress == mIns[i + 1].mAddress && !(mIns[i + 1].mLive & (LIVE_MEM | LIVE_CPU_REG_A)))
-					{
-						mIns[i + 0].mType = ASMIT_LDA;
-						mIns[i + 0].mLive |= LIVE_CPU_REG_A;
-						mIns[i + 1].mType = ASMIT_ASL;
-						mIns[i + 1].mMode = ASMIM_IMPLIED;
-						mIns.Insert(i + 2, NativeCodeInstruction(ASMIT_TAY, ASMIM_IMPLIED));
-						mIns[i + 2].mLive = mIns[i + 1].mLive;
-						mIns[i + 1].mLive |= LIVE_CPU_REG_A;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_STA &&
-						mIns[i + 1].mType == ASMIT_LDY && mIns[i + 0].SameEffectiveAddress(mIns[i + 1]))
-					{
-						mIns[i + 1].mType = ASMIT_TAY;
-						mIns[i + 1].mMode = ASMIM_IMPLIED;
-						mIns[i + 0].mLive |= LIVE_CPU_REG_A;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_STA &&
-						mIns[i + 1].mType == ASMIT_LDX && mIns[i + 0].SameEffectiveAddress(mIns[i + 1]))
-					{
-						mIns[i + 1].mType = ASMIT_TAX;
-						mIns[i + 1].mMode = ASMIM_IMPLIED;
-						mIns[i + 0].mLive |= LIVE_CPU_REG_A;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_TXA &&
-						mIns[i + 1].mType == ASMIT_STA && (mIns[i + 1].mMode == ASMIM_ZERO_PAGE || mIns[i + 1].mMode == ASMIM_ABSOLUTE))
-					{
-						mIns[i + 0].mLive |= LIVE_CPU_REG_X;
-						mIns[i + 1].mType = ASMIT_STX;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_TYA &&
-						mIns[i + 1].mType == ASMIT_STA && (mIns[i + 1].mMode == ASMIM_ZERO_PAGE || mIns[i + 1].mMode == ASMIM_ABSOLUTE))
-					{
-						mIns[i + 0].mLive |= LIVE_CPU_REG_Y;
-						mIns[i + 1].mType = ASMIT_STY;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_TAX &&
-						mIns[i + 1].mType == ASMIT_STX && (mIns[i + 1].mMode == ASMIM_ZERO_PAGE || mIns[i + 1].mMode == ASMIM_ABSOLUTE))
-					{
-						mIns[i + 0].mLive |= LIVE_CPU_REG_A;
-						mIns[i + 1].mType = ASMIT_STA;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_TAY &&
-						mIns[i + 1].mType == ASMIT_STY && (mIns[i + 1].mMode == ASMIM_ZERO_PAGE || mIns[i + 1].mMode == ASMIM_ABSOLUTE))
-					{
-						mIns[i + 0].mLive |= LIVE_CPU_REG_A;
-						mIns[i + 1].mType = ASMIT_STA;
-						progress = true;
-					}
-#if 1
-					else if (mIns[i + 0].mType == ASMIT_TXA && mIns[i + 1].mType == ASMIT_STX)
-					{
-						NativeCodeInstruction	ins(mIns[i + 0]);
-						mIns[i + 0] = mIns[i + 1]; mIns[i + 0].mLive |= LIVE_CPU_REG_X;
-						mIns[i + 1] = ins;
-						progress = true;
-					}
-					else if (mIns[i + 0].mType == ASMIT_TYA && mIns[i + 1].mType == ASMIT_STY)
-					{
-						NativeCodeInstruction	ins(mIns[i + 0]);
-						mIns[i + 0] = mIns[i + 1]; mIns[i + 0].mLive |= LIVE_CPU_REG_Y;
-						mIns[i + 1] = ins;
-						progress = true;
-					}
-					else if (mIns[i + 0].mType == ASMIT_TAX && mIns[i + 1].mType == ASMIT_STA && !mIns[i + 1].RequiresXReg())
-					{
-						NativeCodeInstruction	ins(mIns[i + 0]);
-						mIns[i + 0] = mIns[i + 1]; mIns[i + 0].mLive |= LIVE_CPU_REG_A;
-						mIns[i + 1] = ins;
-						progress = true;
-					}
-					else if (mIns[i + 0].mType == ASMIT_TAY && mIns[i + 1].mType == ASMIT_STA && !mIns[i + 1].RequiresYReg())
-					{
-						NativeCodeInstruction	ins(mIns[i + 0]);
-						mIns[i + 0] = mIns[i + 1]; mIns[i + 0].mLive |= LIVE_CPU_REG_A;
-						mIns[i + 1] = ins;
-						progress = true;
-					}
-#endif
-					else if (
-						mIns[i + 0].mType == ASMIT_ROL && mIns[i + 0].mMode == ASMIM_IMPLIED &&
-						mIns[i + 1].mType == ASMIT_LSR && mIns[i + 1].mMode == ASMIM_IMPLIED &&  !(mIns[i + 1].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Z)))
-					{
-						mIns[i + 0].mType = ASMIT_NOP; mIns[i + 0].mMode = ASMIM_IMPLIED;
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_ROR && mIns[i + 0].mMode == ASMIM_IMPLIED &&
-						mIns[i + 1].mType == ASMIT_ASL && mIns[i + 1].mMode == ASMIM_IMPLIED && !(mIns[i + 1].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Z)))
-					{
-						mIns[i + 0].mType = ASMIT_NOP; mIns[i + 0].mMode = ASMIM_IMPLIED;
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-
-					else if (
-						mIns[i + 0].mType == ASMIT_TXA &&
-						mIns[i + 1].mType == ASMIT_TAX)
-					{
-						mIns[i + 0].mLive |= LIVE_CPU_REG_X;
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_TYA &&
-						mIns[i + 1].mType == ASMIT_TAY)
-					{
-						mIns[i + 0].mLive |= LIVE_CPU_REG_Y;
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_TAX &&
-						mIns[i + 1].mType == ASMIT_TXA)
-					{
-						mIns[i + 0].mLive |= LIVE_CPU_REG_A;
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_TAY &&
-						mIns[i + 1].mType == ASMIT_TYA)
-					{
-						mIns[i + 0].mLive |= LIVE_CPU_REG_A;
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_INX &&
-						mIns[i + 1].mType == ASMIT_DEX && !(mIns[i + 1].mLive & LIVE_CPU_REG_Z))
-					{
-						mIns[i + 0].mType = ASMIT_NOP; mIns[i + 0].mMode = ASMIM_IMPLIED;
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_DEX &&
-						mIns[i + 1].mType == ASMIT_INX && !(mIns[i + 1].mLive & LIVE_CPU_REG_Z))
-					{
-						mIns[i + 0].mType = ASMIT_NOP; mIns[i + 0].mMode = ASMIM_IMPLIED;
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_INY &&
-						mIns[i + 1].mType == ASMIT_DEY && !(mIns[i + 1].mLive & LIVE_CPU_REG_Z))
-					{
-						mIns[i + 0].mType = ASMIT_NOP; mIns[i + 0].mMode = ASMIM_IMPLIED;
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_DEY &&
-						mIns[i + 1].mType == ASMIT_INY && !(mIns[i + 1].mLive & LIVE_CPU_REG_Z))
-					{
-						mIns[i + 0].mType = ASMIT_NOP; mIns[i + 0].mMode = ASMIM_IMPLIED;
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-
-					else if (
-						mIns[i + 0].mType == ASMIT_LDA && (mIns[i + 0].mMode == ASMIM_IMMEDIATE || mIns[i + 0].mMode == ASMIM_ZERO_PAGE || mIns[i + 0].mMode == ASMIM_ABSOLUTE || mIns[i + 0].mMode == ASMIM_ABSOLUTE_X) &&
-						mIns[i + 1].mType == ASMIT_TAY && !(mIns[i + 1].mLive & LIVE_CPU_REG_A))
-					{
-						mIns[i + 0].mType = ASMIT_LDY; mIns[i + 0].mLive |= mIns[i + 1].mLive;
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_LDA && (mIns[i + 0].mMode == ASMIM_IMMEDIATE || mIns[i + 0].mMode == ASMIM_ZERO_PAGE || mIns[i + 0].mMode == ASMIM_ABSOLUTE || mIns[i + 0].mMode == ASMIM_ABSOLUTE_Y) &&
-						mIns[i + 1].mType == ASMIT_TAX && !(mIns[i + 1].mLive & LIVE_CPU_REG_A))
-					{
-						mIns[i + 0].mType = ASMIT_LDX; mIns[i + 0].mLive |= mIns[i + 1].mLive;
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_LDY && (mIns[i + 0].mMode == ASMIM_IMMEDIATE || mIns[i + 0].mMode == ASMIM_ZERO_PAGE || mIns[i + 0].mMode == ASMIM_ABSOLUTE || mIns[i + 0].mMode == ASMIM_ABSOLUTE_X) &&
-						mIns[i + 1].mType == ASMIT_TYA && !(mIns[i + 1].mLive & LIVE_CPU_REG_Y))
-					{
-						mIns[i + 0].mType = ASMIT_LDA; mIns[i + 0].mLive |= mIns[i + 1].mLive;
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_LDX && (mIns[i + 0].mMode == ASMIM_IMMEDIATE || mIns[i + 0].mMode == ASMIM_ZERO_PAGE || mIns[i + 0].mMode == ASMIM_ABSOLUTE || mIns[i + 0].mMode == ASMIM_ABSOLUTE_Y) &&
-						mIns[i + 1].mType == ASMIT_TXA && !(mIns[i + 1].mLive & LIVE_CPU_REG_X))
-					{
-						mIns[i + 0].mType = ASMIT_LDA; mIns[i + 0].mLive |= mIns[i + 1].mLive;
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_TXA &&
-						mIns[i + 1].mType == ASMIT_CMP && (mIns[i + 1].mMode == ASMIM_IMMEDIATE || mIns[i + 1].mMode == ASMIM_ZERO_PAGE || mIns[i + 1].mMode == ASMIM_ABSOLUTE))
-					{
-						mIns[i + 1].mType = ASMIT_CPX;
-						mIns[i + 0].mLive |= LIVE_CPU_REG_X;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_TYA &&
-						mIns[i + 1].mType == ASMIT_CMP && (mIns[i + 1].mMode == ASMIM_IMMEDIATE || mIns[i + 1].mMode == ASMIM_ZERO_PAGE || mIns[i + 1].mMode == ASMIM_ABSOLUTE))
-					{
-						mIns[i + 1].mType = ASMIT_CPY;
-						mIns[i + 0].mLive |= LIVE_CPU_REG_Y;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_LDX &&
-						mIns[i + 1].mType == ASMIT_STX && !(mIns[i + 1].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_X)))
-					{
-						mIns[i + 0].mType = ASMIT_LDA; mIns[i + 0].mLive |= LIVE_CPU_REG_A;
-						mIns[i + 1].mType = ASMIT_STA;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_LDY &&
-						mIns[i + 1].mType == ASMIT_STY && !(mIns[i + 1].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Y)))
-					{
-						mIns[i + 0].mType = ASMIT_LDA; mIns[i + 0].mLive |= LIVE_CPU_REG_A;
-						mIns[i + 1].mType = ASMIT_STA;
-						progress = true;
-					}
-					else if (
-						(mIns[i + 0].mType == ASMIT_LDX || mIns[i + 0].mType == ASMIT_LDY) && mIns[i + 0].mMode == ASMIM_ZERO_PAGE &&
-						mIns[i + 1].mType == ASMIT_STA && mIns[i + 1].mMode == ASMIM_ZERO_PAGE && !mIns[i + 1].SameEffectiveAddress(mIns[i + 0]))
-					{
-						NativeCodeInstruction	ins = mIns[i + 0];
-						mIns[i + 0] = mIns[i + 1]; mIns[i + 0].mLive |= ins.mLive;
-						mIns[i + 1] = ins;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_INY &&
-						mIns[i + 1].mMode == ASMIM_ABSOLUTE_Y && !(mIns[i + 1].mLive & LIVE_CPU_REG_Y))
-					{
-						mIns[i + 0].mType = ASMIT_NOP; mIns[i + 0].mMode = ASMIM_IMPLIED;
-						mIns[i + 1].mAddress++;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_INX &&
-						mIns[i + 1].mMode == ASMIM_ABSOLUTE_X && !(mIns[i + 1].mLive & LIVE_CPU_REG_X))
-					{
-						mIns[i + 0].mType = ASMIT_NOP; mIns[i + 0].mMode = ASMIM_IMPLIED;
-						mIns[i + 1].mAddress++;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_ROL && mIns[i + 0].mMode == ASMIM_IMPLIED &&
-						mIns[i + 1].mType == ASMIT_AND && mIns[i + 1].mMode == ASMIM_IMMEDIATE && !(mIns[i + 1].mAddress & 0x01) && !(mIns[i + 1].mLive & LIVE_CPU_REG_C))
-					{
-						mIns[i + 0].mType = ASMIT_ASL;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_ROR && mIns[i + 0].mMode == ASMIM_IMPLIED &&
-						mIns[i + 1].mType == ASMIT_AND && mIns[i + 1].mMode == ASMIM_IMMEDIATE && !(mIns[i + 1].mAddress & 0x80) && !(mIns[i + 1].mLive & LIVE_CPU_REG_C))
-					{
-						mIns[i + 0].mType = ASMIT_LSR;
-						progress = true;
-					}
 					else if (
-						mIns[i + 0].IsShift() && mIns[i + 0].mMode == ASMIM_ZERO_PAGE &&
-						mIns[i + 1].mType == ASMIT_LDA && mIns[i + 1].mMode == ASMIM_ZERO_PAGE && mIns[i + 1].mAddress == mIns[i + 0].mAddress && !(mIns[i + 1].mLive & LIVE_MEM))
+						mIns[i + 0].mType == ASMIT_ASL && mIns[i + 0].mMode == ASMIM_ZERO_PAGE &&
+						mIns[i + 1].mType == ASMIT_LDY && mIns[i + 1].mMode == ASMIM_ZERO_PAGE && mIns[i + 0].mAddress == mIns[i + 1].mAddress && !(mIns[i + 1].mLive & (LIVE_MEM | LIVE_CPU_REG_A)))
 					{
-						mIns[i + 1].mType = mIns[i + 0].mType;
+						mIns[i + 0].mType = ASMIT_LDA;
+						mIns[i + 0].mLive |= LIVE_CPU_REG_A;
+						mIns[i + 1].mType = ASMIT_ASL;
 						mIns[i + 1].mMode = ASMIM_IMPLIED;
+						mIns.Insert(i + 2, NativeCodeInstruction(ASMIT_TAY, ASMIM_IMPLIED));
+						mIns[i + 2].mLive = mIns[i + 1].mLive;
 						mIns[i + 1].mLive |= LIVE_CPU_REG_A;
-						mIns[i + 0].mLive |= LIVE_CPU_REG_A | LIVE_CPU_REG_C;
-						mIns[i + 0].mType = ASMIT_LDA;
 						progress = true;
 					}
 					else if (mIns[i + 0].mType == ASMIT_LDY && mIns[i + 0].mMode == ASMIM_IMMEDIATE && mIns[i + 1].mMode == ASMIM_INDIRECT_Y)
@@ -22930,25 +23167,8 @@ bool NativeCodeBasicBlock::PeepHoleOptimizer(NativeCodeProcedure* proc, int pass
 #if 1
 				if (i + 2 < mIns.Size())
 				{
-					if (mIns[i].mType == ASMIT_LDA && mIns[i + 2].mType == ASMIT_LDA && (mIns[i + 1].mType == ASMIT_CLC || mIns[i + 1].mType == ASMIT_SEC))
-					{
-						mIns[i].mType = ASMIT_NOP; mIns[i].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (mIns[i + 0].mType == ASMIT_STA && mIns[i + 0].mMode == ASMIM_ZERO_PAGE &&
-						mIns[i + 2].mType == ASMIT_LDA && mIns[i + 2].mMode == ASMIM_ZERO_PAGE && mIns[i + 0].mAddress == mIns[i + 2].mAddress &&
-						mIns[i + 1].mType == ASMIT_INC && mIns[i + 1].mMode == ASMIM_ZERO_PAGE && mIns[i + 0].mAddress == mIns[i + 1].mAddress && (mIns[i + 2].mLive & LIVE_CPU_REG_C) == 0)
-					{
-						mIns[i + 0].mType = ASMIT_CLC;
-						mIns[i + 0].mMode = ASMIM_IMPLIED;
-						mIns[i + 0].mLive |= LIVE_CPU_REG_C;
-						mIns[i + 1].mType = ASMIT_ADC;
-						mIns[i + 1].mMode = ASMIM_IMMEDIATE;
-						mIns[i + 1].mAddress = 1;
-						mIns[i + 2].mType = ASMIT_STA;
+					if (PatternPeepHole(i, 3))
 						progress = true;
-					}
-
 					else if (mIns[i + 0].mType == ASMIT_STA && mIns[i + 0].mMode == ASMIM_ZERO_PAGE &&
 						mIns[i + 1].mType == ASMIT_LDA && mIns[i + 1].mMode != ASMIM_ZERO_PAGE &&
 						mIns[i + 2].mMode == ASMIM_ZERO_PAGE && mIns[i + 0].mAddress == mIns[i + 2].mAddress &&
@@ -22960,16 +23180,6 @@ bool NativeCodeBasicBlock::PeepHoleOptimizer(NativeCodeProcedure* proc, int pass
 						mIns[i + 2].mType = ASMIT_NOP; mIns[i + 2].mMode = ASMIM_IMPLIED;
 						progress = true;
 					}
-					else if (
-						mIns[i + 0].ChangesAccuAndFlag() &&
-						mIns[i + 1].mType == ASMIT_STA && mIns[i + 2].mType == ASMIT_LDA &&
-						mIns[i + 1].SameEffectiveAddress(mIns[i + 2]))
-					{
-						mIns[i + 0].mLive |= mIns[i + 2].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Z);
-						mIns[i + 1].mLive |= mIns[i + 2].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Z);
-						mIns[i + 2].mType = ASMIT_NOP; mIns[i + 2].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
 					else if (
 						mIns[i + 0].mType == ASMIT_STA && mIns[i + 0].mMode == ASMIM_ZERO_PAGE &&
 						mIns[i + 2].mType == ASMIT_LDY && mIns[i + 2].mMode == ASMIM_ZERO_PAGE && mIns[i + 2].mAddress == mIns[i + 0].mAddress &&
@@ -22993,46 +23203,6 @@ bool NativeCodeBasicBlock::PeepHoleOptimizer(NativeCodeProcedure* proc, int pass
 						mIns[i + 1].mLive |= LIVE_CPU_REG_Y;
 						progress = true;
 					}
-					else if (
-						mIns[i + 0].mType == ASMIT_STA && mIns[i + 0].mMode == ASMIM_ZERO_PAGE &&
-						mIns[i + 2].mType == ASMIT_LDA && mIns[i + 2].mMode == ASMIM_ZERO_PAGE && mIns[i + 2].mAddress == mIns[i + 0].mAddress &&
-						mIns[i + 1].mType == ASMIT_DEC && mIns[i + 1].mMode == ASMIM_ZERO_PAGE && mIns[i + 1].mAddress == mIns[i + 0].mAddress &&
-						!(mIns[i + 2].mLive & LIVE_CPU_REG_C))
-					{
-						mIns[i + 0].mType = ASMIT_SEC; mIns[i + 0].mMode = ASMIM_IMPLIED; mIns[i + 0].mLive |= LIVE_CPU_REG_C;
-						mIns[i + 1].mType = ASMIT_SBC; mIns[i + 1].mMode = ASMIM_IMMEDIATE; mIns[i + 1].mAddress = 1;
-						mIns[i + 2].mType = ASMIT_STA;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].mType == ASMIT_LDA && mIns[i + 0].mMode == ASMIM_IMMEDIATE && mIns[i + 0].mAddress == 0 &&
-						mIns[i + 1].mType == ASMIT_CMP && mIns[i + 1].mMode == ASMIM_IMMEDIATE &&
-						mIns[i + 2].mType == ASMIT_ROR && mIns[i + 2].mMode == ASMIM_IMPLIED)
-					{
-						mIns[i + 1].mType = ASMIT_NOP; mIns[i + 1].mMode = ASMIM_IMPLIED;
-						mIns[i + 2].mType = ASMIT_CLC; mIns[i + 2].mMode = ASMIM_IMPLIED;
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].ChangesAccuAndFlag() &&
-						mIns[i + 1].mType == ASMIT_STA &&
-						mIns[i + 2].mType == ASMIT_ORA && mIns[i + 2].mMode == ASMIM_IMMEDIATE && mIns[i + 2].mAddress == 0)
-					{
-						mIns[i + 2].mType = ASMIT_NOP; mIns[i + 2].mMode = ASMIM_IMPLIED;
-						mIns[i + 0].mLive |= mIns[i + 2].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Z);
-						mIns[i + 1].mLive |= mIns[i + 2].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Z);
-						progress = true;
-					}
-					else if (
-						mIns[i + 0].ChangesAccuAndFlag() &&
-						mIns[i + 1].mType == ASMIT_STA &&
-						mIns[i + 2].mType == ASMIT_CMP && mIns[i + 2].mMode == ASMIM_IMMEDIATE && mIns[i + 2].mAddress == 0 && !(mIns[i + 2].mLive & LIVE_CPU_REG_C))
-					{
-						mIns[i + 2].mType = ASMIT_NOP; mIns[i + 2].mMode = ASMIM_IMPLIED;
-						mIns[i + 0].mLive |= mIns[i + 2].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Z);
-						mIns[i + 1].mLive |= mIns[i + 2].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Z);
-						progress = true;
-					}
 					else if (
 						mIns[i + 0].mType == ASMIT_LDA && (mIns[i + 0].mMode == ASMIM_ZERO_PAGE || mIns[i + 0].mMode == ASMIM_ABSOLUTE) &&
 						mIns[i + 1].IsShift() &&
@@ -25062,11 +25232,11 @@ bool NativeCodeBasicBlock::PeepHoleOptimizer(NativeCodeProcedure* proc, int pass
 						mIns[i + 0].mType == ASMIT_LDA && (mIns[i + 0].mMode == ASMIM_ABSOLUTE || mIns[i + 0].mMode == ASMIM_ABSOLUTE_X || mIns[i + 0].mMode == ASMIM_ABSOLUTE_Y || mIns[i + 0].mMode == ASMIM_INDIRECT_Y) &&
 						mIns[i + 1].mType == ASMIT_STA && mIns[i + 1].mMode == ASMIM_ZERO_PAGE)
 					{
-						int	n = 3;
-						if (mIns[i + 0].mFlags & NCIF_VOLATILE)
-							n = 1;
-						if (mIns[i + 1].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Z))
-							n--;
+						int	n = mIns[i + 1].Cycles();
+						if (!(mIns[i + 1].mLive & (LIVE_CPU_REG_A | LIVE_CPU_REG_Z)))
+							n += mIns[i + 0].Cycles();
+						else if (mIns[i + 0].mFlags & NCIF_VOLATILE)
+							n = 0;
 
 						if (n > 0 && (mIns[i + 0].mMode != ASMIM_INDIRECT_Y || (mIns[i + 1].mAddress != mIns[i + 0].mAddress && mIns[i + 1].mAddress != mIns[i + 0].mAddress + 1)))
 						{
@@ -25096,11 +25266,11 @@ bool NativeCodeBasicBlock::PeepHoleOptimizer(NativeCodeProcedure* proc, int pass
 						mIns[i + 0].mType == ASMIT_LDX && mIns[i + 0].mMode == ASMIM_ABSOLUTE &&
 						mIns[i + 1].mType == ASMIT_STX && mIns[i + 1].mMode == ASMIM_ZERO_PAGE)
 					{
-						int	n = 3;
-						if (mIns[i + 0].mFlags & NCIF_VOLATILE)
-							n = 1;
-						if (mIns[i + 1].mLive & (LIVE_CPU_REG_X | LIVE_CPU_REG_Z))
-							n--;
+						int	n = mIns[i + 1].Cycles();
+						if (!(mIns[i + 1].mLive & (LIVE_CPU_REG_X | LIVE_CPU_REG_Z)))
+							n += mIns[i + 0].Cycles();
+						else if (mIns[i + 0].mFlags & NCIF_VOLATILE)
+							n = 0;
 
 						if (n > 0)
 						{
@@ -25119,7 +25289,7 @@ bool NativeCodeBasicBlock::PeepHoleOptimizer(NativeCodeProcedure* proc, int pass
 						mIns[i + 1].mType == ASMIT_STA && mIns[i + 1].mMode == ASMIM_ABSOLUTE)
 					{
 						proc->ResetPatched();
-						if (CheckSingleUseGlobalLoad(this, mIns[i + 0].mAddress, i + 2, mIns[i + 1], 2))
+						if (CheckSingleUseGlobalLoad(this, mIns[i + 0].mAddress, i + 2, mIns[i + 1], mIns[i + 0].Cycles()))
 						{
 							proc->ResetPatched();
 							if (PatchSingleUseGlobalLoad(this, mIns[i + 0].mAddress, i + 2, mIns[i + 1]))
@@ -25961,113 +26131,473 @@ void NativeCodeBasicBlock::CheckBlocks(void)
 		if (mTrueJump) mTrueJump->CheckBlocks();
 		if (mFalseJump) mFalseJump->CheckBlocks();
 	}
-#endif
-}
+#endif
+}
+
+void NativeCodeBasicBlock::CheckLive(void)
+{
+#if _DEBUG
+	uint32	live = 0;
+
+	assert(mBranch == ASMIT_RTS || (mBranch == ASMIT_JMP) == (mFalseJump == nullptr));
+
+	if (mBranch == ASMIT_BCC || mBranch == ASMIT_BCS)
+		live |= LIVE_CPU_REG_C;
+	if (mBranch == ASMIT_BEQ || mBranch == ASMIT_BNE || mBranch == ASMIT_BPL || mBranch == ASMIT_BMI)
+		live |= LIVE_CPU_REG_Z;
+
+	for (int j = mIns.Size() - 1; j >= 0; j--)
+	{
+		assert(mIns[j].mType != ASMIT_INV);
+
+		if (mIns[j].mType != ASMIT_NOP)
+		{
+			assert(!(live & ~mIns[j].mLive));
+
+			if (mIns[j].mType == ASMIT_JSR)
+			{
+				assert(!(live & (LIVE_CPU_REG_X | LIVE_CPU_REG_Y)));
+				if (!(mIns[j].mFlags & NCIF_JSRFLAGS))
+					assert(!(live & (LIVE_CPU_REG_C | LIVE_CPU_REG_Z)));
+			}
+
+			if (mIns[j].ChangesXReg()) live &= ~LIVE_CPU_REG_X;
+			if (mIns[j].ChangesYReg()) live &= ~LIVE_CPU_REG_Y;
+			if (mIns[j].ChangesCarry()) live &= ~LIVE_CPU_REG_C;
+			if (mIns[j].ChangesZFlag()) live &= ~LIVE_CPU_REG_Z;
+
+			if (mIns[j].RequiresXReg()) live |= LIVE_CPU_REG_X;
+			if (mIns[j].RequiresYReg()) live |= LIVE_CPU_REG_Y;
+			if (mIns[j].RequiresCarry()) live |= LIVE_CPU_REG_C;
+		}
+	}
+#endif
+}
+
+void NativeCodeBasicBlock::Assemble(void)
+{
+	if (!mAssembled)
+	{
+		mAssembled = true;
+
+		for (int i = 0; i < mIns.Size(); i++)
+			mIns[i].Assemble(this);
+
+		if (this->mTrueJump)
+			this->mTrueJump->Assemble();
+		if (this->mFalseJump)
+			this->mFalseJump->Assemble();
+		for (int i = 0; i < mCaseJumps.Size(); i++)
+			mCaseJumps[i]->Assemble();
+	}
+}
+
+void NativeCodeBasicBlock::Close(NativeCodeBasicBlock* trueJump, NativeCodeBasicBlock* falseJump, AsmInsType branch)
+{
+	this->mTrueJump = trueJump;
+	this->mFalseJump = falseJump;
+	this->mBranch = branch;
+}
+
+
+NativeCodeBasicBlock* NativeCodeBasicBlock::BypassEmptyBlocks(void)
+{
+	if (mBypassed)
+		return this;
+	else if (mTrueJump && !mFalseJump && mCode.Size() == 0 && this != mTrueJump)
+		return mTrueJump->BypassEmptyBlocks();
+	else
+	{
+		mBypassed = true;
+
+		if (mFalseJump)
+			mFalseJump = mFalseJump->BypassEmptyBlocks();
+		if (mTrueJump)
+			mTrueJump = mTrueJump->BypassEmptyBlocks();
+		for (int i = 0; i < mCaseJumps.Size(); i++)
+			mCaseJumps[i] = mCaseJumps[i]->BypassEmptyBlocks();
+
+		return this;
+	}
+}
+
+int NativeCodeBasicBlock::LeadsInto(NativeCodeBasicBlock* block, int dist)
+{
+	if (mPlaced)
+		return 6;
+	else if (mTrueJump == block || mFalseJump == block)
+		return dist;
+	else if (dist < 5)
+	{
+		int d0 = mTrueJump ? mTrueJump->LeadsInto(block, dist + 1) : 6;
+		int d1 = mFalseJump ? mFalseJump->LeadsInto(block, dist + 1) : 6;
+
+		if (d0 < d1)
+			return d0;
+		else
+			return d1;
+	}
+
+	return 6;
+}
+
+// Flags after comparing the value v with an immediate value, an ORA #0
+// tests the accu and keeps the carry
+
+static void CaseCompare(const NativeCodeInstruction& ins, int v, bool& c, bool& z, bool& n)
+{
+	if (ins.mType == ASMIT_ORA)
+	{
+		z = v == 0;
+		n = (v & 0x80) != 0;
+	}
+	else
+	{
+		int	imm = ins.mAddress & 0xff;
+		c = v >= imm;
+		z = v == imm;
+		n = ((v - imm) & 0x80) != 0;
+	}
+}
+
+static bool CaseBranchTaken(AsmInsType branch, bool c, bool z, bool n, bool& taken)
+{
+	switch (branch)
+	{
+	case ASMIT_BEQ:
+		taken = z;
+		return true;
+	case ASMIT_BNE:
+		taken = !z;
+		return true;
+	case ASMIT_BCS:
+		taken = c;
+		return true;
+	case ASMIT_BCC:
+		taken = !c;
+		return true;
+	case ASMIT_BMI:
+		taken = n;
+		return true;
+	case ASMIT_BPL:
+		taken = !n;
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool NativeCodeBasicBlock::IsCaseNode(AsmInsType cmp) const
+{
+	if (!mFalseJump || mLocked)
+		return false;
+	else if (mIns.Size() == 0)
+		return true;
+	else if (mIns.Size() == 1 && mIns[0].mMode == ASMIM_IMMEDIATE)
+		return mIns[0].mType == cmp || cmp == ASMIT_CMP && mIns[0].mType == ASMIT_ORA && mIns[0].mAddress == 0;
+	else
+		return false;
+}
+
+bool NativeCodeBasicBlock::BuildJumpTable(NativeCodeProcedure* proc)
+{
+	// A tree of blocks that only compare the same register with immediate
+	// values and branch on the result is replaced by a jump table, when it
+	// is dense enough and the dispatch is faster or smaller than the tree
+
+	if (!mFalseJump || mLocked || mIns.Size() == 0)
+		return false;
+
+	NativeCodeInstruction	cins(mIns.Last());
+	if (cins.mMode != ASMIM_IMMEDIATE || (cins.mType != ASMIT_CMP && cins.mType != ASMIT_CPX && cins.mType != ASMIT_CPY))
+		return false;
+
+	NativeCodeBasicBlock* target[256];
+	int		cycles[256];
+
+	GrowingArray<NativeCodeBasicBlock*>	nodes(nullptr);
+	int		ncmps = 0;
+
+	for (int v = 0; v < 256; v++)
+	{
+		NativeCodeBasicBlock* block = this;
+		bool	c, z, n;
+		int	cyc = cins.Cycles();
+
+		CaseCompare(cins, v, c, z, n);
+
+		for (;;)
+		{
+			bool	taken;
+			if (!CaseBranchTaken(block->mBranch, c, z, n, taken))
+				return false;
+			cyc += AsmInsCycles(block->mBranch, ASMIM_RELATIVE, false, taken);
+
+			NativeCodeBasicBlock* next = taken ? block->mTrueJump : block->mFalseJump;
+
+			int	skip = 0;
+			while (!next->mFalseJump && next->mTrueJump && next->mIns.Size() == 0 && skip < 8)
+			{
+				next = next->mTrueJump;
+				cyc += AsmInsCycles(ASMIT_JMP, ASMIM_ABSOLUTE);
+				skip++;
+			}
+
+			if (next != this && next->IsCaseNode(cins.mType))
+			{
+				if (nodes.IndexOf(next) < 0)
+				{
+					if (nodes.Size() == 64)
+						return false;
+					nodes.Push(next);
+					if (next->mIns.Size())
+						ncmps++;
+				}
+
+				if (next->mIns.Size())
+				{
+					CaseCompare(next->mIns[0], v, c, z, n);
+					cyc += next->mIns[0].Cycles();
+				}
+				block = next;
+			}
+			else
+			{
+				target[v] = next;
+				break;
+			}
+		}
+
+		cycles[v] = cyc;
+	}
+
+	if (nodes.Size() < 4)
+		return false;
+
+	int	lo = 0;
+	while (lo < 256 && target[lo] == target[0])
+		lo++;
+	int	hi = 255;
+	while (hi >= 0 && target[hi] == target[255])
+		hi--;
+
+	if (hi - lo < 4)
+		return false;
+
+	// A few more table entries are cheaper than a range check
+
+	if (lo <= 2)
+		lo = 0;
+	if (hi >= 253)
+		hi = 255;
+
+	int	n = hi - lo + 1;
+
+	// The flags at the entry of the targets change and the index
+	// register is lost, the accu can be restored if it holds the value
+
+	NumberSet	required(NUM_REGS);
+	for (int v = 0; v < 256; v++)
+		required |= target[v]->mEntryRequiredRegs;
+
+	if (required[CPU_REG_C] || required[CPU_REG_Z])
+		return false;
+
+	AsmInsType	index, load, restore = ASMIT_INV;
+	if (cins.mType == ASMIT_CPX)
+		index = ASMIT_LDX;
+	else if (cins.mType == ASMIT_CPY)
+		index = ASMIT_LDY;
+	else if (!required[CPU_REG_X])
+		index = ASMIT_TAX;
+	else if (!required[CPU_REG_Y])
+		index = ASMIT_TAY;
+	else
+		return false;
+
+	if (required[CPU_REG_A])
+	{
+		if (index == ASMIT_TAX)
+			restore = ASMIT_TXA;
+		else if (index == ASMIT_TAY)
+			restore = ASMIT_TYA;
+		else
+			return false;
+	}
+
+	AsmInsMode	mode = (index == ASMIT_TAX || index == ASMIT_LDX) ? ASMIM_ABSOLUTE_X : ASMIM_ABSOLUTE_Y;
+
+	int	dcycles = 2 * (AsmInsCycles(ASMIT_LDA, mode) + AsmInsCycles(ASMIT_PHA, ASMIM_IMPLIED)) + AsmInsCycles(ASMIT_RTS, ASMIM_IMPLIED);
+	int	dsize = 3 + 1 + 3 + 1 + 1 + 2 * n;
+	int	rcycles = AsmInsCycles(cins.mType, ASMIM_IMMEDIATE) + AsmInsCycles(ASMIT_BCC, ASMIM_RELATIVE);
+	if (lo > 0)
+	{
+		dcycles += rcycles;
+		dsize += 4;
+	}
+	if (hi < 255)
+	{
+		dcycles += rcycles;
+		dsize += 4;
+	}
+	if (index == ASMIT_TAX || index == ASMIT_TAY)
+	{
+		dcycles += AsmInsCycles(index, ASMIM_IMPLIED);
+		dsize++;
+	}
+	if (restore != ASMIT_INV)
+	{
+		dcycles += AsmInsCycles(restore, ASMIM_IMPLIED);
+		dsize++;
+	}
 
-void NativeCodeBasicBlock::CheckLive(void)
-{
-#if _DEBUG
-	uint32	live = 0;
+	int	tcycles = 0;
+	for (int v = lo; v <= hi; v++)
+		tcycles += cycles[v];
+	int	tsize = 4 + 2 * (nodes.Size() + ncmps);
 
-	assert(mBranch == ASMIT_RTS || (mBranch == ASMIT_JMP) == (mFalseJump == nullptr));
+	if (proc->mInterProc->mCompilerOptions & COPT_OPTIMIZE_CODE_SIZE)
+	{
+		if (dsize > tsize)
+			return false;
+	}
+	else if (dcycles * n >= tcycles || n > 4 * (nodes.Size() + 1))
+		return false;
 
-	if (mBranch == ASMIT_BCC || mBranch == ASMIT_BCS)
-		live |= LIVE_CPU_REG_C;
-	if (mBranch == ASMIT_BEQ || mBranch == ASMIT_BNE || mBranch == ASMIT_BPL || mBranch == ASMIT_BMI)
-		live |= LIVE_CPU_REG_Z;
+	mIns.Pop();
 
-	for (int j = mIns.Size() - 1; j >= 0; j--)
+	NativeCodeBasicBlock* block = this;
+	if (lo > 0)
 	{
-		assert(mIns[j].mType != ASMIT_INV);
+		NativeCodeBasicBlock* nblock = proc->AllocateBlock();
+		block->mIns.Push(NativeCodeInstruction(cins.mType, ASMIM_IMMEDIATE, lo));
+		block->Close(target[0], nblock, ASMIT_BCC);
+		block = nblock;
+	}
+	if (hi < 255)
+	{
+		NativeCodeBasicBlock* nblock = proc->AllocateBlock();
+		block->mIns.Push(NativeCodeInstruction(cins.mType, ASMIM_IMMEDIATE, hi + 1));
+		block->Close(target[255], nblock, ASMIT_BCS);
+		block = nblock;
+	}
 
-		if (mIns[j].mType != ASMIT_NOP)
-		{
-			assert(!(live & ~mIns[j].mLive));
+	char	name[200];
+	const char* pname = proc->mInterProc->mIdent ? proc->mInterProc->mIdent->mString : "";
+	LinkerSection* section = proc->mInterProc->mLinkerObject->mSection;
+	Location	loc;
 
-			if (mIns[j].mType == ASMIT_JSR)
-			{
-				assert(!(live & (LIVE_CPU_REG_X | LIVE_CPU_REG_Y)));
-				if (!(mIns[j].mFlags & NCIF_JSRFLAGS))
-					assert(!(live & (LIVE_CPU_REG_C | LIVE_CPU_REG_Z)));
-			}
+	sprintf_s(name, 200, "%s@caseL%d", pname, block->mIndex);
+	block->mCaseTableLow = proc->mGenerator->mLinker->NewObject(loc, Ident::Unique(name), section, LOT_DATA);
+	block->mCaseTableLow->AddSpace(n);
+	proc->mCaseTables.Push(block->mCaseTableLow);
+	sprintf_s(name, 200, "%s@caseH%d", pname, block->mIndex);
+	block->mCaseTableHigh = proc->mGenerator->mLinker->NewObject(loc, Ident::Unique(name), section, LOT_DATA);
+	block->mCaseTableHigh->AddSpace(n);
+	proc->mCaseTables.Push(block->mCaseTableHigh);
+
+	if (index == ASMIT_TAX || index == ASMIT_TAY)
+		block->mIns.Push(NativeCodeInstruction(index, ASMIM_IMPLIED));
+	block->mIns.Push(NativeCodeInstruction(ASMIT_LDA, mode, -lo, block->mCaseTableHigh));
+	block->mIns.Push(NativeCodeInstruction(ASMIT_PHA, ASMIM_IMPLIED));
+	block->mIns.Push(NativeCodeInstruction(ASMIT_LDA, mode, -lo, block->mCaseTableLow));
+	block->mIns.Push(NativeCodeInstruction(ASMIT_PHA, ASMIM_IMPLIED));
+	if (restore != ASMIT_INV)
+		block->mIns.Push(NativeCodeInstruction(restore, ASMIM_IMPLIED));
+	block->mIns.Push(NativeCodeInstruction(ASMIT_RTS, ASMIM_IMPLIED));
+	block->Close(nullptr, nullptr, ASMIT_RTS);
+
+	for (int v = lo; v <= hi; v++)
+		block->mCaseJumps.Push(target[v]);
 
-			if (mIns[j].ChangesXReg()) live &= ~LIVE_CPU_REG_X;
-			if (mIns[j].ChangesYReg()) live &= ~LIVE_CPU_REG_Y;
-			if (mIns[j].ChangesCarry()) live &= ~LIVE_CPU_REG_C;
-			if (mIns[j].ChangesZFlag()) live &= ~LIVE_CPU_REG_Z;
+	return true;
+}
 
-			if (mIns[j].RequiresXReg()) live |= LIVE_CPU_REG_X;
-			if (mIns[j].RequiresYReg()) live |= LIVE_CPU_REG_Y;
-			if (mIns[j].RequiresCarry()) live |= LIVE_CPU_REG_C;
-		}
+bool NativeCodeBasicBlock::BuildJumpTables(NativeCodeProcedure* proc)
+{
+	bool	changed = false;
+
+	if (!mVisited)
+	{
+		mVisited = true;
+
+		if (BuildJumpTable(proc))
+			changed = true;
+
+		if (mTrueJump && mTrueJump->BuildJumpTables(proc))
+			changed = true;
+		if (mFalseJump && mFalseJump->BuildJumpTables(proc))
+			changed = true;
+		for (int i = 0; i < mCaseJumps.Size(); i++)
+			if (mCaseJumps[i]->BuildJumpTables(proc))
+				changed = true;
 	}
-#endif
+
+	return changed;
 }
 
-void NativeCodeBasicBlock::Assemble(void)
+void NativeCodeBasicBlock::FillJumpTable(NativeCodeProcedure* proc)
 {
-	if (!mAssembled)
+	for (int i = 0; i < mCaseJumps.Size(); i++)
 	{
-		mAssembled = true;
+		LinkerReference	rl;
+		rl.mOffset = i;
+		rl.mRefObject = proc->mInterProc->mLinkerObject;
+		rl.mRefOffset = mCaseJumps[i]->mOffset - 1;
 
-		for (int i = 0; i < mIns.Size(); i++)
-			mIns[i].Assemble(this);
+		rl.mObject = mCaseTableLow;
+		rl.mFlags = LREF_LOWBYTE;
+		mCaseTableLow->AddReference(rl);
 
-		if (this->mTrueJump)
-			this->mTrueJump->Assemble();
-		if (this->mFalseJump)
-			this->mFalseJump->Assemble();
+		rl.mObject = mCaseTableHigh;
+		rl.mFlags = LREF_HIGHBYTE;
+		mCaseTableHigh->AddReference(rl);
 	}
 }
 
-void NativeCodeBasicBlock::Close(NativeCodeBasicBlock* trueJump, NativeCodeBasicBlock* falseJump, AsmInsType branch)
+bool NativeCodeBasicBlock::HasFunctionCall(void) const
 {
-	this->mTrueJump = trueJump;
-	this->mFalseJump = falseJump;
-	this->mBranch = branch;
+	for (int i = 0; i < mIns.Size(); i++)
+		if (mIns[i].mType == ASMIT_JSR && !(mIns[i].mFlags & NCIF_RUNTIME))
+			return true;
+	return false;
 }
 
-
-NativeCodeBasicBlock* NativeCodeBasicBlock::BypassEmptyBlocks(void)
+bool NativeCodeBasicBlock::HasProfiledCall(bool hot) const
 {
-	if (mBypassed)
-		return this;
-	else if (mTrueJump && !mFalseJump && mCode.Size() == 0 && this != mTrueJump)
-		return mTrueJump->BypassEmptyBlocks();
-	else
+	for (int i = 0; i < mIns.Size(); i++)
 	{
-		mBypassed = true;
-
-		if (mFalseJump)
-			mFalseJump = mFalseJump->BypassEmptyBlocks();
-		if (mTrueJump)
-			mTrueJump = mTrueJump->BypassEmptyBlocks();
-
-		return this;
+		const NativeCodeInstruction& ins(mIns[i]);
+		if (ins.mType == ASMIT_JSR && !(ins.mFlags & NCIF_RUNTIME) && ins.mLinkerObject && ins.mLinkerObject->mProc)
+		{
+			const InterCodeProcedure* proc = ins.mLinkerObject->mProc;
+			if (hot ? proc->mHotProcedure : proc->mColdProcedure)
+				return true;
+		}
 	}
+	return false;
 }
 
-int NativeCodeBasicBlock::LeadsInto(NativeCodeBasicBlock* block, int dist)
+bool NativeCodeBasicBlock::IsColdPath(const NativeCodeBasicBlock* block) const
 {
-	if (mPlaced)
-		return 6;
-	else if (mTrueJump == block || mFalseJump == block)
-		return dist;
-	else if (dist < 5)
-	{
-		int d0 = mTrueJump ? mTrueJump->LeadsInto(block, dist + 1) : 6;
-		int d1 = mFalseJump ? mFalseJump->LeadsInto(block, dist + 1) : 6;
+	// A conditional path that calls a function, which never ran in the profile
+	// given by -fprofile-use, is the rare case and may jump back from the end.
+	// Without a profile, a path that calls a function which is not hot and its
+	// alternative does not, is assumed to be the rare case, such as error handling
 
-		if (d0 < d1)
-			return d0;
-		else
-			return d1;
-	}
+	if (mPlaced || mKeepPlace || mNumEntries != 1 || !mTrueJump || mFalseJump || mCaseJumps.Size())
+		return false;
 
-	return 6;
+	if (HasProfiledCall(false) && !block->HasProfiledCall(false))
+		return true;
+
+	if (mTrueJump != block && (mTrueJump->mTrueJump || mTrueJump->mCaseJumps.Size()))
+		return false;
+
+	return HasFunctionCall() && !HasProfiledCall(true) && (mTrueJump == block || !block->HasFunctionCall());
 }
 
-void NativeCodeBasicBlock::BuildPlacement(GrowingArray<NativeCodeBasicBlock*>& placement)
+void NativeCodeBasicBlock::BuildPlacement(GrowingArray<NativeCodeBasicBlock*>& placement, GrowingArray<NativeCodeBasicBlock*>* coldBlocks)
 {
 	if (!mPlaced)
 	{
@@ -26086,36 +26616,46 @@ void NativeCodeBasicBlock::BuildPlacement(GrowingArray<NativeCodeBasicBlock*>& p
 		if (mFalseJump)
 		{
 			if (mFalseJump->mPlaced)
-				mTrueJump->BuildPlacement(placement);
+				mTrueJump->BuildPlacement(placement, coldBlocks);
 			else if (mTrueJump->mPlaced)
-				mFalseJump->BuildPlacement(placement);
+				mFalseJump->BuildPlacement(placement, coldBlocks);
+			else if (coldBlocks && mTrueJump->IsColdPath(mFalseJump))
+			{
+				coldBlocks->Push(mTrueJump);
+				mFalseJump->BuildPlacement(placement, coldBlocks);
+			}
+			else if (coldBlocks && mFalseJump->IsColdPath(mTrueJump))
+			{
+				coldBlocks->Push(mFalseJump);
+				mTrueJump->BuildPlacement(placement, coldBlocks);
+			}
 			else if (!mTrueJump->mFalseJump && !mFalseJump->mFalseJump && mTrueJump->mTrueJump == mFalseJump->mTrueJump)
 			{
 				mFalseJump->mPlaced = true;
 				mFalseJump->mPlace = placement.Size();
 				placement.Push(mFalseJump);
 
-				mTrueJump->BuildPlacement(placement);
+				mTrueJump->BuildPlacement(placement, coldBlocks);
 			}
 			else if (mTrueJump->LeadsInto(mFalseJump, 0) < mFalseJump->LeadsInto(mTrueJump, 0))
 			{
-				mTrueJump->BuildPlacement(placement);
-				mFalseJump->BuildPlacement(placement);
+				mTrueJump->BuildPlacement(placement, coldBlocks);
+				mFalseJump->BuildPlacement(placement, coldBlocks);
 			}
 			else if (mTrueJump->LeadsInto(mFalseJump, 0) > mFalseJump->LeadsInto(mTrueJump, 0))
 			{
-				mFalseJump->BuildPlacement(placement);
-				mTrueJump->BuildPlacement(placement);
+				mFalseJump->BuildPlacement(placement, coldBlocks);
+				mTrueJump->BuildPlacement(placement, coldBlocks);
 			}
 			else if (mTrueJump->mCode.Size() < 32 && (mTrueJump->mTrueJump && mTrueJump->mTrueJump->mPlaced) || (mTrueJump->mFalseJump && mTrueJump->mFalseJump->mPlaced))
 			{
-				mTrueJump->BuildPlacement(placement);
-				mFalseJump->BuildPlacement(placement);
+				mTrueJump->BuildPlacement(placement, coldBlocks);
+				mFalseJump->BuildPlacement(placement, coldBlocks);
 			}
 			else if (mFalseJump->mCode.Size() < 32 && (mFalseJump->mTrueJump && mFalseJump->mTrueJump->mPlaced) || (mFalseJump->mFalseJump && mFalseJump->mFalseJump->mPlaced))
 			{
-				mFalseJump->BuildPlacement(placement);
-				mTrueJump->BuildPlacement(placement);
+				mFalseJump->BuildPlacement(placement, coldBlocks);
+				mTrueJump->BuildPlacement(placement, coldBlocks);
 			}
 			else if (mTrueJump->mIns.Size() == 0 && mTrueJump->mFalseJump == mFalseJump->mFalseJump && mTrueJump->mTrueJump == mFalseJump->mTrueJump)
 			{
@@ -26123,7 +26663,7 @@ void NativeCodeBasicBlock::BuildPlacement(GrowingArray<NativeCodeBasicBlock*>& p
 				mTrueJump->mPlace = placement.Size();
 				placement.Push(mTrueJump);
 
-				mFalseJump->BuildPlacement(placement);
+				mFalseJump->BuildPlacement(placement, coldBlocks);
 			}
 			else if (mTrueJump->mIns.Size() == 0 && mTrueJump->mFalseJump == mFalseJump->mTrueJump && mTrueJump->mTrueJump == mFalseJump->mFalseJump)
 			{
@@ -26131,14 +26671,14 @@ void NativeCodeBasicBlock::BuildPlacement(GrowingArray<NativeCodeBasicBlock*>& p
 				mTrueJump->mPlace = placement.Size();
 				placement.Push(mTrueJump);
 
-				mFalseJump->BuildPlacement(placement);
+				mFalseJump->BuildPlacement(placement, coldBlocks);
 			}
 			else if (
 				!mTrueJump->mFalseJump && mTrueJump->mTrueJump && mTrueJump->mTrueJump->mPlaced && mTrueJump->mCode.Size() < 120 ||
 				mTrueJump->mFalseJump && mTrueJump->mTrueJump && mTrueJump->mFalseJump->mPlaced && mTrueJump->mTrueJump->mPlaced && mTrueJump->mCode.Size() < 120)
 			{
-				mTrueJump->BuildPlacement(placement);
-				mFalseJump->BuildPlacement(placement);
+				mTrueJump->BuildPlacement(placement, coldBlocks);
+				mFalseJump->BuildPlacement(placement, coldBlocks);
 			}
 			else if (!mTrueJump->mFalseJump && mTrueJump->mTrueJump && mFalseJump->mFalseJump && !mTrueJump->mTrueJump->mPlaced && mTrueJump->mTrueJump->mNumEntries > 1 && mTrueJump->mTrueJump->mTrueJump != mTrueJump->mTrueJump)
 			{
@@ -26146,18 +26686,23 @@ void NativeCodeBasicBlock::BuildPlacement(GrowingArray<NativeCodeBasicBlock*>& p
 				mTrueJump->mPlace = placement.Size();
 				placement.Push(mTrueJump);
 
-				mFalseJump->BuildPlacement(placement);
-				mTrueJump->mTrueJump->BuildPlacement(placement);
+				mFalseJump->BuildPlacement(placement, coldBlocks);
+				mTrueJump->mTrueJump->BuildPlacement(placement, coldBlocks);
 			}
 			else
 			{
-				mFalseJump->BuildPlacement(placement);
-				mTrueJump->BuildPlacement(placement);
+				mFalseJump->BuildPlacement(placement, coldBlocks);
+				mTrueJump->BuildPlacement(placement, coldBlocks);
 			}
 		}
 		else if (mTrueJump)
 		{
-			mTrueJump->BuildPlacement(placement);
+			mTrueJump->BuildPlacement(placement, coldBlocks);
+		}
+		else
+		{
+			for (int i = 0; i < mCaseJumps.Size(); i++)
+				mCaseJumps[i]->BuildPlacement(placement, coldBlocks);
 		}
 	}
 }
@@ -26244,6 +26789,8 @@ void NativeCodeBasicBlock::ShortcutTailRecursion()
 
 		if (mTrueJump) mTrueJump->ShortcutTailRecursion();
 		if (mFalseJump) mFalseJump->ShortcutTailRecursion();
+		for (int i = 0; i < mCaseJumps.Size(); i++)
+			mCaseJumps[i]->ShortcutTailRecursion();
 	}
 }
 
@@ -26303,19 +26850,30 @@ void NativeCodeBasicBlock::CopyCode(NativeCodeProcedure * proc, uint8* target)
 }
 
 NativeCodeBasicBlock::NativeCodeBasicBlock(void)
-	: mIns(NativeCodeInstruction(ASMIT_INV, ASMIM_IMPLIED)), mRelocations({ 0 }), mEntryBlocks(nullptr), mCode(0)
+	: mIns(NativeCodeInstruction(ASMIT_INV, ASMIM_IMPLIED)), mRelocations({ 0 }), mEntryBlocks(nullptr), mCode(0), mCaseJumps(nullptr)
 {
 	mBranch = ASMIT_RTS;
-	mTrueJump = mFalseJump = NULL;
+	mTrueJump = mFalseJump = mFromJump = NULL;
+	mCaseTableLow = mCaseTableHigh = nullptr;
 	mOffset = -1;
+	mIndex = mSize = mPlace = mNumEntries = mNumEntered = mFrameOffset = mTemp = mDataFlowIndex = 0;
 	mPlaced = false;
 	mCopied = false;
 	mKnownShortBranch = false;
 	mBypassed = false;
 	mAssembled = false;
+	mNoFrame = false;
+	mVisited = false;
+	mLoopHead = false;
+	mVisiting = false;
 	mLocked = false;
+	mPatched = false;
+	mPatchFail = false;
+	mKeepPlace = false;
 	mDominator = nullptr;
+	mSameBlock = nullptr;
 	mLoopHeadBlock = nullptr;
+	mLoopTailBlock = nullptr;
 }
 
 NativeCodeBasicBlock::~NativeCodeBasicBlock(void)
@@ -26324,13 +26882,16 @@ NativeCodeBasicBlock::~NativeCodeBasicBlock(void)
 }
 
 NativeCodeProcedure::NativeCodeProcedure(NativeCodeGenerator* generator)
-	: mGenerator(generator), mRelocations({ 0 }), mBlocks(nullptr)
+	: mGenerator(generator), mRelocations({ 0 }), mBlocks(nullptr), mCaseTables(nullptr)
 {
 	mTempBlocks = 1000;
+	mProfile = nullptr;
+	mArena = new Arena();
 }
 
 NativeCodeProcedure::~NativeCodeProcedure(void)
 {
+	delete mArena;
 
 }
 
@@ -26464,8 +27025,24 @@ void NativeCodeProcedure::LoadTempsFromStack(int tempSave)
 
 void NativeCodeProcedure::Compile(InterCodeProcedure* proc)
 {
+	Translate(proc);
+	Optimize();
+	Assemble();
+}
+
+void NativeCodeProcedure::Translate(InterCodeProcedure* proc)
+{
+	ArenaScope	scope(mArena);
+
 	mInterProc = proc;
 
+	if (mGenerator->mCompilerOptions & COPT_TIME_REPORT)
+	{
+		proc->mNativeProfile = new PassProfile();
+		proc->mNativeProfile->Start(proc->NumInstructions());
+	}
+	mProfile = proc->mNativeProfile;
+
 	int	nblocks = proc->mBlocks.Size();
 	tblocks = new NativeCodeBasicBlock * [nblocks];
 	for (int i = 0; i < nblocks; i++)
@@ -26518,7 +27095,23 @@ void NativeCodeProcedure::Compile(InterCodeProcedure* proc)
 	mEntryBlock->mTrueJump = CompileBlock(mInterProc, mInterProc->mBlocks[0]);
 	mEntryBlock->mBranch = ASMIT_JMP;
 
-	Optimize();
+	mTempSave = tempSave;
+	mCommonFrameSize = commonFrameSize;
+
+	ProfileCheckpoint("translate");
+}
+
+void NativeCodeProcedure::Assemble(void)
+{
+	ArenaScope	scope(mArena);
+
+	InterCodeProcedure* proc = mInterProc;
+
+	int		tempSave = mTempSave;
+	int		commonFrameSize = mCommonFrameSize;
+
+	if (mProfile)
+		mProfile->Start(NumInstructions());
 
 	assert(mEntryBlock->mIns.Size() == 0);
 
@@ -26836,6 +27429,12 @@ void NativeCodeProcedure::Compile(InterCodeProcedure* proc)
 	else
 		mExitBlock->mIns.Push(NativeCodeInstruction(ASMIT_RTS, ASMIM_IMPLIED));
 
+	if (mGenerator->mCompilerOptions & COPT_OPTIMIZE_BASIC)
+	{
+		LowerTailCalls();
+		BuildJumpTables();
+	}
+
 	mEntryBlock->Assemble();
 
 	mEntryBlock = mEntryBlock->BypassEmptyBlocks();
@@ -26845,29 +27444,67 @@ void NativeCodeProcedure::Compile(InterCodeProcedure* proc)
 
 	proc->mLinkerObject->mType = LOT_NATIVE_CODE;
 
-	GrowingArray<NativeCodeBasicBlock*>	placement(nullptr);
+	GrowingArray<NativeCodeBasicBlock*>	placement(nullptr), coldBlocks(nullptr);
 
-	int	total;
-	total = 0;
+	// Move rarely executed paths to the end of the procedure, when optimizing for speed
 
-	mEntryBlock->BuildPlacement(placement);
+	if ((proc->mCompilerOptions & COPT_OPTIMIZE_AUTO_UNROLL) && !(proc->mCompilerOptions & COPT_OPTIMIZE_CODE_SIZE))
+	{
+		bool	retry;
+		do
+		{
+			placement.SetSize(0);
+			coldBlocks.SetSize(0);
 
-	for (int i = 0; i < placement.Size(); i++)
-		placement[i]->InitialOffset(total);
+			for (int i = 0; i < mBlocks.Size(); i++)
+			{
+				mBlocks[i]->mNumEntries = 0;
+				mBlocks[i]->mPlaced = false;
+			}
+			ResetVisited();
+			mEntryBlock->CountEntries(nullptr);
 
-	bool	progress;
-	do {
-		progress = false;
-		total = 0;
-		for (int i = 0; i < placement.Size(); i++)
-			if (placement[i]->CalculateOffset(total))
-				progress = true;
-	} while (progress);
+			mEntryBlock->BuildPlacement(placement, &coldBlocks);
+			for (int i = 0; i < coldBlocks.Size(); i++)
+				coldBlocks[i]->BuildPlacement(placement, &coldBlocks);
+
+			// A cold path stays in place, if the branch to it does not reach
+			// the end of the procedure and would need a long branch
+
+			retry = false;
+			if (coldBlocks.Size())
+			{
+				CalculateOffsets(placement);
+
+				for (int i = 0; i < placement.Size(); i++)
+				{
+					NativeCodeBasicBlock* block = placement[i];
+					if (block->mFalseJump)
+					{
+						NativeCodeBasicBlock* cblock = coldBlocks.IndexOf(block->mTrueJump) >= 0 ? block->mTrueJump : coldBlocks.IndexOf(block->mFalseJump) >= 0 ? block->mFalseJump : nullptr;
+						if (cblock && block->BranchByteSize(block->mOffset + block->mCode.Size(), cblock->mOffset) > 2)
+						{
+							cblock->mKeepPlace = true;
+							retry = true;
+						}
+					}
+				}
+			}
+		} while (retry);
+	}
+	else
+		mEntryBlock->BuildPlacement(placement, nullptr);
+
+	int	total = CalculateOffsets(placement);
 
 	uint8* data = proc->mLinkerObject->AddSpace(total);
 
 	for (int i = 0; i < placement.Size(); i++)
+	{
 		placement[i]->CopyCode(this, data);
+		if (placement[i]->mCaseJumps.Size())
+			placement[i]->FillJumpTable(this);
+	}
 
 
 	for (int i = 0; i < mRelocations.Size(); i++)
@@ -26878,8 +27515,50 @@ void NativeCodeProcedure::Compile(InterCodeProcedure* proc)
 			rl.mRefObject = proc->mLinkerObject;
 		proc->mLinkerObject->AddReference(rl);
 	}
+
+	ProfileCheckpoint("assemble");
+
+	// The native code blocks are not needed anymore, once the code is
+	// in the linker object
+
+	mEntryBlock = mExitBlock = nullptr;
+	mBlocks.SetSize(0);
+
+	delete mArena;
+	mArena = nullptr;
+}
+
+void NativeCodeProcedure::ProfileCheckpoint(const char* name)
+{
+	if (mProfile)
+		mProfile->Checkpoint(name, NumInstructions());
 }
 
+int NativeCodeProcedure::CalculateOffsets(GrowingArray<NativeCodeBasicBlock*>& placement)
+{
+	int	total = 0;
+	for (int i = 0; i < placement.Size(); i++)
+		placement[i]->InitialOffset(total);
+
+	bool	progress;
+	do {
+		progress = false;
+		total = 0;
+		for (int i = 0; i < placement.Size(); i++)
+			if (placement[i]->CalculateOffset(total))
+				progress = true;
+	} while (progress);
+
+	return total;
+}
+
+int NativeCodeProcedure::NumInstructions(void) const
+{
+	int	num = 0;
+	for (int i = 0; i < mBlocks.Size(); i++)
+		num += mBlocks[i]->mIns.Size();
+	return num;
+}
 
 bool NativeCodeProcedure::MapFastParamsToTemps(void)
 {
@@ -26920,6 +27599,23 @@ bool NativeCodeProcedure::MapFastParamsToTemps(void)
 
 void NativeCodeProcedure::Optimize(void)
 {
+	static const char* StepNames[] = { "step 0", "step 1", "step 2", "step 3", "step 4", "step 5", "step 6", "step 7", "step 8" };
+
+	ArenaScope	scope(mArena);
+
+	if (mProfile)
+		mProfile->Start(NumInstructions());
+
+	NativeCodeCacheKey	cacheKey;
+	if (mGenerator->mCache)
+	{
+		if (mGenerator->mCache->Load(this, cacheKey))
+		{
+			ProfileCheckpoint("cache");
+			return;
+		}
+	}
+
 #if 1
 	int		step = 0;
 	int cnt = 0;
@@ -26980,6 +27676,8 @@ void NativeCodeProcedure::Optimize(void)
 
 			bool	bchanged;
 			do {
+				if (mProfile)
+					mProfile->Iteration("bit field forwarding");
 				ResetVisited();
 				bchanged = mEntryBlock->BitFieldForwarding(data);
 			} while (bchanged);
@@ -27003,6 +27701,9 @@ void NativeCodeProcedure::Optimize(void)
 #if 1
 		do
 		{
+			if (mProfile)
+				mProfile->Iteration("value forwarding");
+
 			BuildDataFlowSets();
 			ResetVisited();
 			changed = mEntryBlock->RemoveUnusedResultInstructions();
@@ -27283,6 +27984,8 @@ void NativeCodeProcedure::Optimize(void)
 #endif
 
 #endif
+		ProfileCheckpoint(StepNames[step]);
+
 		if (cnt > 200)
 		{
 			changed = false;
@@ -27308,14 +28011,102 @@ void NativeCodeProcedure::Optimize(void)
 #endif
 	CompressTemporaries();
 
+	ProfileCheckpoint("compress temporaries");
+
 #if 1
 	ResetVisited();
 	mEntryBlock->BlockSizeReduction(this);
 #endif
 
+	ProfileCheckpoint("block size reduction");
+
+	if (mGenerator->mCache && cnt <= 200)
+		mGenerator->mCache->Store(this, cacheKey);
 #endif
 }
 
+bool NativeCodeProcedure::LowerTailCalls(void)
+{
+	// The epilogue may only restore the saved temporaries from the static
+	// save area, the callee preserves them anyway, so they can be restored
+	// before the call, which then becomes a jump
+
+	int	n = mExitBlock->mIns.Size();
+	if (n < 2 || mExitBlock->mIns[n - 1].mType != ASMIT_RTS || !mInterProc->mSaveTempsLinkerObject)
+		return false;
+
+	for (int i = 0; i < n - 1; i++)
+	{
+		const NativeCodeInstruction& ins(mExitBlock->mIns[i]);
+		if ((ins.mType == ASMIT_LDA && (ins.mMode == ASMIM_ABSOLUTE || ins.mMode == ASMIM_ABSOLUTE_X) && ins.mLinkerObject == mInterProc->mSaveTempsLinkerObject) ||
+			(ins.mType == ASMIT_STA && (ins.mMode == ASMIM_ZERO_PAGE || ins.mMode == ASMIM_ZERO_PAGE_X)) ||
+			(ins.mType == ASMIT_LDX && ins.mMode == ASMIM_IMMEDIATE) ||
+			ins.mType == ASMIT_DEX || ins.mType == ASMIT_BPL)
+			;
+		else
+			return false;
+	}
+
+	for (int i = 0; i < mBlocks.Size(); i++)
+		mBlocks[i]->mNumEntries = 0;
+	ResetVisited();
+	mEntryBlock->CountEntries(nullptr);
+
+	NativeCodeBasicBlock* rblock = nullptr;
+
+	for (int i = 0; i < mBlocks.Size(); i++)
+	{
+		NativeCodeBasicBlock* block = mBlocks[i];
+		if (block->mNumEntries > 0 && block->mTrueJump == mExitBlock && !block->mFalseJump && block->mIns.Size() > 0)
+		{
+			const NativeCodeInstruction& jins(block->mIns.Last());
+			if (jins.IsSimpleJSR() && !(jins.mFlags & (NCIF_RUNTIME | NCIF_USE_CPU_REG_A | NCIF_USE_CPU_REG_X | NCIF_USE_CPU_REG_Y)) &&
+				(mExitBlock->mNumEntries == 1 || !(mInterProc->mCompilerOptions & COPT_OPTIMIZE_CODE_SIZE)))
+			{
+				if (!rblock)
+				{
+					rblock = AllocateBlock();
+					rblock->mIns.Push(NativeCodeInstruction(ASMIT_RTS, ASMIM_IMPLIED));
+					rblock->Close(nullptr, nullptr, ASMIT_RTS);
+				}
+
+				for (int j = 0; j < n - 1; j++)
+					block->mIns.Insert(block->mIns.Size() - 1, mExitBlock->mIns[j]);
+				block->mTrueJump = rblock;
+			}
+		}
+	}
+
+	return rblock != nullptr;
+}
+
+void NativeCodeProcedure::AddCaseTables(void)
+{
+	for (int i = 0; i < mCaseTables.Size(); i++)
+		mGenerator->mLinker->AddObject(mCaseTables[i]);
+	mCaseTables.SetSize(0);
+}
+
+bool NativeCodeProcedure::BuildJumpTables(void)
+{
+	BuildDataFlowSets();
+
+	ResetVisited();
+	if (mEntryBlock->BuildJumpTables(this))
+	{
+		// The register values at the end of the blocks are used to shorten
+		// jumps, they are no longer valid for the targets of the tables
+
+		ResetVisited();
+		NativeRegisterDataSet	data;
+		mEntryBlock->BuildEntryDataSet(data);
+
+		return true;
+	}
+
+	return false;
+}
+
 void NativeCodeProcedure::BuildDataFlowSets(void)
 {
 	//
@@ -27331,14 +28122,14 @@ void NativeCodeProcedure::BuildDataFlowSets(void)
 	mBlocks[0]->BuildGlobalProvidedRegSet(NumberSet(NUM_REGS));
 
 	//
-	// Build set of globaly required temporaries, might need
-	// multiple iterations until it stabilizes
+	// Build set of globaly required temporaries, blocks are revisited
+	// until it stabilizes
 	//
-	NumberSet	totalRequired(NUM_REGS);
-
-	do {
-		ResetVisited();
-	} while (mBlocks[0]->BuildGlobalRequiredRegSet(totalRequired));
+	ResetVisited();
+	BackwardDataFlow<NativeCodeBasicBlock>	flow(mBlocks[0]);
+	int	evaluations = flow.Solve(&NativeCodeBasicBlock::BuildGlobalRequiredRegSet);
+	if (mProfile)
+		mProfile->Iteration("required regs", evaluations);
 }
 
 NativeCodeBasicBlock* NativeCodeProcedure::AllocateBlock(void)
@@ -27843,7 +28634,7 @@ void NativeCodeProcedure::CompileInterBlock(InterCodeProcedure* iproc, InterCode
 
 
 NativeCodeGenerator::NativeCodeGenerator(Errors* errors, Linker* linker, LinkerSection* runtimeSection)
-	: mErrors(errors), mLinker(linker), mRuntimeSection(runtimeSection), mCompilerOptions(COPT_DEFAULT), mRuntime({ 0 }), mMulTables({nullptr})
+	: mErrors(errors), mLinker(linker), mRuntimeSection(runtimeSection), mCompilerOptions(COPT_DEFAULT), mCache(nullptr), mRuntime({ 0 }), mMulTables({nullptr})
 {
 }
 
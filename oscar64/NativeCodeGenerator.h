@@ -8,6 +8,7 @@ class NativeCodeProcedure;
 class NativeCodeBasicBlock;
 class NativeCodeGenerator;
 class NativeCodeInstruction;
+class NativeCodeCache;
 
 enum NativeRegisterDataMode
 {
@@ -37,7 +38,17 @@ struct NativeRegisterDataSet
 {
 	NativeRegisterData		mRegs[261];
 
+	// Registers that may hold a copy of a zero page or absolute location,
+	// only these are visited when a location is changed or sets are
+	// intersected.  A bit may be set for a register that lost its copy
+	// in the meantime, it is cleared on the next visit.
+	uint32					mCopies[9];
+
+	NativeRegisterDataSet(void);
+
 	void Reset(void);
+	void SetMode(int reg, NativeRegisterDataMode mode);
+	void Copy(int dst, int src);
 	void ResetMask(void);
 
 	void ResetZeroPage(int addr);
@@ -133,6 +144,8 @@ public:
 	bool IsCommutative(void) const;
 	bool IsShift(void) const;
 	bool IsSimpleJSR(void) const;
+	bool IsZeroPageAbsolute(void) const;
+	int Cycles(void) const;
 
 	bool ReplaceYRegWithXReg(void);
 	bool ReplaceXRegWithYReg(void);
@@ -141,7 +154,7 @@ public:
 	bool SwapXYReg(void);
 };
 
-class NativeCodeBasicBlock
+class NativeCodeBasicBlock : public ArenaObject<NativeCodeBasicBlock>
 {
 public:
 	NativeCodeBasicBlock(void);
@@ -158,14 +171,20 @@ public:
 
 	GrowingArray<NativeCodeBasicBlock*>	mEntryBlocks;
 
-	int							mOffset, mSize, mPlace, mNumEntries, mNumEntered, mFrameOffset, mTemp;
-	bool						mPlaced, mCopied, mKnownShortBranch, mBypassed, mAssembled, mNoFrame, mVisited, mLoopHead, mVisiting, mLocked, mPatched, mPatchFail;
+	int							mOffset, mSize, mPlace, mNumEntries, mNumEntered, mFrameOffset, mTemp, mDataFlowIndex;
+	bool						mPlaced, mCopied, mKnownShortBranch, mBypassed, mAssembled, mNoFrame, mVisited, mLoopHead, mVisiting, mLocked, mPatched, mPatchFail, mKeepPlace;
 	NativeCodeBasicBlock	*	mDominator, * mSameBlock;
 
 	NativeCodeBasicBlock* mLoopHeadBlock, * mLoopTailBlock;
 
 	NativeRegisterDataSet	mDataSet, mNDataSet, mFDataSet;
 
+	// Block ends with a jump table dispatch to the blocks in mCaseJumps,
+	// the tables hold the low and high bytes of the target addresses - 1
+
+	GrowingArray<NativeCodeBasicBlock*>	mCaseJumps;
+	LinkerObject					*	mCaseTableLow, * mCaseTableHigh;
+
 	int PutBranch(NativeCodeProcedure* proc, AsmInsType code, int offset);
 	int PutJump(NativeCodeProcedure* proc, NativeCodeBasicBlock* target, int offset);
 	int JumpByteSize(NativeCodeBasicBlock * target, int offset);
@@ -174,7 +193,14 @@ public:
 	NativeCodeBasicBlock* BypassEmptyBlocks(void);
 
 	int LeadsInto(NativeCodeBasicBlock* block, int dist);
-	void BuildPlacement(GrowingArray<NativeCodeBasicBlock*>& placement);
+	void BuildPlacement(GrowingArray<NativeCodeBasicBlock*>& placement, GrowingArray<NativeCodeBasicBlock*>* coldBlocks);
+	bool HasFunctionCall(void) const;
+	bool HasProfiledCall(bool hot) const;
+	bool IsColdPath(const NativeCodeBasicBlock* block) const;
+	bool IsCaseNode(AsmInsType cmp) const;
+	bool BuildJumpTable(NativeCodeProcedure* proc);
+	bool BuildJumpTables(NativeCodeProcedure* proc);
+	void FillJumpTable(NativeCodeProcedure* proc);
 	void InitialOffset(int& total);
 	bool CalculateOffset(int& total);
 
@@ -185,6 +211,7 @@ public:
 	void ShortcutTailRecursion();
 
 	bool RemoveNops(void);
+	bool PatternPeepHole(int at, int size);
 	bool PeepHoleOptimizer(NativeCodeProcedure* proc, int pass);
 	void BlockSizeReduction(NativeCodeProcedure* proc);
 	bool BlockSizeCopyReduction(NativeCodeProcedure* proc, int & si, int & di);
@@ -193,6 +220,7 @@ public:
 	bool OptimizeSimpleLoopInvariant(NativeCodeProcedure* proc, NativeCodeBasicBlock * prevBlock, NativeCodeBasicBlock* exitBlock);
 	bool RemoveSimpleLoopUnusedIndex(void);
 
+	int InstructionCycles(void) const;
 	bool OptimizeSimpleLoop(NativeCodeProcedure* proc);
 	bool SimpleLoopReversal(NativeCodeProcedure* proc);
 	bool OptimizeInnerLoop(NativeCodeProcedure* proc, NativeCodeBasicBlock* head, NativeCodeBasicBlock* tail, GrowingArray<NativeCodeBasicBlock*>& blocks);
@@ -248,7 +276,7 @@ public:
 
 	void BuildLocalRegSets(void);
 	void BuildGlobalProvidedRegSet(NumberSet fromProvidedTemps);
-	bool BuildGlobalRequiredRegSet(NumberSet& fromRequiredTemps);
+	bool BuildGlobalRequiredRegSet(void);
 	bool RemoveUnusedResultInstructions(void);
 
 	bool IsSame(const NativeCodeBasicBlock* block) const;
@@ -414,21 +442,38 @@ class NativeCodeProcedure
 
 		InterCodeProcedure* mInterProc;
 
-		int		mProgStart, mProgSize, mIndex, mFrameOffset, mStackExpand;
+		int		mProgStart, mProgSize, mIndex, mFrameOffset, mStackExpand, mTempSave, mCommonFrameSize;
 		bool	mNoFrame;
 		int		mTempBlocks;
 
+		PassProfile	*	mProfile;
+		Arena		*	mArena;
+
 		GrowingArray<LinkerReference>	mRelocations;
 		GrowingArray < NativeCodeBasicBlock*>	 mBlocks;
+		GrowingArray<LinkerObject*>		mCaseTables;
 
 		void Compile(InterCodeProcedure* proc);
+
+		// Compile split into its three phases, Optimize only touches the
+		// procedure itself and may thus run concurrently for independent procedures
+		void Translate(InterCodeProcedure* proc);
 		void Optimize(void);
+		void Assemble(void);
+
+		void ProfileCheckpoint(const char* name);
+		int NumInstructions(void) const;
+		int CalculateOffsets(GrowingArray<NativeCodeBasicBlock*>& placement);
 
 		NativeCodeBasicBlock* CompileBlock(InterCodeProcedure* iproc, InterCodeBasicBlock* block);
 		NativeCodeBasicBlock* AllocateBlock(void);
 
 		void CompileInterBlock(InterCodeProcedure* iproc, InterCodeBasicBlock* iblock, NativeCodeBasicBlock*block);
 
+		bool BuildJumpTables(void);
+		void AddCaseTables(void);
+		bool LowerTailCalls(void);
+
 		bool MapFastParamsToTemps(void);
 		void CompressTemporaries(void);
 
@@ -452,6 +497,8 @@ public:
 
 	uint64		mCompilerOptions;
 
+	NativeCodeCache	*	mCache;
+
 	struct Runtime
 	{
 		const Ident		*	mIdent;
@@ -1,5 +1,14 @@
 #include "NumberSet.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NUMBERSET_SSE2	1
+#include <emmintrin.h>
+#endif
+
+// The set operations process two words at a time with SSE2 where it is
+// available, the remaining word or all words without SSE2 are processed
+// one at a time
+
 NumberSet::NumberSet(void)
 {
 	size = 0;
@@ -12,14 +21,14 @@ NumberSet::NumberSet(int size, bool set)
 	int i;
 
 	this->size = size;
-	dwsize = (size + 31) >> 5;
+	dwsize = (size + 63) >> 6;
 
-	bits = new uint32[dwsize];
+	bits = new uint64[dwsize];
 
 	if (set)
 	{
 		for (i = 0; i < dwsize; i++)
-			bits[i] = 0xffffffff;
+			bits[i] = ~0ULL;
 	}
 	else
 	{
@@ -34,7 +43,7 @@ NumberSet::NumberSet(const NumberSet& set)
 
 	this->size = set.size;
 	this->dwsize = set.dwsize;
-	this->bits = new uint32[dwsize];
+	this->bits = new uint64[dwsize];
 
 	for (i = 0; i < dwsize; i++)
 		bits[i] = set.bits[i];
@@ -52,14 +61,14 @@ void NumberSet::Reset(int size, bool set)
 	delete[] bits;
 
 	this->size = size;
-	dwsize = (size + 31) >> 5;
+	dwsize = (size + 63) >> 6;
 
-	bits = new uint32[dwsize];
+	bits = new uint64[dwsize];
 
 	if (set)
 	{
 		for (i = 0; i < dwsize; i++)
-			bits[i] = 0xffffffff;
+			bits[i] = ~0ULL;
 	}
 	else
 	{
@@ -73,14 +82,23 @@ void NumberSet::Fill(void)
 	int i;
 
 	for (i = 0; i < dwsize; i++)
-		bits[i] = 0xffffffff;
+		bits[i] = ~0ULL;
 }
 
 void NumberSet::OrNot(const NumberSet& set)
 {
-	int i;
+	int i = 0;
 
-	for (i = 0; i < dwsize; i++)
+#if NUMBERSET_SSE2
+	__m128i	ones = _mm_set1_epi32(-1);
+	for (; i + 2 <= dwsize; i += 2)
+	{
+		__m128i	a = _mm_loadu_si128((const __m128i*)(bits + i));
+		__m128i	b = _mm_loadu_si128((const __m128i*)(set.bits + i));
+		_mm_storeu_si128((__m128i*)(bits + i), _mm_or_si128(a, _mm_xor_si128(b, ones)));
+	}
+#endif
+	for (; i < dwsize; i++)
 		bits[i] |= ~set.bits[i];
 }
 
@@ -102,7 +120,7 @@ NumberSet& NumberSet::operator=(const NumberSet& set)
 	{
 		delete[] bits;
 		this->dwsize = set.dwsize;
-		this->bits = new uint32[dwsize];
+		this->bits = new uint64[dwsize];
 	}
 
 	for (i = 0; i < dwsize; i++)
@@ -113,9 +131,17 @@ NumberSet& NumberSet::operator=(const NumberSet& set)
 
 NumberSet& NumberSet::operator&=(const NumberSet& set)
 {
-	int i;
+	int i = 0;
 
-	for (i = 0; i < dwsize; i++)
+#if NUMBERSET_SSE2
+	for (; i + 2 <= dwsize; i += 2)
+	{
+		__m128i	a = _mm_loadu_si128((const __m128i*)(bits + i));
+		__m128i	b = _mm_loadu_si128((const __m128i*)(set.bits + i));
+		_mm_storeu_si128((__m128i*)(bits + i), _mm_and_si128(a, b));
+	}
+#endif
+	for (; i < dwsize; i++)
 		bits[i] &= set.bits[i];
 
 	return *this;
@@ -123,9 +149,17 @@ NumberSet& NumberSet::operator&=(const NumberSet& set)
 
 NumberSet& NumberSet::operator|=(const NumberSet& set)
 {
-	int i;
+	int i = 0;
 
-	for (i = 0; i < dwsize; i++)
+#if NUMBERSET_SSE2
+	for (; i + 2 <= dwsize; i += 2)
+	{
+		__m128i	a = _mm_loadu_si128((const __m128i*)(bits + i));
+		__m128i	b = _mm_loadu_si128((const __m128i*)(set.bits + i));
+		_mm_storeu_si128((__m128i*)(bits + i), _mm_or_si128(a, b));
+	}
+#endif
+	for (; i < dwsize; i++)
 		bits[i] |= set.bits[i];
 
 	return *this;
@@ -133,25 +167,100 @@ NumberSet& NumberSet::operator|=(const NumberSet& set)
 
 NumberSet& NumberSet::operator-=(const NumberSet& set)
 {
-	int i;
+	int i = 0;
 
-	for (i = 0; i < dwsize; i++)
+#if NUMBERSET_SSE2
+	for (; i + 2 <= dwsize; i += 2)
+	{
+		__m128i	a = _mm_loadu_si128((const __m128i*)(bits + i));
+		__m128i	b = _mm_loadu_si128((const __m128i*)(set.bits + i));
+		_mm_storeu_si128((__m128i*)(bits + i), _mm_andnot_si128(b, a));
+	}
+#endif
+	for (; i < dwsize; i++)
 		bits[i] &= ~set.bits[i];
 
 	return *this;
 }
 
-bool NumberSet::operator<=(const NumberSet& set)
+bool NumberSet::operator<=(const NumberSet& set) const
 {
-	int i;
+	int i = 0;
 
-	for (i = 0; i < dwsize; i++)
+#if NUMBERSET_SSE2
+	for (; i + 2 <= dwsize; i += 2)
+	{
+		__m128i	a = _mm_loadu_si128((const __m128i*)(bits + i));
+		__m128i	b = _mm_loadu_si128((const __m128i*)(set.bits + i));
+		__m128i	d = _mm_andnot_si128(b, a);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(d, _mm_setzero_si128())) != 0xffff)
+			return false;
+	}
+#endif
+	for (; i < dwsize; i++)
 		if (bits[i] & ~set.bits[i]) return false;
 
 	return true;
 }
 
+bool NumberSet::Union(const NumberSet& set)
+{
+	int i = 0;
+
+#if NUMBERSET_SSE2
+	__m128i	added = _mm_setzero_si128();
+	for (; i + 2 <= dwsize; i += 2)
+	{
+		__m128i	a = _mm_loadu_si128((const __m128i*)(bits + i));
+		__m128i	b = _mm_loadu_si128((const __m128i*)(set.bits + i));
+		added = _mm_or_si128(added, _mm_andnot_si128(a, b));
+		_mm_storeu_si128((__m128i*)(bits + i), _mm_or_si128(a, b));
+	}
+	bool	changed = _mm_movemask_epi8(_mm_cmpeq_epi32(added, _mm_setzero_si128())) != 0xffff;
+#else
+	bool	changed = false;
+#endif
+	for (; i < dwsize; i++)
+	{
+		if (set.bits[i] & ~bits[i])
+		{
+			bits[i] |= set.bits[i];
+			changed = true;
+		}
+	}
+
+	return changed;
+}
 
+bool NumberSet::UnionExcept(const NumberSet& set, const NumberSet& except)
+{
+	int i = 0;
+
+#if NUMBERSET_SSE2
+	__m128i	added = _mm_setzero_si128();
+	for (; i + 2 <= dwsize; i += 2)
+	{
+		__m128i	a = _mm_loadu_si128((const __m128i*)(bits + i));
+		__m128i	b = _mm_andnot_si128(_mm_loadu_si128((const __m128i*)(except.bits + i)), _mm_loadu_si128((const __m128i*)(set.bits + i)));
+		added = _mm_or_si128(added, _mm_andnot_si128(a, b));
+		_mm_storeu_si128((__m128i*)(bits + i), _mm_or_si128(a, b));
+	}
+	bool	changed = _mm_movemask_epi8(_mm_cmpeq_epi32(added, _mm_setzero_si128())) != 0xffff;
+#else
+	bool	changed = false;
+#endif
+	for (; i < dwsize; i++)
+	{
+		uint64	b = set.bits[i] & ~except.bits[i];
+		if (b & ~bits[i])
+		{
+			bits[i] |= b;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
 
 FastNumberSet::FastNumberSet(void)
 {
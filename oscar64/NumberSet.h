@@ -7,7 +7,7 @@
 class NumberSet
 {
 protected:
-	uint32				* bits;
+	uint64				* bits;
 	int					size, dwsize;
 public:
 	NumberSet(void);
@@ -28,7 +28,13 @@ public:
 	NumberSet& operator|=(const NumberSet& set);
 	NumberSet& operator-=(const NumberSet& set);
 
-	bool operator<=(const NumberSet& set);
+	bool operator<=(const NumberSet& set) const;
+
+	// Add the elements of set, or of set without the elements of
+	// except, and return true if any element was not yet in the set
+
+	bool Union(const NumberSet& set);
+	bool UnionExcept(const NumberSet& set, const NumberSet& except);
 
 	void OrNot(const NumberSet& set);
 
@@ -41,7 +47,7 @@ public:
 inline NumberSet& NumberSet::operator+=(int elem)
 {
 	assert(elem >= 0 && elem < size);
-	bits[elem >> 5] |= (1UL << (elem & 31));
+	bits[elem >> 6] |= (1ULL << (elem & 63));
 
 	return *this;
 }
@@ -49,7 +55,7 @@ inline NumberSet& NumberSet::operator+=(int elem)
 inline NumberSet& NumberSet::operator-=(int elem)
 {
 	assert(elem >= 0 && elem < size);
-	bits[elem >> 5] &= ~(1UL << (elem & 31));
+	bits[elem >> 6] &= ~(1ULL << (elem & 63));
 
 	return *this;
 }
@@ -57,9 +63,11 @@ inline NumberSet& NumberSet::operator-=(int elem)
 inline bool NumberSet::operator[](int elem) const
 {
 	assert(elem >= 0 && elem < size);
-	return (bits[elem >> 5] & (1UL << (elem & 31))) != 0;
+	return (bits[elem >> 6] & (1ULL << (elem & 63))) != 0;
 }
 
+// Sparse set with constant time insert, test and clear, it keeps a dense
+// list of its elements and has no bulk operations that could use wide words
 
 class FastNumberSet
 {
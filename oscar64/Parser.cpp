@@ -647,7 +647,7 @@ uint8* Parser::ParseStringLiteral(int msize)
 	int	size = strlen(mScanner->mTokenString);
 	if (size + 1 > msize)
 		msize = size + 1;
-	uint8* d = new uint8[msize];
+	uint8* d = (uint8*)Arena::NewGlobal(msize, nullptr);
 
 	int i = 0;
 	while (i < size)
@@ -672,7 +672,7 @@ uint8* Parser::ParseStringLiteral(int msize)
 		if (size + s + 1 > msize)
 			msize = size + s + 1;
 
-		uint8* nd = new uint8[msize];
+		uint8* nd = (uint8*)Arena::NewGlobal(msize, nullptr);
 		memcpy(nd, d, size);
 		int i = 0;
 		while (i < s)
@@ -681,7 +681,7 @@ uint8* Parser::ParseStringLiteral(int msize)
 			i++;
 		}
 		size += s;
-		delete[] d;
+		Arena::Delete(d);
 		d = nd;
 		mScanner->NextToken();
 
@@ -1382,7 +1382,7 @@ Expression* Parser::ParseSimpleExpression(void)
 		dec->mBase->mSize = dec->mSize;
 		dec->mBase->mBase = TheConstCharTypeDeclaration;
 		dec->mBase->mFlags |= DTF_DEFINED;
-		uint8* d = new uint8[size + 1];
+		uint8* d = (uint8*)Arena::NewGlobal(size + 1, nullptr);
 		dec->mData = d;
 
 		int i = 0;
@@ -1403,7 +1403,7 @@ Expression* Parser::ParseSimpleExpression(void)
 		while (mScanner->mToken == TK_STRING)
 		{
 			int	s = strlen(mScanner->mTokenString);
-			uint8* d = new uint8[size + s + 1];
+			uint8* d = (uint8*)Arena::NewGlobal(size + s + 1, nullptr);
 			memcpy(d, dec->mData, size);
 			int i = 0;
 			while (i < s)
@@ -1414,7 +1414,7 @@ Expression* Parser::ParseSimpleExpression(void)
 			size += s;
 			d[size] = 0;
 			dec->mSize = size + 1;
-			delete[] dec->mData;
+			Arena::Delete((void*)dec->mData);
 			dec->mData = d;
 			mScanner->NextToken();
 		}
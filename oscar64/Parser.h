@@ -4,7 +4,7 @@
 #include "Declaration.h"
 #include "CompilationUnits.h"
 
-class Parser
+class Parser : public GlobalArenaObject<Parser>
 {
 public:
 	Parser(Errors * errors, Scanner* scanner, CompilationUnits * compilationUnits);
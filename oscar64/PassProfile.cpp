@@ -0,0 +1,221 @@
+#include "PassProfile.h"
+#include "InterCode.h"
+#include <string.h>
+
+PassProfile::PassProfile(void)
+	: mRecords(PassRecord()), mLastIns(0)
+{
+	mLastTime = std::chrono::steady_clock::now();
+}
+
+void PassProfile::Start(int numIns)
+{
+	mLastTime = std::chrono::steady_clock::now();
+	mLastIns = numIns;
+}
+
+PassRecord& PassProfile::Record(const char* name)
+{
+	int	i = 0;
+	while (i < mRecords.Size() && strcmp(mRecords[i].mName, name))
+		i++;
+	if (i == mRecords.Size())
+	{
+		PassRecord	r;
+		r.mName = name;
+		mRecords.Push(r);
+	}
+
+	return mRecords[i];
+}
+
+void PassProfile::Checkpoint(const char* name, int numIns)
+{
+	std::chrono::steady_clock::time_point	now = std::chrono::steady_clock::now();
+
+	PassRecord& r(Record(name));
+	r.mCalls++;
+	r.mNanoSeconds += std::chrono::duration_cast<std::chrono::nanoseconds>(now - mLastTime).count();
+	r.mInsBefore += mLastIns;
+	r.mInsAfter += numIns;
+
+	mLastIns = numIns;
+
+	// Exclude the time spent in the profiler itself
+	mLastTime = std::chrono::steady_clock::now();
+}
+
+void PassProfile::Iteration(const char* name, int count)
+{
+	Record(name).mIterations += count;
+}
+
+int64 PassProfile::TotalNanoSeconds(void) const
+{
+	int64	total = 0;
+	for (int i = 0; i < mRecords.Size(); i++)
+		total += mRecords[i].mNanoSeconds;
+	return total;
+}
+
+PassProfileReport::PassProfileReport(InterCodeModule* module)
+	: mModule(module)
+{
+}
+
+struct PassSummary
+{
+	const char	*	mPhase;
+	PassRecord		mTotal;
+};
+
+static void AddPassSummary(GrowingArray<PassSummary>& summary, const char* phase, const PassProfile* profile)
+{
+	if (profile)
+	{
+		for (int i = 0; i < profile->mRecords.Size(); i++)
+		{
+			const PassRecord& r(profile->mRecords[i]);
+
+			int j = 0;
+			while (j < summary.Size() && (summary[j].mPhase != phase || strcmp(summary[j].mTotal.mName, r.mName)))
+				j++;
+			if (j == summary.Size())
+			{
+				PassSummary	s;
+				s.mPhase = phase;
+				s.mTotal.mName = r.mName;
+				summary.Push(s);
+			}
+
+			PassRecord& t(summary[j].mTotal);
+			t.mCalls += r.mCalls;
+			t.mIterations += r.mIterations;
+			t.mNanoSeconds += r.mNanoSeconds;
+			t.mInsBefore += r.mInsBefore;
+			t.mInsAfter += r.mInsAfter;
+		}
+	}
+}
+
+static void BuildPassSummary(InterCodeModule* module, GrowingArray<PassSummary>& summary)
+{
+	for (int i = 0; i < module->mProcedures.Size(); i++)
+	{
+		InterCodeProcedure* proc = module->mProcedures[i];
+		AddPassSummary(summary, "inter", proc->mInterProfile);
+		AddPassSummary(summary, "native", proc->mNativeProfile);
+	}
+
+	// Sort by decreasing time
+
+	for (int i = 1; i < summary.Size(); i++)
+	{
+		PassSummary	s = summary[i];
+		int	j = i;
+		while (j > 0 && summary[j - 1].mTotal.mNanoSeconds < s.mTotal.mNanoSeconds)
+		{
+			summary[j] = summary[j - 1];
+			j--;
+		}
+		summary[j] = s;
+	}
+}
+
+void PassProfileReport::Print(FILE* file)
+{
+	GrowingArray<PassSummary>	summary(PassSummary{ nullptr, PassRecord() });
+	BuildPassSummary(mModule, summary);
+
+	int64	total = 0;
+	for (int i = 0; i < summary.Size(); i++)
+		total += summary[i].mTotal.mNanoSeconds;
+
+	int64	numIns = 0, numInterIns = 0, interTotal = 0;
+	for (int i = 0; i < mModule->mProcedures.Size(); i++)
+	{
+		InterCodeProcedure* proc = mModule->mProcedures[i];
+		if (proc->mNativeProfile && proc->mNativeProfile->mRecords.Size())
+			numIns += proc->mNativeProfile->mRecords[proc->mNativeProfile->mRecords.Size() - 1].mInsAfter;
+		if (proc->mInterProfile && proc->mInterProfile->mRecords.Size())
+		{
+			numInterIns += proc->mInterProfile->mRecords[proc->mInterProfile->mRecords.Size() - 1].mInsAfter;
+			interTotal += proc->mInterProfile->TotalNanoSeconds();
+		}
+	}
+
+	fprintf(file, "Compile time report\n");
+	fprintf(file, "%-6s %-40s %8s %8s %10s %6s %10s %10s\n", "phase", "pass", "calls", "iters", "msec", "%", "ins before", "ins after");
+	for (int i = 0; i < summary.Size(); i++)
+	{
+		const PassRecord& r(summary[i].mTotal);
+		fprintf(file, "%-6s %-40s %8d %8d %10.3f %6.2f %10lld %10lld\n",
+			summary[i].mPhase, r.mName, r.mCalls, r.mIterations, r.mNanoSeconds * 1e-6, total ? r.mNanoSeconds * 100.0 / total : 0.0, (long long)r.mInsBefore, (long long)r.mInsAfter);
+	}
+	fprintf(file, "%-6s %-40s %8s %8s %10.3f\n", "total", "", "", "", total * 1e-6);
+	if (interTotal)
+		fprintf(file, "%.0f intermediate instructions per second\n", numInterIns * 1e9 / interTotal);
+	if (total)
+		fprintf(file, "%.0f native instructions per second\n", numIns * 1e9 / total);
+}
+
+static void WriteJSONRecords(FILE* file, const PassProfile* profile)
+{
+	fprintf(file, "[");
+	for (int i = 0; i < profile->mRecords.Size(); i++)
+	{
+		const PassRecord& r(profile->mRecords[i]);
+		fprintf(file, "%s\n\t\t\t{\"name\": \"%s\", \"calls\": %d, \"iterations\": %d, \"nsec\": %lld, \"insBefore\": %lld, \"insAfter\": %lld}",
+			i ? "," : "", r.mName, r.mCalls, r.mIterations, (long long)r.mNanoSeconds, (long long)r.mInsBefore, (long long)r.mInsAfter);
+	}
+	fprintf(file, "\n\t\t]");
+}
+
+bool PassProfileReport::WriteJSON(const char* filename)
+{
+	FILE* file;
+	fopen_s(&file, filename, "wb");
+	if (file)
+	{
+		GrowingArray<PassSummary>	summary(PassSummary{ nullptr, PassRecord() });
+		BuildPassSummary(mModule, summary);
+
+		fprintf(file, "{\n\t\"procedures\": [");
+
+		bool	first = true;
+		for (int i = 0; i < mModule->mProcedures.Size(); i++)
+		{
+			InterCodeProcedure* proc = mModule->mProcedures[i];
+			if (proc->mInterProfile || proc->mNativeProfile)
+			{
+				fprintf(file, "%s\n\t{\n\t\t\"name\": \"%s\"", first ? "" : ",", proc->mIdent ? proc->mIdent->mString : "");
+				if (proc->mInterProfile)
+				{
+					fprintf(file, ",\n\t\t\"inter\": ");
+					WriteJSONRecords(file, proc->mInterProfile);
+				}
+				if (proc->mNativeProfile)
+				{
+					fprintf(file, ",\n\t\t\"native\": ");
+					WriteJSONRecords(file, proc->mNativeProfile);
+				}
+				fprintf(file, "\n\t}");
+				first = false;
+			}
+		}
+
+		fprintf(file, "\n\t],\n\t\"summary\": [");
+		for (int i = 0; i < summary.Size(); i++)
+		{
+			const PassRecord& r(summary[i].mTotal);
+			fprintf(file, "%s\n\t\t{\"phase\": \"%s\", \"name\": \"%s\", \"calls\": %d, \"iterations\": %d, \"nsec\": %lld, \"insBefore\": %lld, \"insAfter\": %lld}",
+				i ? "," : "", summary[i].mPhase, r.mName, r.mCalls, r.mIterations, (long long)r.mNanoSeconds, (long long)r.mInsBefore, (long long)r.mInsAfter);
+		}
+		fprintf(file, "\n\t]\n}\n");
+
+		fclose(file);
+		return true;
+	}
+	else
+		return false;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Array.h"
+#include "MachineTypes.h"
+#include <stdio.h>
+#include <chrono>
+
+struct PassRecord
+{
+	const char	*	mName;
+	int				mCalls, mIterations;
+	int64			mNanoSeconds;
+	int64			mInsBefore, mInsAfter;
+
+	PassRecord(void)
+		: mName(nullptr), mCalls(0), mIterations(0), mNanoSeconds(0), mInsBefore(0), mInsAfter(0)
+	{}
+};
+
+// Collects wall time and instruction counts between named checkpoints of
+// one compilation phase of one procedure, the time since the previous
+// checkpoint is attributed to the pass named by the current checkpoint
+
+class PassProfile
+{
+public:
+	PassProfile(void);
+
+	void Start(int numIns);
+	void Checkpoint(const char* name, int numIns);
+	void Iteration(const char* name, int count = 1);
+
+	int64 TotalNanoSeconds(void) const;
+
+	GrowingArray<PassRecord>	mRecords;
+protected:
+	std::chrono::steady_clock::time_point	mLastTime;
+	int										mLastIns;
+
+	PassRecord& Record(const char* name);
+};
+
+class InterCodeModule;
+
+class PassProfileReport
+{
+public:
+	PassProfileReport(InterCodeModule* module);
+
+	void Print(FILE* file);
+	bool WriteJSON(const char* filename);
+protected:
+	InterCodeModule* mModule;
+};
@@ -282,7 +282,7 @@ void SourceFile::Limit(int skip, int limit)
 }
 
 SourceFile::SourceFile(void) 
-	: mFile(nullptr), mFileName{ 0 }, mStack(nullptr)
+	: mFile(nullptr), mFileName{ 0 }, mUp(nullptr), mNext(nullptr), mStack(nullptr), mMode(SFM_TEXT), mLimit(0), mFill(0), mPos(0)
 {
 
 }
@@ -447,6 +447,8 @@ bool Preprocessor::EmbedData(const char* reason, const char* name, bool local, i
 
 		source->mUp = mSource;
 		mSource = source;
+		source->mNext = mSourceList;
+		mSourceList = source;
 		mLocation.mFileName = mSource->mFileName;
 		mLocation.mLine = 0;
 		mLine[0] = 0;
@@ -507,6 +509,8 @@ bool Preprocessor::OpenSource(const char * reason, const char* name, bool local)
 
 		source->mUp = mSource;
 		mSource = source;
+		source->mNext = mSourceList;
+		mSourceList = source;
 		mLocation.mFileName = mSource->mFileName;
 		mLocation.mLine = 0;
 		mLine[0] = 0;
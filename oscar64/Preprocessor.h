@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include "MachineTypes.h"
 #include "CompilerTypes.h"
+#include "Arena.h"
 
 class SourceStack
 {
@@ -21,7 +22,7 @@ enum SourceFileMode
 	SFM_BINARY_RLE,
 	SFM_BINARY_LZO
 };
-class SourceFile
+class SourceFile : public GlobalArenaObject<SourceFile>
 {
 public:
 	char			mFileName[MAXPATHLEN];
@@ -56,7 +57,7 @@ protected:
 	FILE* mFile;
 };
 
-class SourcePath
+class SourcePath : public GlobalArenaObject<SourcePath>
 {
 public:
 	char			mPathName[MAXPATHLEN];
@@ -75,6 +76,8 @@ public:
 	Location	mLocation;
 	Errors* mErrors;
 
+	// mSourceList links all files that were opened, in reverse order
+
 	SourceFile* mSource, * mSourceList;
 	SourcePath* mPaths;
 
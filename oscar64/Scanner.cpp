@@ -155,7 +155,7 @@ Macro::Macro(const Ident* ident)
 
 Macro::~Macro(void)
 {
-
+	delete[] mString;
 }
 
 void Macro::SetString(const char* str)
@@ -297,6 +297,11 @@ Scanner::Scanner(Errors* errors, Preprocessor* preprocessor)
 	mPrepCondFalse = 0;
 	mPrepCondDepth = 0;
 	mPrepCondExit = 0;
+	mStartOfLine = true;
+	mToken = TK_NONE;
+	mTokenIdent = nullptr;
+	mTokenEmbed = nullptr;
+	mTokenEmbedSize = 0;
 	mAssemblerMode = false;
 	mPreprocessorMode = false;
 	mMacroExpansion = nullptr;
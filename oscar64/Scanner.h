@@ -3,6 +3,7 @@
 #include "Ident.h"
 #include "Errors.h"
 #include "Preprocessor.h"
+#include "Arena.h"
 
 enum Token
 {
@@ -148,7 +149,7 @@ enum Token
 
 extern const char* TokenNames[];
 
-class Macro
+class Macro : public GlobalArenaObject<Macro>
 {
 public:
 	Macro(const Ident* ident);
@@ -181,7 +182,7 @@ protected:
 	int				mHashSize, mHashFill;
 };
 
-class Scanner
+class Scanner : public GlobalArenaObject<Scanner>
 {
 public:
 	Scanner(Errors * errors, Preprocessor * preprocessor);
@@ -0,0 +1,483 @@
+#include "SuperOptimizer.h"
+#include <stdio.h>
+
+static const uint8 STATUS_SIGN = 0x80;
+static const uint8 STATUS_ZERO = 0x02;
+static const uint8 STATUS_CARRY = 0x01;
+
+static const AsmInsType ImpliedTypes[] = {
+	ASMIT_ASL, ASMIT_LSR, ASMIT_ROL, ASMIT_ROR, ASMIT_CLC, ASMIT_SEC,
+	ASMIT_TAX, ASMIT_TAY, ASMIT_TXA, ASMIT_TYA, ASMIT_INX, ASMIT_INY, ASMIT_DEX, ASMIT_DEY
+};
+
+static const AsmInsType ImmediateTypes[] = {
+	ASMIT_LDA, ASMIT_LDX, ASMIT_LDY, ASMIT_ADC, ASMIT_SBC, ASMIT_AND, ASMIT_ORA, ASMIT_EOR, ASMIT_CMP, ASMIT_CPX, ASMIT_CPY
+};
+
+static const AsmInsType ZeroPageTypes[] = {
+	ASMIT_LDA, ASMIT_LDX, ASMIT_LDY, ASMIT_STA, ASMIT_STX, ASMIT_STY, ASMIT_ADC, ASMIT_SBC, ASMIT_AND, ASMIT_ORA, ASMIT_EOR,
+	ASMIT_CMP, ASMIT_CPX, ASMIT_CPY, ASMIT_BIT, ASMIT_ASL, ASMIT_LSR, ASMIT_ROL, ASMIT_ROR, ASMIT_INC, ASMIT_DEC
+};
+
+static const int ImmediateValues[] = { 0x00, 0x01, 0x7f, 0x80, 0xff };
+
+SuperOptimizer::SuperOptimizer(void)
+	: mCycleCost(true), mMaxLength(3), mAlphabet({ ASMIT_NOP, ASMIM_IMPLIED, 0 }), mCycles(0), mTests({ 0 }), mSeed(31415)
+{
+	mEmulator = new Emulator(nullptr);
+}
+
+SuperOptimizer::~SuperOptimizer(void)
+{
+	delete mEmulator;
+}
+
+int SuperOptimizer::Random(void)
+{
+	mSeed = mSeed * 1103515245 + 12345;
+	return (mSeed >> 16) & 0xff;
+}
+
+int SuperOptimizer::MemIndex(int addr) const
+{
+	for (int i = 0; i < mNumMem; i++)
+		if (mMem[i] == addr)
+			return i;
+	return -1;
+}
+
+uint32 SuperOptimizer::Reads(const SuperOptInstruction& ins) const
+{
+	uint32	mem = ins.mMode == ASMIM_ZERO_PAGE ? SOPT_MEM << MemIndex(ins.mAddress) : 0;
+
+	switch (ins.mType)
+	{
+	case ASMIT_ADC:
+	case ASMIT_SBC:
+		return mem | SOPT_REG_A | SOPT_FLAG_C;
+	case ASMIT_AND:
+	case ASMIT_ORA:
+	case ASMIT_EOR:
+	case ASMIT_CMP:
+	case ASMIT_BIT:
+		return mem | SOPT_REG_A;
+	case ASMIT_CPX:
+		return mem | SOPT_REG_X;
+	case ASMIT_CPY:
+		return mem | SOPT_REG_Y;
+	case ASMIT_LDA:
+	case ASMIT_LDX:
+	case ASMIT_LDY:
+		return mem;
+	case ASMIT_STA:
+	case ASMIT_TAX:
+	case ASMIT_TAY:
+		return SOPT_REG_A;
+	case ASMIT_STX:
+	case ASMIT_TXA:
+	case ASMIT_INX:
+	case ASMIT_DEX:
+		return SOPT_REG_X;
+	case ASMIT_STY:
+	case ASMIT_TYA:
+	case ASMIT_INY:
+	case ASMIT_DEY:
+		return SOPT_REG_Y;
+	case ASMIT_ASL:
+	case ASMIT_LSR:
+		return ins.mMode == ASMIM_IMPLIED ? SOPT_REG_A : mem;
+	case ASMIT_ROL:
+	case ASMIT_ROR:
+		return (ins.mMode == ASMIM_IMPLIED ? SOPT_REG_A : mem) | SOPT_FLAG_C;
+	case ASMIT_INC:
+	case ASMIT_DEC:
+		return mem;
+	default:
+		return 0;
+	}
+}
+
+uint32 SuperOptimizer::Writes(const SuperOptInstruction& ins) const
+{
+	uint32	mem = ins.mMode == ASMIM_ZERO_PAGE ? SOPT_MEM << MemIndex(ins.mAddress) : 0;
+
+	switch (ins.mType)
+	{
+	case ASMIT_ADC:
+	case ASMIT_SBC:
+		return SOPT_REG_A | SOPT_FLAG_C | SOPT_FLAG_Z | SOPT_FLAG_N;
+	case ASMIT_AND:
+	case ASMIT_ORA:
+	case ASMIT_EOR:
+	case ASMIT_LDA:
+	case ASMIT_TXA:
+	case ASMIT_TYA:
+		return SOPT_REG_A | SOPT_FLAG_Z | SOPT_FLAG_N;
+	case ASMIT_LDX:
+	case ASMIT_TAX:
+	case ASMIT_INX:
+	case ASMIT_DEX:
+		return SOPT_REG_X | SOPT_FLAG_Z | SOPT_FLAG_N;
+	case ASMIT_LDY:
+	case ASMIT_TAY:
+	case ASMIT_INY:
+	case ASMIT_DEY:
+		return SOPT_REG_Y | SOPT_FLAG_Z | SOPT_FLAG_N;
+	case ASMIT_CMP:
+	case ASMIT_CPX:
+	case ASMIT_CPY:
+		return SOPT_FLAG_C | SOPT_FLAG_Z | SOPT_FLAG_N;
+	case ASMIT_BIT:
+		return SOPT_FLAG_Z | SOPT_FLAG_N;
+	case ASMIT_STA:
+	case ASMIT_STX:
+	case ASMIT_STY:
+		return mem;
+	case ASMIT_ASL:
+	case ASMIT_LSR:
+	case ASMIT_ROL:
+	case ASMIT_ROR:
+		return (ins.mMode == ASMIM_IMPLIED ? SOPT_REG_A : mem) | SOPT_FLAG_C | SOPT_FLAG_Z | SOPT_FLAG_N;
+	case ASMIT_INC:
+	case ASMIT_DEC:
+		return mem | SOPT_FLAG_Z | SOPT_FLAG_N;
+	case ASMIT_CLC:
+	case ASMIT_SEC:
+		return SOPT_FLAG_C;
+	default:
+		return 0;
+	}
+}
+
+int SuperOptimizer::Bytes(const SuperOptInstruction& ins) const
+{
+	return ins.mMode == ASMIM_IMPLIED ? 1 : 2;
+}
+
+void SuperOptimizer::BuildAlphabet(const SuperOptInstruction* ref, int num)
+{
+	mAlphabet.SetSize(0);
+	mCycles.SetSize(0);
+
+	GrowingArray<int>	values(0);
+	for (int i = 0; i < sizeof(ImmediateValues) / sizeof(int); i++)
+		values.Push(ImmediateValues[i]);
+
+	for (int i = 0; i < num; i++)
+	{
+		if (ref[i].mMode == ASMIM_IMMEDIATE && values.IndexOf(ref[i].mAddress) < 0)
+			values.Push(ref[i].mAddress);
+	}
+
+	for (int i = 0; i < sizeof(ImpliedTypes) / sizeof(AsmInsType); i++)
+		mAlphabet.Push(SuperOptInstruction{ ImpliedTypes[i], ASMIM_IMPLIED, 0 });
+	for (int i = 0; i < sizeof(ImmediateTypes) / sizeof(AsmInsType); i++)
+		for (int j = 0; j < values.Size(); j++)
+			mAlphabet.Push(SuperOptInstruction{ ImmediateTypes[i], ASMIM_IMMEDIATE, values[j] });
+	for (int i = 0; i < sizeof(ZeroPageTypes) / sizeof(AsmInsType); i++)
+		for (int j = 0; j < mNumMem; j++)
+			mAlphabet.Push(SuperOptInstruction{ ZeroPageTypes[i], ASMIM_ZERO_PAGE, mMem[j] });
+
+	for (int i = 0; i < mAlphabet.Size(); i++)
+		mCycles.Push(AsmInsCycles(mAlphabet[i].mType, mAlphabet[i].mMode));
+}
+
+SuperOptimizer::State SuperOptimizer::RandomState(void)
+{
+	State	s;
+	s.mA = Random();
+	s.mX = Random();
+	s.mY = Random();
+	s.mP = Random() & (STATUS_CARRY | STATUS_ZERO | STATUS_SIGN);
+	for (int i = 0; i < SOPT_MAX_MEM; i++)
+		s.mMem[i] = Random();
+	return s;
+}
+
+SuperOptimizer::State SuperOptimizer::InputState(int64 index)
+{
+	// Unused inputs are filled with random values, so a sequence depending
+	// on them is unlikely to pass
+
+	State	s = RandomState();
+
+	if (mLiveIn & SOPT_REG_A)
+	{
+		s.mA = index & 0xff; index >>= 8;
+	}
+	if (mLiveIn & SOPT_REG_X)
+	{
+		s.mX = index & 0xff; index >>= 8;
+	}
+	if (mLiveIn & SOPT_REG_Y)
+	{
+		s.mY = index & 0xff; index >>= 8;
+	}
+	if (mLiveIn & SOPT_FLAG_C)
+	{
+		s.mP = (s.mP & ~STATUS_CARRY) | (index & STATUS_CARRY); index >>= 1;
+	}
+	for (int i = 0; i < mNumMem; i++)
+	{
+		if (mLiveIn & (SOPT_MEM << i))
+		{
+			s.mMem[i] = index & 0xff; index >>= 8;
+		}
+	}
+
+	return s;
+}
+
+int SuperOptimizer::Execute(const SuperOptInstruction* seq, int num, const State& in, State& out)
+{
+	mEmulator->mRegA = in.mA;
+	mEmulator->mRegX = in.mX;
+	mEmulator->mRegY = in.mY;
+	mEmulator->mRegP = in.mP;
+	for (int i = 0; i < mNumMem; i++)
+		mEmulator->mMemory[mMem[i]] = in.mMem[i];
+
+	int	cycles = 0, ecycles = 0;
+	for (int i = 0; i < num; i++)
+	{
+		cycles += AsmInsCycles(seq[i].mType, seq[i].mMode);
+		mEmulator->EmulateInstruction(seq[i].mType, seq[i].mMode, seq[i].mAddress, ecycles);
+	}
+
+	out.mA = mEmulator->mRegA;
+	out.mX = mEmulator->mRegX;
+	out.mY = mEmulator->mRegY;
+	out.mP = mEmulator->mRegP;
+	for (int i = 0; i < mNumMem; i++)
+		out.mMem[i] = mEmulator->mMemory[mMem[i]];
+
+	return cycles;
+}
+
+bool SuperOptimizer::SameOutput(const State& s0, const State& s1) const
+{
+	if ((mCompare & SOPT_REG_A) && s0.mA != s1.mA)
+		return false;
+	if ((mCompare & SOPT_REG_X) && s0.mX != s1.mX)
+		return false;
+	if ((mCompare & SOPT_REG_Y) && s0.mY != s1.mY)
+		return false;
+
+	uint8	pmask = 0;
+	if (mCompare & SOPT_FLAG_C)
+		pmask |= STATUS_CARRY;
+	if (mCompare & SOPT_FLAG_Z)
+		pmask |= STATUS_ZERO;
+	if (mCompare & SOPT_FLAG_N)
+		pmask |= STATUS_SIGN;
+	if ((s0.mP ^ s1.mP) & pmask)
+		return false;
+
+	for (int i = 0; i < mNumMem; i++)
+		if ((mCompare & (SOPT_MEM << i)) && s0.mMem[i] != s1.mMem[i])
+			return false;
+
+	return true;
+}
+
+bool SuperOptimizer::Cheaper(int bytes, int cycles) const
+{
+	if (mCycleCost)
+		return cycles < mBestCycles || cycles == mBestCycles && bytes < mBestBytes;
+	else
+		return bytes < mBestBytes || bytes == mBestBytes && cycles < mBestCycles;
+}
+
+int64 SuperOptimizer::Verify(const SuperOptInstruction* ref, int num, const SuperOptInstruction* seq, int snum)
+{
+	int	bits = 0;
+	if (mLiveIn & SOPT_REG_A) bits += 8;
+	if (mLiveIn & SOPT_REG_X) bits += 8;
+	if (mLiveIn & SOPT_REG_Y) bits += 8;
+	if (mLiveIn & SOPT_FLAG_C) bits += 1;
+	for (int i = 0; i < mNumMem; i++)
+		if (mLiveIn & (SOPT_MEM << i)) bits += 8;
+
+	bool	exhaustive = bits <= 20;
+	int64	n = 1LL << (exhaustive ? bits : 20);
+
+	for (int64 i = 0; i < n; i++)
+	{
+		State	in, out0, out1;
+		if (exhaustive)
+			in = InputState(i);
+		else
+			in = InputState(int64(Random()) | (int64(Random()) << 8) | (int64(Random()) << 16) | (int64(Random()) << 24) | (int64(Random()) << 32));
+
+		Execute(ref, num, in, out0);
+		Execute(seq, snum, in, out1);
+		if (!SameOutput(out0, out1))
+			return 0;
+	}
+
+	return exhaustive ? n : -n;
+}
+
+void SuperOptimizer::Search(int length, uint32 defined, int bytes, int cycles)
+{
+	for (int i = 0; i < mAlphabet.Size(); i++)
+	{
+		const SuperOptInstruction& ins(mAlphabet[i]);
+
+		int	nbytes = bytes + Bytes(ins), ncycles = cycles + mCycles[i];
+
+		if (!(Reads(ins) & ~defined) && Cheaper(nbytes, ncycles))
+		{
+			uint32	ndefined = defined | Writes(ins);
+
+			mSequence[length] = ins;
+
+			if (!(mLiveOut & ~ndefined))
+			{
+				mNumCandidates++;
+
+				int j = 0;
+				while (j < mTests.Size())
+				{
+					State	out;
+					Execute(mSequence, length + 1, mTests[j], out);
+					if (!SameOutput(out, mResults[j]))
+						break;
+					j++;
+				}
+
+				if (j == mTests.Size())
+				{
+					int64	states = Verify(mReference, mNumReference, mSequence, length + 1);
+					if (states == 0)
+					{
+						mNumRejected++;
+						continue;
+					}
+
+					mBestStates = states;
+					mBestBytes = nbytes;
+					mBestCycles = ncycles;
+					mBestLength = length + 1;
+					for (int k = 0; k < mBestLength; k++)
+						mBest[k] = mSequence[k];
+				}
+			}
+
+			if (length + 1 < mMaxLength)
+				Search(length + 1, ndefined, nbytes, ncycles);
+		}
+	}
+}
+
+void SuperOptimizer::Print(const SuperOptInstruction* seq, int num) const
+{
+	for (int i = 0; i < num; i++)
+	{
+		if (i > 0)
+			printf("; ");
+		if (seq[i].mMode == ASMIM_IMMEDIATE)
+			printf("%s #$%02x", AsmInstructionNames[seq[i].mType], seq[i].mAddress);
+		else if (seq[i].mMode == ASMIM_ZERO_PAGE)
+			printf("%s $%02x", AsmInstructionNames[seq[i].mType], seq[i].mAddress);
+		else
+			printf("%s", AsmInstructionNames[seq[i].mType]);
+	}
+}
+
+bool SuperOptimizer::Optimize(const char* name, const SuperOptInstruction* ref, int num, uint32 liveIn, uint32 liveOut)
+{
+	mNumMem = 0;
+	for (int i = 0; i < num; i++)
+	{
+		if (ref[i].mMode == ASMIM_ZERO_PAGE && MemIndex(ref[i].mAddress) < 0 && mNumMem < SOPT_MAX_MEM)
+			mMem[mNumMem++] = ref[i].mAddress;
+	}
+
+	// A memory flag covers all zero page bytes of the fragment
+
+	uint32	mmask = ((SOPT_MEM << mNumMem) - 1) & ~(SOPT_MEM - 1);
+	mLiveIn = (liveIn & SOPT_MEM) ? (liveIn & ~SOPT_MEM) | mmask : liveIn;
+	mLiveOut = (liveOut & SOPT_MEM) ? (liveOut & ~SOPT_MEM) | mmask : liveOut;
+
+	// Registers, flags and bytes that the reference leaves alone must keep
+	// their value in the replacement as well
+
+	uint32	rwrites = 0;
+	for (int i = 0; i < num; i++)
+		rwrites |= Writes(ref[i]);
+	mCompare = mLiveOut | ((SOPT_REG_A | SOPT_REG_X | SOPT_REG_Y | SOPT_FLAG_C | SOPT_FLAG_Z | SOPT_FLAG_N | mmask) & ~rwrites);
+
+	BuildAlphabet(ref, num);
+
+	mTests.SetSize(0);
+	for (int i = 0; i < 32; i++)
+	{
+		if (i < 2)
+			mTests.Push(InputState(i ? -1 : 0));
+		else
+			mTests.Push(InputState(int64(Random()) | (int64(Random()) << 8) | (int64(Random()) << 16) | (int64(Random()) << 24) | (int64(Random()) << 32)));
+		Execute(ref, num, mTests[i], mResults[i]);
+	}
+
+	mBestBytes = 0;
+	for (int i = 0; i < num; i++)
+		mBestBytes += Bytes(ref[i]);
+	mBestCycles = Execute(ref, num, mTests[0], mResults[0]);
+	mBestLength = 0;
+	mNumCandidates = 0;
+	mNumRejected = 0;
+	mReference = ref;
+	mNumReference = num;
+
+	printf("%s : ", name);
+	Print(ref, num);
+	printf(" (%d bytes, %d cycles)\n", mBestBytes, mBestCycles);
+
+	Search(0, mLiveIn, 0, 0);
+
+	if (mBestLength == 0)
+	{
+		printf("  no cheaper sequence up to length %d, %d candidates, %d rejected\n", mMaxLength, mNumCandidates, mNumRejected);
+		return false;
+	}
+
+	printf("  => ");
+	Print(mBest, mBestLength);
+	if (mBestStates > 0)
+		printf(" (%d bytes, %d cycles), verified on all %lld states\n", mBestBytes, mBestCycles, mBestStates);
+	else
+		printf(" (%d bytes, %d cycles), sampled on %lld random states\n", mBestBytes, mBestCycles, -mBestStates);
+	return true;
+}
+
+void SuperOptimizer::OptimizeIdioms(void)
+{
+	static const SuperOptInstruction	shr7[] = {
+		{ ASMIT_LSR, ASMIM_IMPLIED }, { ASMIT_LSR, ASMIM_IMPLIED }, { ASMIT_LSR, ASMIM_IMPLIED }, { ASMIT_LSR, ASMIM_IMPLIED },
+		{ ASMIT_LSR, ASMIM_IMPLIED }, { ASMIT_LSR, ASMIM_IMPLIED }, { ASMIT_LSR, ASMIM_IMPLIED } };
+	static const SuperOptInstruction	shl7[] = {
+		{ ASMIT_ASL, ASMIM_IMPLIED }, { ASMIT_ASL, ASMIM_IMPLIED }, { ASMIT_ASL, ASMIM_IMPLIED }, { ASMIT_ASL, ASMIM_IMPLIED },
+		{ ASMIT_ASL, ASMIM_IMPLIED }, { ASMIT_ASL, ASMIM_IMPLIED }, { ASMIT_ASL, ASMIM_IMPLIED } };
+	static const SuperOptInstruction	sext[] = {
+		{ ASMIT_ASL, ASMIM_IMPLIED }, { ASMIT_LDA, ASMIM_IMMEDIATE, 0x00 }, { ASMIT_ADC, ASMIM_IMMEDIATE, 0xff }, { ASMIT_EOR, ASMIM_IMMEDIATE, 0xff } };
+	static const SuperOptInstruction	incm[] = {
+		{ ASMIT_LDA, ASMIM_ZERO_PAGE, BC_REG_TMP }, { ASMIT_CLC, ASMIM_IMPLIED }, { ASMIT_ADC, ASMIM_IMMEDIATE, 0x01 }, { ASMIT_STA, ASMIM_ZERO_PAGE, BC_REG_TMP } };
+	static const SuperOptInstruction	incx[] = {
+		{ ASMIT_TXA, ASMIM_IMPLIED }, { ASMIT_CLC, ASMIM_IMPLIED }, { ASMIT_ADC, ASMIM_IMMEDIATE, 0x01 }, { ASMIT_TAX, ASMIM_IMPLIED } };
+	static const SuperOptInstruction	shlm[] = {
+		{ ASMIT_LDA, ASMIM_ZERO_PAGE, BC_REG_TMP }, { ASMIT_ASL, ASMIM_IMPLIED }, { ASMIT_STA, ASMIM_ZERO_PAGE, BC_REG_TMP } };
+	static const SuperOptInstruction	cmp16[] = {
+		{ ASMIT_LDA, ASMIM_ZERO_PAGE, BC_REG_TMP }, { ASMIT_CMP, ASMIM_ZERO_PAGE, BC_REG_TMP + 2 }, { ASMIT_LDA, ASMIM_ZERO_PAGE, BC_REG_TMP + 1 }, { ASMIT_SBC, ASMIM_ZERO_PAGE, BC_REG_TMP + 3 } };
+	static const SuperOptInstruction	neg[] = {
+		{ ASMIT_EOR, ASMIM_IMMEDIATE, 0xff }, { ASMIT_CLC, ASMIM_IMPLIED }, { ASMIT_ADC, ASMIM_IMMEDIATE, 0x01 } };
+
+	Optimize("unsigned shift right by 7", shr7, 7, SOPT_REG_A, SOPT_REG_A);
+	Optimize("shift left by 7", shl7, 7, SOPT_REG_A, SOPT_REG_A);
+	Optimize("sign extension", sext, 4, SOPT_REG_A, SOPT_REG_A);
+	Optimize("increment memory", incm, 4, SOPT_MEM, SOPT_MEM);
+	Optimize("increment x", incx, 4, SOPT_REG_X, SOPT_REG_X);
+	Optimize("shift memory left", shlm, 3, SOPT_MEM, SOPT_MEM | SOPT_FLAG_C);
+	Optimize("unsigned 16 bit compare", cmp16, 4, SOPT_MEM, SOPT_FLAG_C);
+	Optimize("negate", neg, 3, SOPT_REG_A, SOPT_REG_A | SOPT_FLAG_Z | SOPT_FLAG_N);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Emulator.h"
+#include "Array.h"
+
+// Offline search for short native code sequences.  A fragment is given by a
+// reference sequence and the registers, flags and zero page bytes it reads
+// and writes.  All straight line sequences up to a maximum length, built from
+// the implied, immediate and zero page instructions on the bytes of the
+// fragment, are executed on the emulator and compared with the reference on
+// the live outputs and on everything the reference does not write.  Cheaper
+// matches are verified on all input states, or only sampled on a large
+// random set of states if the input is wider than 20 bits, and printed as
+// rewrite rules for the native peephole patterns.  The overflow flag is not
+// compared, the emulator does not model it for all instructions.
+
+static const uint32 SOPT_REG_A		= 0x0001;
+static const uint32 SOPT_REG_X		= 0x0002;
+static const uint32 SOPT_REG_Y		= 0x0004;
+static const uint32 SOPT_FLAG_C		= 0x0008;
+static const uint32 SOPT_FLAG_Z		= 0x0010;
+static const uint32 SOPT_FLAG_N		= 0x0020;
+static const uint32 SOPT_MEM		= 0x0100;
+
+static const int SOPT_MAX_MEM = 4;
+static const int SOPT_MAX_LENGTH = 8;
+
+struct SuperOptInstruction
+{
+	AsmInsType	mType;
+	AsmInsMode	mMode;
+	int			mAddress;
+};
+
+class SuperOptimizer
+{
+public:
+	SuperOptimizer(void);
+	~SuperOptimizer(void);
+
+	bool		mCycleCost;
+	int			mMaxLength;
+
+	bool Optimize(const char* name, const SuperOptInstruction* ref, int num, uint32 liveIn, uint32 liveOut);
+	void OptimizeIdioms(void);
+
+protected:
+	Emulator	*	mEmulator;
+
+	struct State
+	{
+		uint8	mA, mX, mY, mP, mMem[SOPT_MAX_MEM];
+	};
+
+	GrowingArray<SuperOptInstruction>	mAlphabet;
+	GrowingArray<int>					mCycles;
+	GrowingArray<State>					mTests;
+
+	const SuperOptInstruction		*	mReference;
+	int									mNumReference;
+
+	int		mMem[SOPT_MAX_MEM], mNumMem;
+	uint32	mLiveIn, mLiveOut, mCompare;
+	uint32	mSeed;
+
+	SuperOptInstruction	mSequence[SOPT_MAX_LENGTH], mBest[SOPT_MAX_LENGTH];
+	State				mResults[32];
+	int					mBestLength, mBestBytes, mBestCycles, mNumCandidates, mNumRejected;
+	int64				mBestStates;
+
+	int Random(void);
+	int MemIndex(int addr) const;
+	uint32 Reads(const SuperOptInstruction& ins) const;
+	uint32 Writes(const SuperOptInstruction& ins) const;
+	int Bytes(const SuperOptInstruction& ins) const;
+
+	void BuildAlphabet(const SuperOptInstruction* ref, int num);
+	State RandomState(void);
+	State InputState(int64 index);
+	int Execute(const SuperOptInstruction* seq, int num, const State& in, State& out);
+	bool SameOutput(const State& s0, const State& s1) const;
+	bool Cheaper(int bytes, int cycles) const;
+	int64 Verify(const SuperOptInstruction* ref, int num, const SuperOptInstruction* seq, int snum);
+
+	void Search(int length, uint32 defined, int bytes, int cycles);
+	void Print(const SuperOptInstruction* seq, int num) const;
+};
@@ -0,0 +1,193 @@
+#include "../NumberSet.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+// Micro benchmark of the NumberSet bulk operations against the previous
+// representation with 32 bit words and scalar loops, build and run it with
+// "make bench" in the make folder.  The liveness step compares the merge of
+// a successor set the way the dataflow functions did it before, with a
+// temporary set and a compare, to the Union of the current set.
+
+class WordNumberSet
+{
+public:
+	uint32	*	bits;
+	int			size, dwsize;
+
+	WordNumberSet(int size)
+	{
+		this->size = size;
+		dwsize = (size + 31) >> 5;
+		bits = new uint32[dwsize];
+		for (int i = 0; i < dwsize; i++)
+			bits[i] = 0;
+	}
+
+	WordNumberSet(const WordNumberSet& set)
+	{
+		size = set.size;
+		dwsize = set.dwsize;
+		bits = new uint32[dwsize];
+		for (int i = 0; i < dwsize; i++)
+			bits[i] = set.bits[i];
+	}
+
+	~WordNumberSet(void)
+	{
+		delete[] bits;
+	}
+
+	WordNumberSet& operator=(const WordNumberSet& set)
+	{
+		for (int i = 0; i < dwsize; i++)
+			bits[i] = set.bits[i];
+		return *this;
+	}
+
+	void operator+=(int elem)
+	{
+		bits[elem >> 5] |= (1UL << (elem & 31));
+	}
+
+	void operator&=(const WordNumberSet& set)
+	{
+		for (int i = 0; i < dwsize; i++)
+			bits[i] &= set.bits[i];
+	}
+
+	void operator|=(const WordNumberSet& set)
+	{
+		for (int i = 0; i < dwsize; i++)
+			bits[i] |= set.bits[i];
+	}
+
+	void operator-=(const WordNumberSet& set)
+	{
+		for (int i = 0; i < dwsize; i++)
+			bits[i] &= ~set.bits[i];
+	}
+
+	bool operator<=(const WordNumberSet& set) const
+	{
+		for (int i = 0; i < dwsize; i++)
+			if (bits[i] & ~set.bits[i]) return false;
+		return true;
+	}
+
+	void OrNot(const WordNumberSet& set)
+	{
+		for (int i = 0; i < dwsize; i++)
+			bits[i] |= ~set.bits[i];
+	}
+};
+
+static const int	NumSets = 16;
+
+template<class S>
+static void FillRandom(S* sets[], int size, int density)
+{
+	srand(1234);
+	for (int i = 0; i < NumSets; i++)
+		for (int j = 0; j < size; j++)
+			if (rand() % 100 < density)
+				*sets[i] += j;
+}
+
+template<class S>
+static int Operations(S* sets[], int size, int rounds)
+{
+	int	check = 0;
+	for (int r = 0; r < rounds; r++)
+	{
+		for (int i = 0; i < NumSets; i++)
+		{
+			S& a(*sets[i]), & b(*sets[(i + 1) % NumSets]), & c(*sets[(i + 5) % NumSets]);
+			a |= b;
+			a &= c;
+			a.OrNot(b);
+			a -= c;
+			if (a <= b)
+				check++;
+		}
+	}
+	return check;
+}
+
+static int LivenessWord(WordNumberSet* sets[], int size, int rounds)
+{
+	int	check = 0;
+	for (int r = 0; r < rounds; r++)
+	{
+		for (int i = 0; i < NumSets; i++)
+		{
+			WordNumberSet& a(*sets[i]), & b(*sets[(i + 3) % NumSets]);
+			WordNumberSet	t(b);
+			t -= *sets[(i + 7) % NumSets];
+			t |= a;
+			if (!(t <= a))
+			{
+				a = t;
+				check++;
+			}
+		}
+	}
+	return check;
+}
+
+static int LivenessNumber(NumberSet* sets[], int size, int rounds)
+{
+	int	check = 0;
+	for (int r = 0; r < rounds; r++)
+	{
+		for (int i = 0; i < NumSets; i++)
+		{
+			NumberSet& a(*sets[i]), & b(*sets[(i + 3) % NumSets]);
+			if (a.UnionExcept(b, *sets[(i + 7) % NumSets]))
+				check++;
+		}
+	}
+	return check;
+}
+
+template<class S, class F>
+static double Measure(F func, int size, int rounds, int& check)
+{
+	S* sets[NumSets];
+	for (int i = 0; i < NumSets; i++)
+		sets[i] = new S(size);
+	FillRandom(sets, size, 20);
+
+	auto	start = std::chrono::steady_clock::now();
+	check = func(sets, size, rounds);
+	auto	end = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < NumSets; i++)
+		delete sets[i];
+
+	return std::chrono::duration<double, std::nano>(end - start).count() / (double(rounds) * NumSets);
+}
+
+int main(int argc, const char** argv)
+{
+	static const int	sizes[] = { 64, 256, 1024, 4096 };
+
+	printf("%6s %-10s %12s %12s %8s\n", "size", "test", "words ns", "sets ns", "speedup");
+
+	for (int i = 0; i < 4; i++)
+	{
+		int		size = sizes[i];
+		int		rounds = 4000000 / size;
+		int		wcheck, ncheck;
+
+		double	wt = Measure<WordNumberSet>(Operations<WordNumberSet>, size, rounds, wcheck);
+		double	nt = Measure<NumberSet>(Operations<NumberSet>, size, rounds, ncheck);
+		printf("%6d %-10s %12.1f %12.1f %7.2fx%s\n", size, "bulk ops", wt, nt, wt / nt, wcheck == ncheck ? "" : " MISMATCH");
+
+		wt = Measure<WordNumberSet>(LivenessWord, size, rounds, wcheck);
+		nt = Measure<NumberSet>(LivenessNumber, size, rounds, ncheck);
+		printf("%6d %-10s %12.1f %12.1f %7.2fx%s\n", size, "liveness", wt, nt, wt / nt, wcheck == ncheck ? "" : " MISMATCH");
+	}
+
+	return 0;
+}
@@ -1,14 +1,21 @@
 #include <stdio.h>
 #ifdef _WIN32
 #include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
 #else
 #include <unistd.h>
+#include <sys/resource.h>
 #endif
 #ifdef __APPLE__
 #include <mach-o/dyld.h>
 #endif
+#include <thread>
+#include <chrono>
 #include "Compiler.h"
 #include "DiskImage.h"
+#include "NativeCodeCache.h"
+#include "SuperOptimizer.h"
 
 #ifdef _WIN32
 bool GetProductAndVersion(char* strProductName, char* strProductVersion)
@@ -57,14 +64,139 @@ bool GetProductAndVersion(char* strProductName, char* strProductVersion)
 }
 #endif
 
+int PeakMemoryUsage(void)
+{
+	// Peak resident memory of the process in KB
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS	pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return int(pmc.PeakWorkingSetSize >> 10);
+	else
+		return 0;
+#else
+	struct rusage	usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return int(usage.ru_maxrss >> 10);
+#else
+	return int(usage.ru_maxrss);
+#endif
+#endif
+}
+
+// In server mode the compiler stays resident and builds again, whenever one
+// of the files read by the previous build changes.  Each build parses and
+// translates the whole program again, the meaning of a procedure depends on
+// all declarations, macros and pragmas preceding it, and the global analysis
+// and inlining cross procedure boundaries, so there is no sound way to skip a
+// single procedure at source level.  Procedures are reused at native level
+// instead, the cache is keyed by the intermediate code of a procedure, which
+// covers everything it depends on, so unchanged procedures are not optimized
+// again.
+
+class BuildServer
+{
+public:
+	BuildServer(void);
+
+	bool				mActive;
+	Compiler		*	mCompiler;
+	NativeCodeCache	*	mCache;
+
+	// Remember the files read by the build and release the compiler
+
+	void EndBuild(void);
+	void WaitForChange(void);
+protected:
+	GrowingArray<const char*>	mFiles;
+	GrowingArray<uint64>		mHashes;
+
+	void AddFile(const char* name);
+};
+
+static uint64 FileHash(const char* name)
+{
+	FILE* file;
+	if (fopen_s(&file, name, "rb"))
+		return 0;
+
+	uint64	hash = 14695981039346656037ULL;
+	uint8	buffer[4096];
+	size_t	n;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		for (size_t i = 0; i < n; i++)
+			hash = (hash ^ buffer[i]) * 1099511628211ULL;
+	}
+
+	fclose(file);
+
+	return hash;
+}
+
+BuildServer::BuildServer(void)
+	: mActive(false), mCompiler(nullptr), mCache(nullptr), mFiles(nullptr), mHashes(0)
+{
+}
+
+void BuildServer::AddFile(const char* name)
+{
+	for (int i = 0; i < mFiles.Size(); i++)
+		if (!strcmp(mFiles[i], name))
+			return;
+
+	// The modification time has a resolution of one second on some file
+	// systems, so the contents are compared to catch quick successive edits
+
+	mFiles.Push(_strdup(name));
+	mHashes.Push(FileHash(name));
+}
+
+void BuildServer::EndBuild(void)
+{
+	for (int i = 0; i < mFiles.Size(); i++)
+		free((void*)mFiles[i]);
+	mFiles.SetSize(0);
+	mHashes.SetSize(0);
+
+	for (CompilationUnit* cunit = mCompiler->mCompilationUnits->mCompilationUnits; cunit; cunit = cunit->mNext)
+		AddFile(cunit->mFileName);
+	for (SourceFile* source = mCompiler->mPreprocessor->mSourceList; source; source = source->mNext)
+		AddFile(source->mFileName);
+
+	delete mCompiler;
+	mCompiler = nullptr;
+}
+
+void BuildServer::WaitForChange(void)
+{
+	printf("Waiting for changes in %d files\n", mFiles.Size());
+	fflush(stdout);
+
+	for (;;)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+
+		for (int i = 0; i < mFiles.Size(); i++)
+		{
+			if (FileHash(mFiles[i]) != mHashes[i])
+			{
+				printf("Rebuilding after change of \"%s\"\n", mFiles[i]);
+				return;
+			}
+		}
+	}
+}
+
+static BuildServer	TheBuildServer;
+
 int main2(int argc, const char** argv)
 {
-	InitDeclarations();
 	InitAssembler();
 
 	if (argc > 1)
 	{
-		char	basePath[200], crtPath[200], includePath[200], targetPath[200], diskPath[200];
+		char	basePath[200], crtPath[200], includePath[200], targetPath[200], diskPath[200], exePath[200];
 		char	strProductName[100], strProductVersion[200];
 
 #ifdef _WIN32
@@ -88,6 +220,13 @@ int main2(int argc, const char** argv)
 		//		int length = strlen(basePath);
 #endif
 #endif
+		// The executable identifies the build of the compiler for the
+		// native code cache
+
+		int	exeLength = int(length) > 0 && int(length) < int(sizeof(exePath)) ? int(length) : 0;
+		memcpy(exePath, basePath, exeLength);
+		exePath[exeLength] = 0;
+
 		while (length > 0 && basePath[length - 1] != '/' && basePath[length - 1] != '\\')
 			length--;
 
@@ -102,6 +241,8 @@ int main2(int argc, const char** argv)
 
 		Compiler* compiler = new Compiler();
 
+		InitDeclarations();
+
 		Location	loc;
 
 		GrowingArray<const char*>	dataFiles(nullptr);
@@ -122,6 +263,8 @@ int main2(int argc, const char** argv)
 		char	targetFormat[20];
 		strcpy_s(targetFormat, "prg");
 
+		int		superOpt = 0;
+
 		compiler->AddDefine(Ident::Unique("__OSCAR64C__"), "1");
 		compiler->AddDefine(Ident::Unique("__STDC__"), "1");
 		compiler->AddDefine(Ident::Unique("__STDC_VERSION__"), "199901L");
@@ -145,6 +288,34 @@ int main2(int argc, const char** argv)
 					dataFiles.Push(arg + 4);
 					dataFileCompressed.Push(true);
 				}
+				else if (!strcmp(arg, "-ftime-report"))
+				{
+					compiler->mCompilerOptions |= COPT_TIME_REPORT;
+				}
+				else if (!strcmp(arg, "-fzeropage-globals"))
+				{
+					compiler->mCompilerOptions |= COPT_OPTIMIZE_ZEROPAGE;
+					compiler->AddDefine(Ident::Unique("OSCAR_ZEROPAGE_GLOBALS"), "1");
+				}
+				else if (!strncmp(arg, "-fprofile-use=", 14))
+				{
+					if (!compiler->mGlobalAnalyzer->ReadProfile(arg + 14))
+						compiler->mErrors->Error(loc, EERR_FILE_NOT_FOUND, "Could not open profile file", arg + 14);
+				}
+				else if (!strncmp(arg, "-fcache=", 8))
+				{
+					compiler->mNativeCodeGenerator->mCache = new NativeCodeCache(arg + 8, strProductVersion, FileHash(exePath));
+				}
+				else if (!strncmp(arg, "--superopt", 10))
+				{
+					superOpt = arg[10] == '=' ? atoi(arg + 11) : 4;
+					if (superOpt < 1 || superOpt > SOPT_MAX_LENGTH)
+						compiler->mErrors->Error(loc, EERR_COMMAND_LINE, "Invalid superoptimizer sequence length", arg);
+				}
+				else if (!strcmp(arg, "--server"))
+				{
+					TheBuildServer.mActive = true;
+				}
 				else if (arg[1] == 'o' && arg[2] == '=')
 				{
 					strcpy_s(targetPath, arg + 3);
@@ -161,6 +332,12 @@ int main2(int argc, const char** argv)
 				{
 					strcpy_s(targetFormat, arg + 4);
 				}
+				else if (arg[1] == 'j' && arg[2] == '=')
+				{
+					compiler->mNumThreads = atoi(arg + 3);
+					if (compiler->mNumThreads < 1)
+						compiler->mErrors->Error(loc, EERR_COMMAND_LINE, "Invalid number of threads", arg);
+				}
 				else if (arg[1] == 'n')
 				{
 					compiler->mCompilerOptions |= COPT_NATIVE;
@@ -177,7 +354,10 @@ int main2(int argc, const char** argv)
 					else if (arg[2] == '3')
 						compiler->mCompilerOptions |= COPT_OPTIMIZE_ALL;
 					else if (arg[2] == 's')
+					{
 						compiler->mCompilerOptions |= COPT_OPTIMIZE_SIZE;
+						compiler->AddDefine(Ident::Unique("OSCAR_OPTIMIZE_SIZE"), "1");
+					}
 				}
 				else if (arg[1] == 'e')
 				{
@@ -217,6 +397,29 @@ int main2(int argc, const char** argv)
 			}
 		}
 
+		if (TheBuildServer.mActive)
+		{
+			TheBuildServer.mCompiler = compiler;
+			compiler->mErrors->mExitOnLimit = false;
+
+			// The cache is the only state that is carried from one build
+			// to the next
+
+			NativeCodeCache*& cache(compiler->mNativeCodeGenerator->mCache);
+			if (TheBuildServer.mCache)
+			{
+				delete cache;
+				cache = TheBuildServer.mCache;
+			}
+			else if (!cache)
+				cache = new NativeCodeCache(nullptr, strProductVersion, FileHash(exePath));
+			TheBuildServer.mCache = cache;
+
+			cache->mHits = 0;
+			cache->mMisses = 0;
+			cache->mStores = 0;
+		}
+
 		if (!strcmp(targetFormat, "prg"))
 		{
 			compiler->mCompilerOptions |= COPT_TARGET_PRG;
@@ -240,7 +443,14 @@ int main2(int argc, const char** argv)
 		else
 			compiler->mErrors->Error(loc, EERR_COMMAND_LINE, "Invalid target format option", targetFormat);
 
-		if (compiler->mErrors->mErrorCount == 0)
+		if (superOpt && compiler->mErrors->mErrorCount == 0)
+		{
+			SuperOptimizer	sopt;
+			sopt.mMaxLength = superOpt;
+			sopt.mCycleCost = !(compiler->mCompilerOptions & COPT_OPTIMIZE_CODE_SIZE);
+			sopt.OptimizeIdioms();
+		}
+		else if (compiler->mErrors->mErrorCount == 0)
 		{
 			if (compiler->mCompilerOptions & COPT_VERBOSE)
 			{
@@ -265,6 +475,12 @@ int main2(int argc, const char** argv)
 
 				compiler->WriteOutputFile(targetPath, d64);
 
+				if (compiler->mCompilerOptions & COPT_VERBOSE)
+					printf("Peak memory usage %d KB, %d KB in code arenas\n", PeakMemoryUsage(), int(Arena::TotalAllocated() >> 10));
+
+				// The intermediate code is not needed anymore after the output is written
+				compiler->mInterCodeModule->ReleaseCode();
+
 				if (d64)
 				{
 					for (int i = 0; i < dataFiles.Size(); i++)
@@ -283,7 +499,7 @@ int main2(int argc, const char** argv)
 				}
 
 				if (emulate)
-					compiler->ExecuteCode(profile);
+					compiler->ExecuteCode(targetPath, profile);
 			}
 		}
 
@@ -292,7 +508,7 @@ int main2(int argc, const char** argv)
 	}
 	else
 	{
-		printf("oscar64 {-i=includePath} [-o=output.prg] [-rt=runtime.c] [-tf=target] [-e] [-n] {-dSYMBOL[=value]} [-v] [-d64=diskname] {-f[z]=file.xxx} {source.c}\n");
+		printf("oscar64 {-i=includePath} [-o=output.prg] [-rt=runtime.c] [-tf=target] [-e] [-n] {-dSYMBOL[=value]} [-v] [-ftime-report] [-fprofile-use=file.prof] [-fzeropage-globals] [-fcache=dir] [--server] [--superopt[=length]] [-j=threads] [-d64=diskname] {-f[z]=file.xxx} {source.c}\n");
 
 		return 0;
 	}
@@ -301,6 +517,28 @@ int main2(int argc, const char** argv)
 }
 
 
+int RunBuildServer(int argc, const char** argv)
+{
+	auto	start = std::chrono::steady_clock::now();
+	int		result = main2(argc, argv);
+
+	while (TheBuildServer.mActive && TheBuildServer.mCompiler)
+	{
+		int	msecs = int(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+		NativeCodeCache* cache = TheBuildServer.mCache;
+
+		printf("Build %s in %d ms, %d of %d procedures from cache\n", result ? "failed" : "done", msecs, int(cache->mHits), int(cache->mHits + cache->mMisses));
+
+		TheBuildServer.EndBuild();
+		TheBuildServer.WaitForChange();
+
+		start = std::chrono::steady_clock::now();
+		result = main2(argc, argv);
+	}
+
+	return result;
+}
+
 int main(int argc, const char** argv)
 {
 #ifdef _WIN32
@@ -310,7 +548,7 @@ int main(int argc, const char** argv)
 #endif
 #endif
 
-		return main2(argc, argv);
+		return RunBuildServer(argc, argv);
 
 #ifdef _WIN32
 #ifndef _DEBUG